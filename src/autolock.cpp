@@ -21,15 +21,221 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
+#include <list>
+#include <map>
 
 #include "common.h"
 #include "s3fs.h"
+#include "s3fs_util.h"
 #include "autolock.h"
 
+//-------------------------------------------------------------------
+// Typedefs and variables for lock profile
+//-------------------------------------------------------------------
+typedef std::map<std::string, lock_profile*> lock_name_map_t;
+
+// [NOTE]
+// The map is allocated at first use and is never freed, because the
+// profiles are kept by the mutexes of static objects until exiting.
+// It is used only when the profile of a mutex is resolved and dumped.
+//
+static pthread_rwlock_t     profile_lock  = PTHREAD_RWLOCK_INITIALIZER;    // protects the following map
+static lock_name_map_t*     name_profiles  = NULL;
+
+//-------------------------------------------------------------------
+// Struct lock_profile
+//-------------------------------------------------------------------
+lock_profile::lock_profile(const char* pname) : name(pname ? pname : ""), acquired_count(0), contended_count(0), wait_total_us(0), hold_total_us(0)
+{
+    for(int cnt = 0; cnt < LOCK_PROFILE_BUCKETS; ++cnt){
+        wait_hist[cnt] = 0;
+        hold_hist[cnt] = 0;
+    }
+}
+
+//-------------------------------------------------------------------
+// Class LockProfiler
+//-------------------------------------------------------------------
+bool        LockProfiler::is_enable = false;
+std::string LockProfiler::output_path;
+
+bool LockProfiler::SetEnable(bool enable, const char* path)
+{
+    bool old = LockProfiler::is_enable;
+    LockProfiler::is_enable   = enable;
+    LockProfiler::output_path = (path ? path : "");
+    return old;
+}
+
+lock_profile* LockProfiler::GetUnnamedProfile()
+{
+    static lock_profile* punnamed = new lock_profile("(unnamed)");
+    return punnamed;
+}
+
+lock_profile* LockProfiler::GetProfile(const char* name)
+{
+    lock_profile* profile = NULL;
+
+    pthread_rwlock_rdlock(&profile_lock);
+    if(name_profiles){
+        lock_name_map_t::const_iterator iter = name_profiles->find(name);
+        if(name_profiles->end() != iter){
+            profile = iter->second;
+        }
+    }
+    pthread_rwlock_unlock(&profile_lock);
+
+    if(!profile){
+        pthread_rwlock_wrlock(&profile_lock);
+        if(!name_profiles){
+            name_profiles = new lock_name_map_t();
+        }
+        lock_name_map_t::iterator iter = name_profiles->find(name);
+        if(name_profiles->end() == iter){
+            iter = name_profiles->insert(std::make_pair(std::string(name), new lock_profile(name))).first;
+        }
+        profile = iter->second;
+        pthread_rwlock_unlock(&profile_lock);
+    }
+    return profile;
+}
+
+void LockProfiler::SetName(named_mutex* pmutex, const char* name)
+{
+    if(!pmutex){
+        return;
+    }
+    pmutex->name    = name;
+    pmutex->profile = NULL;
+}
+
+//
+// Returns the profile of the mutex, and it is resolved from the name only
+// at the first time. The threads which resolve it at the same time get
+// the same profile.
+//
+lock_profile* LockProfiler::Find(named_mutex* pmutex)
+{
+    lock_profile* profile = __atomic_load_n(&pmutex->profile, __ATOMIC_ACQUIRE);
+    if(!profile){
+        profile = pmutex->name ? LockProfiler::GetProfile(pmutex->name) : LockProfiler::GetUnnamedProfile();
+        __atomic_store_n(&pmutex->profile, profile, __ATOMIC_RELEASE);
+    }
+    return profile;
+}
+
+void LockProfiler::Record(long long* hist, long long* total, long long us)
+{
+    int bucket = 0;
+    for(long long value = us; 0 < value && bucket < (LOCK_PROFILE_BUCKETS - 1); value >>= 1){
+        ++bucket;
+    }
+    __sync_fetch_and_add(&hist[bucket], 1LL);
+    __sync_fetch_and_add(total, us);
+}
+
+long long LockProfiler::ElapsedUs(const struct timespec& start, struct timespec* pnow)
+{
+    struct timespec now;
+    if(-1 == clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &now)){
+        return 0;
+    }
+    if(pnow){
+        *pnow = now;
+    }
+    return (static_cast<long long>(now.tv_sec - start.tv_sec) * 1000000LL) + ((now.tv_nsec - start.tv_nsec) / 1000);
+}
+
+static std::string lock_profile_hist(const long long* hist)
+{
+    std::string result;
+    for(int cnt = 0; cnt < LOCK_PROFILE_BUCKETS; ++cnt){
+        if(0 == hist[cnt]){
+            continue;
+        }
+        char buf[64];
+        if(0 == cnt){
+            snprintf(buf, sizeof(buf), " <1:%lld", hist[cnt]);
+        }else if((LOCK_PROFILE_BUCKETS - 1) == cnt){
+            snprintf(buf, sizeof(buf), " >=%lld:%lld", 1LL << (cnt - 1), hist[cnt]);
+        }else{
+            snprintf(buf, sizeof(buf), " %lld-%lld:%lld", 1LL << (cnt - 1), (1LL << cnt) - 1, hist[cnt]);
+        }
+        result += buf;
+    }
+    return result.empty() ? " none" : result;
+}
+
+// [NOTE]
+// The counters are read without any lock, then the values in a line
+// may be a little inconsistent while the locks are used.
+//
+bool LockProfiler::Dump()
+{
+    if(!LockProfiler::is_enable){
+        return false;
+    }
+    FILE* fp;
+    if(LockProfiler::output_path.empty()){
+        fp = stdout;
+    }else{
+        if(NULL == (fp = fopen(LockProfiler::output_path.c_str(), "a+"))){
+            S3FS_PRN_ERR("Could not open(create) output file(%s) for lock profile by errno(%d)", LockProfiler::output_path.c_str(), errno);
+            return false;
+        }
+    }
+
+    S3FS_PRN_CACHE(fp, "---------------------------------------------------------------------------\n"
+                       "Lock profile at %s\n"
+                       "---------------------------------------------------------------------------", S3fsLog::GetCurrentTime().c_str());
+
+    std::list<lock_profile*> profiles;
+    pthread_rwlock_rdlock(&profile_lock);
+    if(name_profiles){
+        for(lock_name_map_t::const_iterator iter = name_profiles->begin(); iter != name_profiles->end(); ++iter){
+            profiles.push_back(iter->second);
+        }
+    }
+    profiles.push_back(LockProfiler::GetUnnamedProfile());
+    pthread_rwlock_unlock(&profile_lock);
+
+    for(std::list<lock_profile*>::const_iterator iter = profiles.begin(); iter != profiles.end(); ++iter){
+        const lock_profile* profile = *iter;
+        if(0 == profile->acquired_count && 0 == profile->contended_count){
+            continue;
+        }
+        S3FS_PRN_CACHE(fp, "%s: acquired=%lld contended=%lld wait_total=%lldus hold_total=%lldus", profile->name.c_str(), profile->acquired_count, profile->contended_count, profile->wait_total_us, profile->hold_total_us);
+        S3FS_PRN_CACHE(fp, "    wait(us):%s", lock_profile_hist(profile->wait_hist).c_str());
+        S3FS_PRN_CACHE(fp, "    hold(us):%s", lock_profile_hist(profile->hold_hist).c_str());
+    }
+
+    if(stdout != fp){
+        fclose(fp);
+    }
+    return true;
+}
+
 //-------------------------------------------------------------------
 // Class AutoLock
 //-------------------------------------------------------------------
-AutoLock::AutoLock(pthread_mutex_t* pmutex, Type type) : auto_mutex(pmutex)
+AutoLock::AutoLock(pthread_mutex_t* pmutex, Type type) : auto_mutex(pmutex), profile(NULL)
+{
+    if(LockProfiler::IsEnable() && type != ALREADY_LOCKED){
+        profile = LockProfiler::Find(pmutex);
+    }
+    Lock(type);
+}
+
+AutoLock::AutoLock(named_mutex* pmutex, Type type) : auto_mutex(&pmutex->mutex), profile(NULL)
+{
+    if(LockProfiler::IsEnable() && type != ALREADY_LOCKED){
+        profile = LockProfiler::Find(pmutex);
+    }
+    Lock(type);
+}
+
+void AutoLock::Lock(Type type)
 {
     if (type == ALREADY_LOCKED) {
         is_lock_acquired = false;
@@ -37,14 +243,22 @@ AutoLock::AutoLock(pthread_mutex_t* pmutex, Type type) : auto_mutex(pmutex)
         int result = pthread_mutex_trylock(auto_mutex);
         if(result == 0){
             is_lock_acquired = true;
+            if(profile){
+                __sync_fetch_and_add(&profile->acquired_count, 1LL);
+                LockProfiler::Record(profile->wait_hist, &profile->wait_total_us, 0);
+                clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &acquired_time);
+            }
         }else if(result == EBUSY){
             is_lock_acquired = false;
+            if(profile){
+                __sync_fetch_and_add(&profile->contended_count, 1LL);
+            }
         }else{
             S3FS_PRN_CRIT("pthread_mutex_trylock returned: %d", result);
             abort();
         }
     } else {
-        int result = pthread_mutex_lock(auto_mutex);
+        int result = profile ? LockWithProfile() : pthread_mutex_lock(auto_mutex);
         if(result == 0){
             is_lock_acquired = true;
         }else{
@@ -54,6 +268,26 @@ AutoLock::AutoLock(pthread_mutex_t* pmutex, Type type) : auto_mutex(pmutex)
     }
 }
 
+//
+// Try the lock at first for knowing whether the mutex is contended.
+//
+int AutoLock::LockWithProfile()
+{
+    struct timespec start;
+    clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &start);
+
+    int result = pthread_mutex_trylock(auto_mutex);
+    if(EBUSY == result){
+        __sync_fetch_and_add(&profile->contended_count, 1LL);
+        result = pthread_mutex_lock(auto_mutex);
+    }
+    if(0 == result){
+        __sync_fetch_and_add(&profile->acquired_count, 1LL);
+        LockProfiler::Record(profile->wait_hist, &profile->wait_total_us, LockProfiler::ElapsedUs(start, &acquired_time));
+    }
+    return result;
+}
+
 bool AutoLock::isLockAcquired() const
 {
     return is_lock_acquired;
@@ -62,6 +296,9 @@ bool AutoLock::isLockAcquired() const
 AutoLock::~AutoLock()
 {
     if (is_lock_acquired) {
+        if(profile){
+            LockProfiler::Record(profile->hold_hist, &profile->hold_total_us, LockProfiler::ElapsedUs(acquired_time));
+        }
         int result = pthread_mutex_unlock(auto_mutex);
         if(result != 0){
             S3FS_PRN_CRIT("pthread_mutex_unlock returned: %d", result);
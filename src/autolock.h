@@ -22,6 +22,81 @@
 #define S3FS_AUTOLOCK_H_
 
 #include <pthread.h>
+#include <ctime>
+#include <string>
+
+//-------------------------------------------------------------------
+// Lock profile
+//-------------------------------------------------------------------
+// [NOTE]
+// The histograms have the buckets of power of 2 microseconds, the
+// bucket N counts the times in [2^(N-1), 2^N) us(the bucket 0 counts
+// the times under 1 us), and the last bucket counts all the longer.
+//
+#define LOCK_PROFILE_BUCKETS    24
+
+struct lock_profile
+{
+    std::string name;
+    long long   acquired_count;         // count of acquiring
+    long long   contended_count;        // count of waiting for the other holder
+    long long   wait_total_us;
+    long long   hold_total_us;
+    long long   wait_hist[LOCK_PROFILE_BUCKETS];
+    long long   hold_hist[LOCK_PROFILE_BUCKETS];
+
+    explicit lock_profile(const char* pname);
+};
+
+//
+// The mutex which is profiled by its name
+//
+// [NOTE]
+// The profile is kept with the mutex, then AutoLock finds it without any
+// lookup. The name is given by LockProfiler::SetName() after initializing
+// the mutex, and the profile is resolved from the name at the first lock
+// while profiling, so that naming the mutex does not take any lock.
+//
+struct named_mutex
+{
+    pthread_mutex_t mutex;
+    const char*     name;               // must not be freed while the mutex is used(ex. a string literal)
+    lock_profile*   profile;            // NULL until it is resolved
+};
+
+//-------------------------------------------------------------------
+// LockProfiler Class
+//-------------------------------------------------------------------
+// [NOTE]
+// When the lock_profile option is specified, AutoLock records the count
+// of acquiring, the wait time and the hold time of each named_mutex into
+// the profile of the name which is given to the mutex by SetName().
+// The mutexes of the same name(ex. fdent_lock of all entities) share
+// one profile, and the plain pthread mutexes are recorded as "(unnamed)".
+// The profiles are dumped by SIGUSR1 and at exiting.
+// When this is disabled, AutoLock only checks the flag.
+//
+class LockProfiler
+{
+    private:
+        static bool         is_enable;
+        static std::string  output_path;
+
+    private:
+        static lock_profile* GetUnnamedProfile();
+        static lock_profile* GetProfile(const char* name);
+
+    public:
+        static bool SetEnable(bool enable, const char* path = NULL);
+        static bool IsEnable() { return LockProfiler::is_enable; }
+
+        static void SetName(named_mutex* pmutex, const char* name);
+        static lock_profile* Find(named_mutex* pmutex);
+        static lock_profile* Find(const pthread_mutex_t* pmutex) { return LockProfiler::GetUnnamedProfile(); }
+        static void Record(long long* hist, long long* total, long long us);
+        static long long ElapsedUs(const struct timespec& start, struct timespec* pnow = NULL);
+        static bool Dump();
+};
 
 //-------------------------------------------------------------------
 // AutoLock Class
@@ -38,12 +113,18 @@ class AutoLock
     private:
         pthread_mutex_t* const auto_mutex;
         bool is_lock_acquired;
+        lock_profile* profile;          // not NULL only when the lock profiler is enabled
+        struct timespec acquired_time;
 
     private:
         AutoLock(const AutoLock&);
 
+        void Lock(Type type);
+        int LockWithProfile();
+
     public:
         explicit AutoLock(pthread_mutex_t* pmutex, Type type = NONE);
+        explicit AutoLock(named_mutex* pmutex, Type type = NONE);
         ~AutoLock();
         bool isLockAcquired() const;
 };
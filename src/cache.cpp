@@ -28,6 +28,7 @@
 #include "s3fs.h"
 #include "s3fs_util.h"
 #include "cache.h"
+#include "cache_refresher.h"
 #include "autolock.h"
 #include "string_util.h"
 
@@ -76,6 +77,39 @@ inline bool IsExpireStatCacheTime(const struct timespec& ts, const time_t& expir
     return (0 < CompareStatCacheTime(nowts, ts));
 }
 
+// copy only some keys
+static void copy_stat_cache_meta(headers_t& dest, const headers_t& meta)
+{
+    for(headers_t::const_iterator iter = meta.begin(); iter != meta.end(); ++iter){
+        std::string tag   = lower(iter->first);
+        std::string value = iter->second;
+        if(tag == "content-type"){
+            dest[iter->first] = value;
+        }else if(tag == "content-length"){
+            dest[iter->first] = value;
+        }else if(tag == "etag"){
+            dest[iter->first] = value;
+        }else if(tag == "last-modified"){
+            dest[iter->first] = value;
+        }else if(is_prefix(tag.c_str(), "x-oss")){
+            dest[tag] = value;      // key is lower case for "x-oss"
+        }
+    }
+}
+
+// Returns the key of directory listing cache which is not terminated by "/"(except "/").
+static std::string get_dirlist_key(const std::string& path)
+{
+    std::string key = path;
+    while(1 < key.length() && '/' == *key.rbegin()){
+        key.erase(key.length() - 1);
+    }
+    if(key.empty()){
+        key = "/";
+    }
+    return key;
+}
+
 bool convert_header_to_stat(const std::string& strpath, const headers_t& meta, struct stat* pst, bool forcedir, bool noextendedmeta, off_t check_size_meta)
 {
     if(!pst){
@@ -212,13 +246,13 @@ struct sort_symlinkiterlist{
 // Static
 //-------------------------------------------------------------------
 StatCache       StatCache::singleton;
-pthread_mutex_t StatCache::stat_cache_lock;
+named_mutex StatCache::stat_cache_lock;
 
 //-------------------------------------------------------------------
 // Constructor/Destructor
 //-------------------------------------------------------------------
-StatCache::StatCache() : IsExpireTime(true), IsExpireIntervalType(false), ExpireTime(15 * 60), CacheSize(100000), IsCacheNoObject(false),
- IsNoExtendedMeta(false), CheckSizeForMeta(0LL)
+StatCache::StatCache() : IsExpireTime(true), IsExpireIntervalType(false), ExpireTime(15 * 60), StaleGraceTime(0), CacheSize(100000), BudgetSize(0), IsCacheNoObject(false),
+ DirListExpireTime(30), IsNoExtendedMeta(false), CheckSizeForMeta(0LL)
 {
     if(this == StatCache::getStatCacheData()){
         stat_cache.clear();
@@ -228,10 +262,11 @@ StatCache::StatCache() : IsExpireTime(true), IsExpireIntervalType(false), Expire
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
         int result;
-        if(0 != (result = pthread_mutex_init(&StatCache::stat_cache_lock, &attr))){
+        if(0 != (result = pthread_mutex_init(&StatCache::stat_cache_lock.mutex, &attr))){
             S3FS_PRN_CRIT("failed to init stat_cache_lock: %d", result);
             abort();
         }
+        LockProfiler::SetName(&StatCache::stat_cache_lock, "StatCache::stat_cache_lock");
     }else{
         abort();
     }
@@ -241,7 +276,7 @@ StatCache::~StatCache()
 {
     if(this == StatCache::getStatCacheData()){
         Clear();
-        int result = pthread_mutex_destroy(&StatCache::stat_cache_lock);
+        int result = pthread_mutex_destroy(&StatCache::stat_cache_lock.mutex);
         if(result != 0){
             S3FS_PRN_CRIT("failed to destroy stat_cache_lock: %d", result);
             abort();
@@ -266,6 +301,39 @@ unsigned long StatCache::SetCacheSize(unsigned long size)
     return old;
 }
 
+// [NOTE]
+// The memory of the stat cache is estimated from the count of the entries,
+// since the most of it is the headers of the entries.
+//
+uint64_t StatCache::GetMemoryUsage() const
+{
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    return static_cast<uint64_t>(stat_cache.size()) * StatCache::ENTRY_MEMORY_SIZE;
+}
+
+//
+// Limits the stat cache in the budget(bytes) given by MemoryGovernor.
+// The budget does not change the cache size, then it limits the entries
+// which are added while the memory is under pressure, and is removed by
+// the budget 0.
+//
+bool StatCache::SetMemoryBudget(uint64_t budget)
+{
+    unsigned long limit = 0;
+    if(0 != budget){
+        limit = std::max(1UL, static_cast<unsigned long>(budget / StatCache::ENTRY_MEMORY_SIZE));
+    }
+    {
+        AutoLock lock(&StatCache::stat_cache_lock);
+        BudgetSize = limit;
+        if(0 == limit || stat_cache.size() < limit){
+            return true;
+        }
+    }
+    return TruncateCache();
+}
+
 time_t StatCache::GetExpireTime() const
 {
     return (IsExpireTime ? ExpireTime : (-1));
@@ -289,6 +357,30 @@ time_t StatCache::UnsetExpireTime()
     return old;
 }
 
+time_t StatCache::GetStaleGraceTime() const
+{
+    return StaleGraceTime;
+}
+
+time_t StatCache::SetStaleGraceTime(time_t grace)
+{
+    time_t old     = StaleGraceTime;
+    StaleGraceTime = grace;
+    return old;
+}
+
+time_t StatCache::GetDirListExpireTime() const
+{
+    return DirListExpireTime;
+}
+
+time_t StatCache::SetDirListExpireTime(time_t expire)
+{
+    time_t old        = DirListExpireTime;
+    DirListExpireTime = expire;
+    return old;
+}
+
 bool StatCache::SetCacheNoObject(bool flag)
 {
     bool old = IsCacheNoObject;
@@ -312,6 +404,11 @@ void StatCache::Clear()
         delete (*iter).second;
     }
     stat_cache.clear();
+
+    for(dirlist_cache_t::iterator iter = dirlist_cache.begin(); iter != dirlist_cache.end(); ++iter){
+        delete iter->second;
+    }
+    dirlist_cache.clear();
     S3FS_MALLOCTRIM(0);
 }
 
@@ -333,8 +430,9 @@ bool StatCache::GetStat(const std::string& key, struct stat* pst, headers_t* met
     }
 
     if(iter != stat_cache.end() && (*iter).second){
-        stat_cache_entry* ent = (*iter).second;
-        if(0 < ent->notruncate || !IsExpireTime || !IsExpireStatCacheTime(ent->cache_date, ExpireTime)){
+        stat_cache_entry* ent      = (*iter).second;
+        bool              is_stale = false;
+        if(0 < ent->notruncate || !IsExpireTime || !IsExpireStatCacheTime(ent->cache_date, ExpireTime) || (is_stale = IsStaleStatCache(ent))){
             if(ent->noobjcache){
                 if(!IsCacheNoObject){
                     // need to delete this cache.
@@ -381,8 +479,17 @@ bool StatCache::GetStat(const std::string& key, struct stat* pst, headers_t* met
                     (*pisfake) = ent->isfake;
                 }
                 ent->hit_count++;
-  
-                if(IsExpireIntervalType){
+
+                if(is_stale){
+                    // expired but in the grace time, then refresh it in background
+                    if(!ent->refreshing){
+                        headers_t::const_iterator eiter = ent->meta.find("ETag");
+                        if(StatCacheRefresher::Instruct(strpath, (eiter != ent->meta.end() ? eiter->second : std::string("")))){
+                            ent->refreshing = true;
+                        }
+                    }
+                    S3FS_PRN_DBG("stat cache is stale [path=%s]", strpath.c_str());
+                }else if(IsExpireIntervalType){
                     SetStatCacheTime(ent->cache_date);
                 }
                 return true;
@@ -400,6 +507,21 @@ bool StatCache::GetStat(const std::string& key, struct stat* pst, headers_t* met
     return false;
 }
 
+//
+// Returns true if the expired entry can be returned in the stale grace time.
+// The entries which are not able to be refreshed by HEAD request are not.
+//
+bool StatCache::IsStaleStatCache(const stat_cache_entry* ent) const
+{
+    if(!ent || 0 >= StaleGraceTime || !StatCacheRefresher::IsEnable()){
+        return false;
+    }
+    if(ent->noobjcache || ent->isforce){
+        return false;
+    }
+    return !IsExpireStatCacheTime(ent->cache_date, ExpireTime + StaleGraceTime);
+}
+
 bool StatCache::IsNoObjectCache(const std::string& key, bool overcheck)
 {
     bool is_delete_cache = false;
@@ -453,7 +575,7 @@ bool StatCache::AddStat(const std::string& key, headers_t& meta, bool forcedir,
     {
         AutoLock lock(&StatCache::stat_cache_lock);
         found       = stat_cache.end() != stat_cache.find(key);
-        do_truncate = stat_cache.size() > CacheSize;
+        do_truncate = stat_cache.size() > GetCacheLimit();
     }
 
     if(found){
@@ -477,24 +599,10 @@ bool StatCache::AddStat(const std::string& key, headers_t& meta, bool forcedir,
     ent->noobjcache = false;
     ent->notruncate = (no_truncate ? 1L : 0L);
     ent->isfake     = isfake;
+    ent->refreshing = false;
     ent->meta.clear();
     SetStatCacheTime(ent->cache_date);    // Set time.
-    //copy only some keys
-    for(headers_t::iterator iter = meta.begin(); iter != meta.end(); ++iter){
-        std::string tag   = lower(iter->first);
-        std::string value = iter->second;
-        if(tag == "content-type"){
-            ent->meta[iter->first] = value;
-        }else if(tag == "content-length"){
-            ent->meta[iter->first] = value;
-        }else if(tag == "etag"){
-            ent->meta[iter->first] = value;
-        }else if(tag == "last-modified"){
-            ent->meta[iter->first] = value;
-        }else if(is_prefix(tag.c_str(), "x-oss")){
-            ent->meta[tag] = value;      // key is lower case for "x-oss"
-        }
-    }
+    copy_stat_cache_meta(ent->meta, meta);
 
     // add
     AutoLock lock(&StatCache::stat_cache_lock);
@@ -518,6 +626,8 @@ bool StatCache::AddStat(const std::string& key, headers_t& meta, bool forcedir,
 // [NOTE]
 // Updates only meta data if cached data exists.
 // And when these are updated, it also updates the cache time.
+// The refreshing in background is canceled, because its result is for the
+// old meta(etag) and it is discarded by RefreshStat().
 //
 // Since the file mode may change while the file is open, it is
 // updated as well.
@@ -537,24 +647,11 @@ bool StatCache::UpdateMetaStats(const std::string& key, headers_t& meta)
     stat_cache_entry* ent = iter->second;
 
     // update only meta keys
-    for(headers_t::iterator metaiter = meta.begin(); metaiter != meta.end(); ++metaiter){
-        std::string tag   = lower(metaiter->first);
-        std::string value = metaiter->second;
-        if(tag == "content-type"){
-            ent->meta[metaiter->first] = value;
-        }else if(tag == "content-length"){
-            ent->meta[metaiter->first] = value;
-        }else if(tag == "etag"){
-            ent->meta[metaiter->first] = value;
-        }else if(tag == "last-modified"){
-            ent->meta[metaiter->first] = value;
-        }else if(is_prefix(tag.c_str(), "x-oss")){
-            ent->meta[tag] = value;      // key is lower case for "x-oss"
-        }
-    }
+    copy_stat_cache_meta(ent->meta, meta);
 
-    // Update time.
+    // Update time, and the entry is able to be refreshed again after expired.
     SetStatCacheTime(ent->cache_date);
+    ent->refreshing = false;
 
     // Update only mode
     if(!IsNoExtendedMeta){
@@ -564,6 +661,97 @@ bool StatCache::UpdateMetaStats(const std::string& key, headers_t& meta)
     return true;
 }
 
+//
+// [NOTE]
+// The entry is refreshed only if it is still the entry which was instructed
+// to be refreshed(it has the same etag and is not replaced). If the entry
+// was updated or removed meanwhile, the result is discarded.
+// If the refresh failed by other than ENOENT, the entry is left to be
+// expired at the hard limit.
+// If the object is not modified(the conditional request with the etag
+// got 304), only the cache time of the entry is updated.
+//
+bool StatCache::RefreshStat(const std::string& key, const std::string& etag, int result, const headers_t& meta, bool not_modified)
+{
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    stat_cache_t::iterator iter = stat_cache.find(key);
+    if(stat_cache.end() == iter || !(iter->second) || !(iter->second->refreshing)){
+        return false;
+    }
+    stat_cache_entry*         ent   = iter->second;
+    headers_t::const_iterator eiter = ent->meta.find("ETag");
+    if(etag != (eiter != ent->meta.end() ? eiter->second : std::string(""))){
+        return false;
+    }
+    ent->refreshing = false;
+
+    if(-ENOENT == result){
+        S3FS_PRN_INFO3("stat cache entry is removed by refreshing[path=%s]", key.c_str());
+        return DelStat(key, /*lock_already_held=*/ true);
+    }
+    if(0 != result){
+        S3FS_PRN_WARN("failed to refresh stat cache entry[path=%s][result=%d]", key.c_str(), result);
+        return false;
+    }
+    if(not_modified){
+        SetStatCacheTime(ent->cache_date);
+        S3FS_PRN_INFO3("stat cache entry is not modified[path=%s]", key.c_str());
+        return true;
+    }
+
+    struct stat st;
+    if(!convert_header_to_stat(key, meta, &st, ent->isforce, IsNoExtendedMeta, CheckSizeForMeta)){
+        return false;
+    }
+    ent->stbuf  = st;
+    ent->isfake = false;
+    ent->meta.clear();
+    copy_stat_cache_meta(ent->meta, meta);
+    SetStatCacheTime(ent->cache_date);
+
+    S3FS_PRN_INFO3("stat cache entry is refreshed[path=%s]", key.c_str());
+    return true;
+}
+
+//
+// [NOTE]
+// The decoded xattrs are returned only if they were decoded from the same
+// header value as the caller has, so that they are never older than the
+// headers even if the meta of the entry is updated. They are removed
+// together with the entry.
+//
+bool StatCache::GetXattrs(const std::string& key, const std::string& strxattrs, xattr_cache_t& xattrs)
+{
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    stat_cache_t::iterator iter = stat_cache.find(key);
+    if(stat_cache.end() == iter && '/' != *key.rbegin()){
+        iter = stat_cache.find(key + "/");
+    }
+    if(stat_cache.end() == iter || !(iter->second) || iter->second->xattrsrc.empty() || iter->second->xattrsrc != strxattrs){
+        return false;
+    }
+    xattrs = iter->second->xattrs;
+    return true;
+}
+
+bool StatCache::SetXattrs(const std::string& key, const std::string& strxattrs, const xattr_cache_t& xattrs)
+{
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    stat_cache_t::iterator iter = stat_cache.find(key);
+    if(stat_cache.end() == iter && '/' != *key.rbegin()){
+        iter = stat_cache.find(key + "/");
+    }
+    if(stat_cache.end() == iter || !(iter->second) || iter->second->noobjcache){
+        return false;
+    }
+    iter->second->xattrsrc = strxattrs;
+    iter->second->xattrs   = xattrs;
+    return true;
+}
+
 bool StatCache::AddNoObjectCache(const std::string& key)
 {
     if(!IsCacheNoObject){
@@ -579,7 +767,7 @@ bool StatCache::AddNoObjectCache(const std::string& key)
     {
         AutoLock lock(&StatCache::stat_cache_lock);
         found       = stat_cache.end() != stat_cache.find(key);
-        do_truncate = stat_cache.size() > CacheSize;
+        do_truncate = stat_cache.size() > GetCacheLimit();
     }
 
     if(found){
@@ -599,6 +787,7 @@ bool StatCache::AddNoObjectCache(const std::string& key)
     ent->isforce    = false;
     ent->noobjcache = true;
     ent->notruncate = 0L;
+    ent->refreshing = false;
     ent->meta.clear();
     SetStatCacheTime(ent->cache_date);    // Set time.
 
@@ -638,7 +827,7 @@ void StatCache::ChangeNoTruncateFlag(const std::string& key, bool no_truncate)
     }
 }
 
-bool StatCache::TruncateCache()
+bool StatCache::TruncateCache(unsigned long limit)
 {
     AutoLock lock(&StatCache::stat_cache_lock);
 
@@ -650,7 +839,7 @@ bool StatCache::TruncateCache()
     if(IsExpireTime){
         for(stat_cache_t::iterator iter = stat_cache.begin(); iter != stat_cache.end(); ){
             stat_cache_entry* entry = iter->second;
-            if(!entry || (0L == entry->notruncate && IsExpireStatCacheTime(entry->cache_date, ExpireTime))){
+            if(!entry || (0L == entry->notruncate && IsExpireStatCacheTime(entry->cache_date, ExpireTime + StaleGraceTime))){
                 delete entry;
                 stat_cache.erase(iter++);
             }else{
@@ -660,12 +849,12 @@ bool StatCache::TruncateCache()
     }
 
     // 2) check stat cache count
-    if(stat_cache.size() < CacheSize){
+    if(stat_cache.size() < limit){
         return true;
     }
 
     // 3) erase from the old cache in order
-    size_t            erase_count= stat_cache.size() - CacheSize + 1;
+    size_t            erase_count= stat_cache.size() - limit + 1;
     statiterlist_t    erase_iters;
     for(stat_cache_t::iterator iter = stat_cache.begin(); iter != stat_cache.end() && 0 < erase_count; ++iter){
         // check no truncate
@@ -726,6 +915,41 @@ bool StatCache::DelStat(const char* key, bool lock_already_held)
             stat_cache.erase(iter);
         }
     }
+    DelDirList(key, /*lock_already_held=*/ true);
+
+    S3FS_MALLOCTRIM(0);
+
+    return true;
+}
+
+bool StatCache::DelStatTree(const std::string& dirpath)
+{
+    if(dirpath.empty()){
+        return false;
+    }
+    S3FS_PRN_INFO3("delete stat cache entries under directory[path=%s]", dirpath.c_str());
+
+    std::string prefix = dirpath;
+    if('/' != *prefix.rbegin()){
+        prefix += "/";
+    }
+
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    DelStat(prefix, true);          // "dir" and "dir/"
+
+    for(stat_cache_t::iterator iter = stat_cache.lower_bound(prefix); iter != stat_cache.end() && 0 == iter->first.compare(0, prefix.size(), prefix); ){
+        delete iter->second;
+        stat_cache.erase(iter++);
+    }
+    for(symlink_cache_t::iterator iter = symlink_cache.lower_bound(prefix); iter != symlink_cache.end() && 0 == iter->first.compare(0, prefix.size(), prefix); ){
+        delete iter->second;
+        symlink_cache.erase(iter++);
+    }
+    for(dirlist_cache_t::iterator iter = dirlist_cache.lower_bound(prefix); iter != dirlist_cache.end() && 0 == iter->first.compare(0, prefix.size(), prefix); ){
+        delete iter->second;
+        dirlist_cache.erase(iter++);
+    }
     S3FS_MALLOCTRIM(0);
 
     return true;
@@ -875,6 +1099,115 @@ bool StatCache::DelSymlink(const char* key, bool lock_already_held)
     return true;
 }
 
+bool StatCache::GetDirList(const std::string& key, S3ObjList& list)
+{
+    std::string strkey = get_dirlist_key(key);
+
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    dirlist_cache_t::iterator iter = dirlist_cache.find(strkey);
+    if(iter == dirlist_cache.end()){
+        return false;
+    }
+    if(IsExpireStatCacheTime(iter->second->cache_date, DirListExpireTime)){
+        // timeout
+        delete iter->second;
+        dirlist_cache.erase(iter);
+        return false;
+    }
+    S3FS_PRN_DBG("directory listing cache hit [path=%s]", strkey.c_str());
+
+    list = iter->second->list;
+    return true;
+}
+
+bool StatCache::AddDirList(const std::string& key, const S3ObjList& list)
+{
+    if(CacheSize < 1){
+        return false;
+    }
+    std::string strkey = get_dirlist_key(key);
+
+    S3FS_PRN_INFO3("add directory listing cache entry[path=%s]", strkey.c_str());
+
+    bool do_truncate;
+    {
+        AutoLock lock(&StatCache::stat_cache_lock);
+        do_truncate = dirlist_cache.size() >= CacheSize;
+    }
+    if(do_truncate){
+        if(!TruncateDirList()){
+            return false;
+        }
+    }
+
+    // make new
+    dirlist_cache_entry* ent = new dirlist_cache_entry();
+    ent->list = list;
+    SetStatCacheTime(ent->cache_date);
+
+    // add
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    std::pair<dirlist_cache_t::iterator, bool> pair = dirlist_cache.insert(std::make_pair(strkey, ent));
+    if(!pair.second){
+        delete pair.first->second;
+        pair.first->second = ent;
+    }
+    return true;
+}
+
+//
+// The listings are not evicted in LRU order, because they are loaded at
+// once for a subtree. If the cache is still full after removing expired
+// ones, the new listing is not added.
+//
+bool StatCache::TruncateDirList()
+{
+    AutoLock lock(&StatCache::stat_cache_lock);
+
+    for(dirlist_cache_t::iterator iter = dirlist_cache.begin(); iter != dirlist_cache.end(); ){
+        if(IsExpireStatCacheTime(iter->second->cache_date, DirListExpireTime)){
+            delete iter->second;
+            dirlist_cache.erase(iter++);
+        }else{
+            ++iter;
+        }
+    }
+    return (dirlist_cache.size() < CacheSize);
+}
+
+//
+// Delete the listings of the path(if it is a directory) and its parent
+// directory, because the object of the path is changed.
+//
+bool StatCache::DelDirList(const char* key, bool lock_already_held)
+{
+    if(!key){
+        return false;
+    }
+    AutoLock lock(&StatCache::stat_cache_lock, lock_already_held ? AutoLock::ALREADY_LOCKED : AutoLock::NONE);
+
+    if(dirlist_cache.empty()){
+        return true;
+    }
+    std::string strkey = get_dirlist_key(std::string(key));
+    std::string parent = mydirname(strkey);
+
+    dirlist_cache_t::iterator iter;
+    if(dirlist_cache.end() != (iter = dirlist_cache.find(strkey))){
+        S3FS_PRN_INFO3("delete directory listing cache entry[path=%s]", strkey.c_str());
+        delete iter->second;
+        dirlist_cache.erase(iter);
+    }
+    if(dirlist_cache.end() != (iter = dirlist_cache.find(parent))){
+        S3FS_PRN_INFO3("delete directory listing cache entry[path=%s]", parent.c_str());
+        delete iter->second;
+        dirlist_cache.erase(iter);
+    }
+    return true;
+}
+
 bool StatCache::ConvertMetaToStat(const std::string& strpath, const headers_t& meta, struct stat* pst, bool forcedir)
 {
     return convert_header_to_stat(strpath, meta, pst, forcedir, IsNoExtendedMeta, CheckSizeForMeta);
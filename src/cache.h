@@ -21,7 +21,14 @@
 #ifndef S3FS_CACHE_H_
 #define S3FS_CACHE_H_
 
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+
 #include "metaheader.h"
+#include "autolock.h"
+#include "s3objlist.h"
 
 //-------------------------------------------------------------------
 // Structure
@@ -38,8 +45,11 @@ struct stat_cache_entry {
     bool              noobjcache;  // Flag: cache is no object for no listing.
     unsigned long     notruncate;  // 0<:   not remove automatically at checking truncate
     bool              isfake;   // Flag: meta is built from listobject result.
+    bool              refreshing;  // Flag: refreshing in background after expired.
+    std::string       xattrsrc;    // "x-oss-meta-xattr" header value which xattrs are decoded from
+    xattr_cache_t     xattrs;      // decoded xattrs
 
-    stat_cache_entry() : hit_count(0), isforce(false), noobjcache(false), notruncate(0L), isfake(false)
+    stat_cache_entry() : hit_count(0), isforce(false), noobjcache(false), notruncate(0L), isfake(false), refreshing(false)
     {
         memset(&stbuf, 0, sizeof(struct stat));
         cache_date.tv_sec  = 0;
@@ -67,6 +77,22 @@ struct symlink_cache_entry {
 
 typedef std::map<std::string, symlink_cache_entry*> symlink_cache_t;
 
+//
+// Struct for directory listing cache
+//
+struct dirlist_cache_entry {
+    S3ObjList         list;
+    struct timespec   cache_date;
+
+    dirlist_cache_entry()
+    {
+      cache_date.tv_sec  = 0;
+      cache_date.tv_nsec = 0;
+    }
+};
+
+typedef std::map<std::string, dirlist_cache_entry*> dirlist_cache_t;     // key=directory path(not terminated by "/")
+
 //-------------------------------------------------------------------
 // Class StatCache
 //-------------------------------------------------------------------
@@ -79,18 +105,30 @@ typedef std::map<std::string, symlink_cache_entry*> symlink_cache_t;
 // cache. This simplifies user configuration, and from a user perspective,
 // the symbolic link cache appears to be included in the Stats cache.
 //
+// [NOTE] About Directory listing cache
+// The listings of the directories which are loaded at once for a subtree
+// (see TraversalDetector) are also kept in this class, because they must
+// be removed together with the stats of the objects in them.
+// Deleting the stat of an object removes the listings of the object (if
+// it is a directory) and of its parent directory. The listings expire in
+// their own time which is shorter than the Stats cache.
+//
 class StatCache
 {
     private:
         static StatCache       singleton;
-        static pthread_mutex_t stat_cache_lock;
+        static named_mutex     stat_cache_lock;
         stat_cache_t           stat_cache;
         bool                   IsExpireTime;
         bool                   IsExpireIntervalType;    // if this flag is true, cache data is updated at last access time.
         time_t                 ExpireTime;
+        time_t                 StaleGraceTime;          // the expired entries in this time are returned and refreshed in background
         unsigned long          CacheSize;
+        unsigned long          BudgetSize;              // the count of entries in the budget of MemoryGovernor, 0 if not under pressure
         bool                   IsCacheNoObject;
         symlink_cache_t        symlink_cache;
+        dirlist_cache_t        dirlist_cache;
+        time_t                 DirListExpireTime;
         bool                   IsNoExtendedMeta;
         off_t                  CheckSizeForMeta;
 
@@ -100,12 +138,25 @@ class StatCache
 
         void Clear();
         bool GetStat(const std::string& key, struct stat* pst, headers_t* meta, bool overcheck, const char* petag, bool* pisforce, bool *pisfake);
+        bool IsStaleStatCache(const stat_cache_entry* ent) const;
+        unsigned long GetCacheLimit() const
+        {
+            return (0 != BudgetSize && BudgetSize < CacheSize) ? BudgetSize : CacheSize;
+        }
         // Truncate stat cache
-        bool TruncateCache();
+        bool TruncateCache()
+        {
+            return TruncateCache(GetCacheLimit());
+        }
+        bool TruncateCache(unsigned long limit);
         // Truncate symbolic link cache
         bool TruncateSymlink();
+        // Truncate directory listing cache
+        bool TruncateDirList();
 
     public:
+        static const uint64_t ENTRY_MEMORY_SIZE = 400;      // estimated memory of one entry(see max_stat_cache_size)
+
         // Reference singleton
         static StatCache* getStatCacheData()
         {
@@ -115,9 +166,15 @@ class StatCache
         // Attribute
         unsigned long GetCacheSize() const;
         unsigned long SetCacheSize(unsigned long size);
+        uint64_t GetMemoryUsage() const;
+        bool SetMemoryBudget(uint64_t budget);
         time_t GetExpireTime() const;
         time_t SetExpireTime(time_t expire, bool is_interval = false);
         time_t UnsetExpireTime();
+        time_t GetStaleGraceTime() const;
+        time_t SetStaleGraceTime(time_t grace);
+        time_t GetDirListExpireTime() const;
+        time_t SetDirListExpireTime(time_t expire);
         bool SetCacheNoObject(bool flag);
         bool EnableCacheNoObject()
         {
@@ -175,6 +232,9 @@ class StatCache
         // Update meta stats
         bool UpdateMetaStats(const std::string& key, headers_t& meta);
 
+        // Refresh the stat cache which is expired(called from StatCacheRefresher)
+        bool RefreshStat(const std::string& key, const std::string& etag, int result, const headers_t& meta, bool not_modified = false);
+
         // Change no truncate flag
         void ChangeNoTruncateFlag(const std::string& key, bool no_truncate);
 
@@ -184,11 +244,23 @@ class StatCache
         {
             return DelStat(key.c_str(), lock_already_held);
         }
+        // Delete stat and symbolic link caches of the directory and all under it
+        bool DelStatTree(const std::string& dirpath);
+
         // Cache for symbolic link
         bool GetSymlink(const std::string& key, std::string& value);
         bool AddSymlink(const std::string& key, const std::string& value);
         bool DelSymlink(const char* key, bool lock_already_held = false);
 
+        // Cache for directory listing
+        bool GetDirList(const std::string& key, S3ObjList& list);
+        bool AddDirList(const std::string& key, const S3ObjList& list);
+        bool DelDirList(const char* key, bool lock_already_held = false);
+
+        // Decoded xattrs attached to stat cache
+        bool GetXattrs(const std::string& key, const std::string& strxattrs, xattr_cache_t& xattrs);
+        bool SetXattrs(const std::string& key, const std::string& strxattrs, const xattr_cache_t& xattrs);
+
         // header meta to stat
         bool ConvertMetaToStat(const std::string& strpath, const headers_t& meta, struct stat* pst, bool forcedir);
 
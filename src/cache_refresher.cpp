@@ -0,0 +1,174 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+
+#include "s3fs_logger.h"
+#include "cache_refresher.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// StatCacheRefresher class variables
+//------------------------------------------------
+StatCacheRefresher* StatCacheRefresher::singleton = NULL;
+
+//------------------------------------------------
+// StatCacheRefresher class methods
+//------------------------------------------------
+bool StatCacheRefresher::Initialize(stat_refresh_func func)
+{
+    if(!func){
+        S3FS_PRN_ERR("The function for refreshing stat cache is NULL.");
+        return false;
+    }
+    if(StatCacheRefresher::singleton){
+        S3FS_PRN_WARN("Already singleton for stat cache refresher is existed, then re-create it.");
+        StatCacheRefresher::Destroy();
+    }
+    StatCacheRefresher::singleton = new StatCacheRefresher(func);
+    return true;
+}
+
+void StatCacheRefresher::Destroy()
+{
+    if(StatCacheRefresher::singleton){
+        delete StatCacheRefresher::singleton;
+        StatCacheRefresher::singleton = NULL;
+    }
+}
+
+bool StatCacheRefresher::Instruct(const std::string& key, const std::string& etag)
+{
+    if(!StatCacheRefresher::singleton){
+        return false;
+    }
+    return StatCacheRefresher::singleton->SetJob(key, etag);
+}
+
+//
+// Thread worker
+//
+void* StatCacheRefresher::Worker(void* arg)
+{
+    StatCacheRefresher* psingleton = static_cast<StatCacheRefresher*>(arg);
+
+    if(!psingleton){
+        S3FS_PRN_ERR("The parameter for worker thread is invalid.");
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in StatCacheRefresher.");
+
+    while(true){
+        psingleton->refresh_sem.wait();
+
+        std::string key;
+        std::string etag;
+        {
+            AutoLock auto_lock(&(psingleton->refresh_lock));
+
+            if(psingleton->is_exit){
+                break;
+            }
+            if(psingleton->job_list.empty()){
+                continue;
+            }
+            key  = psingleton->job_list.front().key;
+            etag = psingleton->job_list.front().etag;
+            psingleton->job_list.pop_front();
+        }
+        S3FS_PRN_DBG("refresh stat cache[path=%s][etag=%s]", key.c_str(), etag.c_str());
+
+        (*(psingleton->pfunc))(key, etag);
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// StatCacheRefresher methods
+//------------------------------------------------
+StatCacheRefresher::StatCacheRefresher(stat_refresh_func func) : pfunc(func), is_exit(false), refresh_sem(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&refresh_lock, &attr))){
+        S3FS_PRN_CRIT("failed to init refresh_lock: %d", result);
+        abort();
+    }
+    if(0 != (result = pthread_create(&thread, NULL, StatCacheRefresher::Worker, static_cast<void*>(this)))){
+        S3FS_PRN_CRIT("failed pthread_create with return code(%d)", result);
+        abort();
+    }
+}
+
+StatCacheRefresher::~StatCacheRefresher()
+{
+    {
+        AutoLock auto_lock(&refresh_lock);
+        is_exit = true;
+    }
+    refresh_sem.post();
+
+    void* retval = NULL;
+    int   result;
+    if(0 != (result = pthread_join(thread, &retval))){
+        S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+    }
+
+    // [NOTE]
+    // The entries which are left here are expired at the hard limit.
+    if(!job_list.empty()){
+        S3FS_PRN_INFO("%zu stat cache entries were not refreshed before exiting.", job_list.size());
+    }
+
+    if(0 != (result = pthread_mutex_destroy(&refresh_lock))){
+        S3FS_PRN_CRIT("failed to destroy refresh_lock: %d", result);
+        abort();
+    }
+}
+
+bool StatCacheRefresher::SetJob(const std::string& key, const std::string& etag)
+{
+    {
+        AutoLock auto_lock(&refresh_lock);
+
+        if(is_exit){
+            return false;
+        }
+        job_list.push_back(stat_refresh_job(key, etag));
+    }
+    refresh_sem.post();
+    return true;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
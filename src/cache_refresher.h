@@ -0,0 +1,96 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_CACHE_REFRESHER_H_
+#define S3FS_CACHE_REFRESHER_H_
+
+#include <list>
+#include <pthread.h>
+#include <string>
+
+#include "psemaphore.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+//
+// Function which refreshes the stat cache entry for the key and the etag
+//
+typedef void (*stat_refresh_func)(const std::string& key, const std::string& etag);
+
+struct stat_refresh_job
+{
+    std::string key;
+    std::string etag;
+
+    stat_refresh_job(const std::string& path, const std::string& tag) : key(path), etag(tag) {}
+};
+
+typedef std::list<stat_refresh_job> stat_refresh_jobs_t;
+
+//------------------------------------------------
+// Class StatCacheRefresher
+//------------------------------------------------
+// [NOTE]
+// When the stale grace time of the stat cache is specified, the expired
+// entry in the grace time is returned as is, and it is refreshed by this
+// class in background.
+// StatCache instructs only one refresh for each entry(until the entry is
+// refreshed), and the refresh function updates the entry only if the
+// entry still has the same etag.
+//
+class StatCacheRefresher
+{
+    private:
+        static StatCacheRefresher*  singleton;
+
+        stat_refresh_func           pfunc;
+        bool                        is_exit;
+        Semaphore                   refresh_sem;
+        pthread_t                   thread;
+
+        pthread_mutex_t             refresh_lock;   // protects is_exit and job_list
+        stat_refresh_jobs_t         job_list;
+
+    private:
+        static void* Worker(void* arg);
+
+        explicit StatCacheRefresher(stat_refresh_func func);
+        ~StatCacheRefresher();
+
+        bool SetJob(const std::string& key, const std::string& etag);
+
+    public:
+        static bool Initialize(stat_refresh_func func);
+        static void Destroy();
+        static bool IsEnable() { return (NULL != StatCacheRefresher::singleton); }
+        static bool Instruct(const std::string& key, const std::string& etag);
+};
+
+#endif // S3FS_CACHE_REFRESHER_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -33,6 +33,7 @@
 // TODO: namespace these
 static const int64_t  FIVE_GB            = 5LL * 1024LL * 1024LL * 1024LL;
 static const off_t    MIN_MULTIPART_SIZE = 5 * 1024 * 1024;
+static const int      MAX_MULTIDELETE_KEYS = 1000;         // keys in one DeleteMultipleObjects request
 
 extern bool           foreground;
 extern bool           nomultipart;
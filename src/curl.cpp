@@ -36,6 +36,7 @@
 #include "s3fs_util.h"
 #include "string_util.h"
 #include "addhead.h"
+#include "upload_scheduler.h"
 
 //-------------------------------------------------------------------
 // Symbols
@@ -48,6 +49,7 @@ static const char EMPTY_MD5_BASE64_HASH[]           = "1B2M2Y8AsgTpgAmY7PhCfg=="
 //-------------------------------------------------------------------
 static const int MULTIPART_SIZE                     = 10 * 1024 * 1024;
 static const int GET_OBJECT_RESPONSE_LIMIT          = 1024;
+static const int MAX_MPRENAME_PARTS_IN_BATCH        = 1000;
 
 // [NOTE] about default mime.types file
 // If no mime.types file is specified in the mime option, ossfs
@@ -63,6 +65,26 @@ static const int GET_OBJECT_RESPONSE_LIMIT          = 1024;
 static const char DEFAULT_MIME_FILE[]               = "/etc/mime.types";
 static const char SPECIAL_DARWIN_MIME_FILE[]        = "/etc/apache2/mime.types";
 
+//-------------------------------------------------------------------
+// Utility functions
+//-------------------------------------------------------------------
+// Escape the object key for the xml request body.
+static std::string xml_escape_key(const std::string& key)
+{
+    std::string result;
+    for(std::string::const_iterator iter = key.begin(); iter != key.end(); ++iter){
+        switch(*iter){
+            case '&':   result += "&amp;";  break;
+            case '<':   result += "&lt;";   break;
+            case '>':   result += "&gt;";   break;
+            case '"':   result += "&quot;"; break;
+            case '\'': result += "&apos;"; break;
+            default:    result += *iter;    break;
+        }
+    }
+    return result;
+}
+
 // [NOTICE]
 // This symbol is for libcurl under 7.23.0
 #ifndef CURLSHE_NOT_BUILT_IN
@@ -75,8 +97,8 @@ static const char SPECIAL_DARWIN_MIME_FILE[]        = "/etc/apache2/mime.types";
 const long       S3fsCurl::S3FSCURL_RESPONSECODE_NOTSET;
 const long       S3fsCurl::S3FSCURL_RESPONSECODE_FATAL_ERROR;
 const int        S3fsCurl::S3FSCURL_PERFORM_RESULT_NOTSET;
-pthread_mutex_t  S3fsCurl::curl_warnings_lock;
-pthread_mutex_t  S3fsCurl::curl_handles_lock;
+named_mutex  S3fsCurl::curl_warnings_lock;
+named_mutex  S3fsCurl::curl_handles_lock;
 S3fsCurl::callback_locks_t S3fsCurl::callback_locks;
 bool             S3fsCurl::is_initglobal_done  = false;
 CurlHandlerPool* S3fsCurl::sCurlPool           = NULL;
@@ -134,10 +156,10 @@ bool S3fsCurl::InitS3fsCurl()
 #if S3FS_PTHREAD_ERRORCHECK
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
-    if(0 != pthread_mutex_init(&S3fsCurl::curl_warnings_lock, &attr)){
+    if(0 != pthread_mutex_init(&S3fsCurl::curl_warnings_lock.mutex, &attr)){
         return false;
     }
-    if(0 != pthread_mutex_init(&S3fsCurl::curl_handles_lock, &attr)){
+    if(0 != pthread_mutex_init(&S3fsCurl::curl_handles_lock.mutex, &attr)){
         return false;
     }
     if(0 != pthread_mutex_init(&S3fsCurl::callback_locks.dns, &attr)){
@@ -146,6 +168,8 @@ bool S3fsCurl::InitS3fsCurl()
     if(0 != pthread_mutex_init(&S3fsCurl::callback_locks.ssl_session, &attr)){
         return false;
     }
+    LockProfiler::SetName(&S3fsCurl::curl_warnings_lock, "S3fsCurl::curl_warnings_lock");
+    LockProfiler::SetName(&S3fsCurl::curl_handles_lock, "S3fsCurl::curl_handles_lock");
     if(!S3fsCurl::InitGlobalCurl()){
         return false;
     }
@@ -197,10 +221,10 @@ bool S3fsCurl::DestroyS3fsCurl()
     if(0 != pthread_mutex_destroy(&S3fsCurl::callback_locks.ssl_session)){
         result = false;
     }
-    if(0 != pthread_mutex_destroy(&S3fsCurl::curl_handles_lock)){
+    if(0 != pthread_mutex_destroy(&S3fsCurl::curl_handles_lock.mutex)){
         result = false;
     }
-    if(0 != pthread_mutex_destroy(&S3fsCurl::curl_warnings_lock)){
+    if(0 != pthread_mutex_destroy(&S3fsCurl::curl_warnings_lock.mutex)){
         result = false;
     }
     return result;
@@ -724,7 +748,18 @@ size_t S3fsCurl::DownloadWriteStreamCallback(void* ptr, size_t size, size_t nmem
     ssize_t copysize = (size * nmemb) < (size_t)pCurl->partdata.size ? (size * nmemb) : (size_t)pCurl->partdata.size;
     
     // write
-    memcpy(&((char*)pCurl->partdata.streambuffer)[pCurl->partdata.streampos], ptr, copysize);
+    if(pCurl->streambuffers.empty()){
+        memcpy(&((char*)pCurl->partdata.streambuffer)[pCurl->partdata.streampos], ptr, copysize);
+    }else{
+        // the stream is split into the buffers at every streamsegsize bytes
+        for(ssize_t copied = 0; copied < copysize; ){
+            off_t   pos   = pCurl->partdata.streampos + copied;
+            off_t   off   = pos % pCurl->streamsegsize;
+            ssize_t bytes = std::min(copysize - copied, static_cast<ssize_t>(pCurl->streamsegsize - off));
+            memcpy(pCurl->streambuffers[pos / pCurl->streamsegsize] + off, static_cast<const char*>(ptr) + copied, bytes);
+            copied += bytes;
+        }
+    }
 
     pCurl->partdata.startpos  += copysize;
     pCurl->partdata.size      -= copysize;
@@ -1148,6 +1183,7 @@ S3fsCurl* S3fsCurl::UploadMultipartPostRetryCallback(S3fsCurl* s3fscurl)
     newcurl->retry_count         = s3fscurl->retry_count + 1;
     newcurl->op                  = s3fscurl->op;
     newcurl->type                = s3fscurl->type;
+    newcurl->upload_job          = s3fscurl->upload_job;
 
     // setup new curl object
     if(0 != newcurl->UploadMultipartPostSetup(s3fscurl->path.c_str(), part_num, upload_id)){
@@ -1276,6 +1312,9 @@ int S3fsCurl::ParallelMultipartUploadRequest(const char* tpath, headers_t& meta,
     }
     s3fscurl.DestroyCurlHandle();
 
+    // all parts are scheduled as one upload job
+    uint64_t upload_job = UploadScheduler::NewJob();
+
     // Initialize S3fsMultiCurl
     S3fsMultiCurl curlmulti(GetMaxParallelCount());
     curlmulti.SetSuccessCallback(S3fsCurl::UploadMultipartPostCallback);
@@ -1293,6 +1332,7 @@ int S3fsCurl::ParallelMultipartUploadRequest(const char* tpath, headers_t& meta,
         s3fscurl_para->b_partdata_startpos = s3fscurl_para->partdata.startpos;
         s3fscurl_para->b_partdata_size     = s3fscurl_para->partdata.size;
         s3fscurl_para->partdata.add_etag_list(list);
+        s3fscurl_para->upload_job          = upload_job;
 
         // initiate upload part for parallel
         if(0 != (result = s3fscurl_para->UploadMultipartPostSetup(tpath, s3fscurl_para->partdata.get_part_number(), upload_id))){
@@ -1372,6 +1412,9 @@ int S3fsCurl::ParallelMixMultipartUploadRequest(const char* tpath, headers_t& me
     meta["Content-Type"]      = S3fsCurl::LookupMimeType(std::string(tpath));
     meta["x-oss-copy-source"] = srcresource;
 
+    // all parts are scheduled as one upload job
+    uint64_t upload_job = UploadScheduler::NewJob();
+
     // Initialize S3fsMultiCurl
     S3fsMultiCurl curlmulti(GetMaxParallelCount());
     curlmulti.SetSuccessCallback(S3fsCurl::MixMultipartPostCallback);
@@ -1388,6 +1431,7 @@ int S3fsCurl::ParallelMixMultipartUploadRequest(const char* tpath, headers_t& me
             s3fscurl_para->b_partdata_startpos = s3fscurl_para->partdata.startpos;
             s3fscurl_para->b_partdata_size     = s3fscurl_para->partdata.size;
             s3fscurl_para->partdata.add_etag_list(list);
+            s3fscurl_para->upload_job          = upload_job;
 
             S3FS_PRN_INFO3("Upload Part [tpath=%s][start=%lld][size=%lld][part=%d]", SAFESTRPTR(tpath), static_cast<long long>(iter->offset), static_cast<long long>(iter->bytes), s3fscurl_para->partdata.get_part_number());
 
@@ -1488,7 +1532,7 @@ S3fsCurl* S3fsCurl::ParallelGetObjectRetryCallback(S3fsCurl* s3fscurl)
     // duplicate request(setup new curl object)
     S3fsCurl* newcurl = new S3fsCurl(s3fscurl->IsUseAhbe());
     
-    if(0 != (result = newcurl->PreGetObjectRequest(s3fscurl->path.c_str(), s3fscurl->partdata.fd, s3fscurl->partdata.startpos, s3fscurl->partdata.size, s3fscurl->b_ssetype, s3fscurl->b_ssevalue))){
+    if(0 != (result = newcurl->PreGetObjectRequest(s3fscurl->path.c_str(), s3fscurl->partdata.fd, s3fscurl->partdata.startpos, s3fscurl->partdata.size, s3fscurl->b_ssetype, s3fscurl->b_ssevalue, s3fscurl->b_etag))){
         S3FS_PRN_ERR("failed downloading part setup(%d)", result);
         delete newcurl;
         return NULL;;
@@ -1498,7 +1542,7 @@ S3fsCurl* S3fsCurl::ParallelGetObjectRetryCallback(S3fsCurl* s3fscurl)
     return newcurl;
 }
 
-int S3fsCurl::ParallelGetObjectRequest(const char* tpath, int fd, off_t start, off_t size)
+int S3fsCurl::ParallelGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, const std::string& etag)
 {
     S3FS_PRN_INFO3("[tpath=%s][fd=%d]", SAFESTRPTR(tpath), fd);
 
@@ -1527,7 +1571,7 @@ int S3fsCurl::ParallelGetObjectRequest(const char* tpath, int fd, off_t start, o
 
             // s3fscurl sub object
             S3fsCurl* s3fscurl_para = new S3fsCurl();
-            if(0 != (result = s3fscurl_para->PreGetObjectRequest(tpath, fd, (start + size - remaining_bytes), chunk, ssetype, ssevalue))){
+            if(0 != (result = s3fscurl_para->PreGetObjectRequest(tpath, fd, (start + size - remaining_bytes), chunk, ssetype, ssevalue, etag))){
                 S3FS_PRN_ERR("failed downloading part setup(%d)", result);
                 delete s3fscurl_para;
                 return result;
@@ -1815,9 +1859,10 @@ S3fsCurl::S3fsCurl(bool ahbe) :
     hCurl(NULL), type(REQTYPE_UNSET), requestHeaders(NULL),
     LastResponseCode(S3FSCURL_RESPONSECODE_NOTSET), postdata(NULL), postdata_remaining(0), is_use_ahbe(ahbe),
     retry_count(0), b_infile(NULL), b_postdata(NULL), b_postdata_remaining(0), b_partdata_startpos(0), b_partdata_size(0),
-    b_partdata_streambuff(NULL), b_partdata_streampos(0),
+    b_partdata_streambuff(NULL), b_partdata_streampos(0), streamsegsize(0),
     b_ssekey_pos(-1), b_ssetype(sse_type_t::SSE_DISABLE),
-    sem(NULL), completed_tids_lock(NULL), completed_tids(NULL), fpLazySetup(NULL), curlCode(CURLE_OK)
+    sem(NULL), completed_tids_lock(NULL), completed_tids(NULL), fpLazySetup(NULL), curlCode(CURLE_OK),
+    upload_job(UploadScheduler::NO_JOB)
 {
     if(!S3fsCurl::ps3fscred){
         S3FS_PRN_CRIT("The object of S3fs Credential class is not initialized.");
@@ -2163,6 +2208,7 @@ bool S3fsCurl::RemakeHandle()
             break;
 
         case REQTYPE_CHKBUCKET:
+        case REQTYPE_BUCKETINFO:
             if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
                 return false;
             }
@@ -2187,6 +2233,7 @@ bool S3fsCurl::RemakeHandle()
             break;
 
         case REQTYPE_PREMULTIPOST:
+        case REQTYPE_RENAME:
             if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
                 return false;
             }
@@ -2205,6 +2252,7 @@ bool S3fsCurl::RemakeHandle()
             break;
 
         case REQTYPE_COMPLETEMULTIPOST:
+        case REQTYPE_MULTIDELETE:
             if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
                 return false;
             }
@@ -2379,6 +2427,12 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
     long responseCode = S3FSCURL_RESPONSECODE_NOTSET;
     int result        = S3FSCURL_PERFORM_RESULT_NOTSET;
 
+    // [NOTE]
+    // Uploading requests wait for a slot of the upload scheduler here.
+    // The slot is held while retrying, but it is released while sleeping
+    // before the retry.
+    AutoUploadSlot upload_slot((REQTYPE_PUT == type || REQTYPE_UPLOADMULTIPOST == type), upload_job);
+
     // 1 attempt + retries...
     for(int retrycnt = 0; S3FSCURL_PERFORM_RESULT_NOTSET == result && retrycnt < S3fsCurl::retries; ++retrycnt){
         // Reset response code
@@ -2439,6 +2493,14 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
                         result = -EIO;
                         break;
 
+                    case 304:
+                        // [NOTE]
+                        // Only the conditional request(If-None-Match) gets this,
+                        // then the caller checks the response code.
+                        S3FS_PRN_INFO3("HTTP response code 304 was returned, not modified");
+                        result = 0;
+                        break;
+
                     case 400:
                         if(op == "HEAD"){
                             if(path.size() > 1024){
@@ -2464,6 +2526,11 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
                         result = -ENOENT;
                         break;
 
+                    case 412:
+                        S3FS_PRN_WARN("HTTP response code 412 was returned, the object(%s) was changed, returning ESTALE", path.c_str());
+                        result = -ESTALE;
+                        break;
+
                     case 416:
                         S3FS_PRN_INFO3("HTTP response code 416 was returned, returning EIO");
                         result = -EIO;
@@ -2481,7 +2548,7 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
                         S3FS_PRN_DBG("Body Text: %s", bodydata.c_str());
                         // Add jitter to avoid thundering herd.
                         unsigned int sleep_time = 2 << retry_count;
-                        sleep(sleep_time + static_cast<unsigned int>(random()) % sleep_time);
+                        upload_slot.Sleep(sleep_time + static_cast<unsigned int>(random()) % sleep_time);
                         break;
                     }
                     default:
@@ -2493,32 +2560,32 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
 
             case CURLE_WRITE_ERROR:
                 S3FS_PRN_ERR("### CURLE_WRITE_ERROR");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break; 
 
             case CURLE_OPERATION_TIMEDOUT:
                 S3FS_PRN_ERR("### CURLE_OPERATION_TIMEDOUT");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break; 
 
             case CURLE_COULDNT_RESOLVE_HOST:
                 S3FS_PRN_ERR("### CURLE_COULDNT_RESOLVE_HOST");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break; 
 
             case CURLE_COULDNT_CONNECT:
                 S3FS_PRN_ERR("### CURLE_COULDNT_CONNECT");
-                sleep(4);
+                upload_slot.Sleep(4);
                 break; 
 
             case CURLE_GOT_NOTHING:
                 S3FS_PRN_ERR("### CURLE_GOT_NOTHING");
-                sleep(4);
+                upload_slot.Sleep(4);
                 break; 
 
             case CURLE_ABORTED_BY_CALLBACK:
                 S3FS_PRN_ERR("### CURLE_ABORTED_BY_CALLBACK");
-                sleep(4);
+                upload_slot.Sleep(4);
                 {
                     AutoLock lock(&S3fsCurl::curl_handles_lock);
                     S3fsCurl::curl_times[hCurl] = time(0);
@@ -2527,22 +2594,22 @@ int S3fsCurl::RequestPerform(bool dontAddAuthHeaders /*=false*/)
 
             case CURLE_PARTIAL_FILE:
                 S3FS_PRN_ERR("### CURLE_PARTIAL_FILE");
-                sleep(4);
+                upload_slot.Sleep(4);
                 break; 
 
             case CURLE_SEND_ERROR:
                 S3FS_PRN_ERR("### CURLE_SEND_ERROR");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break;
 
             case CURLE_RECV_ERROR:
                 S3FS_PRN_ERR("### CURLE_RECV_ERROR");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break;
 
             case CURLE_SSL_CONNECT_ERROR:
                 S3FS_PRN_ERR("### CURLE_SSL_CONNECT_ERROR");
-                sleep(2);
+                upload_slot.Sleep(2);
                 break;
 
             case CURLE_SSL_CACERT:
@@ -2898,6 +2965,183 @@ int S3fsCurl::DeleteRequest(const char* tpath)
     return RequestPerform();
 }
 
+//
+// Delete objects by one DeleteMultipleObjects request.
+// The paths are the paths in the mount point, and the count of them must not
+// be over MAX_MULTIDELETE_KEYS.
+//
+int S3fsCurl::DeleteMultipleObjectsRequest(const std::list<std::string>& paths)
+{
+    S3FS_PRN_INFO3("[objects=%zu]", paths.size());
+
+    if(paths.empty()){
+        return 0;
+    }
+    if(MAX_MULTIDELETE_KEYS < static_cast<int>(paths.size())){
+        S3FS_PRN_ERR("too many objects(%zu) for one request.", paths.size());
+        return -EINVAL;
+    }
+
+    // make contents(quiet mode responds only the objects which are failed to delete)
+    std::string postContent;
+    postContent += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    postContent += "<Delete>\n";
+    postContent += "<Quiet>true</Quiet>\n";
+    for(std::list<std::string>::const_iterator iter = paths.begin(); iter != paths.end(); ++iter){
+        // the key does not have the leading slash
+        std::string key = get_realpath(iter->c_str()).substr(1);
+        postContent += "<Object><Key>" + xml_escape_key(key) + "</Key></Object>\n";
+    }
+    postContent += "</Delete>\n";
+
+    std::string strMD5;
+    if(!make_md5_from_binary(postContent.c_str(), postContent.size(), strMD5)){
+        S3FS_PRN_ERR("could not make md5 for the request body.");
+        return -EIO;
+    }
+
+    // set postdata
+    postdata             = reinterpret_cast<const unsigned char*>(postContent.c_str());
+    b_postdata           = postdata;
+    postdata_remaining   = postContent.size(); // without null
+    b_postdata_remaining = postdata_remaining;
+
+    if(!CreateCurlHandle()){
+        postdata   = NULL;
+        b_postdata = NULL;
+        return -EIO;
+    }
+    std::string resource;
+    std::string turl;
+    MakeUrlResource("/", resource, turl);
+
+    query_string         = "delete";
+    turl                += "?" + query_string;
+    url                  = prepare_url(turl.c_str());
+    path                 = "/";
+    requestHeaders       = NULL;
+    bodydata.clear();
+    responseHeaders.clear();
+    std::string contype  = "application/xml";
+
+    requestHeaders = curl_slist_sort_insert(requestHeaders, "Accept", NULL);
+    requestHeaders = curl_slist_sort_insert(requestHeaders, "Content-Type", contype.c_str());
+    requestHeaders = curl_slist_sort_insert(requestHeaders, "Content-MD5", strMD5.c_str());
+
+    op = "POST";
+    type = REQTYPE_MULTIDELETE;
+
+    // setopt
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_POST, true)){              // POST
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEDATA, (void*)&bodydata)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_POSTFIELDSIZE, static_cast<curl_off_t>(postdata_remaining))){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_READDATA, (void*)this)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_READFUNCTION, S3fsCurl::ReadCallback)){
+        return -EIO;
+    }
+    if(S3fsCurl::is_verbose){
+        if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_DEBUGFUNCTION, S3fsCurl::CurlDebugBodyOutFunc)){     // replace debug function
+            return -EIO;
+        }
+    }
+    if(!S3fsCurl::AddUserAgent(hCurl)){                            // put User-Agent
+        return -EIO;
+    }
+
+    // request
+    int result = RequestPerform();
+    postdata   = NULL;
+    b_postdata = NULL;
+
+    // [NOTE]
+    // In quiet mode, the response body has only Error elements for the objects
+    // which could not be deleted.
+    if(0 == result && std::string::npos != bodydata.find("<Error>")){
+        S3FS_PRN_ERR("some objects could not be deleted: %s", bodydata.c_str());
+        result = -EIO;
+    }
+    bodydata.clear();
+
+    return result;
+}
+
+//
+// Rename the object by one request on the server side.
+//
+// [NOTE]
+// This api is supported only by the buckets which enable hierarchical
+// namespace, and a directory is renamed with all objects under it.
+// The source is specified in the same format as x-oss-copy-source.
+//
+int S3fsCurl::RenameRequest(const char* from, const char* to)
+{
+    S3FS_PRN_INFO3("[from=%s][to=%s]", SAFESTRPTR(from), SAFESTRPTR(to));
+
+    if(!from || !to){
+        return -EINVAL;
+    }
+    if(!CreateCurlHandle()){
+        return -EIO;
+    }
+    std::string resource;
+    std::string turl;
+    MakeUrlResource(get_realpath(to).c_str(), resource, turl);
+
+    query_string    = "x-oss-rename";
+    turl           += "?" + query_string;
+    url             = prepare_url(turl.c_str());
+    path            = get_realpath(to);
+    requestHeaders  = NULL;
+    responseHeaders.clear();
+    bodydata.clear();
+
+    std::string source = urlEncode(service_path + S3fsCred::GetBucket() + get_realpath(from));
+    requestHeaders = curl_slist_sort_insert(requestHeaders, "Content-Type", NULL);
+    requestHeaders = curl_slist_sort_insert(requestHeaders, "x-oss-rename-source", source.c_str());
+
+    op = "POST";
+    type = REQTYPE_RENAME;
+
+    // setopt
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_POST, true)){              // POST
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEDATA, (void*)&bodydata)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_POSTFIELDSIZE, 0)){
+        return -EIO;
+    }
+    if(!S3fsCurl::AddUserAgent(hCurl)){                            // put User-Agent
+        return -EIO;
+    }
+
+    int result = RequestPerform();
+    bodydata.clear();
+
+    return result;
+}
+
 int S3fsCurl::GetIAMv2ApiToken(const char* token_url, int token_ttl, const char* token_ttl_hdr, std::string& response)
 {
     if(!token_url || !token_ttl_hdr){
@@ -3097,6 +3341,22 @@ bool S3fsCurl::GetRAMRoleFromMetaData(const char* cred_url, const char* iam_v2_t
     return (0 == result);
 }
 
+//
+// Add the conditional header(If-Match or If-None-Match) with the etag.
+// The etag which is not quoted(ex. listed etag) is quoted.
+//
+void S3fsCurl::AddEtagRequestHead(const char* key, const std::string& etag)
+{
+    if(!key || etag.empty()){
+        return;
+    }
+    std::string value = etag;
+    if('"' != value[0]){
+        value = "\"" + value + "\"";
+    }
+    requestHeaders = curl_slist_sort_insert(requestHeaders, key, value.c_str());
+}
+
 bool S3fsCurl::AddSseRequestHead(sse_type_t ssetype, const std::string& input, bool is_only_c, bool is_copy)
 {
     std::string ssevalue = input;
@@ -3190,14 +3450,23 @@ bool S3fsCurl::PreHeadRequest(const char* tpath, const char* bpath, const char*
     return true;
 }
 
-int S3fsCurl::HeadRequest(const char* tpath, headers_t& meta)
+//
+// If etag is specified, the request is conditional(If-None-Match), and
+// the response code is 304 if the object is not modified. Then this
+// returns 0, and the caller checks GetLastResponseCode().
+//
+int S3fsCurl::HeadRequest(const char* tpath, headers_t& meta, const std::string& etag)
 {
     int result = -1;
 
-    S3FS_PRN_INFO3("[tpath=%s]", SAFESTRPTR(tpath));
+    S3FS_PRN_INFO3("[tpath=%s][etag=%s]", SAFESTRPTR(tpath), etag.c_str());
 
     // At first, try to get without SSE-C headers
-    if(!PreHeadRequest(tpath) || !fpLazySetup || !fpLazySetup(this) || 0 != (result = RequestPerform())){
+    bool is_pre = PreHeadRequest(tpath);
+    if(is_pre){
+        AddEtagRequestHead("If-None-Match", etag);
+    }
+    if(!is_pre || !fpLazySetup || !fpLazySetup(this) || 0 != (result = RequestPerform())){
         // If has SSE-C keys, try to get with all SSE-C keys.
         for(size_t pos = 0; pos < S3fsCurl::sseckeys.size(); pos++){
             if(!DestroyCurlHandle()){
@@ -3206,6 +3475,7 @@ int S3fsCurl::HeadRequest(const char* tpath, headers_t& meta)
             if(!PreHeadRequest(tpath, NULL, NULL, pos)){
                 break;
             }
+            AddEtagRequestHead("If-None-Match", etag);
             if(!fpLazySetup || !fpLazySetup(this)){
                 S3FS_PRN_ERR("Failed to lazy setup in single head request.");
                 break;
@@ -3488,7 +3758,11 @@ int S3fsCurl::PutRequest(const char* tpath, headers_t& meta, int fd)
     return result;
 }
 
-int S3fsCurl::PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue)
+//
+// If etag is specified, the request is conditional(If-Match), and it
+// fails with -ESTALE if the object was changed.
+//
+int S3fsCurl::PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue, const std::string& etag)
 {
     S3FS_PRN_INFO3("[tpath=%s][start=%lld][size=%lld]", SAFESTRPTR(tpath), static_cast<long long>(start), static_cast<long long>(size));
 
@@ -3512,6 +3786,8 @@ int S3fsCurl::PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t
         range       += str(start + size - 1);
         requestHeaders = curl_slist_sort_insert(requestHeaders, "Range", range.c_str());
     }
+    AddEtagRequestHead("If-Match", etag);
+
     // SSE
     if(!AddSseRequestHead(ssetype, ssevalue, true, false)){
         S3FS_PRN_WARN("Failed to set SSE header, but continue...");
@@ -3540,11 +3816,12 @@ int S3fsCurl::PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t
     b_ssetype           = ssetype;
     b_ssevalue          = ssevalue;
     b_ssekey_pos        = -1;         // not use this value for get object.
+    b_etag              = etag;
 
     return 0;
 }
 
-int S3fsCurl::GetObjectRequest(const char* tpath, int fd, off_t start, off_t size)
+int S3fsCurl::GetObjectRequest(const char* tpath, int fd, off_t start, off_t size, const std::string& etag)
 {
     int result;
 
@@ -3559,7 +3836,7 @@ int S3fsCurl::GetObjectRequest(const char* tpath, int fd, off_t start, off_t siz
         S3FS_PRN_WARN("Failed to get SSE type for file(%s).", SAFESTRPTR(tpath));
     }
 
-    if(0 != (result = PreGetObjectRequest(tpath, fd, start, size, ssetype, ssevalue))){
+    if(0 != (result = PreGetObjectRequest(tpath, fd, start, size, ssetype, ssevalue, etag))){
         return result;
     }
     if(!fpLazySetup || !fpLazySetup(this)){
@@ -3575,7 +3852,7 @@ int S3fsCurl::GetObjectRequest(const char* tpath, int fd, off_t start, off_t siz
     return result;
 }
 
-int S3fsCurl::PreGetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue) 
+int S3fsCurl::PreGetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue, const std::string& etag) 
 {
     S3FS_PRN_INFO3("[tpath=%s][start=%lld][size=%lld]", SAFESTRPTR(tpath), static_cast<long long>(start), static_cast<long long>(size));
 
@@ -3599,6 +3876,7 @@ int S3fsCurl::PreGetObjectStreamRequest(const char* tpath, char* buf, off_t star
         requestHeaders = curl_slist_sort_insert(requestHeaders, "Range", range.c_str());
         requestHeaders = curl_slist_sort_insert(requestHeaders, "x-oss-range-behavior", "standard");
     }
+    AddEtagRequestHead("If-Match", etag);
 
     // SSE
     if(!AddSseRequestHead(ssetype, ssevalue, true, false)){
@@ -3630,11 +3908,12 @@ int S3fsCurl::PreGetObjectStreamRequest(const char* tpath, char* buf, off_t star
     b_ssetype               = ssetype;
     b_ssevalue              = ssevalue;
     b_ssekey_pos            = -1; 
+    b_etag                  = etag;
 
     return 0;
 }
 
-int S3fsCurl::GetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, ssize_t& rsize) 
+int S3fsCurl::GetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, ssize_t& rsize, const std::string& etag) 
 {
     int result;
     S3FS_PRN_INFO3("[tpath=%s][start=%lld][size=%lld]", SAFESTRPTR(tpath), static_cast<long long>(start), static_cast<long long>(size));
@@ -3648,7 +3927,7 @@ int S3fsCurl::GetObjectStreamRequest(const char* tpath, char* buf, off_t start,
         S3FS_PRN_WARN("Failed to get SSE type for file(%s).", SAFESTRPTR(tpath));
     }
 
-    if(0 != (result = PreGetObjectStreamRequest(tpath, buf, start, size, ssetype, ssevalue))){
+    if(0 != (result = PreGetObjectStreamRequest(tpath, buf, start, size, ssetype, ssevalue, etag))){
         return result;
     }
     if(!fpLazySetup ||!fpLazySetup(this)){
@@ -3663,6 +3942,24 @@ int S3fsCurl::GetObjectStreamRequest(const char* tpath, char* buf, off_t start,
     return result;
 }
 
+//
+// Gets the range into the buffers, bufs[n] receives segsize bytes from
+// start + n * segsize(the last one may be shorter).
+//
+int S3fsCurl::GetObjectStreamRequest(const char* tpath, const std::vector<char*>& bufs, off_t segsize, off_t start, off_t size, ssize_t& rsize, const std::string& etag)
+{
+    if(bufs.empty() || 0 >= segsize || static_cast<off_t>(bufs.size()) * segsize < size){
+        return -EINVAL;
+    }
+    streambuffers = bufs;
+    streamsegsize = segsize;
+    int result = GetObjectStreamRequest(tpath, bufs[0], start, size, rsize, etag);
+    streambuffers.clear();
+    streamsegsize = 0;
+
+    return result;
+}
+
 int S3fsCurl::CheckBucket(const char* check_path)
 {
     S3FS_PRN_INFO3("check a bucket.");
@@ -3716,6 +4013,48 @@ int S3fsCurl::CheckBucket(const char* check_path)
     return result;
 }
 
+//
+// Get the bucket information(GetBucketInfo), the response is left in bodydata.
+//
+int S3fsCurl::GetBucketInfoRequest()
+{
+    S3FS_PRN_INFO3("get bucket info");
+
+    if(!CreateCurlHandle()){
+        return -EIO;
+    }
+    std::string resource;
+    std::string turl;
+    MakeUrlResource("/", resource, turl);
+
+    query_string    = "bucketInfo";
+    turl           += "?" + query_string;
+    url             = prepare_url(turl.c_str());
+    path            = "/";
+    requestHeaders  = NULL;
+    responseHeaders.clear();
+    bodydata.clear();
+
+    op = "GET";
+    type = REQTYPE_BUCKETINFO;
+
+    // setopt
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str())){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEDATA, (void*)&bodydata)){
+        return -EIO;
+    }
+    if(CURLE_OK != curl_easy_setopt(hCurl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback)){
+        return -EIO;
+    }
+    if(!S3fsCurl::AddUserAgent(hCurl)){                            // put User-Agent
+        return -EIO;
+    }
+
+    return RequestPerform();
+}
+
 int S3fsCurl::ListBucketRequest(const char* tpath, const char* query)
 {
     S3FS_PRN_INFO3("[tpath=%s]", SAFESTRPTR(tpath));
@@ -4459,6 +4798,138 @@ int S3fsCurl::MultipartRenameRequest(const char* from, const char* to, headers_t
     return 0;
 }
 
+//
+// Rename(copy) many large objects by multipart copy.
+//
+// [NOTE]
+// The part copies of all objects in a batch are put into one S3fsMultiCurl,
+// so that the parallel requests are kept running across the objects instead
+// of waiting for the completion of each object. The batch has objects up to
+// MAX_MPRENAME_PARTS_IN_BATCH parts(at least one object).
+// The upload_id and list of each entry are set in this method, and the source
+// objects are not removed.
+//
+int S3fsCurl::ParallelMultipartRenameRequest(mprename_list_t& entries)
+{
+    S3FS_PRN_INFO3("[objects=%zu]", entries.size());
+
+    for(mprename_list_t::iterator biter = entries.begin(); biter != entries.end(); ){
+        mprename_list_t::iterator eiter = biter;
+        off_t                     parts = 0;
+        do{
+            parts += (eiter->size + GetMultipartCopySize() - 1) / GetMultipartCopySize();
+            ++eiter;
+        }while(eiter != entries.end() && parts < MAX_MPRENAME_PARTS_IN_BATCH);
+
+        int result;
+        if(0 != (result = S3fsCurl::MultipartRenameBatchRequest(biter, eiter))){
+            return result;
+        }
+        biter = eiter;
+    }
+    return 0;
+}
+
+int S3fsCurl::MultipartRenameBatchRequest(mprename_list_t::iterator begin, mprename_list_t::iterator end)
+{
+    int                       result;
+    mprename_list_t::iterator iter;
+
+    // initiate multipart uploads for all objects
+    for(iter = begin; iter != end; ++iter){
+        S3FS_PRN_INFO3("[from=%s][to=%s]", iter->from.c_str(), iter->to.c_str());
+
+        std::string srcresource;
+        std::string srcurl;
+        MakeUrlResource(get_realpath(iter->from.c_str()).c_str(), srcresource, srcurl);
+
+        iter->meta["Content-Type"]      = S3fsCurl::LookupMimeType(iter->to);
+        iter->meta["x-oss-copy-source"] = srcresource;
+
+        S3fsCurl s3fscurl(true);
+        if(0 != (result = s3fscurl.PreMultipartPostRequest(iter->to.c_str(), iter->meta, iter->upload_id, true))){
+            S3FS_PRN_ERR("failed to initiate multipart copy for %s(errno=%d).", iter->to.c_str(), result);
+            S3fsCurl::AbortMultipartRenameRequests(begin, iter);
+            return result;
+        }
+        s3fscurl.DestroyCurlHandle();
+    }
+
+    // Initialize S3fsMultiCurl
+    S3fsMultiCurl curlmulti(GetMaxParallelCount());
+    curlmulti.SetSuccessCallback(S3fsCurl::CopyMultipartPostCallback);
+    curlmulti.SetRetryCallback(S3fsCurl::CopyMultipartPostRetryCallback);
+
+    for(iter = begin; iter != end; ++iter){
+        off_t chunk;
+        off_t bytes_remaining;
+        for(bytes_remaining = iter->size, chunk = 0; 0 < bytes_remaining; bytes_remaining -= chunk){
+            chunk = bytes_remaining > GetMultipartCopySize() ? GetMultipartCopySize() : bytes_remaining;
+
+            std::ostringstream strrange;
+            strrange << "bytes=" << (iter->size - bytes_remaining) << "-" << (iter->size - bytes_remaining + chunk - 1);
+            iter->meta["x-oss-copy-source-range"] = strrange.str();
+
+            // s3fscurl sub object
+            S3fsCurl* s3fscurl_para = new S3fsCurl(true);
+            s3fscurl_para->b_from   = iter->from;
+            s3fscurl_para->b_meta   = iter->meta;
+            s3fscurl_para->partdata.add_etag_list(iter->list);
+
+            // initiate upload part for parallel
+            if(0 != (result = s3fscurl_para->CopyMultipartPostSetup(iter->from.c_str(), iter->to.c_str(), s3fscurl_para->partdata.get_part_number(), iter->upload_id, iter->meta))){
+                S3FS_PRN_ERR("failed uploading part setup(%d)", result);
+                delete s3fscurl_para;
+                S3fsCurl::AbortMultipartRenameRequests(begin, end);
+                return result;
+            }
+
+            // set into parallel object
+            if(!curlmulti.SetS3fsCurlObject(s3fscurl_para)){
+                S3FS_PRN_ERR("Could not make curl object into multi curl(%s).", iter->to.c_str());
+                delete s3fscurl_para;
+                S3fsCurl::AbortMultipartRenameRequests(begin, end);
+                return -EIO;
+            }
+        }
+        iter->meta.erase("x-oss-copy-source-range");
+    }
+
+    // Multi request
+    if(0 != (result = curlmulti.Request())){
+        S3FS_PRN_ERR("error occurred in multi request(errno=%d).", result);
+        S3fsCurl::AbortMultipartRenameRequests(begin, end);
+        return result;
+    }
+
+    // complete all objects
+    for(iter = begin; iter != end; ++iter){
+        S3fsCurl s3fscurl(true);
+        if(0 != (result = s3fscurl.CompleteMultipartPostRequest(iter->to.c_str(), iter->upload_id, iter->list))){
+            S3FS_PRN_ERR("failed to complete multipart copy for %s(errno=%d).", iter->to.c_str(), result);
+            S3fsCurl::AbortMultipartRenameRequests(iter, end);
+            return result;
+        }
+        iter->is_copied = true;
+    }
+    return 0;
+}
+
+void S3fsCurl::AbortMultipartRenameRequests(mprename_list_t::iterator begin, mprename_list_t::iterator end)
+{
+    for(mprename_list_t::iterator iter = begin; iter != end; ++iter){
+        if(iter->upload_id.empty()){
+            continue;
+        }
+        S3fsCurl s3fscurl_abort(true);
+        int      result = s3fscurl_abort.AbortMultipartUpload(iter->to.c_str(), iter->upload_id);
+        s3fscurl_abort.DestroyCurlHandle();
+        if(result != 0){
+            S3FS_PRN_ERR("error aborting multipart upload for %s(errno=%d).", iter->to.c_str(), result);
+        }
+    }
+}
+
 std::string S3fsCurl::CalcSignatureOSSV1(const std::string& method, const std::string& strMD5, const std::string& content_type, const std::string& date, const std::string& resource, const std::string& secret_access_key, const std::string& access_token)
 {
     std::string Signature;
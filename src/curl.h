@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "common.h"
+#include "autolock.h"
 #include "curl_handlerpool.h"
 #include "psemaphore.h"
 #include "metaheader.h"
@@ -86,6 +87,26 @@ typedef bool (*s3fscurl_lazy_setup)(S3fsCurl* s3fscurl);
 typedef std::map<std::string, std::string> sseckeymap_t;
 typedef std::list<sseckeymap_t>            sseckeylist_t;
 
+// Object renamed by multipart copy in ParallelMultipartRenameRequest
+//
+// [NOTE]
+// The etag list is referred by the part requests, so this structure
+// is stored in std::list which does not move the elements.
+//
+struct mprename_entry
+{
+    std::string from;
+    std::string to;
+    headers_t   meta;
+    off_t       size;
+    std::string upload_id;
+    etaglist_t  list;
+    bool        is_copied;      // the "to" object is made(it is removed if the rename fails)
+
+    mprename_entry(const std::string& from_path, const std::string& to_path, const headers_t& from_meta, off_t from_size) : from(from_path), to(to_path), meta(from_meta), size(from_size), is_copied(false) {}
+};
+typedef std::list<mprename_entry>          mprename_list_t;
+
 // Class for lapping curl
 //
 class S3fsCurl
@@ -110,13 +131,16 @@ class S3fsCurl
             REQTYPE_IAMCRED,
             REQTYPE_ABORTMULTIUPLOAD,
             REQTYPE_IAMROLE,
-            REQTYPE_GET_STREAM
+            REQTYPE_GET_STREAM,
+            REQTYPE_MULTIDELETE,
+            REQTYPE_BUCKETINFO,
+            REQTYPE_RENAME
         };
 
         // class variables
-        static pthread_mutex_t  curl_warnings_lock;
+        static named_mutex      curl_warnings_lock;
         static bool             curl_warnings_once;  // emit older curl warnings only once
-        static pthread_mutex_t  curl_handles_lock;
+        static named_mutex      curl_handles_lock;
         static struct callback_locks_t {
             pthread_mutex_t dns;
             pthread_mutex_t ssl_session;
@@ -184,8 +208,11 @@ class S3fsCurl
         off_t                b_partdata_size;      // backup for retrying
         char*                b_partdata_streambuff;// backup for retrying
         off_t                b_partdata_streampos; // backup for retrying
+        std::vector<char*>   streambuffers;        // the stream is split into these buffers of streamsegsize bytes
+        off_t                streamsegsize;        // use only with streambuffers
         size_t               b_ssekey_pos;         // backup for retrying
         std::string          b_ssevalue;           // backup for retrying
+        std::string          b_etag;               // backup for retrying(If-Match of get object request)
         sse_type_t           b_ssetype;            // backup for retrying
         std::string          b_from;               // backup for retrying(for copy request)
         headers_t            b_meta;               // backup for retrying(for copy request)
@@ -196,6 +223,7 @@ class S3fsCurl
         std::vector<pthread_t> *completed_tids;
         s3fscurl_lazy_setup  fpLazySetup;          // curl options for lazy setting function
         CURLcode             curlCode;             // handle curl return
+        uint64_t             upload_job;           // job id in upload scheduler(for multipart upload parts)
     
     public:
         static const long S3FSCURL_RESPONSECODE_NOTSET      = -1;
@@ -246,6 +274,8 @@ class S3fsCurl
         static bool LoadEnvSseKmsid();
         static bool PushbackSseKeys(const std::string& onekey);
         static bool AddUserAgent(CURL* hCurl);
+        static int MultipartRenameBatchRequest(mprename_list_t::iterator begin, mprename_list_t::iterator end);
+        static void AbortMultipartRenameRequests(mprename_list_t::iterator begin, mprename_list_t::iterator end);
 
         static int CurlDebugFunc(const CURL* hcurl, curl_infotype type, char* data, size_t size, void* userptr);
         static int CurlDebugBodyInFunc(const CURL* hcurl, curl_infotype type, char* data, size_t size, void* userptr);
@@ -282,7 +312,8 @@ class S3fsCurl
         static bool DestroyS3fsCurl();
         static int ParallelMultipartUploadRequest(const char* tpath, headers_t& meta, int fd);
         static int ParallelMixMultipartUploadRequest(const char* tpath, headers_t& meta, int fd, const fdpage_list_t& mixuppages);
-        static int ParallelGetObjectRequest(const char* tpath, int fd, off_t start, off_t size);
+        static int ParallelGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, const std::string& etag = "");
+        static int ParallelMultipartRenameRequest(mprename_list_t& entries);
 
         // class methods(variables)
         static std::string LookupMimeType(const std::string& name);
@@ -355,20 +386,24 @@ class S3fsCurl
         bool GetRAMCredentials(const char* cred_url, const char* iam_v2_token, const char* ibm_secret_access_key, std::string& response);
         bool GetRAMRoleFromMetaData(const char* cred_url, const char* iam_v2_token, std::string& token);
         bool AddSseRequestHead(sse_type_t ssetype, const std::string& ssevalue, bool is_only_c, bool is_copy);
+        void AddEtagRequestHead(const char* key, const std::string& etag);
         bool GetResponseCode(long& responseCode, bool from_curl_handle = true);
         int RequestPerform(bool dontAddAuthHeaders=false);
         int DeleteRequest(const char* tpath);
+        int DeleteMultipleObjectsRequest(const std::list<std::string>& paths);
+        int RenameRequest(const char* from, const char* to);
         int GetIAMv2ApiToken(const char* token_url, int token_ttl, const char* token_ttl_hdr, std::string& response);
         bool PreHeadRequest(const char* tpath, const char* bpath = NULL, const char* savedpath = NULL, size_t ssekey_pos = -1);
         bool PreHeadRequest(const std::string& tpath, const std::string& bpath, const std::string& savedpath, size_t ssekey_pos = -1) {
           return PreHeadRequest(tpath.c_str(), bpath.c_str(), savedpath.c_str(), ssekey_pos);
         }
-        int HeadRequest(const char* tpath, headers_t& meta);
+        int HeadRequest(const char* tpath, headers_t& meta, const std::string& etag = "");
         int PutHeadRequest(const char* tpath, headers_t& meta, bool is_copy);
         int PutRequest(const char* tpath, headers_t& meta, int fd);
-        int PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue);
-        int GetObjectRequest(const char* tpath, int fd, off_t start = -1, off_t size = -1);
+        int PreGetObjectRequest(const char* tpath, int fd, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue, const std::string& etag = "");
+        int GetObjectRequest(const char* tpath, int fd, off_t start = -1, off_t size = -1, const std::string& etag = "");
         int CheckBucket(const char* check_path);
+        int GetBucketInfoRequest();
         int ListBucketRequest(const char* tpath, const char* query);
         int PreMultipartPostRequest(const char* tpath, headers_t& meta, std::string& upload_id, bool is_copy);
         int CompleteMultipartPostRequest(const char* tpath, const std::string& upload_id, etaglist_t& parts);
@@ -378,14 +413,18 @@ class S3fsCurl
         int MultipartHeadRequest(const char* tpath, off_t size, headers_t& meta, bool is_copy);
         int MultipartUploadRequest(const std::string& upload_id, const char* tpath, int fd, off_t offset, off_t size, etagpair* petagpair);
         int MultipartRenameRequest(const char* from, const char* to, headers_t& meta, off_t size);
-        int PreGetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue);
-        int GetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, ssize_t& rsize);
+        int PreGetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, sse_type_t ssetype, const std::string& ssevalue, const std::string& etag = "");
+        int GetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, ssize_t& rsize, const std::string& etag = "");
+        int GetObjectStreamRequest(const char* tpath, const std::vector<char*>& bufs, off_t segsize, off_t start, off_t size, ssize_t& rsize, const std::string& etag = "");
         
         // methods(variables)
         CURL* GetCurlHandle() const { return hCurl; }
         std::string GetPath() const { return path; }
         std::string GetBasePath() const { return base_path; }
         std::string GetSpecialSavedPath() const { return saved_path; }
+        void SetSpecialSavedPath(const std::string& spath) { saved_path = spath; }
+        const char* GetStreamBuffer() const { return partdata.streambuffer; }
+        off_t GetStreamPos() const { return partdata.streampos; }
         std::string GetUrl() const { return url; }
         std::string GetOp() const { return op; }
         headers_t* GetResponseHeaders() { return &responseHeaders; }
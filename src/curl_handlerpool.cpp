@@ -36,10 +36,11 @@ bool CurlHandlerPool::Init()
 #if S3FS_PTHREAD_ERRORCHECK
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
-    if (0 != pthread_mutex_init(&mLock, &attr)) {
+    if (0 != pthread_mutex_init(&mLock.mutex, &attr)) {
         S3FS_PRN_ERR("Init curl handlers lock failed");
         return false;
     }
+    LockProfiler::SetName(&mLock, "CurlHandlerPool::mLock");
 
     for(int cnt = 0; cnt < mMaxHandlers; ++cnt){
         CURL* hCurl = curl_easy_init();
@@ -62,7 +63,7 @@ bool CurlHandlerPool::Destroy()
             curl_easy_cleanup(hCurl);
         }
     }
-    if (0 != pthread_mutex_destroy(&mLock)) {
+    if (0 != pthread_mutex_destroy(&mLock.mutex)) {
         S3FS_PRN_ERR("Destroy curl handlers lock failed");
         return false;
     }
@@ -24,6 +24,8 @@
 #include <cassert>
 #include <curl/curl.h>
 
+#include "autolock.h"
+
 //----------------------------------------------
 // Typedefs
 //----------------------------------------------
@@ -48,7 +50,7 @@ class CurlHandlerPool
 
     private:
         int             mMaxHandlers;
-        pthread_mutex_t mLock;
+        named_mutex     mLock;
         hcurllist_t     mPool;
 };
 
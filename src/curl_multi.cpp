@@ -210,6 +210,10 @@ int S3fsMultiCurl::MultiRead()
                 if(s3fscurl->GetOp() != "HEAD"){
                     S3FS_PRN_WARN("failed a request(%ld: %s)", responseCode, s3fscurl->url.c_str());
                 }
+            }else if(412 == responseCode){
+                // the object was changed(If-Match), then retrying never succeeds.
+                S3FS_PRN_WARN("failed a request(%ld: %s), the object was changed.", responseCode, s3fscurl->url.c_str());
+                result = -ESTALE;
             }else if(500 == responseCode){
                 // case of all other result, do retry.(11/13/2013)
                 // because it was found that ossfs got 500 error from OSS, but could success
@@ -0,0 +1,110 @@
+/*
+ * ossfs -  FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "direct_reader.h"
+
+//-------------------------------------------------------------------
+// Class Chunk
+//-------------------------------------------------------------------
+std::atomic<uint64_t> Chunk::cache_usage = ATOMIC_VAR_INIT(0);
+
+// [NOTE]
+// The buffer of the partial chunk is allocated for the whole chunk but
+// is not touched until its blocks are loaded, so that only the pages of
+// the loaded blocks become resident, and only the loaded blocks are
+// counted in cache_usage. The buffer is kept contiguous because readers
+// copy ranges across blocks and the spill writes it at once.
+//
+Chunk::Chunk(off_t off, off_t size, bool is_partial) : offset(off), size(size), usage(0), reader(NULL), id(0), in_lru(false)
+{
+    if (is_partial) {
+        blocks.assign((size + BLOCK_SIZE - 1) / BLOCK_SIZE, false);
+    } else {
+        usage = size;
+    }
+    buf = static_cast<char*>(malloc(size));
+    cache_usage += usage;
+}
+
+Chunk::~Chunk()
+{
+    if (in_lru) {
+        ChunkLru::Remove(this);
+    }
+    if (buf) {
+        free(buf);
+        buf = NULL;
+        cache_usage -= usage;
+    }
+}
+
+bool Chunk::cache_usage_check() 
+{
+    return cache_usage < DirectReader::GetPrefetchCacheLimits();
+}
+
+//
+// start and len are relative to the chunk.
+//
+bool Chunk::IsLoaded(off_t start, off_t len) const
+{
+    if (IsComplete() || len <= 0) {
+        return true;
+    }
+    for (off_t block = start / BLOCK_SIZE; block * BLOCK_SIZE < start + len; ++block) {
+        if (!blocks[block]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Chunk::SetLoaded(off_t start, off_t len)
+{
+    if (IsComplete()) {
+        return;
+    }
+    for (off_t block = start / BLOCK_SIZE; block * BLOCK_SIZE < start + len; ++block) {
+        if (!blocks[block]) {
+            off_t bytes = std::min(BLOCK_SIZE, size - block * BLOCK_SIZE);
+            blocks[block] = true;
+            usage       += bytes;
+            cache_usage += bytes;
+        }
+    }
+    for (std::vector<bool>::const_iterator iter = blocks.begin(); iter != blocks.end(); ++iter) {
+        if (!*iter) {
+            return;
+        }
+    }
+    blocks.clear();
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,502 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "common.h"
+#include "s3fs.h"
+#include "direct_read_spill.h"
+#include "direct_reader.h"
+#include "s3fs_util.h"
+#include "string_util.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char   SPILL_TMPFILE_FORM[] = ".tmp.XXXXXX";
+static const size_t SPILL_NAME_LENGTH    = 16;
+
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+static bool is_spill_name(const char* name)
+{
+    if(SPILL_NAME_LENGTH != strlen(name)){
+        return false;
+    }
+    for(const char* ptr = name; '\0' != *ptr; ++ptr){
+        if(!(('0' <= *ptr && *ptr <= '9') || ('a' <= *ptr && *ptr <= 'f'))){
+            return false;
+        }
+    }
+    return true;
+}
+
+struct spill_file_info
+{
+    std::string name;
+    time_t      mtime;
+    off_t       size;
+
+    spill_file_info(const char* pname, time_t file_mtime, off_t file_size) : name(pname), mtime(file_mtime), size(file_size) {}
+};
+
+static bool compare_spill_mtime(const spill_file_info& src1, const spill_file_info& src2)
+{
+    return src1.mtime < src2.mtime;
+}
+
+static bool read_all(int fd, char* buf, size_t size, off_t offset)
+{
+    for(size_t total = 0; total < size; ){
+        ssize_t bytes = pread(fd, buf + total, size - total, offset + total);
+        if(-1 == bytes && EINTR == errno){
+            continue;
+        }
+        if(bytes <= 0){
+            return false;
+        }
+        total += bytes;
+    }
+    return true;
+}
+
+//------------------------------------------------
+// ChunkSpill class variables
+//------------------------------------------------
+ChunkSpill* ChunkSpill::singleton   = NULL;
+std::string ChunkSpill::spill_dir;
+off_t       ChunkSpill::spill_limit = ChunkSpill::DEFAULT_SPILL_LIMIT;
+const off_t ChunkSpill::DEFAULT_SPILL_LIMIT;
+const off_t ChunkSpill::MAX_PENDING_SIZE;
+const size_t ChunkSpill::LOAD_BATCH_COUNT;
+
+//------------------------------------------------
+// ChunkSpill class methods
+//------------------------------------------------
+bool ChunkSpill::SetSpillDir(const char* dir)
+{
+    if(!dir || '\0' == dir[0]){
+        return false;
+    }
+    ChunkSpill::spill_dir = dir;
+    if(1 < ChunkSpill::spill_dir.size() && '/' == *ChunkSpill::spill_dir.rbegin()){
+        ChunkSpill::spill_dir.erase(ChunkSpill::spill_dir.size() - 1);
+    }
+    return true;
+}
+
+bool ChunkSpill::SetSpillLimit(off_t limit)
+{
+    if(limit <= 0){
+        return false;
+    }
+    ChunkSpill::spill_limit = limit;
+    return true;
+}
+
+bool ChunkSpill::Initialize()
+{
+    if(ChunkSpill::spill_dir.empty()){
+        return false;
+    }
+    if(0 != mkdirp(ChunkSpill::spill_dir, 0700) && EEXIST != errno){
+        S3FS_PRN_ERR("could not create the directory(%s) for direct_read_spill_dir by errno(%d).", ChunkSpill::spill_dir.c_str(), errno);
+        return false;
+    }
+    if(!check_exist_dir_permission(ChunkSpill::spill_dir.c_str())){
+        S3FS_PRN_ERR("could not access the directory(%s) for direct_read_spill_dir.", ChunkSpill::spill_dir.c_str());
+        return false;
+    }
+    if(ChunkSpill::singleton){
+        S3FS_PRN_WARN("Already singleton for spilling chunks is existed, then re-create it.");
+        ChunkSpill::Destroy();
+    }
+    ChunkSpill::singleton = new ChunkSpill();
+
+    int result;
+    if(0 != (result = pthread_create(&ChunkSpill::singleton->thread, NULL, ChunkSpill::Worker, static_cast<void*>(ChunkSpill::singleton)))){
+        S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+        delete ChunkSpill::singleton;
+        ChunkSpill::singleton = NULL;
+        return false;
+    }
+    return true;
+}
+
+void ChunkSpill::Destroy()
+{
+    if(ChunkSpill::singleton){
+        {
+            AutoLock auto_lock(&(ChunkSpill::singleton->spill_lock));
+            ChunkSpill::singleton->is_exit = true;
+        }
+        ChunkSpill::singleton->spill_sem.post();
+
+        void* retval = NULL;
+        int   result;
+        if(0 != (result = pthread_join(ChunkSpill::singleton->thread, &retval))){
+            S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+        }
+        delete ChunkSpill::singleton;
+        ChunkSpill::singleton = NULL;
+    }
+}
+
+std::string ChunkSpill::MakeKey(const std::string& path, const std::string& etag, uint32_t id)
+{
+    return path + "\n" + etag + "\n" + str(DirectReader::GetChunkSize()) + "\n" + str(id);
+}
+
+// [NOTE]
+// FNV-1a 64bit of the key in hex.
+//
+std::string ChunkSpill::MakeName(const std::string& key)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for(std::string::const_iterator iter = key.begin(); iter != key.end(); ++iter){
+        hash ^= static_cast<unsigned char>(*iter);
+        hash *= 1099511628211ULL;
+    }
+    char name[SPILL_NAME_LENGTH + 1];
+    snprintf(name, sizeof(name), "%016llx", hash);
+    return std::string(name);
+}
+
+//
+// Takes the chunk which is removed from the reader. The chunk is freed
+// here if it is not spilled.
+//
+void ChunkSpill::Push(const std::string& path, const std::string& etag, uint32_t id, Chunk* chunk)
+{
+    if(!chunk){
+        return;
+    }
+    if(!ChunkSpill::singleton || etag.empty() || !chunk->IsComplete()){
+        delete chunk;
+        return;
+    }
+    std::string key  = ChunkSpill::MakeKey(path, etag, id);
+    std::string name = ChunkSpill::MakeName(key);
+    {
+        AutoLock auto_lock(&(ChunkSpill::singleton->spill_lock));
+
+        if(!ChunkSpill::singleton->is_exit && ChunkSpill::singleton->file_map.end() == ChunkSpill::singleton->file_map.find(name) && ChunkSpill::singleton->pending_size + chunk->size <= ChunkSpill::MAX_PENDING_SIZE){
+            ChunkSpill::singleton->job_list.push_back(chunk_spill_job(key, name, chunk));
+            ChunkSpill::singleton->pending_size += chunk->size;
+            chunk = NULL;
+        }
+    }
+    if(chunk){
+        // already spilled or too many chunks are waiting
+        delete chunk;
+        return;
+    }
+    ChunkSpill::singleton->spill_sem.post();
+}
+
+bool ChunkSpill::IsCached(const std::string& path, const std::string& etag, uint32_t id)
+{
+    if(!ChunkSpill::singleton || etag.empty()){
+        return false;
+    }
+    std::string name = ChunkSpill::MakeName(ChunkSpill::MakeKey(path, etag, id));
+
+    AutoLock auto_lock(&(ChunkSpill::singleton->spill_lock));
+    return (ChunkSpill::singleton->file_map.end() != ChunkSpill::singleton->file_map.find(name));
+}
+
+bool ChunkSpill::Read(const std::string& path, const std::string& etag, uint32_t id, char* buf, off_t size)
+{
+    if(!ChunkSpill::singleton || etag.empty() || !buf || size <= 0){
+        return false;
+    }
+    std::string key  = ChunkSpill::MakeKey(path, etag, id);
+    std::string name = ChunkSpill::MakeName(key);
+    {
+        AutoLock auto_lock(&(ChunkSpill::singleton->spill_lock));
+
+        chunk_spill_map_t::iterator iter = ChunkSpill::singleton->file_map.find(name);
+        if(ChunkSpill::singleton->file_map.end() == iter){
+            return false;
+        }
+        // most recently used
+        ChunkSpill::singleton->lru_list.splice(ChunkSpill::singleton->lru_list.end(), ChunkSpill::singleton->lru_list, iter->second.pos);
+    }
+
+    std::string file_path = ChunkSpill::spill_dir + "/" + name;
+    int         fd;
+    if(-1 == (fd = open(file_path.c_str(), O_RDONLY))){
+        return false;
+    }
+    uint32_t    keylen = 0;
+    struct stat st;
+    bool        result = false;
+    if(read_all(fd, reinterpret_cast<char*>(&keylen), sizeof(keylen), 0) && keylen == key.size() && 0 == fstat(fd, &st) && st.st_size == static_cast<off_t>(sizeof(keylen) + keylen) + size){
+        std::string filekey(keylen, '\0');
+        if(read_all(fd, &filekey[0], keylen, sizeof(keylen)) && filekey == key){
+            result = read_all(fd, buf, size, sizeof(keylen) + keylen);
+        }
+    }
+    close(fd);
+
+    S3FS_PRN_DBG("read spilled chunk[path=%s][chunkid=%u][result=%s]", path.c_str(), id, result ? "true" : "false");
+    return result;
+}
+
+//
+// Thread worker
+//
+void* ChunkSpill::Worker(void* arg)
+{
+    ChunkSpill* pspill = static_cast<ChunkSpill*>(arg);
+    if(!pspill){
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in ChunkSpill.");
+
+    // [NOTE]
+    // The files spilled before are loaded here, so that the mount does not
+    // wait for it. The chunks released while loading wait for it.
+    //
+    if(!pspill->LoadFiles()){
+        S3FS_PRN_WARN("could not load the spilled chunk files in %s, but continue...", ChunkSpill::spill_dir.c_str());
+    }
+
+    while(true){
+        pspill->spill_sem.wait();
+
+        chunk_spill_jobs_t jobs;
+        bool               is_exit;
+        {
+            AutoLock auto_lock(&(pspill->spill_lock));
+            jobs.swap(pspill->job_list);
+            is_exit = pspill->is_exit;
+        }
+        for(chunk_spill_jobs_t::iterator iter = jobs.begin(); iter != jobs.end(); ++iter){
+            if(!is_exit){
+                pspill->WriteFile(*iter);
+            }
+            {
+                AutoLock auto_lock(&(pspill->spill_lock));
+                pspill->pending_size -= iter->chunk->size;
+            }
+            delete iter->chunk;
+        }
+        if(is_exit){
+            break;
+        }
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// ChunkSpill methods
+//------------------------------------------------
+ChunkSpill::ChunkSpill() : is_exit(false), spill_sem(0), thread(0), pending_size(0), total_size(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&spill_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init spill_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&spill_lock, "ChunkSpill::spill_lock");
+}
+
+ChunkSpill::~ChunkSpill()
+{
+    for(chunk_spill_jobs_t::iterator iter = job_list.begin(); iter != job_list.end(); ++iter){
+        delete iter->chunk;
+    }
+    job_list.clear();
+
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&spill_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy spill_lock: %d", result);
+        abort();
+    }
+}
+
+//
+// Load the files which were spilled before, in the order of the last
+// access time. The temporary files which were left are removed.
+// The files are added to the head of the lru list(older than the files
+// spilled after the mount) by some files at once, so that the lookups
+// are not blocked while loading.
+//
+bool ChunkSpill::LoadFiles()
+{
+    DIR* dp;
+    if(NULL == (dp = opendir(ChunkSpill::spill_dir.c_str()))){
+        return false;
+    }
+    std::vector<spill_file_info> files;
+    struct dirent*               dent;
+    while(NULL != (dent = readdir(dp))){
+        if(IsExit()){
+            closedir(dp);
+            return true;
+        }
+        std::string file_path = ChunkSpill::spill_dir + "/" + dent->d_name;
+        struct stat st;
+        if(0 != lstat(file_path.c_str(), &st) || !S_ISREG(st.st_mode)){
+            continue;
+        }
+        if(is_spill_name(dent->d_name)){
+            files.push_back(spill_file_info(dent->d_name, st.st_mtime, st.st_size));
+        }else if(NULL != strstr(dent->d_name, ".tmp.")){
+            unlink(file_path.c_str());
+        }
+    }
+    closedir(dp);
+    std::sort(files.begin(), files.end(), compare_spill_mtime);
+
+    // from the newest file
+    size_t count = 0;
+    for(std::vector<spill_file_info>::const_reverse_iterator iter = files.rbegin(); iter != files.rend(); ){
+        AutoLock auto_lock(&spill_lock);
+        if(is_exit){
+            return true;
+        }
+        for(size_t cnt = 0; iter != files.rend() && cnt < ChunkSpill::LOAD_BATCH_COUNT; ++iter, ++cnt){
+            if(file_map.end() != file_map.find(iter->name)){
+                continue;
+            }
+            chunk_spill_file file;
+            file.size = iter->size;
+            file.pos  = lru_list.insert(lru_list.begin(), iter->name);
+            file_map[iter->name] = file;
+            total_size += iter->size;
+            ++count;
+        }
+    }
+    AutoLock auto_lock(&spill_lock);
+    EvictFiles(0);
+
+    S3FS_PRN_INFO("loaded %zu spilled chunk files(%lld bytes).", count, static_cast<long long int>(total_size));
+    return true;
+}
+
+bool ChunkSpill::IsExit()
+{
+    AutoLock auto_lock(&spill_lock);
+    return is_exit;
+}
+
+void ChunkSpill::WriteFile(const chunk_spill_job& job)
+{
+    std::string tmppath  = ChunkSpill::spill_dir + "/" + job.name + SPILL_TMPFILE_FORM;
+    char*       ptmppath = strdup(tmppath.c_str());
+    int         fd;
+    if(-1 == (fd = mkstemp(ptmppath))){
+        S3FS_PRN_ERR("failed to create temporary file in %s by errno(%d)", ChunkSpill::spill_dir.c_str(), errno);
+        free(ptmppath);
+        return;
+    }
+    uint32_t     keylen = static_cast<uint32_t>(job.key.size());
+    off_t        size   = static_cast<off_t>(sizeof(keylen) + keylen) + job.chunk->size;
+    struct iovec iov[3];
+    iov[0].iov_base = &keylen;
+    iov[0].iov_len  = sizeof(keylen);
+    iov[1].iov_base = const_cast<char*>(job.key.data());
+    iov[1].iov_len  = keylen;
+    iov[2].iov_base = job.chunk->buf;
+    iov[2].iov_len  = job.chunk->size;
+
+    bool result = (size == writev(fd, iov, 3));
+    close(fd);
+
+    AutoLock auto_lock(&spill_lock);
+
+    if(!result){
+        S3FS_PRN_ERR("failed to write spilled chunk file(%s) by errno(%d)", ptmppath, errno);
+        unlink(ptmppath);
+        free(ptmppath);
+        return;
+    }
+    chunk_spill_map_t::iterator iter = file_map.find(job.name);
+    if(file_map.end() != iter){
+        total_size -= iter->second.size;
+        lru_list.erase(iter->second.pos);
+        file_map.erase(iter);
+    }
+    EvictFiles(size);
+
+    std::string file_path = ChunkSpill::spill_dir + "/" + job.name;
+    if(-1 == rename(ptmppath, file_path.c_str())){
+        S3FS_PRN_ERR("failed to rename %s to %s by errno(%d)", ptmppath, file_path.c_str(), errno);
+        unlink(ptmppath);
+        free(ptmppath);
+        return;
+    }
+    free(ptmppath);
+
+    chunk_spill_file file;
+    file.size = size;
+    file.pos  = lru_list.insert(lru_list.end(), job.name);
+    file_map[job.name] = file;
+    total_size += size;
+}
+
+//
+// Remove the least recently used files until the file of the size can be
+// added. The caller must hold spill_lock.
+//
+void ChunkSpill::EvictFiles(off_t size)
+{
+    while(!lru_list.empty() && ChunkSpill::spill_limit < total_size + size){
+        std::string                 name = lru_list.front();
+        chunk_spill_map_t::iterator iter = file_map.find(name);
+        lru_list.pop_front();
+        if(file_map.end() != iter){
+            total_size -= iter->second.size;
+            file_map.erase(iter);
+        }
+        std::string file_path = ChunkSpill::spill_dir + "/" + name;
+        unlink(file_path.c_str());
+    }
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
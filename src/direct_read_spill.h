@@ -0,0 +1,134 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef S3FS_DIRECT_READ_SPILL_H_
+#define S3FS_DIRECT_READ_SPILL_H_
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "autolock.h"
+
+#include "psemaphore.h"
+
+struct Chunk;
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+struct chunk_spill_job
+{
+    std::string key;
+    std::string name;
+    Chunk*      chunk;
+
+    chunk_spill_job(const std::string& strkey, const std::string& strname, Chunk* pchunk) : key(strkey), name(strname), chunk(pchunk) {}
+};
+typedef std::list<chunk_spill_job> chunk_spill_jobs_t;
+
+struct chunk_spill_file
+{
+    off_t                             size;
+    std::list<std::string>::iterator  pos;      // position in the lru list
+};
+typedef std::map<std::string, chunk_spill_file> chunk_spill_map_t;     // file name -> file
+
+//------------------------------------------------
+// Class ChunkSpill
+//------------------------------------------------
+// [NOTE]
+// This class is the second tier of the chunks of direct read(the
+// direct_read_spill_dir option). The complete chunks which are released
+// from the memory are written into the local directory in background,
+// and the chunk which is not in the memory is read from it before it is
+// downloaded from the server.
+// The chunk file is keyed by (path, etag, chunk size, chunk index), and
+// the file name is the hash of the key. The key is written at the head
+// of the file and is checked when it is read.
+// The total size of the files is limited by direct_read_spill_size_mb,
+// the least recently used files are removed.
+// The chunks waiting for writing are limited, and the chunk which is
+// released over the limit is just freed.
+//
+class ChunkSpill
+{
+    private:
+        static const off_t  MAX_PENDING_SIZE = 256 * 1024 * 1024;
+        static const size_t LOAD_BATCH_COUNT = 1024;
+
+        static ChunkSpill*  singleton;
+        static std::string  spill_dir;
+        static off_t        spill_limit;
+
+        bool                is_exit;
+        Semaphore           spill_sem;
+        pthread_t           thread;
+
+        named_mutex         spill_lock;         // protects all of the following members
+        chunk_spill_jobs_t  job_list;
+        off_t               pending_size;
+        std::list<std::string> lru_list;
+        chunk_spill_map_t   file_map;
+        off_t               total_size;
+
+    private:
+        static void* Worker(void* arg);
+        static std::string MakeKey(const std::string& path, const std::string& etag, uint32_t id);
+        static std::string MakeName(const std::string& key);
+
+        ChunkSpill();
+        ~ChunkSpill();
+
+        bool IsExit();
+        bool LoadFiles();
+        void WriteFile(const chunk_spill_job& job);
+        void EvictFiles(off_t size);
+
+    public:
+        static const off_t DEFAULT_SPILL_LIMIT = 10LL * 1024 * 1024 * 1024;
+
+        static bool SetSpillDir(const char* dir);
+        static bool SetSpillLimit(off_t limit);
+        static bool IsSpecified() { return !ChunkSpill::spill_dir.empty(); }
+
+        static bool Initialize();
+        static void Destroy();
+        static bool IsEnable() { return (NULL != ChunkSpill::singleton); }
+
+        static void Push(const std::string& path, const std::string& etag, uint32_t id, Chunk* chunk);
+        static bool IsCached(const std::string& path, const std::string& etag, uint32_t id);
+        static bool Read(const std::string& path, const std::string& etag, uint32_t id, char* buf, off_t size);
+};
+
+#endif // S3FS_DIRECT_READ_SPILL_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -18,7 +18,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <algorithm>
+
 #include "direct_reader.h"
+#include "direct_read_spill.h"
 #include "string_util.h"
 
 //-------------------------------------------------------------------
@@ -27,15 +30,99 @@
 static const off_t MIN_CHUNK_SIZE = 1 * 1024 * 1024;
 static const off_t MAX_CHUNK_SIZE = 32 * 1024 * 1024;
 static const uint64_t MIN_PREFETCH_CACHE_LIMITS = 128 * 1024 * 1024;
+static const off_t MAX_FETCH_SIZE = 64 * 1024 * 1024;     // maximum size of one prefetch request over some chunks
 
 //-------------------------------------------------------------------
-// Class Chunk
+// Class ChunkLru
 //-------------------------------------------------------------------
-std::atomic<uint64_t> Chunk::cache_usage = ATOMIC_VAR_INIT(0);
+ChunkLru        ChunkLru::singleton;
+named_mutex ChunkLru::lru_lock;
+
+ChunkLru::ChunkLru()
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+    int result;
+    if(0 != (result = pthread_mutex_init(&ChunkLru::lru_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init lru_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&ChunkLru::lru_lock, "ChunkLru::lru_lock");
+}
+
+ChunkLru::~ChunkLru()
+{
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&ChunkLru::lru_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy lru_lock: %d", result);
+        abort();
+    }
+}
 
-bool Chunk::cache_usage_check() 
+void ChunkLru::Add(Chunk* chunk, DirectReader* reader, uint32_t id)
 {
-    return cache_usage < DirectReader::GetPrefetchCacheLimits();
+    AutoLock auto_lock(&ChunkLru::lru_lock);
+
+    if (chunk->in_lru) {
+        ChunkLru::singleton.lru_list.erase(chunk->lru_pos);
+    }
+    chunk->reader  = reader;
+    chunk->id      = id;
+    chunk->in_lru  = true;
+    chunk->lru_pos = ChunkLru::singleton.lru_list.insert(ChunkLru::singleton.lru_list.end(), chunk);
+}
+
+void ChunkLru::Touch(Chunk* chunk)
+{
+    AutoLock auto_lock(&ChunkLru::lru_lock);
+
+    if (chunk->in_lru) {
+        ChunkLru::singleton.lru_list.splice(ChunkLru::singleton.lru_list.end(), ChunkLru::singleton.lru_list, chunk->lru_pos);
+    }
+}
+
+void ChunkLru::Remove(Chunk* chunk)
+{
+    AutoLock auto_lock(&ChunkLru::lru_lock);
+
+    if (chunk->in_lru) {
+        ChunkLru::singleton.lru_list.erase(chunk->lru_pos);
+        chunk->in_lru = false;
+    }
+}
+
+//
+// Evicts the least recently used chunks of the other readers until the
+// chunk of the size can be admitted. The caller must hold the lock of
+// its reader.
+//
+bool ChunkLru::Reclaim(const DirectReader* reader, off_t size)
+{
+    AutoLock auto_lock(&ChunkLru::lru_lock);
+
+    std::list<Chunk*>& lru_list = ChunkLru::singleton.lru_list;
+    for (std::list<Chunk*>::iterator iter = lru_list.begin(); iter != lru_list.end() && DirectReader::GetPrefetchCacheLimits() < Chunk::cache_usage + static_cast<uint64_t>(size); ) {
+        Chunk*        chunk  = *iter;
+        DirectReader* victim = chunk->reader;
+        if (victim == reader) {
+            ++iter;
+            continue;
+        }
+        AutoLock victim_lock(&victim->direct_read_lock, AutoLock::NO_WAIT);
+        if (!victim_lock.isLockAcquired()) {
+            ++iter;
+            continue;
+        }
+        S3FS_PRN_DBG("evict chunk[path=%s][chunkid=%u]", victim->filepath.c_str(), chunk->id);
+        iter = lru_list.erase(iter);
+        chunk->in_lru = false;
+        victim->chunks.erase(chunk->id);
+        victim->SpillOrDelete(chunk->id, chunk);
+    }
+    return Chunk::cache_usage + static_cast<uint64_t>(size) <= DirectReader::GetPrefetchCacheLimits();
 }
 
 //-------------------------------------------------------------------
@@ -44,6 +131,7 @@ bool Chunk::cache_usage_check()
 off_t     DirectReader::chunk_size                    = 4 * 1024 * 1024;       // default
 int       DirectReader::prefetch_chunk_count          = 32;                    // default 
 uint64_t  DirectReader::prefetch_cache_limits         = 1024 * 1024 * 1024;    // default
+std::atomic<uint64_t> DirectReader::prefetch_cache_budget(0);
 int       DirectReader::backward_chunks               = 1;
 uint64_t  DirectReader::direct_read_local_file_cache_size = 0;   // by default data will not be written to the disk
 
@@ -75,6 +163,24 @@ bool DirectReader::SetPrefetchCacheLimits(uint64_t limit)
     DirectReader::prefetch_cache_limits = limit;
     return true;
 }
+
+//
+// Lowers the limits of the chunks to the budget(bytes) given by MemoryGovernor,
+// and evicts the least recently used chunks over it. The budget 0 restores
+// the limits.
+//
+bool DirectReader::SetMemoryBudget(uint64_t budget)
+{
+    if (0 != budget && budget < static_cast<uint64_t>(DirectReader::chunk_size)) {
+        budget = DirectReader::chunk_size;      // keep one chunk at least for reading
+    }
+    DirectReader::prefetch_cache_budget = budget;
+
+    if (0 == budget) {
+        return true;
+    }
+    return ChunkLru::Reclaim(NULL, 0);
+}
 bool DirectReader::SetDirectReadLocalFileCacheSizeMB(uint64_t limit) {
     limit = limit * 1024 * 1024;
     DirectReader::direct_read_local_file_cache_size = limit;
@@ -89,12 +195,31 @@ bool DirectReader::SetBackwardChunks(int chunk_num) {
     return true;
 }
 
+uint32_t DirectReader::GetMaxFetchChunks()
+{
+    uint32_t count = static_cast<uint32_t>(std::max(MAX_FETCH_SIZE / DirectReader::chunk_size, static_cast<off_t>(1)));
+    return std::max(std::min(count, static_cast<uint32_t>(DirectReader::prefetch_chunk_count)), static_cast<uint32_t>(1));
+}
+
+void DirectReader::GetMonotonicTime(struct timespec& ts)
+{
+    if (-1 == clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &ts)) {
+        ts.tv_sec  = 0;
+        ts.tv_nsec = 0;
+    }
+}
+
+long long DirectReader::ElapsedUs(const struct timespec& start, const struct timespec& end)
+{
+    return (static_cast<long long>(end.tv_sec - start.tv_sec) * 1000000LL) + ((end.tv_nsec - start.tv_nsec) / 1000);
+}
+
 //-------------------------------------------------------------------
 // Class methods for DirectReader
 //-------------------------------------------------------------------
-DirectReader::DirectReader(const std::string& path, off_t size) : 
-    filepath(path), filesize(size), prefetched_sem(0), instruct_count(0), completed_count(0),
-    is_direct_read_lock_init(false), ongoing_prefetch(0)
+DirectReader::DirectReader(const std::string& path, const std::string& etag, off_t size) : 
+    filepath(path), etag(etag), filesize(size), prefetched_sem(0), instruct_count(0), completed_count(0),
+    is_direct_read_lock_init(false), ongoing_prefetch(0), fetch_time_us(0)
 {
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
@@ -102,10 +227,11 @@ DirectReader::DirectReader(const std::string& path, off_t size) :
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
     int result;
-    if (0 != (result = pthread_mutex_init(&direct_read_lock, &attr))) {
+    if (0 != (result = pthread_mutex_init(&direct_read_lock.mutex, &attr))) {
         S3FS_PRN_CRIT("failed to init direct_read_lock: %d", result);
         abort();
     }
+    LockProfiler::SetName(&direct_read_lock, "DirectReader::direct_read_lock");
 
     is_direct_read_lock_init = true;
 }
@@ -116,7 +242,7 @@ DirectReader::~DirectReader()
     ReleaseChunks();
     if(is_direct_read_lock_init){
       int result;
-      if(0 != (result = pthread_mutex_destroy(&direct_read_lock))){
+      if(0 != (result = pthread_mutex_destroy(&direct_read_lock.mutex))){
           S3FS_PRN_CRIT("failed to destroy upload_list_lock: %d", result);
           abort();
       }
@@ -154,6 +280,106 @@ bool DirectReader::Prefetch(off_t start, off_t len)
     return true;
 }
 
+// [NOTE]
+// Loads only the blocks which cover [start, start + len) in the chunk
+// for the random read, and the partial chunk is added if the chunk does
+// not exist. The continuous blocks which are not loaded are requested at
+// once. The caller must hold direct_read_lock.
+//
+bool DirectReader::LoadBlocks(uint32_t chunkid, off_t start, off_t len)
+{
+    off_t chunk_start = static_cast<off_t>(chunkid) * chunk_size;
+    if (chunk_start + start >= filesize || len <= 0) {
+        return false;
+    }
+    Chunk* chunk;
+    if (chunks.count(chunkid)) {
+        chunk = chunks[chunkid];
+    } else {
+        chunk = new Chunk(chunk_start, std::min(chunk_size, filesize - chunk_start), true);
+        AddChunk(chunkid, chunk);
+    }
+
+    off_t end = std::min(start + len, chunk->size);
+    for (off_t block = start / Chunk::BLOCK_SIZE; block * Chunk::BLOCK_SIZE < end; ) {
+        if (chunk->IsLoaded(block * Chunk::BLOCK_SIZE, 1)) {
+            ++block;
+            continue;
+        }
+        off_t load_start = block * Chunk::BLOCK_SIZE;
+        off_t load_end   = load_start;
+        for (; load_end < end && !chunk->IsLoaded(load_end, 1); load_end += Chunk::BLOCK_SIZE);
+        load_end = std::min(load_end, chunk->size);
+
+        S3FS_PRN_DBG("load blocks[path=%s][chunkid=%u][start=%lld][len=%lld]", filepath.c_str(), chunkid, static_cast<long long int>(load_start), static_cast<long long int>(load_end - load_start));
+        S3fsCurl s3fscurl;
+        ssize_t  rsize = 0;
+        if (0 != s3fscurl.GetObjectStreamRequest(filepath.c_str(), chunk->buf + load_start, chunk_start + load_start, load_end - load_start, rsize, etag) || rsize != (load_end - load_start)) {
+            S3FS_PRN_ERR("failed to load blocks[path=%s][chunkid=%u][start=%lld][len=%lld]", filepath.c_str(), chunkid, static_cast<long long int>(load_start), static_cast<long long int>(load_end - load_start));
+            return false;
+        }
+        chunk->SetLoaded(load_start, load_end - load_start);
+        block = load_end / Chunk::BLOCK_SIZE;
+        if (chunk->IsComplete()) {
+            break;
+        }
+    }
+    return true;
+}
+
+long long DirectReader::GetFetchTime()
+{
+    AutoLock lock(&direct_read_lock);
+    return fetch_time_us;
+}
+
+//
+// The caller must hold direct_read_lock.
+//
+void DirectReader::UpdateFetchTime(long long us)
+{
+    fetch_time_us = (0 == fetch_time_us) ? us : ((fetch_time_us * 3 + us) / 4);
+}
+
+//
+// The caller must hold direct_read_lock.
+//
+void DirectReader::AddChunk(uint32_t chunkid, Chunk* chunk)
+{
+    chunks[chunkid] = chunk;
+    ChunkLru::Add(chunk, this, chunkid);
+}
+
+//
+// Releases the chunk which is already removed from chunks. The caller
+// must hold direct_read_lock.
+//
+void DirectReader::DiscardChunk(uint32_t chunkid, Chunk* chunk)
+{
+    if (chunk && chunk->in_lru) {
+        ChunkLru::Remove(chunk);
+    }
+    SpillOrDelete(chunkid, chunk);
+}
+
+//
+// The complete chunk is handed to ChunkSpill if direct_read_spill_dir is
+// specified, otherwise it is freed. The chunk must not be in ChunkLru.
+//
+void DirectReader::SpillOrDelete(uint32_t chunkid, Chunk* chunk)
+{
+    if (ChunkSpill::IsEnable()) {
+        ChunkSpill::Push(filepath, etag, chunkid, chunk);
+    } else {
+        delete chunk;
+    }
+}
+
+bool DirectReader::IsSpilled(uint32_t chunkid) const
+{
+    return ChunkSpill::IsCached(filepath, etag, chunkid);
+}
+
 void DirectReader::WaitAllPrefetchThreadsExit() 
 {
     bool is_loop = true;
@@ -229,7 +455,7 @@ void DirectReader::ReleaseChunks()
 {
     AutoLock lock(&direct_read_lock);
     for (std::map<uint32_t, Chunk*>::iterator it = chunks.begin(); it!= chunks.end(); it++) {
-        delete it->second;
+        DiscardChunk(it->first, it->second);
         it->second = NULL;
     }
     chunks.clear();
@@ -257,39 +483,82 @@ void* direct_read_worker(void* arg)
     S3fsCurl s3fscurl;
     ssize_t rsize;
 
-    Chunk* chunk = new Chunk(start, len); 
-    int result = s3fscurl.GetObjectStreamRequest(direct_reader->filepath.c_str(),
-                                                 chunk->buf, start, len, rsize);
+    // [NOTE]
+    // The prefetch of the sequential stream may request the range over
+    // some chunks at once, then it is split into the chunks.
+    //
+    const off_t chunk_size = DirectReader::GetChunkSize();
+    uint32_t    nchunks    = static_cast<uint32_t>((len + chunk_size - 1) / chunk_size);
+
+    struct timespec fetch_start;
+    struct timespec fetch_end;
+    DirectReader::GetMonotonicTime(fetch_start);
+
+    // [NOTE]
+    // The range is downloaded straight into the buffers of its chunks.
+    // The chunk which was released from the memory may be in the spill
+    // directory, then it is read from there instead of the server.
+    //
+    std::vector<Chunk*> parts;
+    std::vector<char*>  bufs;
+    for (uint32_t cnt = 0; cnt < nchunks; ++cnt) {
+        off_t chunk_off = static_cast<off_t>(cnt) * chunk_size;
+        parts.push_back(new Chunk(start + chunk_off, std::min(chunk_size, len - chunk_off)));
+        bufs.push_back(parts.back()->buf);
+    }
+    bool is_spilled = (1 == nchunks && 0 == start % chunk_size && ChunkSpill::Read(direct_reader->filepath, direct_reader->etag, start / chunk_size, parts[0]->buf, len));
+    int  result     = 0;
+    if (!is_spilled) {
+        result = s3fscurl.GetObjectStreamRequest(direct_reader->filepath.c_str(), bufs, chunk_size, start, len, rsize, direct_reader->etag);
+        if (0 == result && rsize != len) {
+            result = -EIO;
+        }
+    }
 
     if(0 != result){
         S3FS_PRN_ERR("failed to get object stream[pid=%lu][path=%s][start=%ld][len=%ld]", pthread_self(), direct_reader->filepath.c_str(), start, len);
-        delete chunk;
-        chunk = NULL;
+        for (std::vector<Chunk*>::iterator iter = parts.begin(); iter != parts.end(); ++iter) {
+            delete *iter;
+        }
 
         if(!is_sync_download) {
             AutoLock lock(&direct_reader->direct_read_lock);
-            direct_reader->ongoing_prefetch--;
+            direct_reader->ongoing_prefetch -= std::min(nchunks, direct_reader->ongoing_prefetch);
             direct_reader->CompleteInstruction(AutoLock::ALREADY_LOCKED);
         }
 
         delete direct_read_param;
         return reinterpret_cast<void*>(-EIO);
     }
+    DirectReader::GetMonotonicTime(fetch_end);
 
     AutoLock lock(&direct_reader->direct_read_lock, is_sync_download ? AutoLock::ALREADY_LOCKED : AutoLock::NONE);
-    
-    uint32_t chunk_id = start / DirectReader::GetChunkSize();
-    if (!direct_reader->chunks.count(chunk_id)) {
-        S3FS_PRN_DBG("add new chunk[pid=%lu][path=%s][chunkid=%d][start=%ld][len=%ld]", pthread_self(), direct_reader->filepath.c_str(), chunk_id, start, len);
-        direct_reader->chunks[start/DirectReader::GetChunkSize()] = chunk;
-    } else {
-        S3FS_PRN_DBG("chunk already exist[pid=%lu][path=%s][chunkid=%d][start=%ld][len=%ld]", pthread_self(), direct_reader->filepath.c_str(), chunk_id, start, len);
-        delete chunk;
-        chunk = NULL;
+
+    if (!is_spilled) {
+        direct_reader->UpdateFetchTime(DirectReader::ElapsedUs(fetch_start, fetch_end) / nchunks);
+    }
+
+    for (uint32_t cnt = 0; cnt < nchunks; ++cnt) {
+        uint32_t chunk_id = start / chunk_size + cnt;
+        Chunk*   chunk    = parts[cnt];
+
+        if (direct_reader->chunks.count(chunk_id) && !direct_reader->chunks[chunk_id]->IsComplete()) {
+            // replace the partial chunk which is loaded for the random read
+            S3FS_PRN_DBG("replace partial chunk[pid=%lu][path=%s][chunkid=%d]", pthread_self(), direct_reader->filepath.c_str(), chunk_id);
+            delete direct_reader->chunks[chunk_id];
+            direct_reader->chunks.erase(chunk_id);
+        }
+        if (!direct_reader->chunks.count(chunk_id)) {
+            S3FS_PRN_DBG("add new chunk[pid=%lu][path=%s][chunkid=%d][start=%ld][len=%ld]", pthread_self(), direct_reader->filepath.c_str(), chunk_id, chunk->offset, chunk->size);
+            direct_reader->AddChunk(chunk_id, chunk);
+        } else {
+            S3FS_PRN_DBG("chunk already exist[pid=%lu][path=%s][chunkid=%d][start=%ld][len=%ld]", pthread_self(), direct_reader->filepath.c_str(), chunk_id, chunk->offset, chunk->size);
+            delete chunk;
+        }
     }
 
     if (!is_sync_download) {
-        direct_reader->ongoing_prefetch--;
+        direct_reader->ongoing_prefetch -= std::min(nchunks, direct_reader->ongoing_prefetch);
         direct_reader->CompleteInstruction(AutoLock::ALREADY_LOCKED);
     }
 
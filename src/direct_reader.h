@@ -22,10 +22,13 @@
 #ifndef S3FS_PREFETCH_READER_H_
 #define S3FS_PREFETCH_READER_H_
 
+#include <ctime>
 #include <string>
+#include <list>
 #include <map>
 #include <stdint.h>
 #include <atomic>
+#include <vector>
 
 #include "threadpoolman.h"
 #include "s3fs_logger.h"
@@ -34,34 +37,73 @@
 
 void* direct_read_worker(void* arg);
 
+class DirectReader;
+
+// [NOTE]
+// The chunk which is loaded for the random read is partial, only the
+// blocks(BLOCK_SIZE) which are read are loaded and are marked in blocks.
+// When all blocks are loaded, blocks is cleared and it becomes the same
+// as the chunk which is loaded at once.
+//
 struct Chunk
 {
+    static const off_t BLOCK_SIZE = 64 * 1024;
+
     off_t offset;
     off_t size;
     char* buf;
+    std::vector<bool> blocks;       // loaded blocks, empty if the whole chunk is loaded
+    off_t usage;                    // bytes counted in cache_usage, only the loaded blocks for the partial chunk
+
+    // following members are set while the chunk is in ChunkLru
+    DirectReader*               reader;
+    uint32_t                    id;
+    bool                        in_lru;
+    std::list<Chunk*>::iterator lru_pos;
+
+    Chunk(off_t off, off_t size, bool is_partial = false);
+    ~Chunk();
+
+    bool IsComplete() const { return blocks.empty(); }
+    bool IsLoaded(off_t start, off_t len) const;
+    void SetLoaded(off_t start, off_t len);
 
-    Chunk(off_t off, off_t size) : offset(off), size(size)    
-    {
-        buf = static_cast<char*>(malloc(size));
-        memset(buf, 0, size);
-        cache_usage += size;
-    }
-
-    ~Chunk() {
-        if (buf) {
-            free(buf);
-            buf = NULL;
-            cache_usage -= size;
-        }
-    }
-    
     static std::atomic<uint64_t> cache_usage;
     static bool cache_usage_check();
 };
 
+// [NOTE]
+// All chunks of all DirectReaders are in this LRU list, in the order of
+// the last access. When the memory usage of the chunks reaches the limit
+// (prefetch_cache_limits), the least recently used chunks of the other
+// readers are evicted to admit the prefetch of the active reader, instead
+// of stopping the prefetch until the idle readers move or close.
+// The chunk is evicted only when its reader's direct_read_lock can be
+// acquired without waiting, because the caller holds its own reader's
+// lock(the lock order is the reader's lock, then lru_lock).
+//
+class ChunkLru
+{
+    private:
+        static ChunkLru     singleton;
+        static named_mutex     lru_lock;    // protects lru_list and the lru members of chunks
+        std::list<Chunk*>   lru_list;
+
+    private:
+        ChunkLru();
+        ~ChunkLru();
+
+    public:
+        static void Add(Chunk* chunk, DirectReader* reader, uint32_t id);
+        static void Touch(Chunk* chunk);
+        static void Remove(Chunk* chunk);
+        static bool Reclaim(const DirectReader* reader, off_t size);
+};
+
 class DirectReader 
 {
     friend void* direct_read_worker(void* arg); 
+    friend class ChunkLru;
 
     private:
         void WaitAllPrefetchThreadsExit();
@@ -72,11 +114,13 @@ class DirectReader
         static off_t                chunk_size;
         static int                  prefetch_chunk_count;
         static uint64_t             prefetch_cache_limits;
+        static std::atomic<uint64_t> prefetch_cache_budget;     // given by MemoryGovernor under pressure, 0 means no budget
         static int                  backward_chunks;
         static uint64_t             direct_read_local_file_cache_size;
 
         const std::string           filepath;    // used to request data from oss, and If the file is renamed or deleted during reading, 
                                                  // ossfs will exit direct read mode and no loner direct reading data from oss again.
+        const std::string           etag;        // etag when the file is opened, used as the key of the spilled chunks.
 
         const off_t                 filesize;    // equal to the size when the file is opened and will not change again.
         
@@ -94,7 +138,13 @@ class DirectReader
         
         static off_t GetChunkSize() { return DirectReader::chunk_size; }
         static int GetPrefetchChunkCount() { return DirectReader::prefetch_chunk_count; }
-        static uint64_t GetPrefetchCacheLimits() { return DirectReader::prefetch_cache_limits; }
+        static uint64_t GetPrefetchCacheLimits()
+        {
+            uint64_t budget = DirectReader::prefetch_cache_budget;
+            return (0 != budget && budget < DirectReader::prefetch_cache_limits) ? budget : DirectReader::prefetch_cache_limits;
+        }
+        static uint64_t GetMemoryUsage() { return Chunk::cache_usage; }
+        static bool SetMemoryBudget(uint64_t budget);
 
         static bool SetDirectReadLocalFileCacheSizeMB(uint64_t limit);
         static uint64_t GetDirectReadLocalFileCacheSize() { return DirectReader::direct_read_local_file_cache_size; }
@@ -102,17 +152,29 @@ class DirectReader
         static bool SetBackwardChunks(int chunk_num);
         static int GetBackwardChunks() { return DirectReader::backward_chunks; }
 
-        explicit DirectReader(const std::string& path, off_t size);
+        static uint32_t GetMaxFetchChunks();
+        static void GetMonotonicTime(struct timespec& ts);
+        static long long ElapsedUs(const struct timespec& start, const struct timespec& end);
+
+        DirectReader(const std::string& path, const std::string& etag, off_t size);
         ~DirectReader();
 
         bool Prefetch(off_t start, off_t len);
+        bool LoadBlocks(uint32_t chunkid, off_t start, off_t len);
+        void AddChunk(uint32_t chunkid, Chunk* chunk);
+        void DiscardChunk(uint32_t chunkid, Chunk* chunk);
+        void SpillOrDelete(uint32_t chunkid, Chunk* chunk);
+        bool IsSpilled(uint32_t chunkid) const;
         off_t GetFileSize() { return filesize; };
+        long long GetFetchTime();
+        void UpdateFetchTime(long long us);
         void CleanUpChunks(); 
 
         // following members used outside (generating prefetch task and releasing chunks)
-        pthread_mutex_t             direct_read_lock;
+        named_mutex                 direct_read_lock;
         std::map<uint32_t, Chunk*>  chunks;
         uint32_t                    ongoing_prefetch;
+        long long                   fetch_time_us;      // average time for downloading one chunk, 0 if not measured yet
 };
 
 struct DirectReadParam {
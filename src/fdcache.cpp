@@ -22,6 +22,8 @@
 #include <cstdlib>
 #include <cerrno>
 #include <climits>
+#include <algorithm>
+#include <list>
 #include <unistd.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -30,6 +32,8 @@
 #include "s3fs.h"
 #include "fdcache.h"
 #include "fdcache_pseudofd.h"
+#include "fdcache_stat.h"
+#include "fdcache_trash.h"
 #include "s3fs_util.h"
 #include "s3fs_logger.h"
 #include "s3fs_cred.h"
@@ -73,14 +77,21 @@
 //
 #define NOCACHE_PATH_PREFIX_FORM    " __S3FS_UNEXISTED_PATH_%lx__ / "      // important space words for simply
 
+//
+// The maximum count of the files whose etags are recorded for keep_cache.
+//
+static const size_t MAX_KEEP_CACHE_COUNT = 100000;
+
 //------------------------------------------------
 // FdManager class variable
 //------------------------------------------------
 FdManager       FdManager::singleton;
-pthread_mutex_t FdManager::fd_manager_lock;
-pthread_mutex_t FdManager::cache_cleanup_lock;
-pthread_mutex_t FdManager::reserved_diskspace_lock;
-pthread_mutex_t FdManager::except_entmap_lock;
+named_mutex FdManager::fd_manager_lock;
+named_mutex FdManager::cache_cleanup_lock;
+named_mutex FdManager::reserved_diskspace_lock;
+named_mutex FdManager::except_entmap_lock;
+named_mutex FdManager::keep_cache_lock;
+named_mutex FdManager::hashed_keys_lock;
 bool            FdManager::is_lock_init(false);
 std::string     FdManager::cache_dir;
 bool            FdManager::check_cache_dir_exist(false);
@@ -90,6 +101,11 @@ std::string     FdManager::check_cache_output;
 bool            FdManager::checked_lseek(false);
 bool            FdManager::have_lseek_hole(false);
 std::string     FdManager::tmp_dir = "/tmp";
+bool            FdManager::is_keep_cache(false);
+bool            FdManager::is_hashed_dir(false);
+keepcache_map_t FdManager::keep_cache_map;
+hashedkey_set_t FdManager::hashed_keys;
+bool            FdManager::is_hashed_keys_loaded(false);
 
 //------------------------------------------------
 // FdManager class methods
@@ -104,6 +120,38 @@ bool FdManager::SetCacheDir(const char* dir)
     return true;
 }
 
+bool FdManager::SetHashedDir(bool flag)
+{
+    bool old = FdManager::is_hashed_dir;
+    FdManager::is_hashed_dir = flag;
+    return old;
+}
+
+// [NOTE]
+// Returns the path under the top directory of the hashed layout for the
+// object path, "/<h[0:2]>/<h[2:4]>/<h>", where h is FNV-1a 64bit of the
+// object path in hex. Two levels of 256 directories keep each directory
+// small regardless of the number of objects in one prefix.
+//
+std::string FdManager::MakeHashedSubPath(const char* path)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for(const char* pos = path; pos && '\0' != *pos; ++pos){
+        hash ^= static_cast<unsigned char>(*pos);
+        hash *= 1099511628211ULL;
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", hash);
+
+    std::string sub_path("/");
+    sub_path += std::string(name, 2);
+    sub_path += "/";
+    sub_path += std::string(&name[2], 2);
+    sub_path += "/";
+    sub_path += name;
+    return sub_path;
+}
+
 bool FdManager::SetCacheCheckOutput(const char* path)
 {
     if(!path || '\0' == path[0]){
@@ -124,12 +172,25 @@ bool FdManager::DeleteCacheDirectory()
     if(!FdManager::MakeCachePath(NULL, cache_path, false)){
         return false;
     }
-    if(!delete_files_in_dir(cache_path.c_str(), true)){
+    if(!CacheTrash::Remove(cache_path.c_str())){
+        return false;
+    }
+
+    // the cache files in the other layout(left before changing the layout)
+    struct stat st;
+    if(!FdManager::MakeCacheTreePath(NULL, cache_path, false, false, !FdManager::is_hashed_dir)){
+        return false;
+    }
+    if(0 == stat(cache_path.c_str(), &st) && !CacheTrash::Remove(cache_path.c_str())){
         return false;
     }
 
     std::string mirror_path = FdManager::cache_dir + "/." + S3fsCred::GetBucket() + ".mirror";
-    if(!delete_files_in_dir(mirror_path.c_str(), true)){
+    if(!CacheTrash::Remove(mirror_path.c_str())){
+        return false;
+    }
+
+    if(!ChunkCache::DeleteChunkDirectory()){
         return false;
     }
 
@@ -171,10 +232,68 @@ int FdManager::DeleteCacheFile(const char* path)
             result = -EIO;
         }
     }
+    if(ChunkCache::IsEnable() && !ChunkCache::DeleteChunks(path)){
+        S3FS_PRN_ERR("failed to delete chunk files(%s)", path);
+        result = -EIO;
+    }
+    if(FdManager::is_hashed_dir){
+        // the cache file which is not migrated from the mirrored layout yet
+        if(FdManager::MakeCacheTreePath(path, cache_path, false, false, false) && 0 != unlink(cache_path.c_str()) && ENOENT != errno){
+            S3FS_PRN_WARN("failed to delete old layout cache file(%s): errno=%d", path, errno);
+        }
+        CacheFileStat::DeleteCacheFileStat(path, false);
+        FdManager::EraseHashedKey(path);
+    }
+    return result;
+}
+
+//
+// Deletes the cache file and its stat file by the path under the top
+// directory of the hashed layout, for the case that the object path is
+// not known.
+//
+bool FdManager::DeleteHashedCacheFile(const std::string& sub_path)
+{
+    std::string cache_path;
+    if(!FdManager::MakeCacheTreePath(NULL, cache_path, false, false, true)){
+        return false;
+    }
+    cache_path += sub_path;
+
+    bool result = true;
+    if(0 != unlink(cache_path.c_str()) && ENOENT != errno){
+        S3FS_PRN_ERR("failed to delete file(%s): errno=%d", cache_path.c_str(), errno);
+        result = false;
+    }
+    std::string sfile_path = CacheFileStat::GetCacheFileStatTopDir(true) + sub_path;
+    std::string key;
+    if(CacheFileStat::GetCacheFileStatKey(sfile_path.c_str(), key)){
+        FdManager::EraseHashedKey(key);
+    }
+    if(0 != unlink(sfile_path.c_str()) && ENOENT != errno){
+        S3FS_PRN_ERR("failed to delete stat file(%s): errno=%d", sfile_path.c_str(), errno);
+        result = false;
+    }
     return result;
 }
 
 bool FdManager::MakeCachePath(const char* path, std::string& cache_path, bool is_create_dir, bool is_mirror_path)
+{
+    return FdManager::MakeCacheTreePath(path, cache_path, is_create_dir, is_mirror_path, FdManager::is_hashed_dir);
+}
+
+//
+// [NOTE]
+// The cache files are placed in one of the following layouts.
+//
+//   mirrored layout: "<cache_dir>/<bucket>/<object path>"
+//   hashed layout  : "<cache_dir>/.<bucket>.hashed/<h[0:2]>/<h[2:4]>/<h>"
+//
+// In the hashed layout, the object path is kept in the head of the stat
+// file of the cache file(see CacheFileStat).
+// The mirror file is always placed in the mirrored layout.
+//
+bool FdManager::MakeCacheTreePath(const char* path, std::string& cache_path, bool is_create_dir, bool is_mirror_path, bool is_hashed)
 {
     if(FdManager::cache_dir.empty()){
         cache_path = "";
@@ -182,27 +301,68 @@ bool FdManager::MakeCachePath(const char* path, std::string& cache_path, bool is
     }
 
     std::string resolved_path(FdManager::cache_dir);
-    if(!is_mirror_path){
-        resolved_path += "/";
-        resolved_path += S3fsCred::GetBucket();
-    }else{
+    std::string sub_path(SAFESTRPTR(path));
+    if(is_mirror_path){
         resolved_path += "/.";
         resolved_path += S3fsCred::GetBucket();
         resolved_path += ".mirror";
+    }else if(is_hashed){
+        resolved_path += "/.";
+        resolved_path += S3fsCred::GetBucket();
+        resolved_path += ".hashed";
+        if(!sub_path.empty()){
+            sub_path = FdManager::MakeHashedSubPath(path);
+        }
+    }else{
+        resolved_path += "/";
+        resolved_path += S3fsCred::GetBucket();
     }
 
     if(is_create_dir){
         int result;
-        if(0 != (result = mkdirp(resolved_path + mydirname(path), 0777))){
+        if(0 != (result = mkdirp(resolved_path + mydirname(sub_path.c_str()), 0777))){
             S3FS_PRN_ERR("failed to create dir(%s) by errno(%d).", path, result);
             return false;
         }
     }
-    if(!path || '\0' == path[0]){
-        cache_path = resolved_path;
-    }else{
-        cache_path = resolved_path + SAFESTRPTR(path);
+    cache_path = resolved_path + sub_path;
+    return true;
+}
+
+//
+// [NOTE]
+// Moves the cache file and its stat file in the mirrored layout into the
+// hashed layout, then the cache left by the mount without the hashed
+// layout is used continuously. This is called when the object is opened
+// first, and the cache files which are never opened again are removed by
+// the cache cleanup.
+//
+bool FdManager::MigrateCacheFile(const char* path)
+{
+    std::string old_cache_path;
+    std::string new_cache_path;
+    struct stat st;
+    if(!FdManager::MakeCacheTreePath(path, old_cache_path, false, false, false) || 0 != stat(old_cache_path.c_str(), &st) || !S_ISREG(st.st_mode)){
+        return true;
+    }
+    if(!FdManager::MakeCacheTreePath(path, new_cache_path, true, false, true)){
+        return false;
+    }
+
+    // [NOTE]
+    // The cache file is renamed in the same cache directory, then its inode
+    // number which is recorded in the stat file is not changed.
+    //
+    if(-1 == rename(old_cache_path.c_str(), new_cache_path.c_str())){
+        S3FS_PRN_ERR("failed to migrate cache file(%s) to %s by errno(%d).", old_cache_path.c_str(), new_cache_path.c_str(), errno);
+        return false;
+    }
+    if(!CacheFileStat::MigrateCacheFileStat(path)){
+        S3FS_PRN_WARN("failed to migrate cache file stat(%s), then remove the cache file.", path);
+        unlink(new_cache_path.c_str());
+        return false;
     }
+    S3FS_PRN_DBG("migrated cache file(%s) to %s", old_cache_path.c_str(), new_cache_path.c_str());
     return true;
 }
 
@@ -211,7 +371,10 @@ bool FdManager::CheckCacheTopDir()
     if(FdManager::cache_dir.empty()){
         return true;
     }
-    std::string toppath(FdManager::cache_dir + "/" + S3fsCred::GetBucket());
+    std::string toppath;
+    if(!FdManager::MakeCachePath(NULL, toppath, false)){
+        return false;
+    }
 
     return check_exist_dir_permission(toppath.c_str());
 }
@@ -437,6 +600,48 @@ FILE* FdManager::MakeTempFile() {
     return fdopen(fd, "rb+");
 }
 
+bool FdManager::SetKeepCache(bool flag)
+{
+    bool old = FdManager::is_keep_cache;
+    FdManager::is_keep_cache = flag;
+    return old;
+}
+
+//
+// Returns true if the etag and the size of the object are the same as
+// the last opening, then the kernel page cache of the file can be kept.
+// The etag and the size are recorded for the next opening.
+//
+bool FdManager::CheckKeepCache(const char* path, const headers_t& meta, off_t size)
+{
+    if(!FdManager::is_keep_cache || !path){
+        return false;
+    }
+    headers_t::const_iterator iter = meta.find("ETag");
+    if(meta.end() == iter || iter->second.empty()){
+        return false;
+    }
+    std::string value = iter->second + ":" + str(size);
+
+    AutoLock auto_lock(&FdManager::keep_cache_lock);
+
+    keepcache_map_t::iterator miter = FdManager::keep_cache_map.find(path);
+    if(FdManager::keep_cache_map.end() != miter){
+        if(miter->second == value){
+            return true;
+        }
+        miter->second = value;
+        return false;
+    }
+    if(FdManager::keep_cache_map.size() >= MAX_KEEP_CACHE_COUNT){
+        // [NOTE]
+        // It only loses the page caches at the next opening.
+        FdManager::keep_cache_map.clear();
+    }
+    FdManager::keep_cache_map[path] = value;
+    return false;
+}
+
 bool FdManager::HasOpenEntityFd(const char* path)
 {
     AutoLock auto_lock(&FdManager::fd_manager_lock);
@@ -462,7 +667,7 @@ int FdManager::GetOpenFdCount(const char* path)
 //------------------------------------------------
 // FdManager methods
 //------------------------------------------------
-FdManager::FdManager()
+FdManager::FdManager() : fent_generation(0)
 {
     if(this == FdManager::get()){
         pthread_mutexattr_t attr;
@@ -471,22 +676,36 @@ FdManager::FdManager()
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
         int result;
-        if(0 != (result = pthread_mutex_init(&FdManager::fd_manager_lock, &attr))){
+        if(0 != (result = pthread_mutex_init(&FdManager::fd_manager_lock.mutex, &attr))){
             S3FS_PRN_CRIT("failed to init fd_manager_lock: %d", result);
             abort();
         }
-        if(0 != (result = pthread_mutex_init(&FdManager::cache_cleanup_lock, &attr))){
+        if(0 != (result = pthread_mutex_init(&FdManager::cache_cleanup_lock.mutex, &attr))){
             S3FS_PRN_CRIT("failed to init cache_cleanup_lock: %d", result);
             abort();
         }
-        if(0 != (result = pthread_mutex_init(&FdManager::reserved_diskspace_lock, &attr))){
+        if(0 != (result = pthread_mutex_init(&FdManager::reserved_diskspace_lock.mutex, &attr))){
             S3FS_PRN_CRIT("failed to init reserved_diskspace_lock: %d", result);
             abort();
         }
-        if(0 != (result = pthread_mutex_init(&FdManager::except_entmap_lock, &attr))){
+        if(0 != (result = pthread_mutex_init(&FdManager::except_entmap_lock.mutex, &attr))){
             S3FS_PRN_CRIT("failed to init except_entmap_lock: %d", result);
             abort();
         }
+        if(0 != (result = pthread_mutex_init(&FdManager::keep_cache_lock.mutex, &attr))){
+            S3FS_PRN_CRIT("failed to init keep_cache_lock: %d", result);
+            abort();
+        }
+        if(0 != (result = pthread_mutex_init(&FdManager::hashed_keys_lock.mutex, &attr))){
+            S3FS_PRN_CRIT("failed to init hashed_keys_lock: %d", result);
+            abort();
+        }
+        LockProfiler::SetName(&FdManager::fd_manager_lock, "FdManager::fd_manager_lock");
+        LockProfiler::SetName(&FdManager::cache_cleanup_lock, "FdManager::cache_cleanup_lock");
+        LockProfiler::SetName(&FdManager::reserved_diskspace_lock, "FdManager::reserved_diskspace_lock");
+        LockProfiler::SetName(&FdManager::except_entmap_lock, "FdManager::except_entmap_lock");
+        LockProfiler::SetName(&FdManager::keep_cache_lock, "FdManager::keep_cache_lock");
+        LockProfiler::SetName(&FdManager::hashed_keys_lock, "FdManager::hashed_keys_lock");
         FdManager::is_lock_init = true;
     }else{
         abort();
@@ -505,23 +724,32 @@ FdManager::~FdManager()
         except_fent.clear();
 
         if(FdManager::is_lock_init){
+
             int result;
-            if(0 != (result = pthread_mutex_destroy(&FdManager::fd_manager_lock))){
+            if(0 != (result = pthread_mutex_destroy(&FdManager::fd_manager_lock.mutex))){
                 S3FS_PRN_CRIT("failed to destroy fd_manager_lock: %d", result);
                 abort();
             }
-            if(0 != (result = pthread_mutex_destroy(&FdManager::cache_cleanup_lock))){
+            if(0 != (result = pthread_mutex_destroy(&FdManager::cache_cleanup_lock.mutex))){
                 S3FS_PRN_CRIT("failed to destroy cache_cleanup_lock: %d", result);
                 abort();
             }
-            if(0 != (result = pthread_mutex_destroy(&FdManager::reserved_diskspace_lock))){
+            if(0 != (result = pthread_mutex_destroy(&FdManager::reserved_diskspace_lock.mutex))){
                 S3FS_PRN_CRIT("failed to destroy reserved_diskspace_lock: %d", result);
                 abort();
             }
-            if(0 != (result = pthread_mutex_destroy(&FdManager::except_entmap_lock))){
+            if(0 != (result = pthread_mutex_destroy(&FdManager::except_entmap_lock.mutex))){
                 S3FS_PRN_CRIT("failed to destroy except_entmap_lock: %d", result);
                 abort();
             }
+            if(0 != (result = pthread_mutex_destroy(&FdManager::keep_cache_lock.mutex))){
+                S3FS_PRN_CRIT("failed to destroy keep_cache_lock: %d", result);
+                abort();
+            }
+            if(0 != (result = pthread_mutex_destroy(&FdManager::hashed_keys_lock.mutex))){
+                S3FS_PRN_CRIT("failed to destroy hashed_keys_lock: %d", result);
+                abort();
+            }
             FdManager::is_lock_init = false;
         }
     }else{
@@ -572,9 +800,9 @@ FdEntity* FdManager::GetFdEntity(const char* path, int& existfd, bool newfd, boo
         }
     }
 
-    // If the cache directory is not specified, ossfsopens a temporary file
-    // when the file is opened.
-    if(!FdManager::IsCacheDir()){
+    // If the cache directory is not specified(or the chunked layout is used),
+    // ossfs opens a temporary file when the file is opened.
+    if(!FdManager::UseCacheFile()){
         for(iter = fent.begin(); iter != fent.end(); ++iter){
             if(iter->second && iter->second->IsOpen() && 0 == strcmp(iter->second->GetPath(), path)){
                 return iter->second;
@@ -598,7 +826,7 @@ FdEntity* FdManager::Open(int& fd, const char* path, headers_t* pmeta, off_t siz
 
     // search in mapping by key(path)
     fdent_map_t::iterator iter = fent.find(std::string(path));
-    if(fent.end() == iter && !force_tmpfile && !FdManager::IsCacheDir()){
+    if(fent.end() == iter && !force_tmpfile && !FdManager::UseCacheFile()){
         // If the cache directory is not specified, ossfsopens a temporary file
         // when the file is opened.
         // Then if it could not find a entity in map for the file, ossfs should
@@ -639,10 +867,14 @@ FdEntity* FdManager::Open(int& fd, const char* path, headers_t* pmeta, off_t siz
     }else if(is_create){
         // not found
         std::string cache_path;
-        if(!force_tmpfile && !FdManager::MakeCachePath(path, cache_path, true)){
+        if(!force_tmpfile && FdManager::UseCacheFile() && !FdManager::MakeCachePath(path, cache_path, true)){
             S3FS_PRN_ERR("failed to make cache path for object(%s).", path);
             return NULL;
         }
+        if(!cache_path.empty() && FdManager::is_hashed_dir){
+            FdManager::MigrateCacheFile(path);
+            FdManager::AddHashedKey(path);
+        }
         // make new obj
         ent = new FdEntity(path, cache_path.c_str());
 
@@ -655,6 +887,7 @@ FdEntity* FdManager::Open(int& fd, const char* path, headers_t* pmeta, off_t siz
         if(!cache_path.empty()){
             // using cache
             fent[std::string(path)] = ent;
+            ++fent_generation;
         }else{
             // not using cache, so the key of fdentity is set not really existing path.
             // (but not strictly unexisting path.)
@@ -681,6 +914,15 @@ FdEntity* FdManager::GetExistFdEntity(const char* path, int existfd)
 {
     S3FS_PRN_DBG("[path=%s][pseudo_fd=%d]", SAFESTRPTR(path), existfd);
 
+    // [NOTE]
+    // The pseudo fd is owned by the caller, then the entity is not removed
+    // while the caller is using it.
+    //
+    FdEntity* ent;
+    if(NULL != (ent = PseudoFdManager::GetEntity(existfd))){
+        return ent;
+    }
+
     AutoLock auto_lock(&FdManager::fd_manager_lock);
 
     UpdateEntityToTempPath();
@@ -741,7 +983,7 @@ void FdManager::Rename(const std::string &from, const std::string &to)
     UpdateEntityToTempPath();
 
     fdent_map_t::iterator iter = fent.find(from);
-    if(fent.end() == iter && !FdManager::IsCacheDir()){
+    if(fent.end() == iter && !FdManager::UseCacheFile()){
         // If the cache directory is not specified, ossfs opens a temporary file
         // when the file is opened.
         // Then if it could not find a entity in map for the file, ossfs should
@@ -772,6 +1014,92 @@ void FdManager::Rename(const std::string &from, const std::string &to)
 
         // set new fd entity to map
         fent[fentmapkey] = ent;
+        ++fent_generation;
+
+        if(FdManager::is_hashed_dir){
+            FdManager::EraseHashedKey(from);
+            FdManager::AddHashedKey(to);
+        }
+    }
+}
+
+//
+// [NOTE]
+// This method is used when a directory is renamed with all objects under
+// it at once on the server side.
+// The opened entities under the directory are renamed with their cache
+// files, and the other cache files under the directory are removed since
+// they are not referred to any more.
+//
+void FdManager::RenameDirectory(const std::string &from, const std::string &to)
+{
+    std::string from_prefix = from;
+    std::string to_prefix   = to;
+    if(from_prefix.empty() || '/' != *from_prefix.rbegin()){
+        from_prefix += "/";
+    }
+    if(to_prefix.empty() || '/' != *to_prefix.rbegin()){
+        to_prefix += "/";
+    }
+    if(FdManager::IsCacheDir() && FdManager::is_hashed_dir){
+        FdManager::LoadHashedKeys();
+    }
+
+    AutoLock auto_lock(&FdManager::fd_manager_lock);
+
+    UpdateEntityToTempPath();
+
+    // retrieve the entities under the directory from map
+    std::list<FdEntity*> ents;
+    for(fdent_map_t::iterator iter = fent.begin(); iter != fent.end(); ){
+        if(iter->second && is_prefix(iter->second->GetPath(), from_prefix.c_str())){
+            if(ents.end() == std::find(ents.begin(), ents.end(), iter->second)){
+                ents.push_back(iter->second);
+            }
+            fent.erase(iter++);
+        }else{
+            ++iter;
+        }
+    }
+
+    for(std::list<FdEntity*>::iterator iter = ents.begin(); iter != ents.end(); ++iter){
+        std::string oldpath = (*iter)->GetPath();
+        std::string newpath = to_prefix + oldpath.substr(from_prefix.length());
+
+        S3FS_PRN_DBG("[from=%s][to=%s]", oldpath.c_str(), newpath.c_str());
+
+        // rename path and caches in fd entity
+        std::string fentmapkey;
+        if(!(*iter)->RenamePath(newpath, fentmapkey)){
+            S3FS_PRN_ERR("Failed to rename FdEntity object for %s to %s", oldpath.c_str(), newpath.c_str());
+            continue;
+        }
+        // set new fd entity to map
+        fent[fentmapkey] = *iter;
+        ++fent_generation;
+
+        if(FdManager::is_hashed_dir){
+            FdManager::EraseHashedKey(oldpath);
+            FdManager::AddHashedKey(newpath);
+        }
+    }
+
+    // remove the cache files which are left under the directory
+    if(FdManager::IsCacheDir()){
+        std::string cache_path;
+        struct stat st;
+        if(FdManager::MakeCacheTreePath(from.c_str(), cache_path, false, false, false) && !cache_path.empty() && 0 == stat(cache_path.c_str(), &st)){
+            CacheTrash::Remove(cache_path.c_str());
+        }
+        CacheFileStat::DeleteCacheFileStatDirectory(from.c_str());
+
+        if(FdManager::is_hashed_dir){
+            DeleteHashedCacheFiles(from_prefix);
+        }
+
+        if(ChunkCache::IsEnable()){
+            ChunkCache::DeleteChunkDirectory(from.c_str());
+        }
     }
 }
 
@@ -863,7 +1191,27 @@ void FdManager::CleanupCacheDir()
 
     if(auto_lock_no_wait.isLockAcquired()){
         //S3FS_PRN_DBG("cache cleanup started");
-        CleanupCacheDirInternal("");
+        if(ChunkCache::IsEnable()){
+            ChunkCache::Cleanup();
+        }else{
+            std::string           top_path;
+            struct stat           st;
+            std::set<std::string> opened_paths;
+            unsigned long         generation = 0;
+            if(FdManager::is_hashed_dir){
+                // the cache files which are left in the mirrored layout are removed at first.
+                if(FdManager::MakeCacheTreePath(NULL, top_path, false, false, false) && 0 == stat(top_path.c_str(), &st)){
+                    CleanupCacheDirInternal(top_path, "", false, opened_paths, generation);
+                }
+
+                AutoLock auto_lock(&FdManager::fd_manager_lock);
+                MakeOpenedHashedPaths(opened_paths);
+                generation = fent_generation;
+            }
+            if(FdManager::MakeCachePath(NULL, top_path, false) && 0 == stat(top_path.c_str(), &st)){
+                CleanupCacheDirInternal(top_path, "", FdManager::is_hashed_dir, opened_paths, generation);
+            }
+        }
         //S3FS_PRN_DBG("cache cleanup ended");
     }else{
         // wait for other thread to finish cache cleanup
@@ -871,11 +1219,16 @@ void FdManager::CleanupCacheDir()
     }
 }
 
-void FdManager::CleanupCacheDirInternal(const std::string &path)
+//
+// In the hashed layout, opened_paths are the paths of the cache files of
+// the opened entities, which are made before the walk. They are made
+// again only when an entity is added to fent during the walk.
+//
+void FdManager::CleanupCacheDirInternal(const std::string& top_path, const std::string &path, bool is_hashed, std::set<std::string>& opened_paths, unsigned long& generation)
 {
     DIR*           dp;
     struct dirent* dent;
-    std::string    abs_path = cache_dir + "/" + S3fsCred::GetBucket() + path;
+    std::string    abs_path = top_path + path;
 
     if(NULL == (dp = opendir(abs_path.c_str()))){
         S3FS_PRN_ERR("could not open cache dir(%s) - errno(%d)", abs_path.c_str(), errno);
@@ -897,7 +1250,7 @@ void FdManager::CleanupCacheDirInternal(const std::string &path)
         }
         std::string next_path = path + "/" + dent->d_name;
         if(S_ISDIR(st.st_mode)){
-            CleanupCacheDirInternal(next_path);
+            CleanupCacheDirInternal(top_path, next_path, is_hashed, opened_paths, generation);
         }else{
             AutoLock auto_lock(&FdManager::fd_manager_lock, AutoLock::NO_WAIT);
             if (!auto_lock.isLockAcquired()) {
@@ -907,16 +1260,139 @@ void FdManager::CleanupCacheDirInternal(const std::string &path)
 
             UpdateEntityToTempPath();
 
-            fdent_map_t::iterator iter = fent.find(next_path);
-            if(fent.end() == iter) {
+            if(is_hashed){
+                if(generation != fent_generation){
+                    MakeOpenedHashedPaths(opened_paths);
+                    generation = fent_generation;
+                }
+                if(opened_paths.end() == opened_paths.find(next_path)){
+                    S3FS_PRN_DBG("cleaned up: %s", next_path.c_str());
+                    FdManager::DeleteHashedCacheFile(next_path);
+                }
+            }else if(FdManager::is_hashed_dir){
+                // the cache file in the mirrored layout is not opened in the hashed layout.
                 S3FS_PRN_DBG("cleaned up: %s", next_path.c_str());
-                FdManager::DeleteCacheFile(next_path.c_str());
+                if(0 != unlink(fullpath.c_str()) && ENOENT != errno){
+                    S3FS_PRN_ERR("failed to delete file(%s): errno=%d", fullpath.c_str(), errno);
+                }
+                CacheFileStat::DeleteCacheFileStat(next_path.c_str(), false);
+            }else{
+                fdent_map_t::iterator iter = fent.find(next_path);
+                if(fent.end() == iter) {
+                    S3FS_PRN_DBG("cleaned up: %s", next_path.c_str());
+                    FdManager::DeleteCacheFile(next_path.c_str());
+                }
             }
         }
     }
     closedir(dp);
 }
 
+//
+// Makes the paths under the top directory of the hashed layout of the
+// cache files which are used by the opened entities.
+// The caller must hold fd_manager_lock.
+//
+void FdManager::MakeOpenedHashedPaths(std::set<std::string>& opened_paths)
+{
+    opened_paths.clear();
+    for(fdent_map_t::const_iterator iter = fent.begin(); iter != fent.end(); ++iter){
+        opened_paths.insert(FdManager::MakeHashedSubPath(iter->first.c_str()));
+    }
+}
+
+void FdManager::AddHashedKey(const std::string& path)
+{
+    AutoLock auto_lock(&FdManager::hashed_keys_lock);
+    FdManager::hashed_keys.insert(path);
+}
+
+void FdManager::EraseHashedKey(const std::string& path)
+{
+    AutoLock auto_lock(&FdManager::hashed_keys_lock);
+    FdManager::hashed_keys.erase(path);
+}
+
+// [NOTE]
+// The object paths of the cache files in the hashed layout are kept in
+// hashed_keys, since they can not be found by the directory. The cache
+// files which are left by the previous mount are read from the stat files
+// only once, at the first time they are needed.
+//
+void FdManager::LoadHashedKeys()
+{
+    {
+        AutoLock auto_lock(&FdManager::hashed_keys_lock);
+        if(FdManager::is_hashed_keys_loaded){
+            return;
+        }
+    }
+    hashedkey_set_t keys;
+    FdManager::RawLoadHashedKeys("", keys);
+
+    AutoLock auto_lock(&FdManager::hashed_keys_lock);
+    FdManager::hashed_keys.insert(keys.begin(), keys.end());
+    FdManager::is_hashed_keys_loaded = true;
+}
+
+void FdManager::RawLoadHashedKeys(const std::string& sub_path, hashedkey_set_t& keys)
+{
+    DIR*           dp;
+    struct dirent* dent;
+    std::string    abs_path = CacheFileStat::GetCacheFileStatTopDir(true) + sub_path;
+
+    if(NULL == (dp = opendir(abs_path.c_str()))){
+        if(ENOENT != errno){
+            S3FS_PRN_ERR("could not open cache stat dir(%s) - errno(%d)", abs_path.c_str(), errno);
+        }
+        return;
+    }
+
+    for(dent = readdir(dp); dent; dent = readdir(dp)){
+        if(0 == strcmp(dent->d_name, "..") || 0 == strcmp(dent->d_name, ".")){
+            continue;
+        }
+        std::string next_path = sub_path + "/" + dent->d_name;
+        std::string fullpath  = abs_path + "/" + dent->d_name;
+        struct stat st;
+        if(0 != lstat(fullpath.c_str(), &st)){
+            continue;
+        }
+        std::string key;
+        if(S_ISDIR(st.st_mode)){
+            FdManager::RawLoadHashedKeys(next_path, keys);
+        }else if(CacheFileStat::GetCacheFileStatKey(fullpath.c_str(), key)){
+            keys.insert(key);
+        }
+    }
+    closedir(dp);
+}
+
+//
+// Removes the cache files of the objects under the prefix in the hashed
+// layout, which are not opened.
+// The caller must hold fd_manager_lock, and hashed_keys must be loaded.
+//
+void FdManager::DeleteHashedCacheFiles(const std::string& prefix)
+{
+    std::list<std::string> paths;
+    {
+        AutoLock auto_lock(&FdManager::hashed_keys_lock);
+        for(hashedkey_set_t::iterator iter = FdManager::hashed_keys.lower_bound(prefix); iter != FdManager::hashed_keys.end() && is_prefix(iter->c_str(), prefix.c_str()); ){
+            if(fent.end() == fent.find(*iter)){
+                paths.push_back(*iter);
+                FdManager::hashed_keys.erase(iter++);
+            }else{
+                ++iter;
+            }
+        }
+    }
+    for(std::list<std::string>::const_iterator iter = paths.begin(); iter != paths.end(); ++iter){
+        S3FS_PRN_DBG("removed cache file: %s", iter->c_str());
+        FdManager::DeleteHashedCacheFile(FdManager::MakeHashedSubPath(iter->c_str()));
+    }
+}
+
 bool FdManager::ReserveDiskSpace(off_t size)
 {
     if(IsSafeDiskSpace(NULL, size)){
@@ -1005,6 +1481,16 @@ bool FdManager::RawCheckAllCache(FILE* fp, const char* cache_stat_top_dir, const
             std::string cache_path;
             std::string object_file_path = sub_path;
             object_file_path       += pdirent->d_name;
+            if(FdManager::is_hashed_dir){
+                // the object path is read from the stat file in the hashed layout
+                std::string sfile_path = std::string(cache_stat_top_dir) + object_file_path;
+                if(!CacheFileStat::GetCacheFileStatKey(sfile_path.c_str(), object_file_path)){
+                    ++err_file_cnt;
+                    S3FS_PRN_CACHE(fp, CACHEDBG_FMT_FILE_PROB, sfile_path.c_str(), strOpenedWarn.c_str());
+                    S3FS_PRN_CACHE(fp, CACHEDBG_FMT_CRIT_HEAD, "Could not read object path from cache file stats");
+                    continue;
+                }
+            }
             if(!FdManager::MakeCachePath(object_file_path.c_str(), cache_path, false, false) || cache_path.empty()){
                 ++err_file_cnt;
                 S3FS_PRN_CACHE(fp, CACHEDBG_FMT_FILE_PROB, object_file_path.c_str(), strOpenedWarn.c_str());
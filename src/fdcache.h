@@ -21,7 +21,16 @@
 #ifndef S3FS_FDCACHE_H_
 #define S3FS_FDCACHE_H_
 
+#include <set>
+
 #include "fdcache_entity.h"
+#include "fdcache_chunk.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+typedef std::map<std::string, std::string> keepcache_map_t;    // key=path, value=etag and size at the last opening
+typedef std::set<std::string>              hashedkey_set_t;    // object paths which have the cache files in the hashed layout
 
 //------------------------------------------------
 // class FdManager
@@ -30,10 +39,12 @@ class FdManager
 {
   private:
       static FdManager       singleton;
-      static pthread_mutex_t fd_manager_lock;
-      static pthread_mutex_t cache_cleanup_lock;
-      static pthread_mutex_t reserved_diskspace_lock;
-      static pthread_mutex_t except_entmap_lock;
+      static named_mutex     fd_manager_lock;
+      static named_mutex     cache_cleanup_lock;
+      static named_mutex     reserved_diskspace_lock;
+      static named_mutex     except_entmap_lock;
+      static named_mutex     keep_cache_lock;
+      static named_mutex     hashed_keys_lock;
       static bool            is_lock_init;
       static std::string     cache_dir;
       static bool            check_cache_dir_exist;
@@ -43,8 +54,14 @@ class FdManager
       static bool            checked_lseek;
       static bool            have_lseek_hole;
       static std::string     tmp_dir;
+      static bool            is_keep_cache;
+      static bool            is_hashed_dir;
+      static keepcache_map_t keep_cache_map;        // protected by keep_cache_lock
+      static hashedkey_set_t hashed_keys;           // protected by hashed_keys_lock
+      static bool            is_hashed_keys_loaded; // protected by hashed_keys_lock
 
       fdent_map_t            fent;
+      unsigned long          fent_generation;       // counted up when a path is added to fent, protected by fd_manager_lock
 
       // A map of delayed deletion fdentity, see https://github.com/s3fs-fuse/s3fs-fuse/pull/2478
       fdent_direct_map_t     except_fent;
@@ -54,8 +71,18 @@ class FdManager
       static bool IsDir(const std::string* dir);
       static int GetVfsStat(const char* path, struct statvfs* vfsbuf);
 
+      static bool MakeCacheTreePath(const char* path, std::string& cache_path, bool is_create_dir, bool is_mirror_path, bool is_hashed);
+      static bool MigrateCacheFile(const char* path);
+      static bool DeleteHashedCacheFile(const std::string& sub_path);
+      static void AddHashedKey(const std::string& path);
+      static void EraseHashedKey(const std::string& path);
+      static void LoadHashedKeys();
+      static void RawLoadHashedKeys(const std::string& sub_path, hashedkey_set_t& keys);
+
       int GetPseudoFdCount(const char* path);
-      void CleanupCacheDirInternal(const std::string &path = "");
+      void MakeOpenedHashedPaths(std::set<std::string>& opened_paths);
+      void CleanupCacheDirInternal(const std::string& top_path, const std::string &path, bool is_hashed, std::set<std::string>& opened_paths, unsigned long& generation);
+      void DeleteHashedCacheFiles(const std::string& prefix);
       bool RawCheckAllCache(FILE* fp, const char* cache_stat_top_dir, const char* sub_path, int& total_file_cnt, int& err_file_cnt, int& err_dir_cnt);
 
   public:
@@ -70,10 +97,14 @@ class FdManager
       static int DeleteCacheFile(const char* path);
       static bool SetCacheDir(const char* dir);
       static bool IsCacheDir() { return !FdManager::cache_dir.empty(); }
+      static bool UseCacheFile() { return FdManager::IsCacheDir() && !ChunkCache::IsEnable(); }
       static const char* GetCacheDir() { return FdManager::cache_dir.c_str(); }
       static bool SetCacheCheckOutput(const char* path);
       static const char* GetCacheCheckOutput() { return FdManager::check_cache_output.c_str(); }
       static bool MakeCachePath(const char* path, std::string& cache_path, bool is_create_dir = true, bool is_mirror_path = false);
+      static bool SetHashedDir(bool flag);
+      static bool IsHashedDir() { return FdManager::is_hashed_dir; }
+      static std::string MakeHashedSubPath(const char* path);
       static bool CheckCacheTopDir();
       static bool MakeRandomTempPath(const char* path, std::string& tmppath);
       static bool SetCheckCacheDirExist(bool is_check);
@@ -92,6 +123,9 @@ class FdManager
       static bool CheckTmpDirExist();
       static FILE* MakeTempFile();
       static off_t GetTotalDiskSpaceByRatio(int ratio);
+      static bool SetKeepCache(bool flag);
+      static bool IsKeepCache() { return FdManager::is_keep_cache; }
+      static bool CheckKeepCache(const char* path, const headers_t& meta, off_t size);
 
       // Return FdEntity associated with path, returning NULL on error.  This operation increments the reference count; callers must decrement via Close after use.
       FdEntity* GetFdEntity(const char* path, int& existfd, bool newfd = true, bool lock_already_held = false);
@@ -99,6 +133,7 @@ class FdManager
       FdEntity* GetExistFdEntity(const char* path, int existfd = -1);
       FdEntity* OpenExistFdEntity(const char* path, int& fd, int flags = O_RDONLY);
       void Rename(const std::string &from, const std::string &to);
+      void RenameDirectory(const std::string &from, const std::string &to);
       bool Close(FdEntity* ent, int fd);
       bool ChangeEntityToTempPath(FdEntity* ent, const char* path);
       bool UpdateEntityToTempPath();
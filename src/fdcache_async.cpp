@@ -0,0 +1,348 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+
+#include "s3fs_logger.h"
+#include "fdcache_async.h"
+#include "fdcache.h"
+#include "cache.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// AsyncCloseMan class variables
+//------------------------------------------------
+AsyncCloseMan*       AsyncCloseMan::singleton = NULL;
+asyncclose_done_func AsyncCloseMan::done_func = NULL;
+
+//------------------------------------------------
+// AsyncCloseMan class methods
+//------------------------------------------------
+bool AsyncCloseMan::Initialize(int count, asyncclose_done_func func)
+{
+    if(count < 1){
+        S3FS_PRN_ERR("The thread count(%d) for async close is under 1.", count);
+        return false;
+    }
+    if(AsyncCloseMan::singleton){
+        S3FS_PRN_WARN("Already singleton for async close is existed, then re-create it.");
+        AsyncCloseMan::Destroy();
+    }
+    AsyncCloseMan::done_func = func;
+    AsyncCloseMan::singleton = new AsyncCloseMan(count);
+    return true;
+}
+
+void AsyncCloseMan::Destroy()
+{
+    if(AsyncCloseMan::singleton){
+        // uploads all files which are not uploaded yet.
+        AsyncCloseMan::singleton->WaitJobs(NULL);
+
+        long uploaded = 0;
+        long failed   = 0;
+        long inflight = 0;
+        AsyncCloseMan::GetStats(uploaded, failed, inflight);
+        S3FS_PRN_INFO("async close finished: uploaded=%ld, failed=%ld", uploaded, failed);
+
+        delete AsyncCloseMan::singleton;
+        AsyncCloseMan::singleton = NULL;
+    }
+}
+
+bool AsyncCloseMan::Instruct(FdEntity* ent, int pseudo_fd, const char* path)
+{
+    if(!AsyncCloseMan::singleton){
+        return false;
+    }
+    if(!ent || -1 == pseudo_fd){
+        return false;
+    }
+    return AsyncCloseMan::singleton->SetJob(new asyncclose_job(ent, pseudo_fd, path));
+}
+
+// [NOTE]
+// The caller must keep the entity opened while waiting.
+//
+void AsyncCloseMan::Wait(FdEntity* ent)
+{
+    if(!AsyncCloseMan::singleton || !ent){
+        return;
+    }
+    AsyncCloseMan::singleton->WaitJobs(ent);
+}
+
+bool AsyncCloseMan::IsPending(FdEntity* ent)
+{
+    if(!AsyncCloseMan::singleton || !ent){
+        return false;
+    }
+    AutoLock auto_lock(&(AsyncCloseMan::singleton->asyncclose_lock));
+
+    return (AsyncCloseMan::singleton->pending.end() != AsyncCloseMan::singleton->pending.find(ent));
+}
+
+//
+// Returns the current paths of the entities whose uploads are deferred.
+//
+bool AsyncCloseMan::GetPendingPaths(std::list<std::string>& paths)
+{
+    paths.clear();
+    if(!AsyncCloseMan::singleton){
+        return false;
+    }
+    AutoLock auto_lock(&(AsyncCloseMan::singleton->asyncclose_lock));
+
+    for(asyncclose_pending_t::const_iterator iter = AsyncCloseMan::singleton->pending.begin(); iter != AsyncCloseMan::singleton->pending.end(); ++iter){
+        paths.push_back(iter->first->GetPath());
+    }
+    return true;
+}
+
+bool AsyncCloseMan::GetStats(long& uploaded, long& failed, long& inflight)
+{
+    if(!AsyncCloseMan::singleton){
+        return false;
+    }
+    AutoLock auto_lock(&(AsyncCloseMan::singleton->asyncclose_lock));
+
+    uploaded = AsyncCloseMan::singleton->uploaded_count;
+    failed   = AsyncCloseMan::singleton->failed_count;
+    inflight = 0;
+    for(asyncclose_pending_t::const_iterator iter = AsyncCloseMan::singleton->pending.begin(); iter != AsyncCloseMan::singleton->pending.end(); ++iter){
+        inflight += iter->second;
+    }
+    return true;
+}
+
+//
+// Thread worker
+//
+void* AsyncCloseMan::Worker(void* arg)
+{
+    AsyncCloseMan* psingleton = static_cast<AsyncCloseMan*>(arg);
+
+    if(!psingleton){
+        S3FS_PRN_ERR("The parameter for worker thread is invalid.");
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in AsyncCloseMan.");
+
+    while(true){
+        psingleton->asyncclose_sem.wait();
+
+        asyncclose_job* pjob = NULL;
+        {
+            AutoLock auto_lock(&(psingleton->asyncclose_lock));
+
+            if(!psingleton->job_list.empty()){
+                pjob = psingleton->job_list.front();
+                psingleton->job_list.pop_front();
+            }else if(psingleton->is_exit){
+                break;
+            }
+        }
+        if(pjob){
+            psingleton->RunJob(pjob);
+            delete pjob;
+        }
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// AsyncCloseMan methods
+//------------------------------------------------
+AsyncCloseMan::AsyncCloseMan(int count) : is_exit(false), asyncclose_sem(0), uploaded_count(0), failed_count(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&asyncclose_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init asyncclose_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&asyncclose_lock, "AsyncCloseMan::asyncclose_lock");
+
+    if(!StartThreads(count)){
+        S3FS_PRN_ERR("Failed starting threads at initializing.");
+        abort();
+    }
+}
+
+AsyncCloseMan::~AsyncCloseMan()
+{
+    StopThreads();
+
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&asyncclose_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy asyncclose_lock: %d", result);
+        abort();
+    }
+}
+
+bool AsyncCloseMan::StartThreads(int count)
+{
+    AutoLock auto_lock(&asyncclose_lock);
+
+    is_exit = false;
+    for(int cnt = 0; cnt < count; ++cnt){
+        pthread_t thread;
+        int       result;
+        if(0 != (result = pthread_create(&thread, NULL, AsyncCloseMan::Worker, static_cast<void*>(this)))){
+            S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+            return false;
+        }
+        thread_list.push_back(thread);
+    }
+    return true;
+}
+
+bool AsyncCloseMan::StopThreads()
+{
+    std::list<pthread_t> threads;
+    {
+        AutoLock auto_lock(&asyncclose_lock);
+
+        is_exit = true;
+        threads.swap(thread_list);
+    }
+    for(size_t waitcnt = threads.size(); 0 < waitcnt; --waitcnt){
+        asyncclose_sem.post();
+    }
+
+    // wait for threads exiting
+    for(std::list<pthread_t>::const_iterator iter = threads.begin(); iter != threads.end(); ++iter){
+        void* retval = NULL;
+        int   result = pthread_join(*iter, &retval);
+        if(result){
+            S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+        }else{
+            S3FS_PRN_DBG("succeed pthread_join - return code(%ld)", reinterpret_cast<long>(retval));
+        }
+    }
+
+    // [NOTE]
+    // The jobs which are left here have never been run, then the pseudo
+    // fds are only closed.
+    AutoLock auto_lock(&asyncclose_lock);
+    for(asyncclose_jobs_t::iterator iter = job_list.begin(); iter != job_list.end(); ++iter){
+        S3FS_PRN_ERR("The file(%s) was not uploaded before exiting.", (*iter)->path.c_str());
+        FdManager::get()->Close((*iter)->ent, (*iter)->pseudo_fd);
+        delete *iter;
+    }
+    job_list.clear();
+    pending.clear();
+
+    return true;
+}
+
+bool AsyncCloseMan::SetJob(asyncclose_job* pjob)
+{
+    {
+        AutoLock auto_lock(&asyncclose_lock);
+
+        if(is_exit){
+            delete pjob;
+            return false;
+        }
+        job_list.push_back(pjob);
+        ++pending[pjob->ent];
+    }
+    S3FS_PRN_INFO3("Deferred upload[path=%s][pseudo_fd=%d]", pjob->path.c_str(), pjob->pseudo_fd);
+
+    asyncclose_sem.post();
+    return true;
+}
+
+void AsyncCloseMan::RunJob(asyncclose_job* pjob)
+{
+    S3FS_PRN_INFO3("Start deferred upload[path=%s][pseudo_fd=%d]", pjob->path.c_str(), pjob->pseudo_fd);
+
+    // [NOTE]
+    // The path of the entity may be changed by rename while waiting,
+    // then the current path is used.
+    std::string path = pjob->ent->GetPath();
+    int         result;
+    if(0 != (result = pjob->ent->Flush(pjob->pseudo_fd, false))){
+        S3FS_PRN_ERR("failed to upload file(%s) after closing: result=%d", path.c_str(), result);
+    }
+
+    // the stat cache entry which is kept for the local file is released
+    // after the upload, as s3fs_release does without async close.
+    StatCache::getStatCacheData()->ChangeNoTruncateFlag(path, false);
+    StatCache::getStatCacheData()->DelStat(path);
+    if(AsyncCloseMan::done_func){
+        (*AsyncCloseMan::done_func)(path.c_str());
+    }
+    FdManager::get()->Close(pjob->ent, pjob->pseudo_fd);
+
+    AutoLock auto_lock(&asyncclose_lock);
+
+    if(0 != result){
+        ++failed_count;
+    }else{
+        ++uploaded_count;
+    }
+    asyncclose_pending_t::iterator piter = pending.find(pjob->ent);
+    if(piter != pending.end() && 0 >= --(piter->second)){
+        pending.erase(piter);
+    }
+
+    // wake up waiters which have no pending jobs now
+    for(asyncclose_waiters_t::iterator iter = waiters.begin(); iter != waiters.end(); ){
+        if((NULL == (*iter)->ent && pending.empty()) || (NULL != (*iter)->ent && pending.end() == pending.find((*iter)->ent))){
+            (*iter)->psem->post();
+            iter = waiters.erase(iter);
+        }else{
+            ++iter;
+        }
+    }
+}
+
+void AsyncCloseMan::WaitJobs(FdEntity* ent)
+{
+    Semaphore         sem(0);
+    asyncclose_waiter waiter(ent, &sem);
+    {
+        AutoLock auto_lock(&asyncclose_lock);
+
+        if((NULL == ent && pending.empty()) || (NULL != ent && pending.end() == pending.find(ent))){
+            return;
+        }
+        waiters.push_back(&waiter);
+    }
+    sem.wait();
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
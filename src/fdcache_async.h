@@ -0,0 +1,133 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_FDCACHE_ASYNC_H_
+#define S3FS_FDCACHE_ASYNC_H_
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+#include "psemaphore.h"
+#include "fdcache_entity.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+//
+// Deferred upload for one closed pseudo fd
+//
+struct asyncclose_job
+{
+    FdEntity*   ent;
+    int         pseudo_fd;
+    std::string path;
+
+    asyncclose_job(FdEntity* pent, int fd, const char* tpath) : ent(pent), pseudo_fd(fd), path(tpath ? tpath : "") {}
+};
+
+typedef std::list<asyncclose_job*>  asyncclose_jobs_t;
+typedef std::map<FdEntity*, int>    asyncclose_pending_t;
+
+//
+// Function which is called with the path after its deferred upload
+//
+typedef void (*asyncclose_done_func)(const char* path);
+
+//
+// Thread waiting for finishing the uploads of an entity(or all entities if ent is NULL)
+//
+struct asyncclose_waiter
+{
+    FdEntity*  ent;
+    Semaphore* psem;
+
+    asyncclose_waiter(FdEntity* pent, Semaphore* sem) : ent(pent), psem(sem) {}
+};
+
+typedef std::list<asyncclose_waiter*>   asyncclose_waiters_t;
+
+//------------------------------------------------
+// Class AsyncCloseMan
+//------------------------------------------------
+// [NOTE]
+// When the async_close option is specified, s3fs_release does not
+// upload the modified file, but hands its pseudo fd to this class and
+// returns at once. The worker threads upload the file and close the
+// pseudo fd after that.
+// Since the pseudo fd stays open until the upload is finished, the
+// entity is kept in FdManager, and its stat cache entry keeps the no
+// truncate flag until then, so reopen/stat/readdir/rename see the local
+// file during the upload. The flag is cleared after the upload.
+// Wait() is the barrier for fsync and for the operations which need
+// the object on the server to be up to date.
+// Failed uploads are logged and counted.
+//
+class AsyncCloseMan
+{
+    private:
+        static AsyncCloseMan*   singleton;
+        static asyncclose_done_func done_func;
+
+        bool                    is_exit;
+        Semaphore               asyncclose_sem;
+
+        named_mutex             asyncclose_lock;        // protects all of the following members
+        std::list<pthread_t>    thread_list;
+        asyncclose_jobs_t       job_list;
+        asyncclose_pending_t    pending;
+        asyncclose_waiters_t    waiters;
+        long                    uploaded_count;
+        long                    failed_count;
+
+    private:
+        static void* Worker(void* arg);
+
+        explicit AsyncCloseMan(int count);
+        ~AsyncCloseMan();
+
+        bool StartThreads(int count);
+        bool StopThreads();
+        bool SetJob(asyncclose_job* pjob);
+        void RunJob(asyncclose_job* pjob);
+        void WaitJobs(FdEntity* ent);
+
+    public:
+        static bool Initialize(int count, asyncclose_done_func func);
+        static void Destroy();
+        static bool IsEnable() { return (NULL != AsyncCloseMan::singleton); }
+        static bool Instruct(FdEntity* ent, int pseudo_fd, const char* path);
+        static void Wait(FdEntity* ent);
+        static bool IsPending(FdEntity* ent);
+        static bool GetPendingPaths(std::list<std::string>& paths);
+        static bool GetStats(long& uploaded, long& failed, long& inflight);
+};
+
+#endif // S3FS_FDCACHE_ASYNC_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,591 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "s3fs_logger.h"
+#include "fdcache_chunk.h"
+#include "fdcache_chunk_compress.h"
+#include "fdcache.h"
+#include "fdcache_trash.h"
+#include "s3fs_util.h"
+#include "s3fs_cred.h"
+#include "string_util.h"
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char CHUNK_ETAG_FILE[]     = "#etag";
+static const char CHUNK_LOCK_FILE[]     = "#lock";
+static const char CHUNK_FILE_PREFIX[]   = "#";
+static const char CHUNK_ESCAPE_PREFIX[] = "##";
+static const char CHUNK_TMPFILE_FORM[]  = "/#tmp.XXXXXX";
+static const char CHUNK_COMPRESS_SUFFIX[] = ".z";
+
+// [NOTE]
+// The open file description locks are used if they are supported, because
+// the process-associated locks are shared by all threads(entities) in
+// the process and are released by closing any descriptor of the file.
+//
+#ifdef F_OFD_SETLKW
+#define CHUNK_SETLK     F_OFD_SETLK
+#define CHUNK_SETLKW    F_OFD_SETLKW
+#else
+#define CHUNK_SETLK     F_SETLK
+#define CHUNK_SETLKW    F_SETLKW
+#endif
+
+//------------------------------------------------
+// ChunkCache class variables
+//------------------------------------------------
+bool  ChunkCache::is_enable  = false;
+bool  ChunkCache::is_shared  = false;
+bool  ChunkCache::is_compress = false;
+off_t ChunkCache::chunk_size = ChunkCache::DEFAULT_CHUNK_SIZE;
+const off_t ChunkCache::DEFAULT_CHUNK_SIZE;
+
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+static bool write_all(int fd, const char* buf, size_t size)
+{
+    for(size_t total = 0; total < size; ){
+        ssize_t bytes = write(fd, buf + total, size - total);
+        if(-1 == bytes){
+            if(EINTR == errno){
+                continue;
+            }
+            return false;
+        }
+        total += bytes;
+    }
+    return true;
+}
+
+// write the data into the temporary file and rename it to the path
+static bool write_file_atomic(const std::string& dir_path, const std::string& file_path, const char* buf, size_t size)
+{
+    std::string tmppath = dir_path + CHUNK_TMPFILE_FORM;
+    char*       ptmppath = strdup(tmppath.c_str());
+    int         fd;
+    if(-1 == (fd = mkstemp(ptmppath))){
+        S3FS_PRN_ERR("failed to create temporary file in %s by errno(%d)", dir_path.c_str(), errno);
+        free(ptmppath);
+        return false;
+    }
+    if(!write_all(fd, buf, size)){
+        S3FS_PRN_ERR("failed to write temporary file(%s) by errno(%d)", ptmppath, errno);
+        close(fd);
+        unlink(ptmppath);
+        free(ptmppath);
+        return false;
+    }
+    close(fd);
+
+    if(-1 == rename(ptmppath, file_path.c_str())){
+        S3FS_PRN_ERR("failed to rename %s to %s by errno(%d)", ptmppath, file_path.c_str(), errno);
+        unlink(ptmppath);
+        free(ptmppath);
+        return false;
+    }
+    free(ptmppath);
+    return true;
+}
+
+static bool read_all(int fd, char* buf, size_t size, off_t start = 0)
+{
+    for(size_t total = 0; total < size; ){
+        ssize_t bytes = pread(fd, buf + total, size - total, start + total);
+        if(-1 == bytes){
+            if(EINTR == errno){
+                continue;
+            }
+            return false;
+        }
+        if(0 == bytes){
+            return false;
+        }
+        total += bytes;
+    }
+    return true;
+}
+
+// [NOTE]
+// The path components which start with "#" are escaped by one more "#",
+// so that the directory of the object is never same as the chunk files
+// ("#etag", "#lock", "#<index>" and the temporary files) of its parent.
+//
+static std::string escape_chunk_path(const std::string& path)
+{
+    std::string result;
+    for(std::string::size_type pos = 0; pos < path.length(); ++pos){
+        if('#' == path[pos] && (0 == pos || '/' == path[pos - 1])){
+            result += '#';
+        }
+        result += path[pos];
+    }
+    return result;
+}
+
+static bool compare_chunk_mtime(const chunk_file_info& src1, const chunk_file_info& src2)
+{
+    return src1.mtime < src2.mtime;
+}
+
+//------------------------------------------------
+// ChunkCache class methods
+//------------------------------------------------
+bool ChunkCache::SetEnable(bool enable)
+{
+    bool old = ChunkCache::is_enable;
+    ChunkCache::is_enable = enable;
+    return old;
+}
+
+bool ChunkCache::SetShared(bool shared)
+{
+    bool old = ChunkCache::is_shared;
+    ChunkCache::is_shared = shared;
+    return old;
+}
+
+bool ChunkCache::SetCompress(bool compress)
+{
+    bool old = ChunkCache::is_compress;
+    ChunkCache::is_compress = compress;
+    return old;
+}
+
+bool ChunkCache::CanCompress()
+{
+    return ChunkCompress::IsSupported();
+}
+
+bool ChunkCache::SetChunkSize(off_t size)
+{
+    if(size < 1){
+        return false;
+    }
+    ChunkCache::chunk_size = size;
+    return true;
+}
+
+std::string ChunkCache::GetChunkTopDir()
+{
+    std::string top_path;
+    if(!FdManager::IsCacheDir() || S3fsCred::GetBucket().empty()){
+        return top_path;
+    }
+    top_path  = FdManager::GetCacheDir();
+    top_path += "/.";
+    top_path += S3fsCred::GetBucket();
+    top_path += ".chunk";
+    return top_path;
+}
+
+bool ChunkCache::MakeChunkDirPath(const char* path, std::string& dir_path, bool is_create_dir)
+{
+    std::string top_path = ChunkCache::GetChunkTopDir();
+    if(top_path.empty() || !path || '\0' == path[0]){
+        return false;
+    }
+    // keyed by the object key, so that the mounts with other prefixes share it
+    dir_path = top_path + escape_chunk_path(get_realpath(path));
+
+    if(is_create_dir){
+        int result;
+        if(0 != (result = mkdirp(dir_path, 0777))){
+            S3FS_PRN_ERR("failed to create dir(%s) by errno(%d).", dir_path.c_str(), result);
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Check the etag and the chunk size of the chunks in the directory.
+// If is_update is true and they are different, all chunks are removed and
+// the new etag is set.
+//
+bool ChunkCache::CheckChunkEtag(const std::string& dir_path, const std::string& etag, bool is_update)
+{
+    std::string etag_path = dir_path + "/" + CHUNK_ETAG_FILE;
+    std::string expect    = etag + " " + str(ChunkCache::chunk_size);
+
+    int fd;
+    if(-1 != (fd = open(etag_path.c_str(), O_RDONLY))){
+        char    buf[256];
+        ssize_t bytes = pread(fd, buf, sizeof(buf) - 1, 0);
+        close(fd);
+        if(0 < bytes){
+            buf[bytes] = '\0';
+            if(expect == buf){
+                return true;
+            }
+        }
+    }
+    if(!is_update){
+        return false;
+    }
+
+    // the chunks are for another object(or another chunk size)
+    ChunkCache::DeleteChunkFiles(dir_path);
+
+    return write_file_atomic(dir_path, etag_path, expect.c_str(), expect.length());
+}
+
+// Remove the chunk files(not sub directories) in the directory.
+// The lock file is not removed, because the other processes may wait for
+// the lock on it(see RemoveFillLock).
+bool ChunkCache::DeleteChunkFiles(const std::string& dir_path)
+{
+    DIR* dp;
+    if(NULL == (dp = opendir(dir_path.c_str()))){
+        return (ENOENT == errno);
+    }
+    bool result = true;
+    for(struct dirent* dent = readdir(dp); dent; dent = readdir(dp)){
+        // the escaped name is the directory of the child object
+        if(!is_prefix(dent->d_name, CHUNK_FILE_PREFIX) || is_prefix(dent->d_name, CHUNK_ESCAPE_PREFIX) || 0 == strcmp(dent->d_name, CHUNK_LOCK_FILE)){
+            continue;
+        }
+        std::string fullpath = dir_path + "/" + dent->d_name;
+        if(0 != unlink(fullpath.c_str()) && ENOENT != errno){
+            S3FS_PRN_ERR("failed to remove chunk file(%s) by errno(%d)", fullpath.c_str(), errno);
+            result = false;
+        }
+    }
+    closedir(dp);
+    return result;
+}
+
+bool ChunkCache::CollectChunkFiles(const std::string& dir_path, chunk_file_list_t& list)
+{
+    DIR* dp;
+    if(NULL == (dp = opendir(dir_path.c_str()))){
+        return false;
+    }
+    for(struct dirent* dent = readdir(dp); dent; dent = readdir(dp)){
+        if(0 == strcmp(dent->d_name, "..") || 0 == strcmp(dent->d_name, ".")){
+            continue;
+        }
+        std::string fullpath = dir_path + "/" + dent->d_name;
+        struct stat st;
+        if(0 != lstat(fullpath.c_str(), &st)){
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)){
+            ChunkCache::CollectChunkFiles(fullpath, list);
+        }else if(is_prefix(dent->d_name, CHUNK_FILE_PREFIX) && 0 != strcmp(dent->d_name, CHUNK_ETAG_FILE) && 0 != strcmp(dent->d_name, CHUNK_LOCK_FILE)){
+            list.push_back(chunk_file_info(fullpath, st.st_mtime, st.st_size));
+        }
+    }
+    closedir(dp);
+    return true;
+}
+
+ssize_t ChunkCache::ReadCompressedChunk(const std::string& chunk_path, off_t chunk_bytes, off_t offset, char* buf, size_t size)
+{
+    if(!ChunkCompress::IsSupported()){
+        return -ENOTSUP;
+    }
+    int fd;
+    if(-1 == (fd = open(chunk_path.c_str(), O_RDONLY))){
+        return -errno;
+    }
+    ssize_t result = ChunkCompress::ReadPart(fd, chunk_bytes, offset, buf, size);
+    if(-EIO == result){
+        // broken chunk
+        S3FS_PRN_WARN("compressed chunk file(%s) is broken or is not %lld bytes, then remove it.", chunk_path.c_str(), static_cast<long long int>(chunk_bytes));
+        close(fd);
+        unlink(chunk_path.c_str());
+        return -EIO;
+    }
+    if(result < 0){
+        close(fd);
+        return result;
+    }
+
+    // update mtime for eviction order
+    futimens(fd, NULL);
+    close(fd);
+
+    return result;
+}
+
+//
+// Read the chunk into buf, the size must be the size of the chunk.
+// Returns the read bytes, or -errno if the chunk is not cached.
+//
+ssize_t ChunkCache::Read(const char* path, const std::string& etag, off_t index, char* buf, size_t size)
+{
+    return ChunkCache::ReadPart(path, etag, index, static_cast<off_t>(size), 0, buf, size);
+}
+
+//
+// Read the part(offset and size in the chunk) of the chunk into buf,
+// chunk_bytes must be the size of the chunk.
+//
+ssize_t ChunkCache::ReadPart(const char* path, const std::string& etag, off_t index, off_t chunk_bytes, off_t offset, char* buf, size_t size)
+{
+    if(offset < 0 || chunk_bytes < offset + static_cast<off_t>(size)){
+        return -EINVAL;
+    }
+    std::string dir_path;
+    if(!ChunkCache::is_enable || etag.empty() || !ChunkCache::MakeChunkDirPath(path, dir_path, false)){
+        return -EINVAL;
+    }
+    if(!ChunkCache::CheckChunkEtag(dir_path, etag, false)){
+        return -ENOENT;
+    }
+    std::string chunk_path = dir_path + "/" + CHUNK_FILE_PREFIX + str(index);
+
+    int fd;
+    if(-1 == (fd = open(chunk_path.c_str(), O_RDONLY))){
+        if(ENOENT == errno){
+            return ChunkCache::ReadCompressedChunk(chunk_path + CHUNK_COMPRESS_SUFFIX, chunk_bytes, offset, buf, size);
+        }
+        return -errno;
+    }
+    struct stat st;
+    if(-1 == fstat(fd, &st) || chunk_bytes != st.st_size){
+        // broken chunk
+        S3FS_PRN_WARN("chunk file(%s) size is not %lld bytes, then remove it.", chunk_path.c_str(), static_cast<long long int>(chunk_bytes));
+        close(fd);
+        unlink(chunk_path.c_str());
+        return -EIO;
+    }
+
+    if(!read_all(fd, buf, size, offset)){
+        S3FS_PRN_ERR("failed to read chunk file(%s) by errno(%d)", chunk_path.c_str(), errno);
+        close(fd);
+        return -EIO;
+    }
+    // update mtime for eviction order
+    futimens(fd, NULL);
+    close(fd);
+
+    return static_cast<ssize_t>(size);
+}
+
+bool ChunkCache::Write(const char* path, const std::string& etag, off_t index, const char* buf, size_t size)
+{
+    std::string dir_path;
+    if(!ChunkCache::is_enable || etag.empty() || !ChunkCache::MakeChunkDirPath(path, dir_path, true)){
+        return false;
+    }
+    if(!ChunkCache::CheckChunkEtag(dir_path, etag, true)){
+        return false;
+    }
+    std::string chunk_path    = dir_path + "/" + CHUNK_FILE_PREFIX + str(index);
+    std::string compress_path = chunk_path + CHUNK_COMPRESS_SUFFIX;
+
+    std::string data;
+    if(ChunkCache::is_compress && ChunkCompress::Compress(buf, size, data)){
+        if(!write_file_atomic(dir_path, compress_path, data.data(), data.size())){
+            return false;
+        }
+        // only one of both is left
+        unlink(chunk_path.c_str());
+        return true;
+    }
+    if(!write_file_atomic(dir_path, chunk_path, buf, size)){
+        return false;
+    }
+    unlink(compress_path.c_str());
+    return true;
+}
+
+bool ChunkCache::DeleteChunks(const char* path)
+{
+    std::string dir_path;
+    if(!ChunkCache::MakeChunkDirPath(path, dir_path, false)){
+        return true;
+    }
+    if(!ChunkCache::DeleteChunkFiles(dir_path)){
+        return false;
+    }
+    // remove the directory if it is empty
+    ChunkCache::RemoveFillLock(dir_path);
+    rmdir(dir_path.c_str());
+    return true;
+}
+
+//
+// Remove the lock file only if no other process locks any chunk on it.
+// The whole file is locked exclusively while removing, and LockFill()
+// does not take the lock on the removed file.
+//
+bool ChunkCache::RemoveFillLock(const std::string& dir_path)
+{
+    std::string lock_path = dir_path + "/" + CHUNK_LOCK_FILE;
+
+    int fd;
+    if(-1 == (fd = open(lock_path.c_str(), O_RDWR))){
+        return (ENOENT == errno);
+    }
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start  = 0;
+    fl.l_len    = 0;        // whole file
+
+    bool result = false;
+    if(-1 != fcntl(fd, CHUNK_SETLK, &fl)){
+        result = (0 == unlink(lock_path.c_str()) || ENOENT == errno);
+    }else{
+        S3FS_PRN_DBG("the chunk lock file(%s) is used by the other, then it is not removed.", lock_path.c_str());
+    }
+    close(fd);
+    return result;
+}
+
+//
+// Remove all chunks under the directory, or all chunks if dirpath is NULL.
+//
+bool ChunkCache::DeleteChunkDirectory(const char* dirpath)
+{
+    std::string top_path = ChunkCache::GetChunkTopDir();
+    if(top_path.empty()){
+        return true;
+    }
+    if(dirpath && '\0' != dirpath[0] && 0 != strcmp(dirpath, "/")){
+        top_path += escape_chunk_path(get_realpath(dirpath));
+    }else if(ChunkCache::is_shared){
+        // the other processes may use the chunks
+        S3FS_PRN_INFO("the chunk cache is shared, then all chunks are not removed.");
+        return true;
+    }
+    struct stat st;
+    if(0 != stat(top_path.c_str(), &st)){
+        return true;
+    }
+    return CacheTrash::Remove(top_path.c_str());
+}
+
+//
+// Evict the chunks in the order of the last access time until the disk
+// space is enough.
+//
+void ChunkCache::Cleanup()
+{
+    std::string top_path = ChunkCache::GetChunkTopDir();
+    if(top_path.empty()){
+        return;
+    }
+    chunk_file_list_t list;
+    if(!ChunkCache::CollectChunkFiles(top_path, list)){
+        return;
+    }
+    list.sort(compare_chunk_mtime);
+
+    size_t count = 0;
+    for(chunk_file_list_t::const_iterator iter = list.begin(); iter != list.end(); ++iter){
+        if(FdManager::IsSafeDiskSpace(NULL, 0)){
+            break;
+        }
+        if(0 == unlink(iter->path.c_str())){
+            ++count;
+        }
+    }
+    S3FS_PRN_INFO("evicted %zu chunk files.", count);
+}
+
+//
+// Open the lock file for filling the chunks of the object.
+// Returns -1 if the cache is not shared or failed to open.
+//
+int ChunkCache::OpenFillLock(const char* path)
+{
+    std::string dir_path;
+    if(!ChunkCache::is_enable || !ChunkCache::is_shared || !ChunkCache::MakeChunkDirPath(path, dir_path, true)){
+        return -1;
+    }
+    std::string lock_path = dir_path + "/" + CHUNK_LOCK_FILE;
+
+    int fd;
+    if(-1 == (fd = open(lock_path.c_str(), O_CREAT | O_RDWR, 0600))){
+        S3FS_PRN_WARN("failed to open chunk lock file(%s) by errno(%d)", lock_path.c_str(), errno);
+        return -1;
+    }
+    return fd;
+}
+
+//
+// Lock the chunk index for filling it.
+// If is_wait is false, returns false at once when the other owns it.
+// The lock is released by CloseFillLock().
+//
+bool ChunkCache::LockFill(int fd, off_t index, bool is_wait)
+{
+    if(-1 == fd){
+        return false;
+    }
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start  = index;
+    fl.l_len    = 1;
+
+    while(-1 == fcntl(fd, (is_wait ? CHUNK_SETLKW : CHUNK_SETLK), &fl)){
+        if(EINTR == errno){
+            continue;
+        }
+        if(EAGAIN != errno && EACCES != errno){
+            S3FS_PRN_WARN("failed to lock the chunk(%lld) by errno(%d)", static_cast<long long int>(index), errno);
+        }
+        return false;
+    }
+
+    // the lock file was removed before locking(see RemoveFillLock)
+    struct stat st;
+    if(-1 == fstat(fd, &st) || 0 == st.st_nlink){
+        S3FS_PRN_DBG("the chunk lock file was removed, then the chunk(%lld) is not owned.", static_cast<long long int>(index));
+        return false;
+    }
+    return true;
+}
+
+void ChunkCache::CloseFillLock(int fd)
+{
+    if(-1 != fd){
+        close(fd);      // release all locks
+    }
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,130 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_FDCACHE_CHUNK_H_
+#define S3FS_FDCACHE_CHUNK_H_
+
+#include <ctime>
+#include <list>
+#include <string>
+#include <sys/types.h>
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+struct chunk_file_info
+{
+    std::string path;
+    time_t      mtime;
+    off_t       size;
+
+    chunk_file_info(const std::string& file_path, time_t file_mtime, off_t file_size) : path(file_path), mtime(file_mtime), size(file_size) {}
+};
+typedef std::list<chunk_file_info> chunk_file_list_t;
+
+//------------------------------------------------
+// Class ChunkCache
+//------------------------------------------------
+// [NOTE]
+// This class is the chunked layout of the local cache(cache_layout=chunk).
+// An object is not cached as one sparse file of the object size, but as
+// fixed size chunk files keyed by (path, etag, chunk index) under the
+// "<cache_dir>/.<bucket>.chunk" directory.
+//
+//   <chunk top dir>/<object path>/#etag           : etag and chunk size of the chunks
+//   <chunk top dir>/<object path>/#<index>        : chunk file
+//
+// The path components of the object which start with "#" are escaped as
+// "##...", then they never conflict with the chunk files.
+//
+// The opened file is read from the chunks directly while the area is not
+// loaded into its temporary file, and its temporary file holds only the
+// written pages and the pages loaded for uploading(the chunks are copied
+// into it before downloading and are saved from it after downloading).
+// The chunk files are written to a temporary file and renamed, so that
+// they can be filled concurrently without any lock over the object, and
+// they can be evicted one by one.
+//
+// When the cache_compress option is specified, the chunk is compressed by
+// zlib in frames(see ChunkCompress) and is saved as "#<index>.z" instead
+// of "#<index>". The chunk which does not become smaller(judged by
+// compressing the head of it at first) is saved without compressing. Both
+// are read regardless of the option.
+//
+// When the cache is shared by some ossfs processes on the host(the
+// cache_shared option), the chunk directories are keyed by the object
+// key in the bucket instead of the mounted path. Each chunk is downloaded
+// by one process which owns the byte range lock of the chunk index on
+// the "#lock" file, and the other processes wait for the lock and read
+// the chunk from the cache. The lock file is left when the chunks are
+// removed, unless no process locks it.
+//
+class ChunkCache
+{
+    private:
+        static bool  is_enable;
+        static bool  is_shared;
+        static bool  is_compress;
+        static off_t chunk_size;
+
+    private:
+        static bool MakeChunkDirPath(const char* path, std::string& dir_path, bool is_create_dir);
+        static bool CheckChunkEtag(const std::string& dir_path, const std::string& etag, bool is_update);
+        static bool DeleteChunkFiles(const std::string& dir_path);
+        static bool RemoveFillLock(const std::string& dir_path);
+        static bool CollectChunkFiles(const std::string& dir_path, chunk_file_list_t& list);
+        static ssize_t ReadCompressedChunk(const std::string& chunk_path, off_t chunk_bytes, off_t offset, char* buf, size_t size);
+
+    public:
+        static const off_t DEFAULT_CHUNK_SIZE = 8 * 1024 * 1024;
+
+        static bool SetEnable(bool enable);
+        static bool IsEnable() { return ChunkCache::is_enable; }
+        static bool SetChunkSize(off_t size);
+        static off_t GetChunkSize() { return ChunkCache::chunk_size; }
+        static bool SetShared(bool shared);
+        static bool IsShared() { return ChunkCache::is_shared; }
+        static bool SetCompress(bool compress);
+        static bool IsCompress() { return ChunkCache::is_compress; }
+        static bool CanCompress();
+        static std::string GetChunkTopDir();
+
+        static ssize_t Read(const char* path, const std::string& etag, off_t index, char* buf, size_t size);
+        static ssize_t ReadPart(const char* path, const std::string& etag, off_t index, off_t chunk_bytes, off_t offset, char* buf, size_t size);
+        static bool Write(const char* path, const std::string& etag, off_t index, const char* buf, size_t size);
+        static bool DeleteChunks(const char* path);
+        static bool DeleteChunkDirectory(const char* dirpath = NULL);
+        static void Cleanup();
+
+        static int OpenFillLock(const char* path);
+        static bool LockFill(int fd, off_t index, bool is_wait);
+        static void CloseFillLock(int fd);
+};
+
+#endif // S3FS_FDCACHE_CHUNK_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,248 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "common.h"
+#include "s3fs_logger.h"
+#include "fdcache_chunk_compress.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char   CHUNK_COMPRESS_MAGIC[] = "OFZ1";
+static const size_t CHUNK_MAGIC_SIZE       = 4;
+static const size_t CHUNK_HEADER_SIZE      = CHUNK_MAGIC_SIZE + sizeof(uint32_t) * 2;
+static const size_t CHUNK_SAMPLE_SIZE      = 64 * 1024;   // head of the chunk which is compressed for judging
+static const int    CHUNK_COMPRESS_RATIO   = 90;          // compressed only if it becomes less than 90%
+
+//------------------------------------------------
+// ChunkCompress class variables
+//------------------------------------------------
+const size_t ChunkCompress::FRAME_SIZE;
+
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+static bool pread_all(int fd, char* buf, size_t size, off_t start)
+{
+    for(size_t total = 0; total < size; ){
+        ssize_t bytes = pread(fd, buf + total, size - total, start + total);
+        if(-1 == bytes){
+            if(EINTR == errno){
+                continue;
+            }
+            return false;
+        }
+        if(0 == bytes){
+            return false;
+        }
+        total += bytes;
+    }
+    return true;
+}
+
+//------------------------------------------------
+// ChunkCompress class methods
+//------------------------------------------------
+bool ChunkCompress::IsSupported()
+{
+#ifdef HAVE_LIBZ
+    return true;
+#else
+    return false;
+#endif
+}
+
+//
+// The head of the chunk is compressed at first, and the chunk is not
+// compressed if it does not become small enough(ex. already compressed
+// data or media files).
+//
+bool ChunkCompress::IsCompressible(const char* buf, size_t size)
+{
+#ifdef HAVE_LIBZ
+    uLong  sample  = static_cast<uLong>(std::min(size, CHUNK_SAMPLE_SIZE));
+    uLongf destlen = compressBound(sample);
+    Bytef* dest    = static_cast<Bytef*>(malloc(destlen));
+    if(!dest){
+        return false;
+    }
+    bool result = (Z_OK == compress2(dest, &destlen, reinterpret_cast<const Bytef*>(buf), sample, Z_BEST_SPEED) && destlen * 100 < sample * CHUNK_COMPRESS_RATIO);
+    free(dest);
+    return result;
+#else
+    return false;
+#endif
+}
+
+//
+// Compress the chunk into data, returns false if the chunk is not
+// compressed(not small enough or zlib is not supported).
+//
+bool ChunkCompress::Compress(const char* buf, size_t size, std::string& data)
+{
+#ifdef HAVE_LIBZ
+    if(!buf || 0 == size || !ChunkCompress::IsCompressible(buf, size)){
+        return false;
+    }
+    size_t                frame_count = (size + ChunkCompress::FRAME_SIZE - 1) / ChunkCompress::FRAME_SIZE;
+    size_t                index_size  = CHUNK_HEADER_SIZE + sizeof(uint64_t) * (frame_count + 1);
+    std::vector<uint64_t> offsets(frame_count + 1);
+
+    data.resize(index_size + frame_count * compressBound(static_cast<uLong>(ChunkCompress::FRAME_SIZE)));
+
+    size_t pos = index_size;
+    for(size_t cnt = 0; cnt < frame_count; ++cnt){
+        size_t frame_start = cnt * ChunkCompress::FRAME_SIZE;
+        uLong  frame_bytes = static_cast<uLong>(std::min(ChunkCompress::FRAME_SIZE, size - frame_start));
+        uLongf destlen     = static_cast<uLongf>(data.size() - pos);
+        if(Z_OK != compress2(reinterpret_cast<Bytef*>(&data[pos]), &destlen, reinterpret_cast<const Bytef*>(&buf[frame_start]), frame_bytes, Z_BEST_SPEED)){
+            data.clear();
+            return false;
+        }
+        offsets[cnt] = pos;
+        pos         += destlen;
+    }
+    offsets[frame_count] = pos;
+    if(size * CHUNK_COMPRESS_RATIO <= pos * 100){
+        data.clear();
+        return false;
+    }
+    data.resize(pos);
+
+    uint32_t frame_size = static_cast<uint32_t>(ChunkCompress::FRAME_SIZE);
+    uint32_t count      = static_cast<uint32_t>(frame_count);
+    memcpy(&data[0], CHUNK_COMPRESS_MAGIC, CHUNK_MAGIC_SIZE);
+    memcpy(&data[CHUNK_MAGIC_SIZE], &frame_size, sizeof(uint32_t));
+    memcpy(&data[CHUNK_MAGIC_SIZE + sizeof(uint32_t)], &count, sizeof(uint32_t));
+    memcpy(&data[CHUNK_HEADER_SIZE], &offsets[0], sizeof(uint64_t) * offsets.size());
+    return true;
+#else
+    return false;
+#endif
+}
+
+//
+// Read the part(offset and size in the chunk) of the compressed chunk
+// file into buf, chunk_bytes must be the size of the chunk.
+// Only the frames which cover the part are read and decompressed.
+// Returns the read bytes, -EIO if the file is broken, or -errno.
+//
+ssize_t ChunkCompress::ReadPart(int fd, off_t chunk_bytes, off_t offset, char* buf, size_t size)
+{
+#ifdef HAVE_LIBZ
+    if(chunk_bytes <= 0 || offset < 0 || chunk_bytes < offset + static_cast<off_t>(size)){
+        return -EINVAL;
+    }
+    struct stat st;
+    if(-1 == fstat(fd, &st)){
+        return -errno;
+    }
+
+    // header and offsets
+    char     header[CHUNK_HEADER_SIZE];
+    uint32_t frame_size;
+    uint32_t frame_count;
+    if(!pread_all(fd, header, sizeof(header), 0) || 0 != memcmp(header, CHUNK_COMPRESS_MAGIC, CHUNK_MAGIC_SIZE)){
+        return -EIO;
+    }
+    memcpy(&frame_size, &header[CHUNK_MAGIC_SIZE], sizeof(uint32_t));
+    memcpy(&frame_count, &header[CHUNK_MAGIC_SIZE + sizeof(uint32_t)], sizeof(uint32_t));
+    if(0 == frame_size || static_cast<off_t>(frame_count) != (chunk_bytes + frame_size - 1) / frame_size){
+        return -EIO;
+    }
+    std::vector<uint64_t> offsets(frame_count + 1);
+    if(!pread_all(fd, reinterpret_cast<char*>(&offsets[0]), sizeof(uint64_t) * offsets.size(), CHUNK_HEADER_SIZE) || static_cast<uint64_t>(st.st_size) != offsets[frame_count]){
+        return -EIO;
+    }
+    if(0 == size){
+        return 0;
+    }
+
+    // compressed frames which cover the part
+    size_t first = static_cast<size_t>(offset / frame_size);
+    size_t last  = static_cast<size_t>((offset + size - 1) / frame_size);
+    for(size_t cnt = first; cnt <= last; ++cnt){
+        if(offsets[cnt + 1] < offsets[cnt] || offsets[cnt] < CHUNK_HEADER_SIZE + sizeof(uint64_t) * offsets.size()){
+            return -EIO;
+        }
+    }
+    size_t src_size = static_cast<size_t>(offsets[last + 1] - offsets[first]);
+    Bytef* src      = static_cast<Bytef*>(malloc(std::max(src_size, static_cast<size_t>(1))));
+    Bytef* frame    = static_cast<Bytef*>(malloc(static_cast<size_t>(std::min(static_cast<off_t>(frame_size), chunk_bytes))));
+    if(!src || !frame){
+        free(src);
+        free(frame);
+        return -ENOMEM;
+    }
+    if(!pread_all(fd, reinterpret_cast<char*>(src), src_size, static_cast<off_t>(offsets[first]))){
+        free(src);
+        free(frame);
+        return -EIO;
+    }
+
+    // decompress each frame, the frame which is covered entirely is
+    // decompressed into buf directly.
+    ssize_t result = static_cast<ssize_t>(size);
+    for(size_t cnt = first; cnt <= last; ++cnt){
+        off_t  frame_start = static_cast<off_t>(cnt) * frame_size;
+        uLongf frame_bytes = static_cast<uLongf>(std::min(static_cast<off_t>(frame_size), chunk_bytes - frame_start));
+        off_t  copy_start  = std::max(offset, frame_start);
+        off_t  copy_end    = std::min(offset + static_cast<off_t>(size), frame_start + static_cast<off_t>(frame_bytes));
+        bool   is_whole    = (copy_start == frame_start && copy_end == frame_start + static_cast<off_t>(frame_bytes));
+        Bytef* dest        = is_whole ? reinterpret_cast<Bytef*>(&buf[frame_start - offset]) : frame;
+        uLongf destlen     = frame_bytes;
+        if(Z_OK != uncompress(dest, &destlen, &src[offsets[cnt] - offsets[first]], static_cast<uLong>(offsets[cnt + 1] - offsets[cnt])) || destlen != frame_bytes){
+            result = -EIO;
+            break;
+        }
+        if(!is_whole){
+            memcpy(&buf[copy_start - offset], &frame[copy_start - frame_start], static_cast<size_t>(copy_end - copy_start));
+        }
+    }
+    free(src);
+    free(frame);
+    return result;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,70 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_FDCACHE_CHUNK_COMPRESS_H_
+#define S3FS_FDCACHE_CHUNK_COMPRESS_H_
+
+#include <string>
+#include <sys/types.h>
+
+//------------------------------------------------
+// Class ChunkCompress
+//------------------------------------------------
+// [NOTE]
+// This class is the format of the compressed chunk file of ChunkCache
+// (the cache_compress option). The chunk is split into the frames of
+// FRAME_SIZE, and each frame is compressed by zlib independently, then
+// reading a part of the chunk decompresses only the frames which cover
+// the part instead of the whole chunk.
+//
+//   "OFZ1"                             : magic(4 bytes)
+//   frame size                         : uint32
+//   frame count                        : uint32
+//   offsets[frame count + 1]           : uint64, offset of each frame in the file
+//                                        (the last one is the file size)
+//   compressed frames
+//
+// The numbers are written in the host byte order, because the chunk
+// files are only read on the host which wrote them. The file which is
+// not this format(ex. truncated) is treated as broken.
+//
+class ChunkCompress
+{
+    private:
+        static bool IsCompressible(const char* buf, size_t size);
+
+    public:
+        static const size_t FRAME_SIZE = 256 * 1024;
+
+        static bool IsSupported();
+        static bool Compress(const char* buf, size_t size, std::string& data);
+        static ssize_t ReadPart(int fd, off_t chunk_bytes, off_t offset, char* buf, size_t size);
+};
+
+#endif // S3FS_FDCACHE_CHUNK_COMPRESS_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -21,6 +21,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
+#include <cstring>
 #include <unistd.h>
 #include <limits.h>
 #include <sys/time.h>
@@ -30,10 +31,13 @@
 #include "s3fs.h"
 #include "fdcache_entity.h"
 #include "fdcache.h"
+#include "fdcache_pseudofd.h"
 #include "string_util.h"
 #include "s3fs_util.h"
 #include "autolock.h"
 #include "curl.h"
+#include "cache.h"
+#include "peer_cache.h"
 
 //------------------------------------------------
 // Symbols
@@ -108,14 +112,16 @@ FdEntity::FdEntity(const char* tpath, const char* cpath) :
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
     int result;
-    if(0 != (result = pthread_mutex_init(&fdent_lock, &attr))){
+    if(0 != (result = pthread_mutex_init(&fdent_lock.mutex, &attr))){
         S3FS_PRN_CRIT("failed to init fdent_lock: %d", result);
         abort();
     }
-    if(0 != (result = pthread_mutex_init(&fdent_data_lock, &attr))){
+    if(0 != (result = pthread_mutex_init(&fdent_data_lock.mutex, &attr))){
         S3FS_PRN_CRIT("failed to init fdent_data_lock: %d", result);
         abort();
     }
+    LockProfiler::SetName(&fdent_lock, "FdEntity::fdent_lock");
+    LockProfiler::SetName(&fdent_data_lock, "FdEntity::fdent_data_lock");
     is_lock_init = true;
 }
 
@@ -125,11 +131,11 @@ FdEntity::~FdEntity()
 
     if(is_lock_init){
       int result;
-      if(0 != (result = pthread_mutex_destroy(&fdent_data_lock))){
+      if(0 != (result = pthread_mutex_destroy(&fdent_data_lock.mutex))){
           S3FS_PRN_CRIT("failed to destroy fdent_data_lock: %d", result);
           abort();
       }
-      if(0 != (result = pthread_mutex_destroy(&fdent_lock))){
+      if(0 != (result = pthread_mutex_destroy(&fdent_lock.mutex))){
           S3FS_PRN_CRIT("failed to destroy fdent_lock: %d", result);
           abort();
       }
@@ -269,6 +275,7 @@ int FdEntity::Dup(int fd, bool lock_already_held)
     PseudoFdInfo*   ppseudoinfo    = new PseudoFdInfo(physical_fd, (org_pseudoinfo ? org_pseudoinfo->GetFlags() : 0));
     int             pseudo_fd      = ppseudoinfo->GetPseudoFd();
     pseudo_fd_map[pseudo_fd]       = ppseudoinfo;
+    PseudoFdManager::SetEntity(pseudo_fd, this);
 
     return pseudo_fd;
 }
@@ -285,6 +292,7 @@ int FdEntity::OpenPseudoFd(int flags, bool lock_already_held)
     PseudoFdInfo*   ppseudoinfo = new PseudoFdInfo(physical_fd, flags);
     int             pseudo_fd   = ppseudoinfo->GetPseudoFd();
     pseudo_fd_map[pseudo_fd]    = ppseudoinfo;
+    PseudoFdManager::SetEntity(pseudo_fd, this);
 
     return pseudo_fd;
 }
@@ -631,9 +639,15 @@ int FdEntity::Open(const headers_t* pmeta, off_t size, time_t time, int flags, A
     }
 
     // create new pseudo fd, and set it to map
-    PseudoFdInfo*   ppseudoinfo = new PseudoFdInfo(physical_fd, flags, is_direct_read, path, size_orgmeta);
+    std::string               etag;
+    headers_t::const_iterator etag_iter = orgmeta.find("ETag");
+    if(etag_iter != orgmeta.end()){
+        etag = etag_iter->second;
+    }
+    PseudoFdInfo*   ppseudoinfo = new PseudoFdInfo(physical_fd, flags, is_direct_read, path, size_orgmeta, etag);
     int             pseudo_fd   = ppseudoinfo->GetPseudoFd();
     pseudo_fd_map[pseudo_fd]    = ppseudoinfo;
+    PseudoFdManager::SetEntity(pseudo_fd, this);
 
     return pseudo_fd;
 }
@@ -725,7 +739,7 @@ bool FdEntity::RenamePath(const std::string& newpath, std::string& fentmapkey)
 
 bool FdEntity::IsModified() const
 {
-    AutoLock auto_data_lock(const_cast<pthread_mutex_t *>(&fdent_data_lock));
+    AutoLock auto_data_lock(const_cast<named_mutex*>(&fdent_data_lock));
     return pagelist.IsModified();
 }
 
@@ -987,22 +1001,7 @@ bool FdEntity::SetContentType(const char* path)
 bool FdEntity::GetSymlinkAttr(std::string& type, std::string& symlink)
 {
     AutoLock auto_lock(&fdent_lock);
-    headers_t::const_iterator iter = orgmeta.find("x-oss-meta-symlink-target");
-    if(iter == orgmeta.end()){
-        return false;
-    }    
-    std::string value = (*iter).second;
-    std::string::size_type pos = value.find(':', 0);
-    if(std::string::npos != pos){
-        type = value.substr(0, pos);
-    }
-
-    pos = value.find(':', pos + 1);
-    if(std::string::npos != pos){
-        symlink = urlDecode(value.substr(pos + 1));
-    }
-
-    return true;
+    return get_symlink_attr(orgmeta, type, symlink);
 }
 
 bool FdEntity::SetSymlinkAttr(const std::string& type, const std::string& symlink)
@@ -1058,6 +1057,16 @@ int FdEntity::LoadWithSizeInfo(off_t start, off_t size, AutoLock::Type type, uin
 
     int result = 0;
 
+    // fill the unloaded area from the chunked cache
+    int chunk_lock_fd = LoadChunkCache(start, size, is_modified_flag);
+
+    // [NOTE]
+    // The ranges are requested with the etag of the opened object(If-Match),
+    // so that the object which is changed while loading is not mixed into
+    // the loaded pages.
+    //
+    std::string etag = GetOrgEtag();
+
     // check loaded area & load
     fdpage_list_t unloaded_list;
     if(0 < pagelist.GetUnloadedPages(unloaded_list, start, size)){
@@ -1076,12 +1085,12 @@ int FdEntity::LoadWithSizeInfo(off_t start, off_t size, AutoLock::Type type, uin
             // download
             if(S3fsCurl::GetMultipartSize() <= need_load_size && !nomultipart){
                 // parallel request
-                result = S3fsCurl::ParallelGetObjectRequest(path.c_str(), physical_fd, iter->offset, need_load_size);
+                result = S3fsCurl::ParallelGetObjectRequest(path.c_str(), physical_fd, iter->offset, need_load_size, etag);
             }else{
                 // single request
                 if(0 < need_load_size){
                     S3fsCurl s3fscurl;
-                    result = s3fscurl.GetObjectRequest(path.c_str(), physical_fd, iter->offset, need_load_size);
+                    result = s3fscurl.GetObjectRequest(path.c_str(), physical_fd, iter->offset, need_load_size, etag);
                 }else{
                     result = 0;
                 }
@@ -1092,12 +1101,258 @@ int FdEntity::LoadWithSizeInfo(off_t start, off_t size, AutoLock::Type type, uin
           loaded_size += need_load_size;
           // Set loaded flag
           pagelist.SetPageLoadedStatus(iter->offset, iter->bytes, (is_modified_flag ? PageList::PAGE_LOAD_MODIFIED : PageList::PAGE_LOADED));
+
+          // save the downloaded area into the chunked cache
+          if(0 < need_load_size){
+              SaveChunkCache(iter->offset, need_load_size);
+          }
         }
         PageList::FreeList(unloaded_list);
     }
+    ChunkCache::CloseFillLock(chunk_lock_fd);
+
+    if(-ESTALE == result){
+        // [NOTE]
+        // The object was changed after opening. The pages which are loaded
+        // from the old object are dropped(if not modified), and the stat
+        // cache is removed so that the next opening gets the new object.
+        S3FS_PRN_WARN("the object(%s) was changed while loading, the loaded pages are dropped.", path.c_str());
+        if(!pagelist.IsModified()){
+            SetAllStatusUnloaded();
+        }
+        StatCache::getStatCacheData()->DelStat(path);
+    }
     return result;
 }
 
+//
+// Returns the etag of the opened object, or empty if it is unknown(ex.
+// the object was uploaded after opening).
+//
+std::string FdEntity::GetOrgEtag() const
+{
+    headers_t::const_iterator iter = orgmeta.find("ETag");
+    if(iter == orgmeta.end()){
+        return std::string("");
+    }
+    return iter->second;
+}
+
+//
+// The chunked cache is used only for the entity which uses the temporary
+// file and has the etag of the object.
+//
+bool FdEntity::GetChunkCacheEtag(std::string& etag) const
+{
+    if(!ChunkCache::IsEnable() || !cachepath.empty() || size_orgmeta <= 0){
+        return false;
+    }
+    headers_t::const_iterator iter = orgmeta.find("ETag");
+    if(iter == orgmeta.end() || iter->second.empty()){
+        return false;
+    }
+    etag = iter->second;
+    return true;
+}
+
+// [NOTE]
+// This method reads the whole chunk from the chunked cache into buf.
+//
+// If the chunk cache is shared, this method takes the ownership of filling
+// the chunk which is not cached. The chunk which is owned by the other
+// process is waited for and read after it is filled. The lock file is
+// opened into lockfd at first, and the caller must close it by
+// ChunkCache::CloseFillLock() after saving the chunk.
+// If the peer cache is enabled, the chunk which is not cached on the host
+// is read from the owner node of it before downloading from the server.
+//
+bool FdEntity::FetchChunkCache(const std::string& etag, off_t index, char* buf, off_t chunk_bytes, int& lockfd)
+{
+    bool is_cached = (static_cast<ssize_t>(chunk_bytes) == ChunkCache::Read(path.c_str(), etag, index, buf, chunk_bytes));
+    if(!is_cached && ChunkCache::IsShared()){
+        if(-1 == lockfd){
+            lockfd = ChunkCache::OpenFillLock(path.c_str());
+        }
+        if(-1 != lockfd && !ChunkCache::LockFill(lockfd, index, false)){
+            // the other process is filling it
+            S3FS_PRN_DBG("wait for filling the chunk(%lld) of %s by the other.", static_cast<long long int>(index), path.c_str());
+            if(ChunkCache::LockFill(lockfd, index, true)){
+                is_cached = (static_cast<ssize_t>(chunk_bytes) == ChunkCache::Read(path.c_str(), etag, index, buf, chunk_bytes));
+            }
+        }
+    }
+    if(!is_cached && PeerCache::IsEnable() && static_cast<ssize_t>(chunk_bytes) == PeerCache::Read(path.c_str(), etag, index, buf, chunk_bytes)){
+        // got it from the owner in the cluster, then keep it in the local cache too
+        ChunkCache::Write(path.c_str(), etag, index, buf, chunk_bytes);
+        is_cached = true;
+    }
+    return is_cached;
+}
+
+// [NOTE]
+// This method copies the cached chunks which cover the unloaded pages in
+// the area into the temporary file, and sets those pages loaded.
+// The area over the original object size is not covered by any chunk.
+//
+// The chunks which are not cached are filled in the order of the chunk
+// index(see FetchChunkCache). Returns the lock file descriptor which the
+// caller must close by ChunkCache::CloseFillLock() after saving the chunks.
+//
+int FdEntity::LoadChunkCache(off_t start, off_t size, bool is_modified_flag)
+{
+    std::string etag;
+    if(!GetChunkCacheEtag(etag)){
+        return -1;
+    }
+    off_t chunk_size = ChunkCache::GetChunkSize();
+    off_t end        = (0 == size || size_orgmeta < start + size) ? size_orgmeta : (start + size);
+    char* buf        = NULL;
+    int   lockfd     = -1;
+
+    for(off_t index = start / chunk_size; index * chunk_size < end; ++index){
+        off_t chunk_start = index * chunk_size;
+        off_t chunk_bytes = std::min(chunk_size, size_orgmeta - chunk_start);
+
+        fdpage_list_t unloaded_list;
+        if(0 == pagelist.GetUnloadedPages(unloaded_list, chunk_start, chunk_bytes)){
+            continue;
+        }
+        if(!buf){
+            buf = new char[chunk_size];
+        }
+        if(FetchChunkCache(etag, index, buf, chunk_bytes, lockfd)){
+            for(fdpage_list_t::const_iterator iter = unloaded_list.begin(); iter != unloaded_list.end(); ++iter){
+                if(-1 == pwrite(physical_fd, &buf[iter->offset - chunk_start], iter->bytes, iter->offset)){
+                    S3FS_PRN_ERR("failed to write chunk into file(physical_fd=%d) by errno(%d).", physical_fd, errno);
+                    break;
+                }
+                pagelist.SetPageLoadedStatus(iter->offset, iter->bytes, (is_modified_flag ? PageList::PAGE_LOAD_MODIFIED : PageList::PAGE_LOADED));
+            }
+        }
+        PageList::FreeList(unloaded_list);
+    }
+    delete[] buf;
+
+    return lockfd;
+}
+
+// [NOTE]
+// This method reads the area which is not loaded into the temporary file
+// from the chunks, so that the chunks are the backing store of the opened
+// object and the temporary file does not have the copy of them.
+// The chunk which is not cached is downloaded and is saved as the chunk.
+// Returns the read bytes, or -errno.
+//
+ssize_t FdEntity::ReadChunkCache(char* bytes, off_t start, size_t size)
+{
+    std::string etag;
+    if(!GetChunkCacheEtag(etag)){
+        return -EINVAL;
+    }
+    off_t chunk_size = ChunkCache::GetChunkSize();
+    off_t end        = std::min(start + static_cast<off_t>(size), size_orgmeta);
+    char* buf        = NULL;
+    int   lockfd     = -1;
+    int   result     = 0;
+
+    for(off_t index = start / chunk_size; index * chunk_size < end; ++index){
+        off_t chunk_start = index * chunk_size;
+        off_t chunk_bytes = std::min(chunk_size, size_orgmeta - chunk_start);
+        off_t part_start  = std::max(start, chunk_start);
+        off_t part_bytes  = std::min(end, chunk_start + chunk_bytes) - part_start;
+        char* part_buf    = &bytes[part_start - start];
+
+        // read only the part from the local cache at first
+        if(static_cast<ssize_t>(part_bytes) == ChunkCache::ReadPart(path.c_str(), etag, index, chunk_bytes, part_start - chunk_start, part_buf, part_bytes)){
+            continue;
+        }
+        if(!buf){
+            buf = new char[chunk_size];
+        }
+        if(!FetchChunkCache(etag, index, buf, chunk_bytes, lockfd)){
+            ssize_t rsize = 0;
+            S3fsCurl s3fscurl;
+            if(0 != (result = s3fscurl.GetObjectStreamRequest(path.c_str(), buf, chunk_start, chunk_bytes, rsize, etag))){
+                break;
+            }
+            if(rsize != static_cast<ssize_t>(chunk_bytes)){
+                S3FS_PRN_ERR("could not download the chunk(%lld) of %s, read size(%zd) is wrong.", static_cast<long long int>(index), path.c_str(), rsize);
+                result = -EIO;
+                break;
+            }
+            if(!FdManager::IsSafeDiskSpace(NULL, chunk_bytes)){
+                FdManager::get()->CleanupCacheDir();
+            }
+            if(!FdManager::IsSafeDiskSpace(NULL, chunk_bytes) || !ChunkCache::Write(path.c_str(), etag, index, buf, chunk_bytes)){
+                S3FS_PRN_WARN("failed to save the chunk(%lld) for %s.", static_cast<long long int>(index), path.c_str());
+            }
+        }
+        memcpy(part_buf, &buf[part_start - chunk_start], part_bytes);
+    }
+    delete[] buf;
+    ChunkCache::CloseFillLock(lockfd);
+
+    if(-ESTALE == result){
+        // same as LoadWithSizeInfo()
+        S3FS_PRN_WARN("the object(%s) was changed while loading, the loaded pages are dropped.", path.c_str());
+        StatCache::getStatCacheData()->DelStat(path);
+    }
+    if(0 != result){
+        return result;
+    }
+    return std::max(static_cast<off_t>(0), end - start);
+}
+
+// [NOTE]
+// This method saves the chunks which overlap with the area and are loaded
+// entirely and not modified.
+//
+void FdEntity::SaveChunkCache(off_t start, off_t size)
+{
+    std::string etag;
+    if(!GetChunkCacheEtag(etag)){
+        return;
+    }
+    off_t chunk_size = ChunkCache::GetChunkSize();
+    off_t end        = std::min(start + size, size_orgmeta);
+    char* buf        = NULL;
+
+    for(off_t index = start / chunk_size; index * chunk_size < end; ++index){
+        off_t chunk_start = index * chunk_size;
+        off_t chunk_bytes = std::min(chunk_size, size_orgmeta - chunk_start);
+
+        if(!pagelist.IsPageLoaded(chunk_start, chunk_bytes) || pagelist.IsPageModified(chunk_start, chunk_bytes)){
+            continue;
+        }
+        if(!FdManager::IsSafeDiskSpace(NULL, chunk_bytes)){
+            FdManager::get()->CleanupCacheDir();
+            if(!FdManager::IsSafeDiskSpace(NULL, chunk_bytes)){
+                S3FS_PRN_WARN("no enough disk space for the chunk cache, then skip saving chunks for %s.", path.c_str());
+                break;
+            }
+        }
+        if(!buf){
+            buf = new char[chunk_size];
+        }
+        ssize_t total = 0;
+        while(total < static_cast<ssize_t>(chunk_bytes)){
+            ssize_t bytes = pread(physical_fd, &buf[total], chunk_bytes - total, chunk_start + total);
+            if(bytes <= 0){
+                break;
+            }
+            total += bytes;
+        }
+        if(total != static_cast<ssize_t>(chunk_bytes)){
+            S3FS_PRN_ERR("failed to read the chunk(%lld) from file(physical_fd=%d).", static_cast<long long int>(index), physical_fd);
+            break;
+        }
+        if(!ChunkCache::Write(path.c_str(), etag, index, buf, chunk_bytes)){
+            S3FS_PRN_WARN("failed to save the chunk(%lld) for %s.", static_cast<long long int>(index), path.c_str());
+        }
+    }
+    delete[] buf;
+}
+
 // [NOTE]
 // At no disk space for caching object.
 // This method is downloading by dividing an object of the specified range
@@ -1210,7 +1465,7 @@ int FdEntity::NoCacheLoadAndPost(PseudoFdInfo* pseudo_obj, off_t start, off_t si
                 // single area get request
                 if(0 < need_load_size){
                     S3fsCurl s3fscurl;
-                    if(0 != (result = s3fscurl.GetObjectRequest(path.c_str(), tmpfd, offset, oneread))){
+                    if(0 != (result = s3fscurl.GetObjectRequest(path.c_str(), tmpfd, offset, oneread, GetOrgEtag()))){
                         S3FS_PRN_ERR("failed to get object(start=%lld, size=%lld) for file(physical_fd=%d).", static_cast<long long int>(offset), static_cast<long long int>(oneread), tmpfd);
                         break;
                     }
@@ -1420,6 +1675,12 @@ int FdEntity::RowFlush(int fd, const char* tpath, bool force_sync)
         result = RowFlushMultipart(pseudo_obj, tpath);
     }
 
+    // [NOTE]
+    // The etag of the uploaded object is not known, then the area which is
+    // not loaded yet is loaded without the etag after this.
+    if(0 == result){
+        orgmeta.erase("ETag");
+    }
     return result;
 }
 
@@ -1791,6 +2052,16 @@ ssize_t FdEntity::Read(int fd, char* bytes, off_t start, size_t size, bool force
 
     if(force_load){
         pagelist.SetPageLoadedStatus(start, size, PageList::PAGE_NOT_LOAD_MODIFIED);
+    }else if(0 < size && start < pagelist.Size() && std::min(start + static_cast<off_t>(size), pagelist.Size()) <= size_orgmeta){
+        // [NOTE]
+        // The area which is not loaded at all is read from the chunks
+        // without loading it into the temporary file.
+        //
+        std::string etag;
+        off_t       read_size = std::min(start + static_cast<off_t>(size), pagelist.Size()) - start;
+        if(GetChunkCacheEtag(etag) && read_size == pagelist.GetTotalUnloadedPageSize(start, read_size)){
+            return ReadChunkCache(bytes, start, static_cast<size_t>(read_size));
+        }
     }
 
     int result = 0;
@@ -1839,7 +2110,7 @@ ssize_t FdEntity::Read(int fd, char* bytes, off_t start, size_t size, bool force
         // direct read from oss, but no prefetch
         S3FS_PRN_WARN("could not reserve disk space for download, direct read from cloud.");
         S3fsCurl s3fscurl;
-        result = s3fscurl.GetObjectStreamRequest(path.c_str(), bytes, start, size, rsize);
+        result = s3fscurl.GetObjectStreamRequest(path.c_str(), bytes, start, size, rsize, GetOrgEtag());
         if(0 != result){
             S3FS_PRN_ERR("could not download. start(%lld), size(%zu), errno(%d)", static_cast<long long int>(start), size, result);
             return result;
@@ -35,7 +35,7 @@ class FdEntity
     private:
         static bool     mixmultipart;   // whether multipart uploading can use copy api.
 
-        pthread_mutex_t fdent_lock;
+        named_mutex     fdent_lock;
         bool            is_lock_init;
         std::string     path;           // object path
         int             physical_fd;    // physical file(cache or temporary file) descriptor
@@ -45,7 +45,7 @@ class FdEntity
         headers_t       orgmeta;        // original headers at opening
         off_t           size_orgmeta;   // original file size in original headers
 
-        pthread_mutex_t fdent_data_lock;// protects the following members
+        named_mutex     fdent_data_lock;// protects the following members
         PageList        pagelist;
         std::string     cachepath;      // local cache file path
                                         // (if this is empty, does not load/save pagelist.)
@@ -63,6 +63,12 @@ class FdEntity
         ino_t GetInode();
         int OpenMirrorFile();
         int NoCacheLoadAndPost(PseudoFdInfo* pseudo_obj, off_t start = 0, off_t size = 0);  // size=0 means loading to end
+        std::string GetOrgEtag() const;                                       // [NOTE] not locking
+        bool GetChunkCacheEtag(std::string& etag) const;
+        bool FetchChunkCache(const std::string& etag, off_t index, char* buf, off_t chunk_bytes, int& lockfd);  // [NOTE] not locking
+        int LoadChunkCache(off_t start, off_t size, bool is_modified_flag);   // [NOTE] not locking
+        ssize_t ReadChunkCache(char* bytes, off_t start, size_t size);        // [NOTE] not locking
+        void SaveChunkCache(off_t start, off_t size);                         // [NOTE] not locking
         PseudoFdInfo* CheckPseudoFdFlags(int fd, bool writable, bool lock_already_held = false);
         bool IsUploading(bool lock_already_held = false);
         bool SetAllStatus(bool is_loaded);                          // [NOTE] not locking
@@ -139,6 +145,7 @@ class FdEntity
 
         void MarkDirtyNewFile();
 
+        bool IsDirectRead() const { return is_direct_read; }
         void CheckAndExitDirectReadIfNeeded();
         
         void CheckAndFreeDiskCacheIfNeeded();
@@ -32,24 +32,29 @@
 //------------------------------------------------
 // PseudoFdInfo methods
 //------------------------------------------------
-PseudoFdInfo::PseudoFdInfo(int fd, int open_flags, bool is_direct_read, std::string path, off_t size) : pseudo_fd(-1), physical_fd(fd), flags(0),
-    is_direct_read(is_direct_read), last_read_tail(0), prefetch_cnt(0), direct_reader_mgr(NULL) //, is_lock_init(false)
+PseudoFdInfo::PseudoFdInfo(int fd, int open_flags, bool is_direct_read, std::string path, off_t size, std::string etag) : pseudo_fd(-1), physical_fd(fd), flags(0),
+    is_direct_read(is_direct_read), last_read_tail(0), prefetch_cnt(0), last_read_end(0), random_read_cnt(0), fetch_chunks(1), consume_time_us(0), direct_reader_mgr(NULL) //, is_lock_init(false)
 {
+    last_read_time.tv_sec  = 0;
+    last_read_time.tv_nsec = 0;
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
 #if S3FS_PTHREAD_ERRORCHECK
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
     int result;
-    if(0 != (result = pthread_mutex_init(&upload_list_lock, &attr))){
+    if(0 != (result = pthread_mutex_init(&upload_list_lock.mutex, &attr))){
         S3FS_PRN_CRIT("failed to init upload_list_lock: %d", result);
         abort();
     }
 
-    if(0 != (result = pthread_mutex_init(&direct_read_lock, &attr))){
+    if(0 != (result = pthread_mutex_init(&direct_read_lock.mutex, &attr))){
         S3FS_PRN_CRIT("failed to init seq_stream_read_lock: %d", result);
         abort();
     }
+    LockProfiler::SetName(&upload_list_lock, "PseudoFdInfo::upload_list_lock");
+    LockProfiler::SetName(&direct_read_lock, "PseudoFdInfo::direct_read_lock");
 
     is_lock_init = true;
 
@@ -59,7 +64,7 @@ PseudoFdInfo::PseudoFdInfo(int fd, int open_flags, bool is_direct_read, std::str
     }
 
     if(is_direct_read){
-        direct_reader_mgr = new DirectReader(path, size);
+        direct_reader_mgr = new DirectReader(path, etag, size);
     }
 }
 
@@ -72,12 +77,12 @@ PseudoFdInfo::~PseudoFdInfo()
 
     if(is_lock_init){
         int result;
-        if(0 != (result = pthread_mutex_destroy(&direct_read_lock))){
+        if(0 != (result = pthread_mutex_destroy(&direct_read_lock.mutex))){
             S3FS_PRN_CRIT("failed to destroy seq_stream_read_lock: %d", result);
             abort();
         }
 
-        if(0 != (result = pthread_mutex_destroy(&upload_list_lock))){
+        if(0 != (result = pthread_mutex_destroy(&upload_list_lock.mutex))){
             S3FS_PRN_CRIT("failed to destroy upload_list_lock: %d", result);
             abort();
         }
@@ -276,6 +281,10 @@ void PseudoFdInfo::ExitDirectRead()
     is_direct_read = false;
     last_read_tail = 0;
     prefetch_cnt = 0;
+    last_read_end = 0;
+    random_read_cnt = 0;
+    fetch_chunks = 1;
+    consume_time_us = 0;
     
     // clean up chunks
     if(direct_reader_mgr != NULL){
@@ -285,12 +294,23 @@ void PseudoFdInfo::ExitDirectRead()
     return;
 }
 
-uint32_t PseudoFdInfo::GetPrefetchCount(off_t offset, size_t size)
+// [NOTE]
+// For the sequential stream, the count of chunks which are prefetched by
+// one request(fetch_cnt) is doubled each time the stream moves into the
+// next chunk, up to 64MB. The prefetch count is doubled by each read, and
+// is limited by the count of chunks which the stream reads while one
+// prefetch request is downloaded(the time of downloading / the time of
+// reading one chunk), so that the slow reader does not hold many chunks.
+//
+uint32_t PseudoFdInfo::GetPrefetchCount(off_t offset, size_t size, uint32_t& fetch_cnt)
 {
     S3FS_PRN_DBG("GetPrefetchCount[offset=%ld][size=%ld][last_read_tail=%ld]", offset, size, last_read_tail);
     
+    long long fetch_time_us = direct_reader_mgr ? direct_reader_mgr->GetFetchTime() : 0;
+
     AutoLock auto_lock(&direct_read_lock);
     
+    fetch_cnt = 1;
     if(!is_direct_read){
         return 0;
     }
@@ -302,21 +322,63 @@ uint32_t PseudoFdInfo::GetPrefetchCount(off_t offset, size_t size)
     if(last_read_tail == 0 
        || offset == last_read_tail 
        || (offset + chunk_size >= last_read_tail && last_read_tail + chunk_size >= offset)){
+        struct timespec now;
+        DirectReader::GetMonotonicTime(now);
+        if(0 != last_read_tail && (0 != last_read_time.tv_sec || 0 != last_read_time.tv_nsec) && 0 < size){
+            long long us = DirectReader::ElapsedUs(last_read_time, now) * chunk_size / static_cast<off_t>(size);
+            consume_time_us = (0 == consume_time_us) ? us : ((consume_time_us * 7 + us) / 8);
+        }
+        last_read_time = now;
+
+        if(0 != last_read_tail && (last_read_tail - 1) / chunk_size < (offset + static_cast<off_t>(size) - 1) / chunk_size){
+            fetch_chunks = std::min(fetch_chunks * 2, DirectReader::GetMaxFetchChunks());
+        }
         last_read_tail = offset + static_cast<off_t>(size);
         if(prefetch_cnt == 0){
             prefetch_cnt = 1;
         }else{
             prefetch_cnt = std::min(prefetch_cnt * 2, DirectReader::GetPrefetchChunkCount());
         }
+        if(0 < fetch_time_us && 0 < consume_time_us){
+            long long depth = (fetch_time_us * fetch_chunks) / consume_time_us + fetch_chunks;
+            prefetch_cnt = static_cast<int>(std::min(static_cast<long long>(prefetch_cnt), std::max(depth, static_cast<long long>(fetch_chunks))));
+        }
+        fetch_cnt = fetch_chunks;
     }else{
         last_read_tail = 0;
         prefetch_cnt = 0;
+        fetch_chunks = 1;
+        last_read_time.tv_sec  = 0;
+        last_read_time.tv_nsec = 0;
     }
 
-    S3FS_PRN_DBG("GetPrefetchCount[pseudo_fd=%d][offset=%ld][size=%ld][last_read_tail=%ld][prefetch_cnt=%d]", pseudo_fd, offset, size, last_read_tail, prefetch_cnt);
+    S3FS_PRN_DBG("GetPrefetchCount[pseudo_fd=%d][offset=%ld][size=%ld][last_read_tail=%ld][prefetch_cnt=%d][fetch_cnt=%u]", pseudo_fd, offset, size, last_read_tail, prefetch_cnt, fetch_cnt);
     return prefetch_cnt;
 }
 
+// [NOTE]
+// The read is random when some reads in a row are not in the range of
+// the chunk around the end of the previous read. The random read loads
+// only the blocks which are read, instead of the whole chunk, and the
+// whole chunk is loaded again once the sequential read resumes.
+//
+bool PseudoFdInfo::IsRandomRead(off_t offset, size_t size)
+{
+    static const int RANDOM_READ_THRESHOLD = 2;
+
+    AutoLock auto_lock(&direct_read_lock);
+
+    const off_t chunk_size = DirectReader::GetChunkSize();
+    if(0 == last_read_end || (offset + chunk_size >= last_read_end && last_read_end + chunk_size >= offset)){
+        random_read_cnt = 0;
+    }else if(random_read_cnt < RANDOM_READ_THRESHOLD){
+        ++random_read_cnt;
+    }
+    last_read_end = offset + static_cast<off_t>(size);
+
+    return (RANDOM_READ_THRESHOLD <= random_read_cnt);
+}
+
 ssize_t PseudoFdInfo::DirectReadAndPrefetch(char* bytes, off_t start, size_t size)
 {
     S3FS_PRN_DBG("direct read and prefetch[pseudo_fd=%d][physical_fd=%d][offset=%lld][size=%zu]", pseudo_fd, physical_fd, static_cast<long long int>(start), size);
@@ -332,6 +394,8 @@ ssize_t PseudoFdInfo::DirectReadAndPrefetch(char* bytes, off_t start, size_t siz
         return 0;
     }
     
+    bool is_random = IsRandomRead(start, size);
+
     uint32_t chunkid_start = offset / chunk_size;
     uint32_t chunkid_end = (offset + readsize - 1) / chunk_size;
     for (uint32_t id = chunkid_start; id <= chunkid_end; id++) {
@@ -360,15 +424,24 @@ ssize_t PseudoFdInfo::DirectReadAndPrefetch(char* bytes, off_t start, size_t siz
                 iter++;
             } else {
                 S3FS_PRN_DBG("release chunk[pseudo_fd=%d][chunkid=%d]", pseudo_fd, chunkid);
-                delete iter->second;
-                iter->second = NULL;
+                Chunk* chunk = iter->second;
                 iter = direct_reader_mgr->chunks.erase(iter);
+                direct_reader_mgr->DiscardChunk(chunkid, chunk);
             }
         }
         
-        if (direct_reader_mgr->chunks.count(id)) {
+        if (is_random && 0 < real_read_size && (!direct_reader_mgr->chunks.count(id) || !direct_reader_mgr->chunks[id]->IsLoaded(chunk_off, real_read_size))) {
+            // load only the blocks which are read into the partial chunk
+            S3FS_PRN_DBG("reading blocks from cloud[chunkid=%d][start=%ld][chunk_off=%ld][real_read_size=%ld]", id, offset, chunk_off, real_read_size);
+            if (!direct_reader_mgr->LoadBlocks(id, chunk_off, real_read_size)) {
+                return -EIO;
+            }
+        }
+
+        if (direct_reader_mgr->chunks.count(id) && direct_reader_mgr->chunks[id]->IsLoaded(chunk_off, real_read_size)) {
             S3FS_PRN_DBG("reading from buffer[chunkid=%d][offset=%ld][chunk_off=%ld][real_read_size=%ld]", id, offset, chunk_off, real_read_size);
             assert(chunk_off + static_cast<off_t>(real_read_size) <= direct_reader_mgr->chunks[id]->size);
+            ChunkLru::Touch(direct_reader_mgr->chunks[id]);
             memcpy(bytes, direct_reader_mgr->chunks[id]->buf + chunk_off, real_read_size);
         } else {
             // if the chunk does not exist, we should download it from oss directly.
@@ -401,14 +474,15 @@ ssize_t PseudoFdInfo::DirectReadAndPrefetch(char* bytes, off_t start, size_t siz
     }
 
     if(max_prefetch_chunks != 0){
-        uint32_t prefetch_cnt = GetPrefetchCount(start, size);
-        GeneratePrefetchTask(chunkid_end, prefetch_cnt);
+        uint32_t fetch_cnt    = 1;
+        uint32_t prefetch_cnt = GetPrefetchCount(start, size, fetch_cnt);
+        GeneratePrefetchTask(chunkid_end, prefetch_cnt, fetch_cnt);
     }
 
     return rsize;
 }
 
-void PseudoFdInfo::GeneratePrefetchTask(uint32_t start_prefetch_chunk, uint32_t prefetch_cnt)
+void PseudoFdInfo::GeneratePrefetchTask(uint32_t start_prefetch_chunk, uint32_t prefetch_cnt, uint32_t fetch_cnt)
 {
     const off_t chunk_size = DirectReader::GetChunkSize();
     const off_t file_size = direct_reader_mgr->GetFileSize();
@@ -426,15 +500,42 @@ void PseudoFdInfo::GeneratePrefetchTask(uint32_t start_prefetch_chunk, uint32_t
     }
 
     S3FS_PRN_DBG("generate prefetch task[start_chunk=%d][end_chunk=%d]", start_prefetch_chunk+1, last_prefetch_chunk);
-    for (uint32_t i = start_prefetch_chunk + 1 ; i <= last_prefetch_chunk; i++) {
-        if (!direct_reader_mgr->chunks.count(i) && Chunk::cache_usage_check()) {
-            off_t prefetch_size = std::min(chunk_size, file_size - i * chunk_size);
-            if (!direct_reader_mgr->Prefetch(i * chunk_size, prefetch_size)) {
+    for (uint32_t i = start_prefetch_chunk + 1 ; i <= last_prefetch_chunk; ) {
+        if (direct_reader_mgr->chunks.count(i) && direct_reader_mgr->chunks[i]->IsComplete()) {
+            direct_reader_mgr->ongoing_prefetch--;
+            i++;
+            continue;
+        }
+        // the continuous chunks which are not loaded are prefetched by one request,
+        // but the spilled chunk is read from the local file by itself.
+        uint32_t count = 1;
+        for (; count < fetch_cnt && i + count <= last_prefetch_chunk && !direct_reader_mgr->IsSpilled(i); ++count) {
+            if ((direct_reader_mgr->chunks.count(i + count) && direct_reader_mgr->chunks[i + count]->IsComplete()) || direct_reader_mgr->IsSpilled(i + count)) {
+                break;
+            }
+        }
+        // [NOTE]
+        // The whole range is admitted before the request. If the chunks
+        // of the other readers can not be reclaimed enough, the range is
+        // shortened to the chunks which fit in the rest of the limits, and
+        // one chunk is still admitted while the usage is under the limits.
+        //
+        off_t prefetch_size = std::min(chunk_size * count, file_size - i * chunk_size);
+        if (Chunk::cache_usage + static_cast<uint64_t>(prefetch_size) > DirectReader::GetPrefetchCacheLimits() && !ChunkLru::Reclaim(direct_reader_mgr, prefetch_size)) {
+            uint64_t limits = DirectReader::GetPrefetchCacheLimits();
+            uint64_t usage  = Chunk::cache_usage;
+            if (usage >= limits) {
                 direct_reader_mgr->ongoing_prefetch--;
+                i++;
+                continue;
             }
-        } else {
-            direct_reader_mgr->ongoing_prefetch--;
+            count         = std::max(static_cast<uint32_t>(1), std::min(count, static_cast<uint32_t>((limits - usage) / chunk_size)));
+            prefetch_size = std::min(chunk_size * count, file_size - i * chunk_size);
+        }
+        if (!direct_reader_mgr->Prefetch(i * chunk_size, prefetch_size)) {
+            direct_reader_mgr->ongoing_prefetch -= count;
         }
+        i += count;
     }
     return;
 }
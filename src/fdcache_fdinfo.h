@@ -39,21 +39,27 @@ class PseudoFdInfo
         etaglist_t      etag_entities;      // list of etag string and part number entities(to maintain the etag entity even if MPPART_INFO is destroyed)
 
         bool            is_lock_init;
-        pthread_mutex_t upload_list_lock;   // protects upload_id and upload_list
+        named_mutex     upload_list_lock;   // protects upload_id and upload_list
 
-        pthread_mutex_t direct_read_lock;
+        named_mutex     direct_read_lock;
         bool            is_direct_read;
         off_t           last_read_tail;
         int             prefetch_cnt;
+        off_t           last_read_end;      // end of the last read, which is not reset by the random read
+        int             random_read_cnt;    // count of the continuous random reads
+        uint32_t        fetch_chunks;       // count of chunks which are prefetched by one request
+        struct timespec last_read_time;
+        long long       consume_time_us;    // average time for the stream to read one chunk, 0 if not measured yet
         DirectReader*   direct_reader_mgr;
         uint64_t        loaded_size = 0;
 
     private:
         bool Clear();
-        void GeneratePrefetchTask(uint32_t start_prefetch_chunk, uint32_t prefetch_cnt);
-        uint32_t GetPrefetchCount(off_t offset, size_t size);
+        void GeneratePrefetchTask(uint32_t start_prefetch_chunk, uint32_t prefetch_cnt, uint32_t fetch_cnt);
+        uint32_t GetPrefetchCount(off_t offset, size_t size, uint32_t& fetch_cnt);
+        bool IsRandomRead(off_t offset, size_t size);
     public:
-        PseudoFdInfo(int fd = -1, int open_flags = 0, bool is_direct_read = false, std::string path = "", off_t size = 0);
+        PseudoFdInfo(int fd = -1, int open_flags = 0, bool is_direct_read = false, std::string path = "", off_t size = 0, std::string etag = "");
         ~PseudoFdInfo();
 
         int GetPhysicalFd() const { return physical_fd; }
@@ -472,6 +472,22 @@ bool PageList::IsPageLoaded(off_t start, off_t size) const
     return true;
 }
 
+bool PageList::IsPageModified(off_t start, off_t size) const
+{
+    for(fdpage_list_t::const_iterator iter = pages.begin(); iter != pages.end(); ++iter){
+        if(iter->next() <= start){
+            continue;
+        }
+        if(0 != size && start + size <= iter->offset){
+            break;
+        }
+        if(iter->modified){
+            return true;
+        }
+    }
+    return false;
+}
+
 bool PageList::SetPageLoadedStatus(off_t start, off_t size, PageList::page_status pstatus, bool is_compress)
 {
     off_t now_size    = Size();
@@ -804,6 +820,10 @@ bool PageList::Serialize(CacheFileStat& file, bool is_output, ino_t inode)
         // put to file
         //
         std::ostringstream ssall;
+        std::string        keyline = file.GetKeyLine();
+        if(!keyline.empty()){
+            ssall << keyline << "\n";
+        }
         ssall << inode << ":" << Size();
 
         for(fdpage_list_t::iterator iter = pages.begin(); iter != pages.end(); ++iter){
@@ -851,12 +871,22 @@ bool PageList::Serialize(CacheFileStat& file, bool is_output, ino_t inode)
         Clear();
     
         // load head line(for size and inode)
-        off_t total;
-        ino_t cache_inode;                  // if this value is 0, it means old format.
+        //
+        // [NOTE]
+        // In the hashed layout of the cache directory, the head line follows
+        // the line of the object path, which must be the path of this file.
+        //
+        off_t       total;
+        ino_t       cache_inode;            // if this value is 0, it means old format.
+        std::string key;
         if(!getline(ssall, oneline, '\n')){
             S3FS_PRN_ERR("failed to parse stats.");
             delete[] ptmp;
             return false;
+        }else if(CacheFileStat::ParseKeyLine(oneline, key) && (key != file.GetPath() || !getline(ssall, oneline, '\n'))){
+            S3FS_PRN_ERR("failed to parse stats for path(%s), it has path(%s).", file.GetPath().c_str(), key.c_str());
+            delete[] ptmp;
+            return false;
         }else{
             std::istringstream sshead(oneline);
             std::string        strhead1;
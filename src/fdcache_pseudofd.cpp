@@ -55,29 +55,48 @@ bool PseudoFdManager::Release(int fd)
     return (PseudoFdManager::GetManager()).ReleasePseudoFd(fd);
 }
 
+bool PseudoFdManager::SetEntity(int fd, FdEntity* ent)
+{
+    return (PseudoFdManager::GetManager()).SetPseudoFdEntity(fd, ent);
+}
+
+FdEntity* PseudoFdManager::GetEntity(int fd)
+{
+    return (PseudoFdManager::GetManager()).GetPseudoFdEntity(fd);
+}
+
 //------------------------------------------------
 // PseudoFdManager methods
 //------------------------------------------------
 PseudoFdManager::PseudoFdManager() : is_lock_init(false)
 {
+    for(int cnt = 0; cnt < PSEUDOFD_ENT_PAGE_MAX; ++cnt){
+        pseudofd_ents[cnt].store(NULL);
+    }
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
 #if S3FS_PTHREAD_ERRORCHECK
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
 #endif
     int result;
-    if(0 != (result = pthread_mutex_init(&pseudofd_list_lock, &attr))){
+    if(0 != (result = pthread_mutex_init(&pseudofd_list_lock.mutex, &attr))){
         S3FS_PRN_CRIT("failed to init pseudofd_list_lock: %d", result);
         abort();
     }
+    LockProfiler::SetName(&pseudofd_list_lock, "PseudoFdManager::pseudofd_list_lock");
     is_lock_init = true;
 }
 
 PseudoFdManager::~PseudoFdManager()
 {
+    for(int cnt = 0; cnt < PSEUDOFD_ENT_PAGE_MAX; ++cnt){
+        delete[] pseudofd_ents[cnt].exchange(NULL);
+    }
+
     if(is_lock_init){
       int result;
-      if(0 != (result = pthread_mutex_destroy(&pseudofd_list_lock))){
+      if(0 != (result = pthread_mutex_destroy(&pseudofd_list_lock.mutex))){
           S3FS_PRN_CRIT("failed to destroy pseudofd_list_lock: %d", result);
           abort();
       }
@@ -118,12 +137,64 @@ bool PseudoFdManager::ReleasePseudoFd(int fd)
     for(pseudofd_list_t::iterator iter = pseudofd_list.begin(); iter != pseudofd_list.end(); ++iter){
         if(fd == (*iter)){
             pseudofd_list.erase(iter);
+
+            // clear the entity before the pseudo fd is reused
+            pseudofd_ent_page_t* page = GetEntityPage(fd, false);
+            if(page){
+                page[fd % PSEUDOFD_ENT_PAGE_SIZE].store(NULL, std::memory_order_release);
+            }
             return true;
         }
     }
     return false;
 }
 
+//
+// Returns the page of the table for the pseudo fd, or NULL if the pseudo
+// fd is out of the table(or the page is not allocated and is_create is
+// false).
+//
+// [NOTE]
+// If is_create is true, pseudofd_list_lock must be locked by the caller.
+//
+pseudofd_ent_page_t* PseudoFdManager::GetEntityPage(int fd, bool is_create)
+{
+    if(fd < 0 || (PSEUDOFD_ENT_PAGE_SIZE * PSEUDOFD_ENT_PAGE_MAX) <= fd){
+        return NULL;
+    }
+    int                  pos  = fd / PSEUDOFD_ENT_PAGE_SIZE;
+    pseudofd_ent_page_t* page = pseudofd_ents[pos].load(std::memory_order_acquire);
+    if(!page && is_create){
+        page = new pseudofd_ent_page_t[PSEUDOFD_ENT_PAGE_SIZE];
+        for(int cnt = 0; cnt < PSEUDOFD_ENT_PAGE_SIZE; ++cnt){
+            page[cnt].store(NULL, std::memory_order_relaxed);
+        }
+        pseudofd_ents[pos].store(page, std::memory_order_release);
+    }
+    return page;
+}
+
+bool PseudoFdManager::SetPseudoFdEntity(int fd, FdEntity* ent)
+{
+    AutoLock auto_lock(&pseudofd_list_lock);
+
+    pseudofd_ent_page_t* page = GetEntityPage(fd, true);
+    if(!page){
+        return false;
+    }
+    page[fd % PSEUDOFD_ENT_PAGE_SIZE].store(ent, std::memory_order_release);
+    return true;
+}
+
+FdEntity* PseudoFdManager::GetPseudoFdEntity(int fd)
+{
+    pseudofd_ent_page_t* page = GetEntityPage(fd, false);
+    if(!page){
+        return NULL;
+    }
+    return page[fd % PSEUDOFD_ENT_PAGE_SIZE].load(std::memory_order_acquire);
+}
+
 /*
 * Local variables:
 * tab-width: 4
@@ -21,6 +21,12 @@
 #ifndef S3FS_FDCACHE_PSEUDOFD_H_
 #define S3FS_FDCACHE_PSEUDOFD_H_
 
+#include <atomic>
+
+#include "autolock.h"
+
+class FdEntity;
+
 //------------------------------------------------
 // Typdefs
 //------------------------------------------------
@@ -28,15 +34,35 @@
 //
 typedef std::vector<int>    pseudofd_list_t;
 
+//
+// Table page of the entities which own the pseudo fds
+//
+typedef std::atomic<FdEntity*>  pseudofd_ent_page_t;
+
 //------------------------------------------------
 // Class PseudoFdManager
 //------------------------------------------------
+// [NOTE]
+// This class also has the table from the pseudo fd to the entity which
+// owns it, so that the entity for fi->fh is found without the lock of
+// FdManager and without scanning all entities.
+// Since pseudo fds are the smallest unused numbers, the table is the two
+// level array indexed by the pseudo fd. The pages are allocated under
+// pseudofd_list_lock and are never freed until exiting, then the lookup
+// does not need any lock.
+// The entry is set when the entity maps the pseudo fd and is cleared when
+// the pseudo fd is released.
+//
 class PseudoFdManager
 {
     private:
+        static const int PSEUDOFD_ENT_PAGE_SIZE = 1024;
+        static const int PSEUDOFD_ENT_PAGE_MAX  = 1024;
+
         pseudofd_list_t pseudofd_list;
         bool            is_lock_init;
-        pthread_mutex_t pseudofd_list_lock;    // protects pseudofd_list
+        named_mutex     pseudofd_list_lock;    // protects pseudofd_list and allocating pages of pseudofd_ents
+        std::atomic<pseudofd_ent_page_t*> pseudofd_ents[PSEUDOFD_ENT_PAGE_MAX];
 
     private:
         static PseudoFdManager& GetManager();
@@ -47,10 +73,15 @@ class PseudoFdManager
         int GetUnusedMinPseudoFd() const;
         int CreatePseudoFd();
         bool ReleasePseudoFd(int fd);
+        pseudofd_ent_page_t* GetEntityPage(int fd, bool is_create);
+        bool SetPseudoFdEntity(int fd, FdEntity* ent);
+        FdEntity* GetPseudoFdEntity(int fd);
 
     public:
         static int Get();
         static bool Release(int fd);
+        static bool SetEntity(int fd, FdEntity* ent);
+        static FdEntity* GetEntity(int fd);
 };
 
 #endif // S3FS_FDCACHE_PSEUDOFD_H_
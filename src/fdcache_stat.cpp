@@ -21,58 +21,168 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
+#include <cstring>
 #include <unistd.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "s3fs.h"
 #include "fdcache_stat.h"
 #include "fdcache.h"
+#include "fdcache_trash.h"
 #include "s3fs_util.h"
 #include "s3fs_cred.h"
 #include "string_util.h"
 
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+//
+// Copies the stat file with replacing the line of the object path at the
+// head, and removes the source.
+//
+static bool copy_cache_file_stat(const std::string& src_path, const std::string& dst_path, const std::string& keyline)
+{
+    int src_fd;
+    if(-1 == (src_fd = open(src_path.c_str(), O_RDONLY))){
+        S3FS_PRN_ERR("failed to open cache file stat path(%s) by errno(%d).", src_path.c_str(), errno);
+        return false;
+    }
+    std::string contents;
+    char        buf[4096];
+    ssize_t     bytes;
+    while(0 < (bytes = read(src_fd, buf, sizeof(buf)))){
+        contents.append(buf, bytes);
+    }
+    close(src_fd);
+    if(0 > bytes){
+        S3FS_PRN_ERR("failed to read cache file stat path(%s) by errno(%d).", src_path.c_str(), errno);
+        return false;
+    }
+
+    // remove the old object path line
+    std::string key;
+    std::string::size_type pos = contents.find('\n');
+    if(CacheFileStat::ParseKeyLine(contents.substr(0, pos), key)){
+        contents.erase(0, (std::string::npos == pos ? pos : pos + 1));
+    }
+    if(!keyline.empty()){
+        contents = keyline + "\n" + contents;
+    }
+
+    int dst_fd;
+    if(0 != unlink(dst_path.c_str()) && ENOENT != errno){
+        S3FS_PRN_ERR("failed to unlink new cache file stat path(%s) by errno(%d).", dst_path.c_str(), errno);
+        return false;
+    }
+    if(-1 == (dst_fd = open(dst_path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0600))){
+        S3FS_PRN_ERR("failed to open new cache file stat path(%s) by errno(%d).", dst_path.c_str(), errno);
+        return false;
+    }
+    if(static_cast<ssize_t>(contents.length()) != write(dst_fd, contents.c_str(), contents.length())){
+        S3FS_PRN_ERR("failed to write new cache file stat path(%s) by errno(%d).", dst_path.c_str(), errno);
+        close(dst_fd);
+        unlink(dst_path.c_str());
+        return false;
+    }
+    close(dst_fd);
+
+    if(-1 == unlink(src_path.c_str())){
+        S3FS_PRN_ERR("failed to unlink old cache file stat path(%s) by errno(%d).", src_path.c_str(), errno);
+        return false;
+    }
+    return true;
+}
+
 //------------------------------------------------
 // CacheFileStat class methods
 //------------------------------------------------
 std::string CacheFileStat::GetCacheFileStatTopDir()
+{
+    return CacheFileStat::GetCacheFileStatTopDir(FdManager::IsHashedDir());
+}
+
+std::string CacheFileStat::GetCacheFileStatTopDir(bool is_hashed)
 {
     std::string top_path;
     if(!FdManager::IsCacheDir() || S3fsCred::GetBucket().empty()){
         return top_path;
     }
 
-    // stat top dir( "/<cache_dir>/.<bucket_name>.stat" )
+    // stat top dir( "/<cache_dir>/.<bucket_name>.stat" or "/<cache_dir>/.<bucket_name>.hashed.stat" )
     top_path += FdManager::GetCacheDir();
     top_path += "/.";
     top_path += S3fsCred::GetBucket();
-    top_path += ".stat";
+    top_path += (is_hashed ? ".hashed.stat" : ".stat");
     return top_path;
 }
 
-bool CacheFileStat::MakeCacheFileStatPath(const char* path, std::string& sfile_path, bool is_create_dir)
+bool CacheFileStat::MakeCacheFileStatPath(const char* path, std::string& sfile_path, bool is_create_dir, bool is_hashed)
 {
-    std::string top_path = CacheFileStat::GetCacheFileStatTopDir();
+    std::string top_path = CacheFileStat::GetCacheFileStatTopDir(is_hashed);
     if(top_path.empty()){
         S3FS_PRN_ERR("The path to cache top dir is empty.");
         return false;
     }
 
+    std::string sub_path(SAFESTRPTR(path));
+    if(is_hashed && !sub_path.empty()){
+        sub_path = FdManager::MakeHashedSubPath(path);
+    }
     if(is_create_dir){
       int result;
-      if(0 != (result = mkdirp(top_path + mydirname(path), 0777))){
+      if(0 != (result = mkdirp(top_path + mydirname(sub_path.c_str()), 0777))){
           S3FS_PRN_ERR("failed to create dir(%s) by errno(%d).", path, result);
           return false;
       }
     }
-    if(!path || '\0' == path[0]){
-        sfile_path = top_path;
-    }else{
-        sfile_path = top_path + SAFESTRPTR(path);
+    sfile_path = top_path + sub_path;
+    return true;
+}
+
+// [NOTE]
+// In the hashed layout, the stat file starts with the line of the object
+// path, since the path of the stat file does not tell it.
+// The object path is url encoded, so that the line starts with "/" and
+// it is distinguished from the head line of the page list("<inode>:<size>").
+//
+std::string CacheFileStat::MakeKeyLine(const char* path)
+{
+    if(!FdManager::IsHashedDir() || !path){
+        return std::string("");
+    }
+    return urlEncode(std::string(path));
+}
+
+bool CacheFileStat::ParseKeyLine(const std::string& line, std::string& key)
+{
+    if(line.empty() || '/' != line[0]){
+        return false;
     }
+    key = urlDecode(line);
     return true;
 }
 
+bool CacheFileStat::GetCacheFileStatKey(const char* sfile_path, std::string& key)
+{
+    int fd;
+    if(!sfile_path || -1 == (fd = open(sfile_path, O_RDONLY))){
+        return false;
+    }
+    // the encoded object path is at most three times of PATH_MAX
+    char    buf[PATH_MAX * 3 + 2];
+    ssize_t bytes = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+    if(0 >= bytes){
+        return false;
+    }
+    buf[bytes] = '\0';
+
+    const char* pos = strchr(buf, '\n');
+    return CacheFileStat::ParseKeyLine(std::string(buf, (pos ? static_cast<size_t>(pos - buf) : static_cast<size_t>(bytes))), key);
+}
+
 bool CacheFileStat::CheckCacheFileStatTopDir()
 {
     std::string top_path = CacheFileStat::GetCacheFileStatTopDir();
@@ -85,13 +195,18 @@ bool CacheFileStat::CheckCacheFileStatTopDir()
 }
 
 bool CacheFileStat::DeleteCacheFileStat(const char* path)
+{
+    return CacheFileStat::DeleteCacheFileStat(path, FdManager::IsHashedDir());
+}
+
+bool CacheFileStat::DeleteCacheFileStat(const char* path, bool is_hashed)
 {
     if(!path || '\0' == path[0]){
         return false;
     }
     // stat path
     std::string sfile_path;
-    if(!CacheFileStat::MakeCacheFileStatPath(path, sfile_path, false)){
+    if(!CacheFileStat::MakeCacheFileStatPath(path, sfile_path, false, is_hashed)){
         S3FS_PRN_ERR("failed to create cache stat file path(%s)", path);
         return false;
     }
@@ -110,14 +225,35 @@ bool CacheFileStat::DeleteCacheFileStat(const char* path)
 // If remove stat file directory, it should do before removing
 // file cache directory.
 //
-bool CacheFileStat::DeleteCacheFileStatDirectory()
+//
+// Remove the stat files directory for the dirpath, or the top directory
+// if dirpath is not specified.
+// The dirpath is only for the mirrored layout, and the stat files in the
+// hashed layout are removed with their cache files by FdManager.
+//
+bool CacheFileStat::DeleteCacheFileStatDirectory(const char* dirpath)
 {
-    std::string top_path = CacheFileStat::GetCacheFileStatTopDir();
+    std::string top_path = CacheFileStat::GetCacheFileStatTopDir(false);
     if(top_path.empty()){
         S3FS_PRN_INFO("The path to cache top dir is empty, thus not need to remove it.");
         return true;
     }
-    return delete_files_in_dir(top_path.c_str(), true);
+    if(!dirpath || '\0' == dirpath[0]){
+        // the top directory of the hashed layout
+        std::string hashed_top_path = CacheFileStat::GetCacheFileStatTopDir(true);
+        struct stat st;
+        if(0 == stat(hashed_top_path.c_str(), &st) && !CacheTrash::Remove(hashed_top_path.c_str())){
+            return false;
+        }
+    }else{
+        top_path += dirpath;
+
+        struct stat st;
+        if(-1 == stat(top_path.c_str(), &st) && ENOENT == errno){
+            return true;
+        }
+    }
+    return CacheTrash::Remove(top_path.c_str());
 }
 
 bool CacheFileStat::RenameCacheFileStat(const char* oldpath, const char* newpath)
@@ -129,9 +265,19 @@ bool CacheFileStat::RenameCacheFileStat(const char* oldpath, const char* newpath
     // stat path
     std::string old_filestat;
     std::string new_filestat;
-    if(!CacheFileStat::MakeCacheFileStatPath(oldpath, old_filestat, false) || !CacheFileStat::MakeCacheFileStatPath(newpath, new_filestat, false)){
+    bool        is_hashed = FdManager::IsHashedDir();
+    if(!CacheFileStat::MakeCacheFileStatPath(oldpath, old_filestat, false, is_hashed) || !CacheFileStat::MakeCacheFileStatPath(newpath, new_filestat, is_hashed, is_hashed)){
         return false;
     }
+    if(is_hashed){
+        // the object path in the stat file is also changed
+        struct stat st;
+        if(0 != stat(old_filestat.c_str(), &st)){
+            unlink(new_filestat.c_str());
+            return true;
+        }
+        return copy_cache_file_stat(old_filestat, new_filestat, CacheFileStat::MakeKeyLine(newpath));
+    }
 
     // check new stat path
     struct stat st;
@@ -161,6 +307,22 @@ bool CacheFileStat::RenameCacheFileStat(const char* oldpath, const char* newpath
    return true;
 }
 
+//
+// Moves the stat file in the mirrored layout into the hashed layout.
+//
+bool CacheFileStat::MigrateCacheFileStat(const char* path)
+{
+    if(!path || '\0' == path[0] || !FdManager::IsHashedDir()){
+        return false;
+    }
+    std::string old_filestat;
+    std::string new_filestat;
+    if(!CacheFileStat::MakeCacheFileStatPath(path, old_filestat, false, false) || !CacheFileStat::MakeCacheFileStatPath(path, new_filestat, true, true)){
+        return false;
+    }
+    return copy_cache_file_stat(old_filestat, new_filestat, CacheFileStat::MakeKeyLine(path));
+}
+
 //------------------------------------------------
 // CacheFileStat methods
 //------------------------------------------------
@@ -203,7 +365,7 @@ bool CacheFileStat::RawOpen(bool readonly)
     }
     // stat path
     std::string sfile_path;
-    if(!CacheFileStat::MakeCacheFileStatPath(path.c_str(), sfile_path, true)){
+    if(!CacheFileStat::MakeCacheFileStatPath(path.c_str(), sfile_path, true, FdManager::IsHashedDir())){
         S3FS_PRN_ERR("failed to create cache stat file path(%s)", path.c_str());
         return false;
     }
@@ -249,6 +411,11 @@ bool CacheFileStat::ReadOnlyOpen()
     return RawOpen(true);
 }
 
+std::string CacheFileStat::GetKeyLine() const
+{
+    return CacheFileStat::MakeKeyLine(path.c_str());
+}
+
 bool CacheFileStat::Release()
 {
     if(-1 == fd){
@@ -31,16 +31,22 @@ class CacheFileStat
         int         fd;
 
     private:
-        static bool MakeCacheFileStatPath(const char* path, std::string& sfile_path, bool is_create_dir = true);
+        static bool MakeCacheFileStatPath(const char* path, std::string& sfile_path, bool is_create_dir, bool is_hashed);
+        static std::string MakeKeyLine(const char* path);
 
         bool RawOpen(bool readonly);
 
     public:
         static std::string GetCacheFileStatTopDir();
+        static std::string GetCacheFileStatTopDir(bool is_hashed);
         static bool DeleteCacheFileStat(const char* path);
+        static bool DeleteCacheFileStat(const char* path, bool is_hashed);
         static bool CheckCacheFileStatTopDir();
-        static bool DeleteCacheFileStatDirectory();
+        static bool DeleteCacheFileStatDirectory(const char* dirpath = NULL);
         static bool RenameCacheFileStat(const char* oldpath, const char* newpath);
+        static bool MigrateCacheFileStat(const char* path);
+        static bool ParseKeyLine(const std::string& line, std::string& key);
+        static bool GetCacheFileStatKey(const char* sfile_path, std::string& key);
 
         explicit CacheFileStat(const char* tpath = NULL);
         ~CacheFileStat();
@@ -50,6 +56,8 @@ class CacheFileStat
         bool Release();
         bool SetPath(const char* tpath, bool is_open = true);
         int GetFd() const { return fd; }
+        const std::string& GetPath() const { return path; }
+        std::string GetKeyLine() const;
 };
 
 #endif // S3FS_FDCACHE_STAT_H_
@@ -0,0 +1,285 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "common.h"
+#include "s3fs.h"
+#include "fdcache_trash.h"
+#include "fdcache.h"
+#include "s3fs_util.h"
+#include "s3fs_cred.h"
+#include "string_util.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+#ifdef __linux__
+static const int IOPRIO_CLASS_IDLE  = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+static const int IOPRIO_WHO_PROCESS = 1;
+#endif
+
+//------------------------------------------------
+// CacheTrash class variables
+//------------------------------------------------
+CacheTrash* CacheTrash::singleton = NULL;
+
+//------------------------------------------------
+// CacheTrash class methods
+//------------------------------------------------
+std::string CacheTrash::GetTrashDir()
+{
+    std::string trash_dir;
+    if(!FdManager::IsCacheDir() || S3fsCred::GetBucket().empty()){
+        return trash_dir;
+    }
+    // trash dir( "/<cache_dir>/.<bucket_name>.trash" )
+    trash_dir += FdManager::GetCacheDir();
+    trash_dir += "/.";
+    trash_dir += S3fsCred::GetBucket();
+    trash_dir += ".trash";
+    return trash_dir;
+}
+
+bool CacheTrash::Initialize()
+{
+    if(CacheTrash::GetTrashDir().empty()){
+        return false;
+    }
+    if(CacheTrash::singleton){
+        S3FS_PRN_WARN("Already singleton for cache trash is existed, then re-create it.");
+        CacheTrash::Destroy(false);
+    }
+    CacheTrash::singleton = new CacheTrash();
+
+    int result;
+    if(0 != (result = pthread_create(&CacheTrash::singleton->thread, NULL, CacheTrash::Worker, static_cast<void*>(CacheTrash::singleton)))){
+        S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+        delete CacheTrash::singleton;
+        CacheTrash::singleton = NULL;
+        return false;
+    }
+    // remove the trash left by the previous mount
+    CacheTrash::singleton->trash_sem.post();
+    return true;
+}
+
+//
+// Stops the worker thread. If is_remove_trash is true, the files left in
+// the trash directory are removed here.
+//
+void CacheTrash::Destroy(bool is_remove_trash)
+{
+    if(CacheTrash::singleton){
+        {
+            AutoLock auto_lock(&(CacheTrash::singleton->trash_lock));
+            CacheTrash::singleton->is_exit = true;
+        }
+        CacheTrash::singleton->trash_sem.post();
+
+        void* retval = NULL;
+        int   result;
+        if(0 != (result = pthread_join(CacheTrash::singleton->thread, &retval))){
+            S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+        }
+        delete CacheTrash::singleton;
+        CacheTrash::singleton = NULL;
+    }
+
+    std::string trash_dir = CacheTrash::GetTrashDir();
+    struct stat st;
+    if(is_remove_trash && !trash_dir.empty() && 0 == stat(trash_dir.c_str(), &st)){
+        if(!delete_files_in_dir(trash_dir.c_str(), true)){
+            S3FS_PRN_WARN("could not remove the trash directory(%s).", trash_dir.c_str());
+        }
+    }
+}
+
+//
+// Removes the directory with its files. While the worker thread is running,
+// the directory is only renamed into the trash directory here.
+//
+bool CacheTrash::Remove(const char* dir)
+{
+    struct stat st;
+    if(!dir || '\0' == dir[0] || (0 != stat(dir, &st) && ENOENT == errno)){
+        return true;
+    }
+    if(!CacheTrash::singleton){
+        return delete_files_in_dir(dir, true);
+    }
+
+    std::string trash_dir = CacheTrash::GetTrashDir();
+    std::string trash_path;
+    {
+        AutoLock auto_lock(&(CacheTrash::singleton->trash_lock));
+        trash_path = trash_dir + "/" + mybasename(dir) + "." + str(getpid()) + "." + str(time(NULL)) + "." + str(CacheTrash::singleton->seq++);
+    }
+    if(0 != mkdirp(trash_dir, 0700) && EEXIST != errno){
+        S3FS_PRN_WARN("could not create the trash directory(%s) by errno(%d), then remove %s at once.", trash_dir.c_str(), errno, dir);
+        return delete_files_in_dir(dir, true);
+    }
+    if(-1 == rename(dir, trash_path.c_str())){
+        S3FS_PRN_WARN("could not rename %s to %s by errno(%d), then remove it at once.", dir, trash_path.c_str(), errno);
+        return delete_files_in_dir(dir, true);
+    }
+    S3FS_PRN_INFO("moved %s to the trash(%s).", dir, trash_path.c_str());
+
+    CacheTrash::singleton->trash_sem.post();
+    return true;
+}
+
+//
+// Thread worker
+//
+void* CacheTrash::Worker(void* arg)
+{
+    CacheTrash* ptrash = static_cast<CacheTrash*>(arg);
+    if(!ptrash){
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in CacheTrash.");
+
+#ifdef __linux__
+    // [NOTE]
+    // The priorities are changed only for this thread.
+    //
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    if(0 != setpriority(PRIO_PROCESS, tid, 19)){
+        S3FS_PRN_INFO("could not lower the cpu priority of the thread for cache trash by errno(%d).", errno);
+    }
+#ifdef SYS_ioprio_set
+    if(0 != syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT)){
+        S3FS_PRN_INFO("could not lower the io priority of the thread for cache trash by errno(%d).", errno);
+    }
+#endif
+#endif
+
+    std::string trash_dir = CacheTrash::GetTrashDir();
+    while(true){
+        ptrash->trash_sem.wait();
+        if(ptrash->IsExit()){
+            break;
+        }
+        struct stat st;
+        if(0 == stat(trash_dir.c_str(), &st) && ptrash->PurgeDir(trash_dir)){
+            S3FS_PRN_INFO("removed the files in the trash(%s).", trash_dir.c_str());
+        }
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// CacheTrash methods
+//------------------------------------------------
+CacheTrash::CacheTrash() : trash_sem(0), thread(0), is_exit(false), seq(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&trash_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init trash_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&trash_lock, "CacheTrash::trash_lock");
+}
+
+CacheTrash::~CacheTrash()
+{
+
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&trash_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy trash_lock: %d", result);
+        abort();
+    }
+}
+
+bool CacheTrash::IsExit()
+{
+    AutoLock auto_lock(&trash_lock);
+    return is_exit;
+}
+
+//
+// Removes the files under the directory(but not the directory itself),
+// and stops when the worker is exiting.
+//
+bool CacheTrash::PurgeDir(const std::string& dir)
+{
+    DIR* dp;
+    if(NULL == (dp = opendir(dir.c_str()))){
+        S3FS_PRN_ERR("could not open dir(%s) - errno(%d)", dir.c_str(), errno);
+        return false;
+    }
+
+    bool           result = true;
+    struct dirent* dent;
+    while(result && NULL != (dent = readdir(dp))){
+        if(0 == strcmp(dent->d_name, "..") || 0 == strcmp(dent->d_name, ".")){
+            continue;
+        }
+        if(IsExit()){
+            result = false;
+            break;
+        }
+        std::string fullpath = dir + "/" + dent->d_name;
+        struct stat st;
+        if(0 != lstat(fullpath.c_str(), &st)){
+            S3FS_PRN_ERR("could not get stats of file(%s) - errno(%d)", fullpath.c_str(), errno);
+            result = false;
+        }else if(S_ISDIR(st.st_mode)){
+            if(!PurgeDir(fullpath) || 0 != rmdir(fullpath.c_str())){
+                result = false;
+            }
+        }else if(0 != unlink(fullpath.c_str())){
+            S3FS_PRN_ERR("could not remove file(%s) - errno(%d)", fullpath.c_str(), errno);
+            result = false;
+        }
+    }
+    closedir(dp);
+
+    return result;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
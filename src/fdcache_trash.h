@@ -0,0 +1,82 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef S3FS_FDCACHE_TRASH_H_
+#define S3FS_FDCACHE_TRASH_H_
+
+#include <pthread.h>
+#include <string>
+
+#include "psemaphore.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Class CacheTrash
+//------------------------------------------------
+// [NOTE]
+// This class removes the cache directories in background.
+// While it is enabled, the cache directory which is removed(by del_cache
+// at the mount) is renamed into the trash directory
+// "<cache_dir>/.<bucket>.trash" at once, and the worker thread removes
+// the files in the trash directory with the lowest cpu and io priority.
+// The trash which is left by the previous mount is also removed after
+// the mount.
+// When it is not enabled, the directory is removed at once.
+//
+class CacheTrash
+{
+    private:
+        static CacheTrash*  singleton;
+
+        Semaphore           trash_sem;
+        pthread_t           thread;
+
+        named_mutex         trash_lock;         // protects all of the following members
+        bool                is_exit;
+        long                seq;                // for the names in the trash directory
+
+    private:
+        static void* Worker(void* arg);
+        static std::string GetTrashDir();
+
+        CacheTrash();
+        ~CacheTrash();
+
+        bool IsExit();
+        bool PurgeDir(const std::string& dir);
+
+    public:
+        static bool Initialize();
+        static void Destroy(bool is_remove_trash);
+        static bool IsEnable() { return (NULL != CacheTrash::singleton); }
+        static bool Remove(const char* dir);
+};
+
+#endif // S3FS_FDCACHE_TRASH_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,188 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "s3fs_logger.h"
+#include "folder_detector.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char FOLDER_SUFFIX[] = "_$folder$";
+
+//------------------------------------------------
+// FolderObjectDetector class variables
+//------------------------------------------------
+FolderObjectDetector FolderObjectDetector::singleton;
+
+//------------------------------------------------
+// FolderObjectDetector class methods
+//------------------------------------------------
+bool FolderObjectDetector::SetEnable(bool enable)
+{
+    bool old = FolderObjectDetector::singleton.is_enable;
+    FolderObjectDetector::singleton.is_enable = enable;
+    return old;
+}
+
+//
+// Called after sampling the bucket at mounting.
+// If sampling failed, the probes are sent under all directories.
+// If the sample is not all of the objects, last_path is the last object
+// path in it.
+//
+void FolderObjectDetector::SetSampled(bool is_success, const std::string& last_path)
+{
+    AutoLock auto_lock(&FolderObjectDetector::singleton.detector_lock);
+
+    FolderObjectDetector::singleton.is_all_dirs  = !is_success;
+    FolderObjectDetector::singleton.sampled_last = is_success ? last_path : std::string("");
+    if(is_success && !last_path.empty()){
+        S3FS_PRN_INFO("\"_$folder$\" objects after %s are always checked.", last_path.c_str());
+    }
+
+    S3FS_PRN_INFO("\"_$folder$\" objects are %s[found in %zu directories].", (is_success ? "detected" : "not detected, then always checked"), FolderObjectDetector::singleton.folder_dirs.size());
+}
+
+// Returns the parent directory path which is terminated by "/".
+std::string FolderObjectDetector::GetParentDir(const std::string& path)
+{
+    std::string strpath = path;
+    std::string::size_type pos;
+    if(std::string::npos != (pos = strpath.find(FOLDER_SUFFIX))){
+        strpath.erase(pos);
+    }
+    while(1 < strpath.length() && '/' == *strpath.rbegin()){
+        strpath.erase(strpath.length() - 1);
+    }
+    if(std::string::npos == (pos = strpath.find_last_of('/'))){
+        return std::string("/");
+    }
+    return strpath.substr(0, pos + 1);
+}
+
+// Returns the "_$folder$" object path for the path.
+std::string FolderObjectDetector::GetFolderPath(const std::string& path)
+{
+    std::string strpath = path;
+    std::string::size_type pos;
+    if(std::string::npos != (pos = strpath.find(FOLDER_SUFFIX))){
+        strpath.erase(pos);
+    }
+    while(1 < strpath.length() && '/' == *strpath.rbegin()){
+        strpath.erase(strpath.length() - 1);
+    }
+    return strpath + FOLDER_SUFFIX;
+}
+
+void FolderObjectDetector::AddFolderObject(const std::string& path)
+{
+    if(!FolderObjectDetector::singleton.is_enable){
+        return;
+    }
+    std::string dirpath = FolderObjectDetector::GetParentDir(path);
+
+    AutoLock auto_lock(&FolderObjectDetector::singleton.detector_lock);
+
+    if(FolderObjectDetector::singleton.folder_dirs.insert(dirpath).second){
+        S3FS_PRN_INFO("found \"_$folder$\" object(%s), then check them under %s.", path.c_str(), dirpath.c_str());
+    }
+}
+
+//
+// Learn from the listing of the directory.
+// The names in the list are relative paths from the directory.
+//
+void FolderObjectDetector::AddFolderObjects(const char* dirpath, const S3ObjList& head)
+{
+    if(!FolderObjectDetector::singleton.is_enable || !dirpath){
+        return;
+    }
+    s3obj_list_t names;
+    if(!head.GetNameList(names, false, false)){
+        return;
+    }
+    std::string basepath = dirpath;
+    if(basepath.empty() || '/' != *basepath.rbegin()){
+        basepath += "/";
+    }
+    for(s3obj_list_t::const_iterator iter = names.begin(); iter != names.end(); ++iter){
+        if(std::string::npos != iter->find(FOLDER_SUFFIX)){
+            FolderObjectDetector::AddFolderObject(basepath + (*iter));
+        }
+    }
+}
+
+bool FolderObjectDetector::IsNeedCheck(const char* path)
+{
+    if(!FolderObjectDetector::singleton.is_enable || !path){
+        return true;
+    }
+    std::string dirpath = FolderObjectDetector::GetParentDir(std::string(path));
+
+    AutoLock auto_lock(&FolderObjectDetector::singleton.detector_lock);
+
+    if(FolderObjectDetector::singleton.is_all_dirs){
+        return true;
+    }
+    if(!FolderObjectDetector::singleton.sampled_last.empty() && FolderObjectDetector::singleton.sampled_last < FolderObjectDetector::GetFolderPath(std::string(path))){
+        // the sample did not cover it
+        return true;
+    }
+    return (FolderObjectDetector::singleton.folder_dirs.end() != FolderObjectDetector::singleton.folder_dirs.find(dirpath));
+}
+
+//------------------------------------------------
+// FolderObjectDetector methods
+//------------------------------------------------
+FolderObjectDetector::FolderObjectDetector() : is_enable(false), is_all_dirs(true)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+    int result;
+    if(0 != (result = pthread_mutex_init(&detector_lock, &attr))){
+        S3FS_PRN_CRIT("failed to init detector_lock: %d", result);
+        abort();
+    }
+}
+
+FolderObjectDetector::~FolderObjectDetector()
+{
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&detector_lock))){
+        S3FS_PRN_CRIT("failed to destroy detector_lock: %d", result);
+        abort();
+    }
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,86 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_FOLDER_DETECTOR_H_
+#define S3FS_FOLDER_DETECTOR_H_
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <set>
+#include <string>
+
+#include "s3objlist.h"
+
+//------------------------------------------------
+// Class FolderObjectDetector
+//------------------------------------------------
+// [NOTE]
+// When the compat_dir_detect option is specified, this class learns the
+// directories which have "_$folder$" objects in them, from the listing
+// which is sampled at mounting and from all listings after that.
+// The HEAD requests for "<dir>_$folder$" are sent only under the learned
+// directories, and they are sent under all directories until sampling is
+// finished(or if sampling failed).
+// The sample is one page of the listing in the order of the object keys,
+// then the HEAD requests are always sent for the "_$folder$" objects which
+// are after the last object in the sample.
+// Since the "_$folder$" object is listed in its parent directory, the
+// probes under the directory are enabled again once the directory is
+// listed after the object is made by other clients.
+//
+class FolderObjectDetector
+{
+    private:
+        static FolderObjectDetector singleton;
+
+        bool                  is_enable;
+        pthread_mutex_t       detector_lock;    // protects is_all_dirs and folder_dirs
+        bool                  is_all_dirs;      // need to check under all directories
+        std::string           sampled_last;     // last path in the sample(empty if all objects are sampled)
+        std::set<std::string> folder_dirs;      // directories which have "_$folder$" objects
+
+    private:
+        FolderObjectDetector();
+        ~FolderObjectDetector();
+
+        static std::string GetParentDir(const std::string& path);
+        static std::string GetFolderPath(const std::string& path);
+
+    public:
+        static bool SetEnable(bool enable);
+        static bool IsEnable() { return FolderObjectDetector::singleton.is_enable; }
+        static void SetSampled(bool is_success, const std::string& last_path = std::string(""));
+
+        static void AddFolderObject(const std::string& path);
+        static void AddFolderObjects(const char* dirpath, const S3ObjList& head);
+        static bool IsNeedCheck(const char* path);
+};
+
+#endif // S3FS_FOLDER_DETECTOR_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
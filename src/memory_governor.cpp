@@ -0,0 +1,395 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <unistd.h>
+
+#include "common.h"
+#include "memory_governor.h"
+#include "string_util.h"
+#include "autolock.h"
+
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char     CGROUP_ROOT_DIR[]       = "/sys/fs/cgroup";
+static const uint64_t CGROUP_NO_LIMIT         = 1ULL << 62;         // cgroup v1 shows no limit by the huge value
+static const int      MIN_BUDGET_DIVISOR      = 8;                  // the budget is not halved under 1/8 of the first one
+
+//------------------------------------------------
+// MemoryGovernor class variables
+//------------------------------------------------
+MemoryGovernor*     MemoryGovernor::singleton = NULL;
+bool                MemoryGovernor::is_auto_limit = false;
+uint64_t            MemoryGovernor::memory_limit = 0;
+memory_consumers_t  MemoryGovernor::consumers;
+std::atomic<bool>   MemoryGovernor::is_trim_requested(false);
+
+//------------------------------------------------
+// Utility
+//------------------------------------------------
+static bool read_cgroup_limit_file(const std::string& path, uint64_t& limit)
+{
+    std::ifstream file(path.c_str());
+    std::string   line;
+    if(!file.good() || !std::getline(file, line)){
+        return false;
+    }
+    line = trim(line);
+
+    off_t value = 0;
+    if("max" == line){
+        limit = 0;
+    }else if(s3fs_strtoofft(&value, line.c_str(), /*base=*/ 10) && 0 < value){
+        limit = (CGROUP_NO_LIMIT <= static_cast<uint64_t>(value)) ? 0 : static_cast<uint64_t>(value);
+    }else{
+        return false;
+    }
+    S3FS_PRN_INFO3("read the memory limit(%llu) of cgroup from %s", static_cast<unsigned long long>(limit), path.c_str());
+    return true;
+}
+
+//------------------------------------------------
+// MemoryGovernor class methods
+//------------------------------------------------
+//
+// The value is "auto" or the limit in MB.
+//
+bool MemoryGovernor::SetMemoryLimit(const char* value)
+{
+    if(!value){
+        return false;
+    }
+    if(0 == strcasecmp(value, "auto")){
+        MemoryGovernor::is_auto_limit = true;
+        MemoryGovernor::memory_limit  = 0;
+        return true;
+    }
+    off_t limit = 0;
+    if(!s3fs_strtoofft(&limit, value, /*base=*/ 10) || limit <= 0){
+        return false;
+    }
+    MemoryGovernor::is_auto_limit = false;
+    MemoryGovernor::memory_limit  = static_cast<uint64_t>(limit) * 1024 * 1024;
+    return true;
+}
+
+bool MemoryGovernor::AddConsumer(const char* name, int percent, memory_usage_func usage, memory_budget_func budget)
+{
+    if(!name || percent <= 0 || 100 < percent || !usage || !budget){
+        return false;
+    }
+    if(MemoryGovernor::singleton){
+        S3FS_PRN_ERR("Could not add the memory consumer(%s) after starting.", name);
+        return false;
+    }
+    MemoryGovernor::consumers.push_back(memory_consumer(name, percent, usage, budget));
+    return true;
+}
+
+bool MemoryGovernor::Initialize()
+{
+    uint64_t limit = MemoryGovernor::memory_limit;
+    if(MemoryGovernor::is_auto_limit && (!MemoryGovernor::ReadCgroupLimit(limit) || 0 == limit)){
+        S3FS_PRN_WARN("The memory of cgroup is not limited, then the memory governor is not started.");
+        return false;
+    }
+    if(0 == limit){
+        return false;
+    }
+    uint64_t rss = 0;
+    if(!MemoryGovernor::ReadRss(rss)){
+        S3FS_PRN_ERR("Could not read the memory usage of the process, then the memory governor is not started.");
+        return false;
+    }
+    if(MemoryGovernor::singleton){
+        S3FS_PRN_WARN("Already singleton for memory governor is existed, then re-create it.");
+        MemoryGovernor::Destroy();
+    }
+    MemoryGovernor::singleton = new MemoryGovernor(limit);
+
+    int result;
+    if(0 != (result = pthread_create(&MemoryGovernor::singleton->thread, NULL, MemoryGovernor::Worker, static_cast<void*>(MemoryGovernor::singleton)))){
+        S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+        delete MemoryGovernor::singleton;
+        MemoryGovernor::singleton = NULL;
+        return false;
+    }
+    S3FS_PRN_INFO("started the memory governor[limit=%llu][rss=%llu]", static_cast<unsigned long long>(limit), static_cast<unsigned long long>(rss));
+    return true;
+}
+
+void MemoryGovernor::Destroy()
+{
+    if(MemoryGovernor::singleton){
+        {
+            AutoLock auto_lock(&(MemoryGovernor::singleton->governor_lock));
+            MemoryGovernor::singleton->is_exit = true;
+            pthread_cond_broadcast(&(MemoryGovernor::singleton->governor_cond));
+        }
+        void* retval = NULL;
+        int   result;
+        if(0 != (result = pthread_join(MemoryGovernor::singleton->thread, &retval))){
+            S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+        }
+        delete MemoryGovernor::singleton;
+        MemoryGovernor::singleton = NULL;
+    }
+}
+
+//
+// While the worker thread is running, the trimming is done by it at the
+// next interval. Otherwise the caller trims only in the build with the
+// S3FS_MALLOC_TRIM flag.
+//
+void MemoryGovernor::RequestTrim(int pad)
+{
+    if(MemoryGovernor::singleton){
+        MemoryGovernor::is_trim_requested = true;
+        return;
+    }
+#if defined(S3FS_MALLOC_TRIM) && defined(HAVE_MALLOC_TRIM)
+    malloc_trim(pad);
+#endif
+}
+
+//
+// Reads the memory limit of the cgroup(v2, then v1) which the process
+// belongs to. The limit is 0 if it is not limited.
+//
+bool MemoryGovernor::ReadCgroupLimit(uint64_t& limit)
+{
+    std::list<std::string> candidates;
+
+    std::ifstream cgroup("/proc/self/cgroup");
+    std::string   line;
+    while(cgroup.good() && std::getline(cgroup, line)){
+        // "<id>:<controllers>:<path>"
+        std::string::size_type pos1 = line.find(':');
+        std::string::size_type pos2 = (std::string::npos == pos1) ? std::string::npos : line.find(':', pos1 + 1);
+        if(std::string::npos == pos2){
+            continue;
+        }
+        std::string controllers = "," + line.substr(pos1 + 1, pos2 - pos1 - 1) + ",";
+        std::string path        = line.substr(pos2 + 1);
+        if("/" == path){
+            path.clear();
+        }
+        if("0" == line.substr(0, pos1) && ",," == controllers){
+            candidates.push_front(std::string(CGROUP_ROOT_DIR) + path + "/memory.max");
+        }else if(std::string::npos != controllers.find(",memory,")){
+            candidates.push_back(std::string(CGROUP_ROOT_DIR) + "/memory" + path + "/memory.limit_in_bytes");
+        }
+    }
+    // [NOTE]
+    // In the container, the cgroup of the process may be shown as the root.
+    candidates.push_back(std::string(CGROUP_ROOT_DIR) + "/memory.max");
+    candidates.push_back(std::string(CGROUP_ROOT_DIR) + "/memory/memory.limit_in_bytes");
+
+    for(std::list<std::string>::const_iterator iter = candidates.begin(); iter != candidates.end(); ++iter){
+        if(read_cgroup_limit_file(*iter, limit) && 0 < limit){
+            return true;
+        }
+    }
+    limit = 0;
+    return false;
+}
+
+bool MemoryGovernor::ReadRss(uint64_t& rss)
+{
+    std::ifstream      statm("/proc/self/statm");
+    unsigned long long size     = 0;
+    unsigned long long resident = 0;
+    if(!statm.good() || !(statm >> size >> resident)){
+        return false;
+    }
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if(pagesize <= 0){
+        return false;
+    }
+    rss = static_cast<uint64_t>(resident) * static_cast<uint64_t>(pagesize);
+    return true;
+}
+
+bool MemoryGovernor::Trim()
+{
+#ifdef HAVE_MALLOC_TRIM
+    return (1 == malloc_trim(0));
+#else
+    return false;
+#endif
+}
+
+//
+// Thread worker
+//
+void* MemoryGovernor::Worker(void* arg)
+{
+    MemoryGovernor* pgovernor = static_cast<MemoryGovernor*>(arg);
+    if(!pgovernor){
+        S3FS_PRN_ERR("The parameter for worker thread is invalid.");
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in MemoryGovernor.");
+
+    while(pgovernor->WaitInterval()){
+        pgovernor->Govern();
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// MemoryGovernor methods
+//------------------------------------------------
+MemoryGovernor::MemoryGovernor(uint64_t limit_bytes) : is_exit(false), is_pressure(false), limit(limit_bytes)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&governor_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init governor_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&governor_lock, "MemoryGovernor::governor_lock");
+
+    if(0 != (result = pthread_cond_init(&governor_cond, NULL))){
+        S3FS_PRN_CRIT("failed to init governor_cond: %d", result);
+        abort();
+    }
+}
+
+MemoryGovernor::~MemoryGovernor()
+{
+    // restore the budgets of the consumers
+    for(memory_consumers_t::iterator iter = MemoryGovernor::consumers.begin(); iter != MemoryGovernor::consumers.end(); ++iter){
+        if(0 != iter->budget){
+            iter->budget = 0;
+            (*(iter->pbudget))(0);
+        }
+    }
+
+    int result;
+    if(0 != (result = pthread_cond_destroy(&governor_cond))){
+        S3FS_PRN_CRIT("failed to destroy governor_cond: %d", result);
+        abort();
+    }
+    if(0 != (result = pthread_mutex_destroy(&governor_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy governor_lock: %d", result);
+        abort();
+    }
+}
+
+//
+// Returns false if the worker thread should exit.
+//
+bool MemoryGovernor::WaitInterval()
+{
+    AutoLock auto_lock(&governor_lock);
+
+    if(is_exit){
+        return false;
+    }
+    struct timespec abstime;
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_sec += MemoryGovernor::CHECK_INTERVAL;
+
+    int result = 0;
+    while(!is_exit && 0 == (result = pthread_cond_timedwait(&governor_cond, &governor_lock.mutex, &abstime))){
+        // spurious wakeup
+    }
+    if(0 != result && ETIMEDOUT != result){
+        S3FS_PRN_WARN("failed pthread_cond_timedwait - result(%d)", result);
+    }
+    return !is_exit;
+}
+
+void MemoryGovernor::Govern()
+{
+    uint64_t rss = 0;
+    if(!MemoryGovernor::ReadRss(rss)){
+        S3FS_PRN_WARN("Could not read the memory usage of the process.");
+        return;
+    }
+    uint64_t target = limit / 100 * MemoryGovernor::TARGET_PERCENT;
+    uint64_t relief = limit / 100 * MemoryGovernor::RELIEF_PERCENT;
+
+    if(rss <= target){
+        if(is_pressure && rss < relief){
+            S3FS_PRN_INFO("memory pressure is relieved[rss=%llu][limit=%llu]", static_cast<unsigned long long>(rss), static_cast<unsigned long long>(limit));
+            is_pressure = false;
+            for(memory_consumers_t::iterator iter = MemoryGovernor::consumers.begin(); iter != MemoryGovernor::consumers.end(); ++iter){
+                iter->budget = 0;
+                (*(iter->pbudget))(0);
+            }
+        }
+        if(MemoryGovernor::is_trim_requested.exchange(false)){
+            MemoryGovernor::Trim();
+        }
+        return;
+    }
+
+    if(!is_pressure){
+        S3FS_PRN_WARN("memory is under pressure[rss=%llu][target=%llu][limit=%llu]", static_cast<unsigned long long>(rss), static_cast<unsigned long long>(target), static_cast<unsigned long long>(limit));
+        is_pressure = true;
+    }
+
+    // [NOTE]
+    // At first, the consumers are given the budgets in the target. If the
+    // pressure continues, the budgets are halved down to the usage.
+    //
+    for(memory_consumers_t::iterator iter = MemoryGovernor::consumers.begin(); iter != MemoryGovernor::consumers.end(); ++iter){
+        uint64_t usage  = (*(iter->pusage))();
+        uint64_t budget = target / 100 * iter->percent;
+        if(0 != iter->budget){
+            budget = std::max(std::min(iter->budget, usage) / 2, budget / MIN_BUDGET_DIVISOR);
+        }
+        iter->budget = std::max(budget, static_cast<uint64_t>(1));
+
+        S3FS_PRN_INFO("shrink %s in the budget[usage=%llu][budget=%llu]", iter->name.c_str(), static_cast<unsigned long long>(usage), static_cast<unsigned long long>(iter->budget));
+        if(!(*(iter->pbudget))(iter->budget)){
+            S3FS_PRN_DBG("%s could not shrink in the budget now.", iter->name.c_str());
+        }
+    }
+    MemoryGovernor::is_trim_requested = false;
+    MemoryGovernor::Trim();
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,122 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_MEMORY_GOVERNOR_H_
+#define S3FS_MEMORY_GOVERNOR_H_
+
+#include <atomic>
+#include <list>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+
+#include "autolock.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+//
+// Functions which return the memory usage(bytes) of the subsystem, and
+// which shrink the subsystem in the budget(bytes, 0 means no budget)
+//
+typedef uint64_t (*memory_usage_func)();
+typedef bool (*memory_budget_func)(uint64_t budget);
+
+struct memory_consumer
+{
+    std::string         name;
+    int                 percent;        // budget in the target memory(%)
+    memory_usage_func   pusage;
+    memory_budget_func  pbudget;
+    uint64_t            budget;         // current budget, 0 while the memory is not under pressure
+
+    memory_consumer(const char* cname, int cpercent, memory_usage_func usage, memory_budget_func budget_func) : name(cname), percent(cpercent), pusage(usage), pbudget(budget_func), budget(0) {}
+};
+
+typedef std::list<memory_consumer> memory_consumers_t;
+
+//------------------------------------------------
+// Class MemoryGovernor
+//------------------------------------------------
+// [NOTE]
+// This class keeps the memory(RSS) of the process under the limit which
+// is specified by the memory_limit option, or which is read from the
+// cgroup of the process(memory_limit=auto).
+// The worker thread checks the RSS at every interval. When it is over the
+// target(TARGET_PERCENT of the limit), the subsystems which are added as
+// consumers are given the budgets in the target and are asked to shrink
+// in them, and the freed memory is returned to the system by malloc_trim.
+// The budgets are halved while the pressure continues, and are removed
+// when the RSS goes down under RELIEF_PERCENT of the limit.
+// While the worker thread is running, S3FS_MALLOCTRIM only requests the
+// trimming to it, instead of trimming in the caller thread.
+//
+class MemoryGovernor
+{
+    private:
+        static MemoryGovernor*      singleton;
+        static bool                 is_auto_limit;
+        static uint64_t             memory_limit;
+        static memory_consumers_t   consumers;
+        static std::atomic<bool>    is_trim_requested;
+
+        pthread_t                   thread;
+        named_mutex                 governor_lock;      // protects is_exit and governor_cond
+        pthread_cond_t              governor_cond;
+        bool                        is_exit;
+        bool                        is_pressure;
+        uint64_t                    limit;
+
+    private:
+        static void* Worker(void* arg);
+        static bool ReadCgroupLimit(uint64_t& limit);
+        static bool ReadRss(uint64_t& rss);
+        static bool Trim();
+
+        explicit MemoryGovernor(uint64_t limit_bytes);
+        ~MemoryGovernor();
+
+        bool WaitInterval();
+        void Govern();
+
+    public:
+        static const int TARGET_PERCENT     = 80;
+        static const int RELIEF_PERCENT     = 70;
+        static const int CHECK_INTERVAL     = 1;        // seconds
+
+        static bool SetMemoryLimit(const char* value);
+        static bool IsSpecified() { return (MemoryGovernor::is_auto_limit || 0 < MemoryGovernor::memory_limit); }
+        static bool AddConsumer(const char* name, int percent, memory_usage_func usage, memory_budget_func budget);
+        static bool Initialize();
+        static void Destroy();
+        static bool IsEnable() { return (NULL != MemoryGovernor::singleton); }
+        static void RequestTrim(int pad);
+};
+
+#endif // S3FS_MEMORY_GOVERNOR_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
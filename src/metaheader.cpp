@@ -420,6 +420,29 @@ off_t get_symlink_size(const headers_t& meta)
     return ret < 0 ? 0 : ret;
 }
 
+//
+// Get the type and the target of the symbolic link from
+// "x-oss-meta-symlink-target" header("type:size:urlencode(target)").
+//
+bool get_symlink_attr(const headers_t& meta, std::string& type, std::string& target)
+{
+    headers_t::const_iterator iter = meta.find("x-oss-meta-symlink-target");
+    if(meta.end() == iter){
+        return false;
+    }
+    const std::string& value = iter->second;
+    std::string::size_type pos = value.find(':', 0);
+    if(std::string::npos != pos){
+        type = value.substr(0, pos);
+    }
+
+    pos = value.find(':', pos + 1);
+    if(std::string::npos != pos){
+        target = urlDecode(value.substr(pos + 1));
+    }
+    return true;
+}
+
 
 /*
 * Local variables:
@@ -60,6 +60,7 @@ bool merge_headers(headers_t& base, const headers_t& additional, bool add_noexis
 bool simple_parse_xml(const char* data, size_t len, const char* key, std::string& value);
 std::string utc_to_gmt(const char* s);
 off_t get_symlink_size(const headers_t& meta);
+bool get_symlink_attr(const headers_t& meta, std::string& type, std::string& target);
 #endif // S3FS_METAHEADER_H_
 
 /*
@@ -0,0 +1,802 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fstream>
+#include <stdint.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <curl/curl.h>
+
+#include "common.h"
+#include "s3fs.h"
+#include "peer_cache.h"
+#include "fdcache_chunk.h"
+#include "curl.h"
+#include "string_util.h"
+#include "autolock.h"
+#include "singleflight.h"
+
+//------------------------------------------------
+// Symbols
+//------------------------------------------------
+static const char   PEER_TOKEN_HEADER[] = "X-Ossfs-Peer-Token";
+static const char   PEER_TOKEN_ENV[]    = "OSSPEERCACHETOKEN";
+static const size_t MAX_REQUEST_SIZE    = 8192;
+
+static SingleFlight<std::string> serve_flight;     // for downloading the chunks which are requested at the same time
+
+#ifdef MSG_NOSIGNAL
+#define PEER_SEND_FLAGS     MSG_NOSIGNAL
+#else
+#define PEER_SEND_FLAGS     0
+#endif
+
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+static bool split_host_port(const std::string& peer, std::string& host, std::string& port)
+{
+    std::string::size_type pos = peer.rfind(':');
+    if(std::string::npos == pos || 0 == pos || peer.size() <= pos + 1){
+        return false;
+    }
+    host = peer.substr(0, pos);
+    port = peer.substr(pos + 1);
+    return true;
+}
+
+static bool send_all(int fd, const char* buf, size_t size)
+{
+    for(size_t sent = 0; sent < size; ){
+        ssize_t bytes = send(fd, &buf[sent], size - sent, PEER_SEND_FLAGS);
+        if(bytes <= 0){
+            if(-1 == bytes && EINTR == errno){
+                continue;
+            }
+            return false;
+        }
+        sent += static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+static bool send_response(int fd, int code, const char* body, size_t size)
+{
+    const char* reason;
+    switch(code){
+        case 200: reason = "OK";            break;
+        case 400: reason = "Bad Request";   break;
+        case 403: reason = "Forbidden";     break;
+        case 404: reason = "Not Found";     break;
+        case 503: reason = "Service Unavailable"; break;
+        default:  reason = "Error";         break;
+    }
+    std::string header = "HTTP/1.0 " + str(code) + " " + reason + "\r\nContent-Length: " + str(size) + "\r\nConnection: close\r\n\r\n";
+    if(!send_all(fd, header.c_str(), header.size())){
+        return false;
+    }
+    return (0 == size || send_all(fd, body, size));
+}
+
+static long elapsed_msec(const struct timespec& start)
+{
+    struct timespec now;
+    if(-1 == clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &now)){
+        return 0;
+    }
+    return static_cast<long>(now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / (1000 * 1000);
+}
+
+//
+// Receive the request header into request, returns false if failed.
+// The whole header must be received in timeout_ms, so that the peer which
+// sends the header byte by byte can not keep the connection.
+//
+static bool recv_request(int fd, std::string& request, long timeout_ms)
+{
+    struct timespec start;
+    if(-1 == clock_gettime(static_cast<clockid_t>(CLOCK_MONOTONIC), &start)){
+        return false;
+    }
+    char buf[1024];
+    while(std::string::npos == request.find("\r\n\r\n")){
+        long rest = timeout_ms - elapsed_msec(start);
+        if(rest <= 0){
+            return false;
+        }
+        struct pollfd pfd;
+        pfd.fd      = fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        int result  = poll(&pfd, 1, static_cast<int>(rest));
+        if(-1 == result && EINTR == errno){
+            continue;
+        }
+        if(result <= 0){
+            return false;
+        }
+        ssize_t bytes = recv(fd, buf, sizeof(buf), 0);
+        if(-1 == bytes && EINTR == errno){
+            continue;
+        }
+        if(bytes <= 0 || MAX_REQUEST_SIZE < request.size() + bytes){
+            return false;
+        }
+        request.append(buf, bytes);
+    }
+    return true;
+}
+
+static void set_send_timeout(int fd, long sec, long usec)
+{
+    struct timeval tv;
+    tv.tv_sec  = sec;
+    tv.tv_usec = usec;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+//
+// Compare the token in constant time for the length of the received one,
+// so that the time does not tell how many bytes are matched.
+//
+static bool is_equal_token(const std::string& received, const std::string& token)
+{
+    unsigned char diff = (received.size() == token.size() ? 0 : 1);
+    for(std::string::size_type pos = 0; pos < received.size(); ++pos){
+        diff |= static_cast<unsigned char>(received[pos]) ^ static_cast<unsigned char>(pos < token.size() ? token[pos] : 0);
+    }
+    return (0 == diff);
+}
+
+//
+// Buffer for receiving a chunk from the peer
+//
+struct peer_recv_buffer
+{
+    char*  buf;
+    size_t size;
+    size_t received;
+
+    peer_recv_buffer(char* pbuf, size_t bufsize) : buf(pbuf), size(bufsize), received(0) {}
+};
+
+static size_t peer_write_callback(void* ptr, size_t size, size_t nmemb, void* userp)
+{
+    peer_recv_buffer* pbody = static_cast<peer_recv_buffer*>(userp);
+    size_t            bytes = size * nmemb;
+    if(pbody->size < pbody->received + bytes){
+        // larger than the chunk, then stop receiving
+        return 0;
+    }
+    memcpy(&pbody->buf[pbody->received], ptr, bytes);
+    pbody->received += bytes;
+    return bytes;
+}
+
+//------------------------------------------------
+// PeerCache class variables
+//------------------------------------------------
+PeerCache*  PeerCache::singleton = NULL;
+peer_list_t PeerCache::peers;
+std::string PeerCache::self;
+std::string PeerCache::token;
+
+//------------------------------------------------
+// PeerCache class methods
+//------------------------------------------------
+bool PeerCache::SetPeers(const char* strpeers)
+{
+    PeerCache::peers.clear();
+    if(!strpeers){
+        return false;
+    }
+    std::string list = strpeers;
+    for(std::string::size_type start = 0; start <= list.size(); ){
+        std::string::size_type pos  = list.find(',', start);
+        std::string            peer = trim(list.substr(start, (std::string::npos == pos ? std::string::npos : pos - start)));
+        std::string            host;
+        std::string            port;
+        if(!split_host_port(peer, host, port)){
+            S3FS_PRN_ERR("peer(%s) is not host:port.", peer.c_str());
+            PeerCache::peers.clear();
+            return false;
+        }
+        PeerCache::peers.push_back(peer);
+        if(std::string::npos == pos){
+            break;
+        }
+        start = pos + 1;
+    }
+    return !PeerCache::peers.empty();
+}
+
+bool PeerCache::SetSelf(const char* strself)
+{
+    std::string host;
+    std::string port;
+    if(!strself || !split_host_port(strself, host, port)){
+        return false;
+    }
+    PeerCache::self = strself;
+    return true;
+}
+
+bool PeerCache::SetTokenFile(const char* filepath)
+{
+    if(!filepath || '\0' == filepath[0]){
+        S3FS_PRN_ERR("peer cache token filepath is empty.");
+        return false;
+    }
+    struct stat st;
+    if(0 != stat(filepath, &st)){
+        S3FS_PRN_ERR("could not open peer cache token file(%s).", filepath);
+        return false;
+    }
+    if(st.st_mode & (S_IXUSR | S_IRWXG | S_IRWXO)){
+        S3FS_PRN_ERR("peer cache token file %s should be 0600 permissions.", filepath);
+        return false;
+    }
+    std::ifstream tokenfs(filepath);
+    std::string   line;
+    if(!tokenfs.good() || !getline(tokenfs, line)){
+        S3FS_PRN_ERR("Could not read peer cache token file(%s).", filepath);
+        return false;
+    }
+    PeerCache::token = trim(line);
+    if(PeerCache::token.empty()){
+        S3FS_PRN_ERR("There is no token in peer cache token file(%s).", filepath);
+        return false;
+    }
+    return true;
+}
+
+bool PeerCache::CheckParameters()
+{
+    if(PeerCache::peers.empty()){
+        return true;
+    }
+    if(PeerCache::token.empty()){
+        const char* envtoken = getenv(PEER_TOKEN_ENV);
+        if(envtoken){
+            PeerCache::token = trim(std::string(envtoken));
+        }
+    }
+    if(PeerCache::self.empty()){
+        S3FS_PRN_EXIT("peer_cache option requires peer_cache_self option.");
+        return false;
+    }
+    if(PeerCache::peers.end() == std::find(PeerCache::peers.begin(), PeerCache::peers.end(), PeerCache::self)){
+        S3FS_PRN_EXIT("peer_cache_self(%s) is not in the peer_cache list.", PeerCache::self.c_str());
+        return false;
+    }
+    if(PeerCache::token.empty()){
+        S3FS_PRN_EXIT("peer_cache option requires peer_cache_token_file option or %s environment.", PEER_TOKEN_ENV);
+        return false;
+    }
+    if(!ChunkCache::IsEnable()){
+        S3FS_PRN_EXIT("peer_cache option requires cache_layout=chunk option.");
+        return false;
+    }
+    return true;
+}
+
+bool PeerCache::Initialize()
+{
+    if(PeerCache::singleton){
+        S3FS_PRN_WARN("Already singleton for peer cache is existed, then re-create it.");
+        PeerCache::Destroy();
+    }
+    PeerCache::singleton = new PeerCache();
+    if(!PeerCache::singleton->StartListener()){
+        delete PeerCache::singleton;
+        PeerCache::singleton = NULL;
+        return false;
+    }
+    S3FS_PRN_INFO("peer cache started on %s with %zu peers.", PeerCache::self.c_str(), PeerCache::peers.size());
+    return true;
+}
+
+void PeerCache::Destroy()
+{
+    if(PeerCache::singleton){
+        PeerCache::singleton->StopListener();
+        delete PeerCache::singleton;
+        PeerCache::singleton = NULL;
+    }
+}
+
+// [NOTE]
+// FNV-1a 64bit with the finalizer of MurmurHash3.
+// FNV-1a alone hardly changes the upper bits for the keys which differ
+// only in the last characters(ex. "host#1" and "host#2"), then the points
+// on the ring are clustered and one peer owns most of the chunks.
+//
+unsigned long long PeerCache::Hash(const std::string& key)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for(std::string::const_iterator iter = key.begin(); iter != key.end(); ++iter){
+        hash ^= static_cast<unsigned char>(*iter);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void PeerCache::MakeRing(const peer_list_t& peerlist, peer_ring_t& peerring)
+{
+    peerring.clear();
+    for(peer_list_t::const_iterator iter = peerlist.begin(); iter != peerlist.end(); ++iter){
+        for(int cnt = 0; cnt < PeerCache::VIRTUAL_NODES; ++cnt){
+            peerring[PeerCache::Hash(*iter + "#" + str(cnt))] = *iter;
+        }
+    }
+}
+
+//
+// Returns the peer which owns the chunk, or empty if the ring is empty.
+//
+std::string PeerCache::FindOwner(const peer_ring_t& peerring, const char* path, off_t index)
+{
+    if(peerring.empty() || !path){
+        return std::string();
+    }
+    peer_ring_t::const_iterator iter = peerring.lower_bound(PeerCache::Hash(std::string(path) + ":" + str(index)));
+    if(peerring.end() == iter){
+        iter = peerring.begin();
+    }
+    return iter->second;
+}
+
+//
+// Returns the size of the chunk read from the owner, or -1 if the owner
+// does not return it(the owner is this node, down or failed).
+//
+ssize_t PeerCache::Read(const char* path, const std::string& etag, off_t index, char* buf, size_t size)
+{
+    if(!PeerCache::singleton || !path || !buf || 0 == size){
+        return -1;
+    }
+    std::string owner;
+    if(!PeerCache::singleton->GetOwner(path, index, owner)){
+        return -1;
+    }
+    std::string url = "http://" + owner + "/chunk?path=" + urlEncodeOssv4Query(path) + "&etag=" + urlEncodeOssv4Query(etag) + "&index=" + str(index) + "&size=" + str(size);
+    std::string hdr = std::string(PEER_TOKEN_HEADER) + ": " + PeerCache::token;
+
+    CURL* hCurl = curl_easy_init();
+    if(!hCurl){
+        return -1;
+    }
+    struct curl_slist* headers = curl_slist_append(NULL, hdr.c_str());
+    peer_recv_buffer   body(buf, size);
+    long               code    = 0;
+
+    curl_easy_setopt(hCurl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(hCurl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(hCurl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(hCurl, CURLOPT_NOPROXY, "*");
+    curl_easy_setopt(hCurl, CURLOPT_CONNECTTIMEOUT, PeerCache::CONNECT_TIMEOUT);
+    curl_easy_setopt(hCurl, CURLOPT_TIMEOUT, PeerCache::REQUEST_TIMEOUT);
+    curl_easy_setopt(hCurl, CURLOPT_WRITEFUNCTION, peer_write_callback);
+    curl_easy_setopt(hCurl, CURLOPT_WRITEDATA, static_cast<void*>(&body));
+
+    CURLcode result = curl_easy_perform(hCurl);
+    if(CURLE_OK == result){
+        curl_easy_getinfo(hCurl, CURLINFO_RESPONSE_CODE, &code);
+    }
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(hCurl);
+
+    if(CURLE_OK != result){
+        S3FS_PRN_WARN("failed to get the chunk(%lld) of %s from peer(%s): %s", static_cast<long long int>(index), path, owner.c_str(), curl_easy_strerror(result));
+        PeerCache::singleton->SetPeerDown(owner);
+        return -1;
+    }
+    if(503 == code){
+        // the owner is busy, but it is not down
+        S3FS_PRN_DBG("peer(%s) is busy for the chunk(%lld) of %s.", owner.c_str(), static_cast<long long int>(index), path);
+        return -1;
+    }
+    if(200 != code || size != body.received){
+        S3FS_PRN_DBG("peer(%s) did not return the chunk(%lld) of %s: code=%ld, size=%zu", owner.c_str(), static_cast<long long int>(index), path, code, body.received);
+        return -1;
+    }
+    S3FS_PRN_DBG("got the chunk(%lld) of %s from peer(%s).", static_cast<long long int>(index), path, owner.c_str());
+    return static_cast<ssize_t>(body.received);
+}
+
+//
+// Thread which accepts the requests from the peers
+//
+void* PeerCache::Listener(void* arg)
+{
+    PeerCache* pcache = static_cast<PeerCache*>(arg);
+    if(!pcache){
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start listener thread in PeerCache.");
+
+    while(!pcache->IsExit()){
+        struct pollfd pfd;
+        pfd.fd      = pcache->listen_fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, 1000) <= 0){
+            continue;
+        }
+        int fd = accept(pcache->listen_fd, NULL, NULL);
+        if(-1 == fd){
+            continue;
+        }
+        if(!pcache->recv_sem.try_wait()){
+            // [NOTE]
+            // The request is received before replying, so that the peer
+            // gets the response instead of the reset connection.
+            S3FS_PRN_WARN("too many connections from peers, then the request is rejected.");
+            set_send_timeout(fd, 0, 100 * 1000);
+
+            std::string request;
+            recv_request(fd, request, 100);
+            send_response(fd, 503, NULL, 0);
+            close(fd);
+            continue;
+        }
+        pthread_attr_t attr;
+        pthread_t      handler;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int result;
+        if(0 != (result = pthread_create(&handler, &attr, PeerCache::Handler, reinterpret_cast<void*>(static_cast<intptr_t>(fd))))){
+            S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+            close(fd);
+            pcache->recv_sem.post();
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return NULL;
+}
+
+//
+// Thread which serves one request from the peer
+//
+// [NOTE]
+// The handler holds a receiving slot(recv_sem) until the request is
+// authorized, and only the authorized request takes a serving slot
+// (serve_sem) for loading and sending the chunk.
+//
+void* PeerCache::Handler(void* arg)
+{
+    int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+
+    set_send_timeout(fd, PeerCache::HEADER_TIMEOUT, 0);
+
+    std::string request;
+    std::string path;
+    std::string etag;
+    off_t       index = -1;
+    off_t       size  = -1;
+    int         code;
+    if(!recv_request(fd, request, PeerCache::HEADER_TIMEOUT * 1000)){
+        code = 400;
+    }else if(403 == (code = PeerCache::ParseRequest(request, path, etag, index, size))){
+        S3FS_PRN_WARN("the request from peer is not authorized.");
+    }
+
+    if(200 != code || !PeerCache::singleton->serve_sem.try_wait()){
+        if(200 == code){
+            S3FS_PRN_WARN("too many requests from peers, then the request is rejected.");
+            code = 503;
+        }
+        send_response(fd, code, NULL, 0);
+        close(fd);
+        PeerCache::singleton->recv_sem.post();
+        return NULL;
+    }
+    PeerCache::singleton->recv_sem.post();
+
+    set_send_timeout(fd, PeerCache::REQUEST_TIMEOUT, 0);
+    ServeChunk(fd, path, etag, index, size);
+    close(fd);
+
+    PeerCache::singleton->serve_sem.post();
+    return NULL;
+}
+
+//
+// Parse the request header, and returns the HTTP status code for it.
+// 200 means that the request is authorized and the parameters are valid.
+//
+int PeerCache::ParseRequest(const std::string& request, std::string& path, std::string& etag, off_t& index, off_t& size)
+{
+    // request line
+    std::string::size_type eol = request.find("\r\n");
+    if(std::string::npos == eol){
+        return 400;
+    }
+    std::string line = request.substr(0, eol);
+    if(0 != line.compare(0, 11, "GET /chunk?")){
+        return 400;
+    }
+    std::string::size_type qend = line.find(' ', 11);
+    if(std::string::npos == qend){
+        return 400;
+    }
+    std::string query = line.substr(11, qend - 11);
+
+    // token
+    bool is_auth = false;
+    for(std::string::size_type pos = eol + 2; pos < request.size(); ){
+        std::string::size_type next   = request.find("\r\n", pos);
+        std::string            header = request.substr(pos, (std::string::npos == next ? std::string::npos : next - pos));
+        std::string::size_type colon  = header.find(':');
+        if(std::string::npos != colon && 0 == strcasecmp(trim(header.substr(0, colon)).c_str(), PEER_TOKEN_HEADER)){
+            is_auth = is_equal_token(trim(header.substr(colon + 1)), PeerCache::token);
+            break;
+        }
+        if(std::string::npos == next){
+            break;
+        }
+        pos = next + 2;
+    }
+    if(!is_auth){
+        return 403;
+    }
+
+    // parameters
+    path.clear();
+    etag.clear();
+    index = -1;
+    size  = -1;
+    for(std::string::size_type start = 0; start <= query.size(); ){
+        std::string::size_type pos   = query.find('&', start);
+        std::string            param = query.substr(start, (std::string::npos == pos ? std::string::npos : pos - start));
+        std::string::size_type eq    = param.find('=');
+        if(std::string::npos != eq){
+            std::string key   = param.substr(0, eq);
+            std::string value = urlDecode(param.substr(eq + 1));
+            if(key == "path"){
+                path = value;
+            }else if(key == "etag"){
+                etag = value;
+            }else if(key == "index"){
+                index = cvt_strtoofft(value.c_str(), /*base=*/ 10);
+            }else if(key == "size"){
+                size = cvt_strtoofft(value.c_str(), /*base=*/ 10);
+            }
+        }
+        if(std::string::npos == pos){
+            break;
+        }
+        start = pos + 1;
+    }
+    off_t chunk_size = ChunkCache::GetChunkSize();
+    if(path.empty() || '/' != path[0] || std::string::npos != (path + "/").find("/../") || etag.empty() || index < 0 || size <= 0 || chunk_size < size){
+        return 400;
+    }
+    return 200;
+}
+
+bool PeerCache::ServeChunk(int fd, const std::string& path, const std::string& etag, off_t index, off_t size)
+{
+    // the requests for the same chunk wait for one loading
+    int         code;
+    std::string data;
+    std::string flight_key = path + "\n" + etag + "\n" + str(index) + "\n" + str(size);
+    if(serve_flight.Join(flight_key, code, data)){
+        code = PeerCache::LoadChunk(path, etag, index, size, data);
+        serve_flight.Done(flight_key, code, data);
+    }
+    if(200 != code){
+        return send_response(fd, code, NULL, 0);
+    }
+    return send_response(fd, 200, data.data(), data.size());
+}
+
+//
+// Load the chunk from the cache or the server into data, and returns the
+// HTTP status code for the response.
+//
+int PeerCache::LoadChunk(const std::string& path, const std::string& etag, off_t index, off_t size, std::string& data)
+{
+    data.resize(static_cast<size_t>(size));
+    if(size == ChunkCache::Read(path.c_str(), etag, index, &data[0], size)){
+        return 200;
+    }
+
+    // [NOTE]
+    // The chunk is downloaded only if the object has the same etag and
+    // the requested size is the same as the chunk of the object.
+    headers_t meta;
+    S3fsCurl  s3fscurl;
+    ssize_t   rsize = 0;
+    off_t     chunk_size = ChunkCache::GetChunkSize();
+    data.clear();
+    if(0 != s3fscurl.HeadRequest(path.c_str(), meta) || meta.end() == meta.find("ETag") || etag != meta["ETag"]){
+        return 404;
+    }
+    off_t objsize = meta.end() == meta.find("Content-Length") ? 0 : cvt_strtoofft(meta["Content-Length"].c_str(), /*base=*/ 10);
+    if(objsize <= index * chunk_size || size != std::min(chunk_size, objsize - index * chunk_size)){
+        return 400;
+    }
+    data.resize(static_cast<size_t>(size));
+    S3fsCurl getcurl;
+    if(0 != getcurl.GetObjectStreamRequest(path.c_str(), &data[0], index * chunk_size, size, rsize, etag) || size != rsize){
+        data.clear();
+        return 404;
+    }
+    ChunkCache::Write(path.c_str(), etag, index, data.data(), size);
+    return 200;
+}
+
+//------------------------------------------------
+// PeerCache methods
+//------------------------------------------------
+PeerCache::PeerCache() : is_exit(false), listen_fd(-1), thread(0), recv_sem(PeerCache::MAX_RECV_COUNT), serve_sem(PeerCache::MAX_SERVE_COUNT)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&peer_lock, &attr))){
+        S3FS_PRN_CRIT("failed to init peer_lock: %d", result);
+        abort();
+    }
+    PeerCache::MakeRing(PeerCache::peers, ring);
+}
+
+PeerCache::~PeerCache()
+{
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&peer_lock))){
+        S3FS_PRN_CRIT("failed to destroy peer_lock: %d", result);
+        abort();
+    }
+}
+
+bool PeerCache::StartListener()
+{
+    std::string host;
+    std::string port;
+    if(!split_host_port(PeerCache::self, host, port)){
+        return false;
+    }
+
+    struct addrinfo  hints;
+    struct addrinfo* res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    int result;
+    if(0 != (result = getaddrinfo(host.c_str(), port.c_str(), &hints, &res)) || !res){
+        S3FS_PRN_ERR("could not resolve peer_cache_self(%s): %s", PeerCache::self.c_str(), gai_strerror(result));
+        return false;
+    }
+    listen_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if(-1 == listen_fd){
+        S3FS_PRN_ERR("could not create socket by errno(%d).", errno);
+        freeaddrinfo(res);
+        return false;
+    }
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(-1 == bind(listen_fd, res->ai_addr, res->ai_addrlen) || -1 == listen(listen_fd, PeerCache::MAX_SERVE_COUNT * 4)){
+        S3FS_PRN_ERR("could not listen on %s by errno(%d).", PeerCache::self.c_str(), errno);
+        freeaddrinfo(res);
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    freeaddrinfo(res);
+
+    if(0 != (result = pthread_create(&thread, NULL, PeerCache::Listener, static_cast<void*>(this)))){
+        S3FS_PRN_ERR("failed pthread_create with return code(%d)", result);
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void PeerCache::StopListener()
+{
+    if(-1 == listen_fd){
+        return;
+    }
+    {
+        AutoLock auto_lock(&peer_lock);
+        is_exit = true;
+    }
+    void* retval = NULL;
+    int   result = pthread_join(thread, &retval);
+    if(result){
+        S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+    }
+    close(listen_fd);
+    listen_fd = -1;
+
+    // wait for the handlers which are receiving and serving
+    for(int cnt = 0; cnt < PeerCache::MAX_RECV_COUNT; ++cnt){
+        recv_sem.wait();
+    }
+    for(int cnt = 0; cnt < PeerCache::MAX_SERVE_COUNT; ++cnt){
+        serve_sem.wait();
+    }
+}
+
+bool PeerCache::IsExit()
+{
+    AutoLock auto_lock(&peer_lock);
+    return is_exit;
+}
+
+//
+// Returns false if the owner is this node or is down now.
+//
+bool PeerCache::GetOwner(const char* path, off_t index, std::string& owner)
+{
+    owner = PeerCache::FindOwner(ring, path, index);
+    if(owner.empty() || owner == PeerCache::self){
+        return false;
+    }
+
+    AutoLock auto_lock(&peer_lock);
+    peer_down_t::iterator diter = down_map.find(owner);
+    if(down_map.end() != diter){
+        if(time(NULL) < diter->second){
+            return false;
+        }
+        down_map.erase(diter);
+    }
+    return true;
+}
+
+void PeerCache::SetPeerDown(const std::string& peer)
+{
+    AutoLock auto_lock(&peer_lock);
+    down_map[peer] = time(NULL) + PeerCache::PEER_DOWN_TIME;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,140 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef S3FS_PEER_CACHE_H_
+#define S3FS_PEER_CACHE_H_
+
+#include <ctime>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "psemaphore.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+typedef std::vector<std::string>                    peer_list_t;
+typedef std::map<unsigned long long, std::string>   peer_ring_t;    // hash -> "host:port"
+typedef std::map<std::string, time_t>               peer_down_t;    // "host:port" -> time until the peer is skipped
+
+//------------------------------------------------
+// Class PeerCache
+//------------------------------------------------
+// [NOTE]
+// This class shares the chunks of cache_layout=chunk between the ossfs
+// processes on the nodes of a cluster(the peer_cache option).
+// Each chunk which is keyed by (path, etag, chunk index) is owned by one
+// node, which is decided by the consistent hashing over all nodes. When a
+// node misses a chunk in its local cache, it asks the owner for the chunk
+// before downloading it from the server. The owner returns the chunk from
+// its cache, or downloads it from the server once and caches it, so that
+// the chunk is downloaded only once in the cluster.
+// If the owner is this node, or the owner fails or returns an error, the
+// chunk is downloaded from the server as without this class. The failed
+// peer is skipped for a while.
+//
+// All nodes must mount the same bucket(and the same path in it) with the
+// same cache_chunk_size, and must have the same token which is sent with
+// each request, because the chunks are served over plain HTTP. The token
+// is read from the peer_cache_token_file option or the OSSPEERCACHETOKEN
+// environment, so that it is not shown in the command line.
+// The request header must be received within a short time, and the token
+// is checked before the request takes one of the serving slots, so that
+// the connections which send nothing or the wrong token never hold them.
+// The node which is serving too many requests returns 503, and the peer
+// is not skipped for it. The concurrent requests for the same chunk wait
+// for one downloading.
+//
+//   GET /chunk?path=<path>&etag=<etag>&index=<index>&size=<size> HTTP/1.0
+//   X-Ossfs-Peer-Token: <token>
+//
+class PeerCache
+{
+    private:
+        static const int    MAX_SERVE_COUNT   = 16;   // maximum count of requests which are served at the same time
+        static const int    MAX_RECV_COUNT    = 64;   // maximum count of connections whose request headers are received at the same time
+        static const int    VIRTUAL_NODES     = 64;   // count of the points of each peer on the hash ring
+        static const time_t PEER_DOWN_TIME    = 30;   // seconds for skipping the failed peer
+        static const long   CONNECT_TIMEOUT   = 1;    // seconds
+        static const long   REQUEST_TIMEOUT   = 30;   // seconds
+        static const long   HEADER_TIMEOUT    = 2;    // seconds for receiving the whole request header
+
+        static PeerCache*   singleton;
+        static peer_list_t  peers;
+        static std::string  self;
+        static std::string  token;
+
+        bool                is_exit;
+        int                 listen_fd;
+        pthread_t           thread;
+        Semaphore           recv_sem;
+        Semaphore           serve_sem;
+        peer_ring_t         ring;
+
+        pthread_mutex_t     peer_lock;          // protects is_exit and down_map
+        peer_down_t         down_map;
+
+    private:
+        static void* Listener(void* arg);
+        static void* Handler(void* arg);
+        static bool ServeChunk(int fd, const std::string& path, const std::string& etag, off_t index, off_t size);
+        static int LoadChunk(const std::string& path, const std::string& etag, off_t index, off_t size, std::string& data);
+
+        PeerCache();
+        ~PeerCache();
+
+        bool StartListener();
+        void StopListener();
+        bool IsExit();
+        bool GetOwner(const char* path, off_t index, std::string& owner);
+        void SetPeerDown(const std::string& peer);
+
+    public:
+        static bool SetPeers(const char* strpeers);
+        static bool SetSelf(const char* strself);
+        static bool SetTokenFile(const char* filepath);
+        static bool IsSpecified() { return !PeerCache::peers.empty(); }
+        static bool CheckParameters();
+
+        static bool Initialize();
+        static void Destroy();
+        static bool IsEnable() { return (NULL != PeerCache::singleton); }
+        static ssize_t Read(const char* path, const std::string& etag, off_t index, char* buf, size_t size);
+
+        static unsigned long long Hash(const std::string& key);
+        static void MakeRing(const peer_list_t& peerlist, peer_ring_t& peerring);
+        static std::string FindOwner(const peer_ring_t& peerring, const char* path, off_t index);
+        static int ParseRequest(const std::string& request, std::string& path, std::string& etag, off_t& index, off_t& size);
+};
+
+#endif // S3FS_PEER_CACHE_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -48,6 +48,16 @@
 #include "s3fs_util.h"
 #include "mpu_util.h"
 #include "threadpoolman.h"
+#include "upload_scheduler.h"
+#include "fdcache_async.h"
+#include "fdcache_trash.h"
+#include "singleflight.h"
+#include "cache_refresher.h"
+#include "folder_detector.h"
+#include "traversal_detector.h"
+#include "peer_cache.h"
+#include "direct_read_spill.h"
+#include "memory_governor.h"
 
 //-------------------------------------------------------------------
 // Symbols
@@ -64,6 +74,18 @@ enum dirtype {
     DIRTYPE_NOOBJ = 3,
 };
 
+//
+// Result of HEAD requests which is shared by concurrent lookups
+//
+struct head_flight_value
+{
+    std::string strpath;        // found object path
+    headers_t   meta;
+    bool        isforce;
+
+    head_flight_value() : isforce(false) {}
+};
+
 //-------------------------------------------------------------------
 // Static variables
 //-------------------------------------------------------------------
@@ -102,6 +124,13 @@ static bool is_refresh_fakemeta   = false;
 static off_t readdir_check_size   = 0;
 static bool is_new_symlink_format = false;
 static bool is_specified_region   = false;
+static int upload_concurrency     = 0;    // default is not using upload scheduler(0)
+static bool is_async_close        = false;
+static int async_close_thread_count = 4;
+static bool serverrenameapi       = true; // use the server side rename api if the bucket supports it
+static bool is_server_rename      = false;// set at checking the bucket
+static SingleFlight<head_flight_value> head_flight;   // for HEAD requests in get_object_attribute
+static SingleFlight<S3ObjList>         list_flight;   // for listing directories in list_bucket
 
 //-------------------------------------------------------------------
 // Global functions : prototype
@@ -119,12 +148,22 @@ static int check_object_access(const char* path, int mask, struct stat* pstbuf);
 static int check_object_owner(const char* path, struct stat* pstbuf);
 static int check_parent_object_access(const char* path, int mask);
 static int get_local_fent(AutoFdEntity& autoent, FdEntity **entity, const char* path, int flags = O_RDONLY, bool is_load = false);
+static void wait_async_close(const char* path);
+static void refresh_stat_cache(const std::string& key, const std::string& etag);
+static uint64_t stat_cache_memory_usage();
+static bool stat_cache_memory_budget(uint64_t budget);
 static bool multi_head_callback(S3fsCurl* s3fscurl);
 static S3fsCurl* multi_head_retry_callback(S3fsCurl* s3fscurl);
 static int readdir_multi_head(const char* path, const S3ObjList& head, void* buf, fuse_fill_dir_t filler);
+static int load_subtree(const char* path);
 static int list_bucket(const char* path, S3ObjList& head, const char* delimiter, bool check_content_only = false);
+static void forget_flights(const char* path);
+static int list_bucket_request(const char* path, S3ObjList& head, const char* delimiter, bool check_content_only, size_t max_count = 0);
 static int directory_empty(const char* path);
 static int rename_large_object(const char* from, const char* to);
+static void rollback_large_objects(const mprename_list_t& objects);
+static int rename_large_objects(mprename_list_t& objects);
+static int rename_object_server(const char* from, const char* to, bool is_dir);
 static int create_file_object(const char* path, mode_t mode, uid_t uid, gid_t gid);
 static int create_directory_object(const char* path, mode_t mode, time_t atime, time_t mtime, time_t ctime, uid_t uid, gid_t gid);
 static int rename_object(const char* from, const char* to, bool update_ctime);
@@ -135,6 +174,9 @@ static void free_xattrs(xattrs_t& xattrs);
 static bool parse_xattr_keyval(const std::string& xattrpair, std::string& key, PXATTRVAL& pval);
 static size_t parse_xattrs(const std::string& strxattrs, xattrs_t& xattrs);
 static std::string build_xattrs(const xattrs_t& xattrs);
+static size_t get_cached_xattrs(const char* path, const std::string& strxattrs, xattr_cache_t& xattrs);
+static bool check_server_rename();
+static bool sample_folder_objects(std::string& last_path);
 static int s3fs_check_service();
 static bool set_mountpoint_attribute(struct stat& mpst);
 static int set_bucket(const char* arg);
@@ -206,6 +248,10 @@ static bool is_special_name_folder_object(const char* path)
     if(!path || '\0' == path[0]){
         return false;
     }
+    if(!FolderObjectDetector::IsNeedCheck(path)){
+        // there is no "_$folder$" object in the parent directory.
+        return false;
+    }
 
     std::string strpath = path;
     headers_t header;
@@ -331,6 +377,75 @@ static int remove_old_type_dir(const std::string& path, dirtype type)
     return 0;
 }
 
+//
+// Send HEAD requests for the path(and for the directory names if overcheck
+// is true), and set the found object path and its headers into value.
+//
+static int head_object_attribute(const char* path, bool overcheck, head_flight_value& value)
+{
+    int         result;
+    std::string strpath;
+    S3fsCurl    s3fscurl;
+    std::string::size_type Pos;
+
+    // At first, check path
+    strpath     = path;
+    result      = s3fscurl.HeadRequest(strpath.c_str(), value.meta);
+    s3fscurl.DestroyCurlHandle();
+
+    // if not found target path object, do over checking
+   if(0 != result){
+        if(overcheck){
+            // when support_compat_dir is disabled, strpath maybe have "_$folder$".
+            if('/' != *strpath.rbegin() && std::string::npos == strpath.find("_$folder$", 0)){
+                // now path is "object", do check "object/" for over checking
+                strpath    += "/";
+                result      = s3fscurl.HeadRequest(strpath.c_str(), value.meta);
+                s3fscurl.DestroyCurlHandle();
+            }
+            if(support_compat_dir && 0 != result && FolderObjectDetector::IsNeedCheck(strpath.c_str())){
+                // now path is "object/", do check "object_$folder$" for over checking
+                strpath.erase(strpath.length() - 1);
+                strpath    += "_$folder$";
+                result      = s3fscurl.HeadRequest(strpath.c_str(), value.meta);
+                s3fscurl.DestroyCurlHandle();
+
+              if(0 != result){
+                  // cut "_$folder$" for over checking "no dir object" after here
+                  if(std::string::npos != (Pos = strpath.find("_$folder$", 0))){
+                      strpath.erase(Pos);
+                  }
+              }
+            }
+        }
+        if(support_compat_dir && 0 != result && std::string::npos == strpath.find("_$folder$", 0)){
+            // now path is "object" or "object/", do check "no dir object" which is not object but has only children.
+            if('/' == *strpath.rbegin()){
+                strpath.erase(strpath.length() - 1);
+            }
+            if(-ENOTEMPTY == directory_empty(strpath.c_str())){
+                // found "no dir object".
+                strpath      += "/";
+                value.isforce = true;
+                result        = 0;
+            }
+        }
+    }else{
+        if(support_compat_dir && '/' != *strpath.rbegin() && std::string::npos == strpath.find("_$folder$", 0) && is_need_check_obj_detail(value.meta)){
+            // check a case of that "object" does not have attribute and "object" is possible to be directory.
+            if(-ENOTEMPTY == directory_empty(strpath.c_str())){
+                // found "no dir object".
+                strpath      += "/";
+                value.isforce = true;
+                result        = 0;
+            }
+        }
+    }
+
+    value.strpath = strpath;
+    return result;
+}
+
 //
 // Get object attributes with stat cache.
 // This function is base for s3fs_getattr().
@@ -349,7 +464,6 @@ static int get_object_attribute(const char* path, struct stat* pstbuf, headers_t
     headers_t    tmpHead;
     headers_t*   pheader = pmeta ? pmeta : &tmpHead;
     std::string  strpath;
-    S3fsCurl     s3fscurl;
     bool         forcedir = false;
     bool         fakemeta = false;
     std::string::size_type Pos;
@@ -389,59 +503,22 @@ static int get_object_attribute(const char* path, struct stat* pstbuf, headers_t
         return -ENOENT;
     }
 
-    // At first, check path
-    strpath     = path;
-    result      = s3fscurl.HeadRequest(strpath.c_str(), (*pheader));
-    s3fscurl.DestroyCurlHandle();
-
-    // if not found target path object, do over checking
-   if(0 != result){
-        if(overcheck){
-            // when support_compat_dir is disabled, strpath maybe have "_$folder$".
-            if('/' != *strpath.rbegin() && std::string::npos == strpath.find("_$folder$", 0)){
-                // now path is "object", do check "object/" for over checking
-                strpath    += "/";
-                result      = s3fscurl.HeadRequest(strpath.c_str(), (*pheader));
-                s3fscurl.DestroyCurlHandle();
-            }
-            if(support_compat_dir && 0 != result){
-                // now path is "object/", do check "object_$folder$" for over checking
-                strpath.erase(strpath.length() - 1);
-                strpath    += "_$folder$";
-                result      = s3fscurl.HeadRequest(strpath.c_str(), (*pheader));
-                s3fscurl.DestroyCurlHandle();
-
-              if(0 != result){
-                  // cut "_$folder$" for over checking "no dir object" after here
-                  if(std::string::npos != (Pos = strpath.find("_$folder$", 0))){
-                      strpath.erase(Pos);
-                  }
-              }
-            }
-        }
-        if(support_compat_dir && 0 != result && std::string::npos == strpath.find("_$folder$", 0)){
-            // now path is "object" or "object/", do check "no dir object" which is not object but has only children.
-            if('/' == *strpath.rbegin()){
-                strpath.erase(strpath.length() - 1);
-            }
-            if(-ENOTEMPTY == directory_empty(strpath.c_str())){
-                // found "no dir object".
-                strpath  += "/";
-                *pisforce = true;
-                result    = 0;
-            }
-        }
-    }else{
-        if(support_compat_dir && '/' != *strpath.rbegin() && std::string::npos == strpath.find("_$folder$", 0) && is_need_check_obj_detail(*pheader)){
-            // check a case of that "object" does not have attribute and "object" is possible to be directory.
-            if(-ENOTEMPTY == directory_empty(strpath.c_str())){
-                // found "no dir object".
-                strpath  += "/";
-                *pisforce = true;
-                result    = 0;
-            }
+    // [NOTE]
+    // Concurrent lookups for the same path wait for one lookup and share
+    // its result. If the path is changed while looking up, the lookup is
+    // sent again(see forget_flights).
+    //
+    head_flight_value value;
+    std::string       flight_key = std::string(overcheck ? "1" : "0") + path;
+    while(head_flight.Join(flight_key, result, value)){
+        result = head_object_attribute(path, overcheck, value);
+        if(head_flight.Done(flight_key, result, value)){
+            break;
         }
     }
+    strpath     = value.strpath;
+    (*pheader)  = value.meta;
+    (*pisforce) = value.isforce;
 
     // [NOTE]
     // If the file is listed but not allowed access, put it in
@@ -491,6 +568,32 @@ static int get_object_attribute(const char* path, struct stat* pstbuf, headers_t
     return 0;
 }
 
+//
+// Refresh the expired stat cache entry in background.
+// This function is called from StatCacheRefresher.
+//
+static void refresh_stat_cache(const std::string& key, const std::string& etag)
+{
+    headers_t meta;
+    S3fsCurl  s3fscurl;
+    int       result = s3fscurl.HeadRequest(key.c_str(), meta, etag);
+
+    StatCache::getStatCacheData()->RefreshStat(key, etag, result, meta, (0 == result && 304 == s3fscurl.GetLastResponseCode()));
+}
+
+//
+// The stat cache as the consumer of MemoryGovernor.
+//
+static uint64_t stat_cache_memory_usage()
+{
+    return StatCache::getStatCacheData()->GetMemoryUsage();
+}
+
+static bool stat_cache_memory_budget(uint64_t budget)
+{
+    return StatCache::getStatCacheData()->SetMemoryBudget(budget);
+}
+
 //
 // Check the object uid and gid for write/read/execute.
 // The param "mask" is as same as access() function.
@@ -689,6 +792,8 @@ static int get_local_fent(AutoFdEntity& autoent, FdEntity **entity, const char*
 
     S3FS_PRN_INFO2("[path=%s]", path);
 
+    wait_async_close(path);
+
     if(0 != (result = get_object_attribute(path, &stobj, &meta))){
         return result;
     }
@@ -711,6 +816,26 @@ static int get_local_fent(AutoFdEntity& autoent, FdEntity **entity, const char*
     return 0;
 }
 
+//
+// Wait for finishing the deferred upload of the file by async_close.
+//
+// [NOTE]
+// The object on the server is not updated until the deferred upload is
+// finished. The operations which read the object's headers to open the
+// entity or which replace the object must call this first.
+//
+static void wait_async_close(const char* path)
+{
+    if(!AsyncCloseMan::IsEnable()){
+        return;
+    }
+    AutoFdEntity autoent;
+    FdEntity*    ent;
+    if(NULL != (ent = autoent.OpenExistFdEntity(path))){
+        AsyncCloseMan::Wait(ent);
+    }
+}
+
 //
 // create or update s3 meta
 // ow_sse_flg is for over writing sse header by use_sse option.
@@ -794,6 +919,57 @@ static int s3fs_getattr(const char* _path, struct stat* stbuf)
     return result;
 }
 
+//
+// Makes the value of the symbolic link cache from the target in the
+// headers or in the body of the link object.
+//
+static std::string make_symlink_value(const std::string& target)
+{
+    // check buf if it has space words.
+    std::string strValue = trim(std::string(target.c_str()));
+
+    // decode wtf8. This will always be shorter
+    if(use_wtf8){
+        strValue = s3fs_wtf8_decode(strValue);
+    }
+    return strValue;
+}
+
+//
+// Reads the target of the symbolic link without opening the entity.
+// The target is in the headers for the header format, otherwise it is
+// the body of the link object.
+//
+static int read_symlink_target(const char* path, const headers_t& meta, std::string& value)
+{
+    std::string strType;
+    std::string strTarget;
+    if(get_symlink_attr(meta, strType, strTarget) && strType == "header"){
+        if(strTarget.empty()){
+            S3FS_PRN_ERR("could not get symlink target");
+            return -EIO;
+        }
+    }else{
+        // the target is not longer than PATH_MAX
+        off_t size = std::min(get_size(meta), static_cast<off_t>(PATH_MAX));
+        if(0 < size){
+            headers_t::const_iterator iter = meta.find("ETag");
+            std::string               etag = (meta.end() != iter ? iter->second : std::string(""));
+            S3fsCurl                  s3fscurl;
+            ssize_t                   rsize = 0;
+            int                       result;
+            strTarget.resize(size);
+            if(0 != (result = s3fscurl.GetObjectStreamRequest(path, &strTarget[0], 0, size, rsize, etag))){
+                S3FS_PRN_ERR("could not read file(file=%s, result=%d)", path, result);
+                return result;
+            }
+            strTarget.resize(rsize);
+        }
+    }
+    value = make_symlink_value(strTarget);
+    return 0;
+}
+
 static int s3fs_readlink(const char* _path, char* buf, size_t size)
 {
     if(!_path || !buf || 0 == size){
@@ -806,8 +982,22 @@ static int s3fs_readlink(const char* _path, char* buf, size_t size)
 
     // check symbolic link cache
     if(!StatCache::getStatCacheData()->GetSymlink(std::string(path), strValue)){
-        // not found in cache, then open the path
-        {   // scope for AutoFdEntity
+        // [NOTE]
+        // The link which is opened may not be uploaded yet, then it is read
+        // from the entity. Otherwise it is read from the headers in the stat
+        // cache(or the object) without opening the entity.
+        //
+        if(!FdManager::HasOpenEntityFd(path)){
+            headers_t meta;
+            int       result;
+            if(0 != (result = get_object_attribute(path, NULL, &meta))){
+                return result;
+            }
+            if(0 != (result = read_symlink_target(path, meta, strValue))){
+                return result;
+            }
+        }else{
+            // scope for AutoFdEntity
             AutoFdEntity autoent;
             FdEntity*    ent;
             int          result;
@@ -852,14 +1042,7 @@ static int s3fs_readlink(const char* _path, char* buf, size_t size)
                 }
                 buf[ressize] = '\0';
             }
-        }
-
-        // check buf if it has space words.
-        strValue = trim(std::string(buf));
-
-        // decode wtf8. This will always be shorter
-        if(use_wtf8){
-          strValue = s3fs_wtf8_decode(strValue);
+            strValue = make_symlink_value(std::string(buf));
         }
 
         // add symbolic link cache
@@ -912,6 +1095,7 @@ static int s3fs_mknod(const char *_path, mode_t mode, dev_t rdev)
         return result;
     }
     StatCache::getStatCacheData()->DelStat(path);
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -963,6 +1147,7 @@ static int s3fs_create(const char* _path, mode_t mode, struct fuse_file_info* fi
     if(!StatCache::getStatCacheData()->AddStat(path, meta, false, true)){
         return -EIO;
     }
+    StatCache::getStatCacheData()->DelDirList(path);
 
     AutoFdEntity autoent;
     FdEntity*    ent;
@@ -973,6 +1158,7 @@ static int s3fs_create(const char* _path, mode_t mode, struct fuse_file_info* fi
     ent->MarkDirtyNewFile();
     fi->fh = autoent.Detach();       // KEEP fdentity open;
 
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -1028,6 +1214,7 @@ static int s3fs_mkdir(const char* _path, mode_t mode)
     result = create_directory_object(path, mode, now, now, now, pcxt->uid, pcxt->gid);
 
     StatCache::getStatCacheData()->DelStat(path);
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -1043,11 +1230,15 @@ static int s3fs_unlink(const char* _path)
     if(0 != (result = check_parent_object_access(path, W_OK | X_OK))){
         return result;
     }
+    // the deferred upload must not make the object again after deleting.
+    wait_async_close(path);
+
     S3fsCurl s3fscurl;
     result = s3fscurl.DeleteRequest(path);
     StatCache::getStatCacheData()->DelStat(path);
     StatCache::getStatCacheData()->DelSymlink(path);
     FdManager::DeleteCacheFile(path);
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -1120,6 +1311,7 @@ static int s3fs_rmdir(const char* _path)
         strpath += "_$folder$";
         result   = s3fscurl.DeleteRequest(strpath.c_str());
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -1202,6 +1394,7 @@ static int s3fs_symlink(const char* _from, const char* _to)
     if(!StatCache::getStatCacheData()->AddSymlink(std::string(to), strFrom)){
         S3FS_PRN_ERR("failed to add symbolic link cache for %s", to);
     }
+    forget_flights(to);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -1246,7 +1439,7 @@ static int rename_object(const char* from, const char* to, bool update_ctime)
         FdEntity*    ent;
         if(NULL == (ent = autoent.OpenExistFdEntity(from))){
             // no opened fd
-            if(FdManager::IsCacheDir()){
+            if(FdManager::UseCacheFile()){
                 // create cache file if be needed
                 ent = autoent.Open(from, &meta, buf.st_size, -1, O_RDONLY, false, true, false, AutoLock::NONE);
             }
@@ -1382,6 +1575,152 @@ static int rename_large_object(const char* from, const char* to)
     return result;
 }
 
+//
+// Remove the "to" objects which are already copied by the failed
+// rename_large_objects, then the source files are left as they were.
+//
+static void rollback_large_objects(const mprename_list_t& objects)
+{
+    std::list<std::string> paths;
+    for(mprename_list_t::const_iterator iter = objects.begin(); iter != objects.end(); ){
+        if(iter->is_copied){
+            paths.push_back(iter->to);
+        }
+        ++iter;
+        if(paths.empty() || (MAX_MULTIDELETE_KEYS > static_cast<int>(paths.size()) && iter != objects.end())){
+            continue;
+        }
+        S3fsCurl s3fscurl;
+        if(0 != s3fscurl.DeleteMultipleObjectsRequest(paths)){
+            for(std::list<std::string>::const_iterator piter = paths.begin(); piter != paths.end(); ++piter){
+                S3fsCurl s3fscurl_del;
+                int      result;
+                if(0 != (result = s3fscurl_del.DeleteRequest(piter->c_str()))){
+                    S3FS_PRN_ERR("could not remove the copied object(%s) for rolling back the rename(%d).", piter->c_str(), result);
+                }
+            }
+        }
+        for(std::list<std::string>::const_iterator piter = paths.begin(); piter != paths.end(); ++piter){
+            StatCache::getStatCacheData()->DelStat(*piter);
+        }
+        paths.clear();
+    }
+}
+
+//
+// Rename large files in a directory together.
+//
+// [NOTE]
+// The part copies of all files are run in one pipeline, and the source
+// files are removed by DeleteMultipleObjects requests which have up to
+// MAX_MULTIDELETE_KEYS keys. If a batched delete fails, the files in it
+// are removed one by one.
+// No source file is removed until all files are copied, and if any copy
+// fails, the files which are already copied are removed.
+//
+static int rename_large_objects(mprename_list_t& objects)
+{
+    int result;
+
+    S3FS_PRN_INFO1("[objects=%zu]", objects.size());
+
+    if(objects.empty()){
+        return 0;
+    }
+    mprename_list_t::iterator iter;
+    for(iter = objects.begin(); iter != objects.end(); ++iter){
+        if(0 != (result = check_parent_object_access(iter->to.c_str(), W_OK | X_OK))){
+            // not permit writing "to" object parent dir.
+            return result;
+        }
+        if(0 != (result = check_parent_object_access(iter->from.c_str(), W_OK | X_OK))){
+            // not permit removing "from" object parent dir.
+            return result;
+        }
+        // the deferred upload must not make the "from" object again after deleting.
+        wait_async_close(iter->from.c_str());
+    }
+
+    if(0 != (result = S3fsCurl::ParallelMultipartRenameRequest(objects))){
+        rollback_large_objects(objects);
+        return result;
+    }
+
+    // Remove files
+    std::list<std::string> paths;
+    for(iter = objects.begin(); iter != objects.end(); ){
+        paths.push_back(iter->from);
+        ++iter;
+        if(MAX_MULTIDELETE_KEYS > static_cast<int>(paths.size()) && iter != objects.end()){
+            continue;
+        }
+        S3fsCurl s3fscurl;
+        if(0 != (result = s3fscurl.DeleteMultipleObjectsRequest(paths))){
+            S3FS_PRN_WARN("failed to delete %zu objects by one request(%d), then delete them one by one.", paths.size(), result);
+            for(std::list<std::string>::const_iterator piter = paths.begin(); piter != paths.end(); ++piter){
+                if(0 != (result = s3fs_unlink(piter->c_str()))){
+                    return result;
+                }
+            }
+        }
+        paths.clear();
+    }
+
+    for(iter = objects.begin(); iter != objects.end(); ++iter){
+        StatCache::getStatCacheData()->DelStat(iter->from);
+        StatCache::getStatCacheData()->DelSymlink(iter->from.c_str());
+        FdManager::DeleteCacheFile(iter->from.c_str());
+
+        StatCache::getStatCacheData()->DelStat(iter->to);
+        FdManager::DeleteCacheFile(iter->to.c_str());
+    }
+    S3FS_MALLOCTRIM(0);
+
+    return 0;
+}
+
+//
+// Rename the object by one request on the server side.
+// A directory is renamed with all objects under it at once, so the caches
+// of all objects under it are moved or removed.
+//
+// [NOTE]
+// The meta data is not changed by this api, so ctime is not updated.
+//
+static int rename_object_server(const char* from, const char* to, bool is_dir)
+{
+    int result;
+
+    S3FS_PRN_INFO1("[from=%s][to=%s][is_dir=%s]", from , to, is_dir ? "true" : "false");
+
+    // the directory is renamed by its directory object("dir/")
+    std::string strfrom = from;
+    std::string strto   = to;
+    if(is_dir){
+        strfrom += "/";
+        strto   += "/";
+    }
+    S3fsCurl s3fscurl;
+    if(0 != (result = s3fscurl.RenameRequest(strfrom.c_str(), strto.c_str()))){
+        return result;
+    }
+
+    if(is_dir){
+        StatCache::getStatCacheData()->DelStatTree(from);
+        StatCache::getStatCacheData()->DelStatTree(to);
+        FdManager::get()->RenameDirectory(from, to);
+    }else{
+        FdManager::get()->Rename(from, to);
+        FdManager::DeleteCacheFile(from);
+
+        StatCache::getStatCacheData()->DelStat(from);
+        StatCache::getStatCacheData()->DelSymlink(from);
+        StatCache::getStatCacheData()->DelStat(to);
+        StatCache::getStatCacheData()->DelSymlink(to);
+    }
+    return 0;
+}
+
 static int clone_directory_object(const char* from, const char* to, bool update_ctime)
 {
     int result = -1;
@@ -1506,9 +1845,20 @@ static int rename_directory(const char* from, const char* to)
 
     // iterate over the list - copy the files with rename_object
     // does a safe copy - copies first and then deletes old
+    //
+    // [NOTE]
+    // The large files which are copied by multipart copy are collected and
+    // renamed together after the other files.
+    //
+    mprename_list_t large_objects;
     for(mn_cur = mn_head; mn_cur; mn_cur = mn_cur->next){
         if(!mn_cur->is_dir){
             if(!nocopyapi && !norenameapi){
+                headers_t meta;
+                if(!nomultipart && !shallowcopyapi && 0 == get_object_attribute(mn_cur->old_path, &stbuf, &meta, false, NULL, false, is_refresh_fakemeta) && stbuf.st_size >= singlepart_copy_limit){
+                    large_objects.push_back(mprename_entry(mn_cur->old_path, mn_cur->new_path, meta, stbuf.st_size));
+                    continue;
+                }
                 result = rename_object(mn_cur->old_path, mn_cur->new_path, false);          // keep ctime
             }else{
                 result = rename_object_nocopy(mn_cur->old_path, mn_cur->new_path, false);   // keep ctime
@@ -1520,6 +1870,11 @@ static int rename_directory(const char* from, const char* to)
             }
         }
     }
+    if(0 != (result = rename_large_objects(large_objects))){
+        S3FS_PRN_ERR("rename_large_objects returned an error(%d)", result);
+        free_mvnodes(mn_head);
+        return result;
+    }
 
     // Iterate over old the directories, bottoms up and remove
     for(mn_cur = mn_tail; mn_cur; mn_cur = mn_cur->prev){
@@ -1564,6 +1919,8 @@ static int s3fs_rename(const char* _from, const char* _to)
     if(0 != (result = directory_empty(to))){
         return result;
     }
+    // the deferred upload must not overwrite the renamed object.
+    wait_async_close(to);
 
     // flush pending writes if file is open
     {   // scope for AutoFdEntity
@@ -1579,7 +1936,9 @@ static int s3fs_rename(const char* _from, const char* _to)
     }
 
     // files larger than 5GB must be modified via the multipart interface
-    if(S_ISDIR(buf.st_mode)){
+    if(is_server_rename){
+        result = rename_object_server(from, to, S_ISDIR(buf.st_mode));
+    }else if(S_ISDIR(buf.st_mode)){
         result = rename_directory(from, to);
     }else if(!nomultipart && buf.st_size >= singlepart_copy_limit && !shallowcopyapi){
         result = rename_large_object(from, to);
@@ -1590,6 +1949,8 @@ static int s3fs_rename(const char* _from, const char* _to)
             result = rename_object_nocopy(from, to, true);      // update ctime
         }
     }
+    forget_flights(from);
+    forget_flights(to);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -1695,6 +2056,7 @@ static int s3fs_chmod(const char* _path, mode_t mode)
             StatCache::getStatCacheData()->DelStat(nowcache);
         }
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -1777,6 +2139,7 @@ static int s3fs_chmod_nocopy(const char* _path, mode_t mode)
         }
         StatCache::getStatCacheData()->DelStat(nowcache);
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
   
     return result;
@@ -1880,6 +2243,7 @@ static int s3fs_chown(const char* _path, uid_t uid, gid_t gid)
             StatCache::getStatCacheData()->DelStat(nowcache);
         }
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -1970,6 +2334,7 @@ static int s3fs_chown_nocopy(const char* _path, uid_t uid, gid_t gid)
         }
         StatCache::getStatCacheData()->DelStat(nowcache);
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
   
     return result;
@@ -2108,6 +2473,7 @@ static int s3fs_utimens(const char* _path, const struct timespec ts[2])
             }
         }
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -2206,6 +2572,7 @@ static int s3fs_utimens_nocopy(const char* _path, const struct timespec ts[2])
         }
         StatCache::getStatCacheData()->DelStat(nowcache);
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -2231,6 +2598,7 @@ static int s3fs_truncate(const char* _path, off_t size)
     if(0 != (result = check_object_access(path, W_OK, NULL))){
         return result;
     }
+    wait_async_close(path);
 
     // Get file information
     if(0 == (result = get_object_attribute(path, NULL, &meta, true, NULL, false, is_refresh_fakemeta))){
@@ -2308,6 +2676,7 @@ static int s3fs_truncate(const char* _path, off_t size)
         }
         StatCache::getStatCacheData()->DelStat(path);
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return result;
@@ -2343,6 +2712,18 @@ static int s3fs_open(const char* _path, struct fuse_file_info* fi)
         return result;
     }
 
+    // [NOTE]
+    // While the upload of the file is deferred by async close, the entity
+    // is reopened with its own headers and size instead of waiting for the
+    // upload, because the stat cache entry is the one at the creation.
+    // The entity is kept opened by pendent until it is reopened.
+    //
+    AutoFdEntity pendent;
+    FdEntity*    pent = NULL;
+    if(AsyncCloseMan::IsEnable() && NULL != (pent = pendent.OpenExistFdEntity(path)) && !AsyncCloseMan::IsPending(pent)){
+        pent = NULL;
+    }
+
     result = check_object_access(path, mask, &st);
     if(-ENOENT == result){
         if(0 != (result = check_parent_object_access(path, W_OK))){
@@ -2352,6 +2733,12 @@ static int s3fs_open(const char* _path, struct fuse_file_info* fi)
         return result;
     }
 
+    if(pent){
+        struct stat entst;
+        if(pent->GetStats(entst)){
+            st.st_size = entst.st_size;
+        }
+    }
     if((unsigned int)fi->flags & O_TRUNC){
         if(0 != st.st_size){
             st.st_size = 0;
@@ -2368,7 +2755,7 @@ static int s3fs_open(const char* _path, struct fuse_file_info* fi)
     if(0 != (result = get_object_attribute(path, NULL, &meta, true, NULL, true))){    // no truncate cache
       return result;
     }
-    if(NULL == (ent = autoent.Open(path, &meta, st.st_size, st.st_mtime, fi->flags, false, true, false, AutoLock::NONE))){
+    if(NULL == (ent = autoent.Open(path, (pent ? NULL : &meta), st.st_size, st.st_mtime, fi->flags, false, true, false, AutoLock::NONE))){
         StatCache::getStatCacheData()->DelStat(path);
         return -EIO;
     }
@@ -2383,6 +2770,21 @@ static int s3fs_open(const char* _path, struct fuse_file_info* fi)
             return result;
         }
     }
+
+    // [NOTE]
+    // The kernel drops the page cache of the file at every opening unless
+    // keep_cache is set. It is kept only for reading the object which is
+    // not changed since the last opening, and the file in direct read mode
+    // does not use the page cache because the data is streamed.
+    //
+    if(FdManager::IsKeepCache() && O_RDONLY == (fi->flags & O_ACCMODE) && !needs_flush){
+        if(ent->IsDirectRead()){
+            fi->direct_io = 1;
+        }else if(FdManager::CheckKeepCache(path, meta, st.st_size)){
+            S3FS_PRN_DBG("keep the page cache of the file(%s)", path);
+            fi->keep_cache = 1;
+        }
+    }
     fi->fh = autoent.Detach();       // KEEP fdentity open;
 
     S3FS_MALLOCTRIM(0);
@@ -2498,11 +2900,24 @@ static int s3fs_flush(const char* _path, struct fuse_file_info* fi)
     if(NULL != (ent = autoent.GetExistFdEntity(path, static_cast<int>(fi->fh)))){
         ent->UpdateMtime(true);         // clear the flag not to update mtime.
         ent->UpdateCtime();
-        result = ent->Flush(static_cast<int>(fi->fh), false);
-        StatCache::getStatCacheData()->DelStat(path);
-    }
-    S3FS_MALLOCTRIM(0);
-
+        if(!AsyncCloseMan::IsEnable()){
+            result = ent->Flush(static_cast<int>(fi->fh), false);
+        }else{
+            // [NOTE]
+            // The file is uploaded at release by the async close.
+            // If the file is still modified, fsync uploads it.
+            result = 0;
+        }
+        // [NOTE]
+        // The stat cache entry of the modified file is kept for the deferred
+        // upload, since the object may not exist on the server yet.
+        if(!AsyncCloseMan::IsEnable() || !ent->IsModified()){
+            StatCache::getStatCacheData()->DelStat(path);
+        }
+    }
+    forget_flights(path);
+    S3FS_MALLOCTRIM(0);
+
     return result;
 }
 
@@ -2523,12 +2938,15 @@ static int s3fs_fsync(const char* _path, int datasync, struct fuse_file_info* fi
             ent->UpdateMtime();
             ent->UpdateCtime();
         }
+        // fsync is the barrier for the deferred upload by async close.
+        AsyncCloseMan::Wait(ent);
         result = ent->Flush(static_cast<int>(fi->fh), false);
     }
     S3FS_MALLOCTRIM(0);
 
     // Issue 320: Delete stat cache entry because st_size may have changed.
     StatCache::getStatCacheData()->DelStat(path);
+    forget_flights(path);
 
     return result;
 }
@@ -2539,18 +2957,35 @@ static int s3fs_release(const char* _path, struct fuse_file_info* fi)
     S3FS_PRN_INFO("[path=%s][pseudo_fd=%llu]", path, (unsigned long long)(fi->fh));
 
     // [NOTE]
-    // All opened file's stats is cached with no truncate flag.
-    // Thus we unset it here.
-    StatCache::getStatCacheData()->ChangeNoTruncateFlag(std::string(path), false);
-
-    // [NOTICE]
-    // At first, we remove stats cache.
-    // Because fuse does not wait for response from "release" function. :-(
-    // And fuse runs next command before this function returns.
-    // Thus we call deleting stats function ASAP.
+    // If async_close is specified, the modified file is uploaded in the
+    // background. The pseudo fd is handed to AsyncCloseMan and closed
+    // after uploading, so the entity stays in FdManager until then.
+    // The stat cache entry of the file is also kept with no truncate flag
+    // until then, because the object may not exist on the server yet.
     //
-    if((fi->flags & O_RDWR) || (fi->flags & O_WRONLY)){
-        StatCache::getStatCacheData()->DelStat(path);
+    FdEntity* deferred_ent = NULL;
+    if(AsyncCloseMan::IsEnable() && ((fi->flags & O_RDWR) || (fi->flags & O_WRONLY))){
+        FdEntity* ent;
+        if(NULL != (ent = FdManager::get()->GetExistFdEntity(path, static_cast<int>(fi->fh))) && ent->IsModified()){
+            deferred_ent = ent;
+        }
+    }
+
+    if(!deferred_ent){
+        // [NOTE]
+        // All opened file's stats is cached with no truncate flag.
+        // Thus we unset it here.
+        StatCache::getStatCacheData()->ChangeNoTruncateFlag(std::string(path), false);
+
+        // [NOTICE]
+        // At first, we remove stats cache.
+        // Because fuse does not wait for response from "release" function. :-(
+        // And fuse runs next command before this function returns.
+        // Thus we call deleting stats function ASAP.
+        //
+        if((fi->flags & O_RDWR) || (fi->flags & O_WRONLY)){
+            StatCache::getStatCacheData()->DelStat(path);
+        }
     }
 
     {   // scope for AutoFdEntity
@@ -2564,6 +2999,20 @@ static int s3fs_release(const char* _path, struct fuse_file_info* fi)
             S3FS_PRN_ERR("could not find pseudo_fd(%llu) for path(%s)", (unsigned long long)(fi->fh), path);
             return -EIO;
         }
+
+        // the stat cache entry and the lookups are released by the job.
+        if(deferred_ent){
+            if(AsyncCloseMan::Instruct(deferred_ent, static_cast<int>(fi->fh), path)){
+                autoent.Detach();
+                return 0;
+            }
+            int result;
+            if(0 != (result = deferred_ent->Flush(static_cast<int>(fi->fh), false))){
+                S3FS_PRN_ERR("could not upload file(%s): result=%d", path, result);
+            }
+            StatCache::getStatCacheData()->ChangeNoTruncateFlag(std::string(path), false);
+            StatCache::getStatCacheData()->DelStat(path);
+        }
     }
 
     // check - for debug
@@ -2572,6 +3021,7 @@ static int s3fs_release(const char* _path, struct fuse_file_info* fi)
             S3FS_PRN_WARN("file(%s) is still opened(another pseudo fd is opend).", path);
         }
     }
+    forget_flights(path);
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -2641,6 +3091,85 @@ static S3fsCurl* multi_head_retry_callback(S3fsCurl* s3fscurl)
     return newcurl;
 }
 
+static bool multi_symlink_callback(S3fsCurl* s3fscurl)
+{
+    if(!s3fscurl || !s3fscurl->GetStreamBuffer()){
+        return false;
+    }
+    std::string saved_path = s3fscurl->GetSpecialSavedPath();
+    std::string strValue   = make_symlink_value(std::string(s3fscurl->GetStreamBuffer(), static_cast<size_t>(s3fscurl->GetStreamPos())));
+    if(!StatCache::getStatCacheData()->AddSymlink(saved_path, strValue)){
+        S3FS_PRN_ERR("failed to add symbolic link cache for %s", saved_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+//
+// Adds the symbolic link caches for the links in the listing from their
+// stat caches, so that readlink after readdir does not send any request.
+// The bodies of the links in the content format are read by one multi
+// request.
+//
+static void readdir_symlinks(const s3obj_list_t& pathlist)
+{
+    S3fsMultiCurl          curlmulti(S3fsCurl::GetMaxMultiRequest());
+    std::list<std::string> bodies;      // buffers for the bodies of the links
+    std::string            strValue;
+
+    curlmulti.SetSuccessCallback(multi_symlink_callback);
+
+    for(s3obj_list_t::const_iterator iter = pathlist.begin(); pathlist.end() != iter; ++iter){
+        struct stat st;
+        headers_t   meta;
+        if(!StatCache::getStatCacheData()->GetStat((*iter), &st, &meta) || !S_ISLNK(st.st_mode) || StatCache::getStatCacheData()->GetSymlink((*iter), strValue) || FdManager::HasOpenEntityFd(iter->c_str())){
+            continue;
+        }
+
+        std::string strType;
+        std::string strTarget;
+        if(get_symlink_attr(meta, strType, strTarget) && strType == "header"){
+            if(!strTarget.empty() && !StatCache::getStatCacheData()->AddSymlink((*iter), make_symlink_value(strTarget))){
+                S3FS_PRN_ERR("failed to add symbolic link cache for %s", iter->c_str());
+            }
+            continue;
+        }
+
+        // the target is not longer than PATH_MAX
+        off_t size = std::min(get_size(meta), static_cast<off_t>(PATH_MAX));
+        if(0 >= size){
+            continue;
+        }
+        sse_type_t  ssetype = sse_type_t::SSE_DISABLE;
+        std::string ssevalue;
+        if(!get_object_sse_type(iter->c_str(), ssetype, ssevalue)){
+            S3FS_PRN_WARN("Failed to get SSE type for file(%s).", iter->c_str());
+        }
+        headers_t::const_iterator etagiter = meta.find("ETag");
+        std::string               etag     = (meta.end() != etagiter ? etagiter->second : std::string(""));
+
+        bodies.push_back(std::string(static_cast<size_t>(size), '\0'));
+        S3fsCurl* s3fscurl = new S3fsCurl();
+        if(0 != s3fscurl->PreGetObjectStreamRequest(iter->c_str(), &(bodies.back()[0]), 0, size, ssetype, ssevalue, etag)){
+            S3FS_PRN_WARN("Could not make curl object for get request(%s).", iter->c_str());
+            delete s3fscurl;
+            continue;
+        }
+        s3fscurl->SetSpecialSavedPath(*iter);
+
+        if(!curlmulti.SetS3fsCurlObject(s3fscurl)){
+            S3FS_PRN_WARN("Could not make curl object into multi curl(%s).", iter->c_str());
+            delete s3fscurl;
+            continue;
+        }
+    }
+
+    int result;
+    if(0 != (result = curlmulti.Request())){
+        S3FS_PRN_WARN("could not read some symbolic links(errno=%d), but continue...", result);
+    }
+}
+
 static int readdir_multi_head(const char* path, const S3ObjList& head, void* buf, fuse_fill_dir_t filler)
 {
     S3fsMultiCurl curlmulti(S3fsCurl::GetMaxMultiRequest());
@@ -2705,6 +3234,9 @@ static int readdir_multi_head(const char* path, const S3ObjList& head, void* buf
         }
     }
 
+    // symbolic link caches
+    readdir_symlinks(fillerlist);
+
     // populate fuse buffer
     // here is best position, because a case is cache size < files in directory
     //
@@ -2831,6 +3363,9 @@ static int readdir_multi_head_optimize(const char* path, const S3ObjList& head,
         }
     }
 
+    // symbolic link caches
+    readdir_symlinks(fillerlist);
+
     // populate fuse buffer
     // here is best position, because a case is cache size < files in directory
     //
@@ -2864,12 +3399,34 @@ static int s3fs_readdir(const char* _path, void* buf, fuse_fill_dir_t filler, of
         return result;
     }
 
+    // load the whole subtree in background if the traversal is detected,
+    // and this directory is listed as usual.
+    bool is_listed = false;
+    if(TraversalDetector::IsEnable() && !(is_listed = StatCache::getStatCacheData()->GetDirList(path, head))){
+        std::string root = TraversalDetector::Detect(path);
+        if(!root.empty()){
+            SubtreeLoader::Instruct(root);
+        }
+    }
+
     // get a list of all the objects
-    if((result = list_bucket(path, head, "/")) != 0){
+    if(!is_listed && (result = list_bucket(path, head, "/")) != 0){
         S3FS_PRN_ERR("list_bucket returns error(%d).", result);
         return result;
     }
 
+    // the files whose uploads are deferred by async close may not be on
+    // the server yet, then they are listed from their entities.
+    std::list<std::string> pending_paths;
+    if(AsyncCloseMan::GetPendingPaths(pending_paths)){
+        for(std::list<std::string>::const_iterator iter = pending_paths.begin(); iter != pending_paths.end(); ++iter){
+            std::string name = mybasename(*iter);
+            if(mydirname(*iter) == path && head.GetOrgName(name.c_str()).empty()){
+                head.insert(name.c_str());
+            }
+        }
+    }
+
     // force to add "." and ".." name.
     filler(buf, ".", 0, 0);
     filler(buf, "..", 0, 0);
@@ -2898,7 +3455,105 @@ static int s3fs_readdir(const char* _path, void* buf, fuse_fill_dir_t filler, of
     return result;
 }
 
+//
+// List all objects under the directory without delimiter, and keep the
+// listings of every directory in it.
+// This function is called from SubtreeLoader.
+// The listing is given up as soon as the count of objects is over the stat
+// cache size, because the listings would be evicted before they are used.
+// Then the traversal lists each directory.
+//
+static int load_subtree(const char* path)
+{
+    S3ObjList head;
+    size_t    max_count = StatCache::getStatCacheData()->GetCacheSize();
+    int       result;
+
+    S3FS_PRN_INFO1("[path=%s]", path);
+
+    if(0 != (result = list_bucket_request(path, head, NULL, false, max_count))){
+        if(-ENOSPC == result){
+            S3FS_PRN_WARN("the subtree(%s) has objects over the stat cache size(%zu), then it is not loaded.", path, max_count);
+        }else{
+            S3FS_PRN_WARN("could not list the subtree(%s), result=%d.", path, result);
+        }
+        return result;
+    }
+    TraversalDetector::AddSubtree(path, head);
+
+    return 0;
+}
+
+//
+// [NOTE]
+// Concurrent listings of the same directory(with delimiter) wait for one
+// listing and share its result.
+// The listing without delimiter is not shared, because it is used for
+// renaming the directory and must not miss the objects which are created
+// just before it.
+//
 static int list_bucket(const char* path, S3ObjList& head, const char* delimiter, bool check_content_only)
+{
+    if(!delimiter || '\0' == delimiter[0]){
+        return list_bucket_request(path, head, delimiter, check_content_only);
+    }
+    if(TraversalDetector::IsEnable() && StatCache::getStatCacheData()->GetDirList(path, head)){
+        return 0;
+    }
+
+    int         result;
+    S3ObjList   list;
+    std::string flight_key = std::string(check_content_only ? "1" : "0") + delimiter + ":" + path;
+    while(list_flight.Join(flight_key, result, list)){
+        list = S3ObjList();
+        result = list_bucket_request(path, list, delimiter, check_content_only);
+        if(list_flight.Done(flight_key, result, list)){
+            break;
+        }
+    }
+    if(0 == result){
+        head = list;
+    }
+    return result;
+}
+
+//
+// [NOTE]
+// The lookups and the listings which are in flight when the path is
+// changed may get the result before the change, then they are marked
+// stale and the lookups and listings after the change do not join them.
+// This must be called after changing(create, flush, rename, unlink, rmdir,
+// setattr and so on) the path.
+//
+static void forget_flights(const char* path)
+{
+    if(!path || '\0' == path[0]){
+        return;
+    }
+    std::string strpath = path;
+    if(1 < strpath.length() && '/' == *strpath.rbegin()){
+        strpath.erase(strpath.length() - 1);
+    }
+    std::string parent = mydirname(strpath);
+
+    // lookups for "path" and "path/"
+    head_flight.Forget("0" + strpath);
+    head_flight.Forget("1" + strpath);
+    head_flight.Forget("0" + strpath + "/");
+    head_flight.Forget("1" + strpath + "/");
+
+    // listings of the path(if it is a directory) and its parent
+    list_flight.Forget("0/:" + strpath);
+    list_flight.Forget("1/:" + strpath);
+    list_flight.Forget("0/:" + parent);
+    list_flight.Forget("1/:" + parent);
+}
+
+//
+// If max_count is not 0, the listing is stopped and returns -ENOSPC when
+// the count of the listed objects is over it.
+//
+static int list_bucket_request(const char* path, S3ObjList& head, const char* delimiter, bool check_content_only, size_t max_count)
 {
     std::string s3_realpath;
     std::string query_delimiter;
@@ -3005,7 +3660,13 @@ static int list_bucket(const char* path, S3ObjList& head, const char* delimiter,
         if(check_content_only){
             break;
         }
+        if(0 < max_count && max_count < head.Size()){
+            return -ENOSPC;
+        }
     }
+    // learn "_$folder$" objects
+    FolderObjectDetector::AddFolderObjects(path, head);
+
     S3FS_MALLOCTRIM(0);
 
     return 0;
@@ -3110,6 +3771,35 @@ static std::string build_xattrs(const xattrs_t& xattrs)
     return strxattrs;
 }
 
+//
+// Get the decoded xattrs from the header value.
+// The decoded xattrs are cached with the stat cache entry, then the same
+// header value is not decoded again.
+//
+static size_t get_cached_xattrs(const char* path, const std::string& strxattrs, xattr_cache_t& xattrs)
+{
+    if(StatCache::getStatCacheData()->GetXattrs(path, strxattrs, xattrs)){
+        return xattrs.size();
+    }
+
+    xattrs_t pxattrs;
+    parse_xattrs(strxattrs, pxattrs);
+
+    xattrs.clear();
+    for(xattrs_t::const_iterator iter = pxattrs.begin(); iter != pxattrs.end(); ++iter){
+        if(iter->second && iter->second->pvalue){
+            xattrs[iter->first] = std::string(reinterpret_cast<const char*>(iter->second->pvalue), iter->second->length);
+        }else{
+            xattrs[iter->first] = std::string("");
+        }
+    }
+    free_xattrs(pxattrs);
+
+    StatCache::getStatCacheData()->SetXattrs(path, strxattrs, xattrs);
+
+    return xattrs.size();
+}
+
 static int set_xattrs_to_header(headers_t& meta, const char* name, const char* value, size_t size, int flags)
 {
     std::string strxattrs;
@@ -3285,6 +3975,7 @@ static int s3fs_setxattr(const char* path, const char* name, const char* value,
         StatCache::getStatCacheData()->DelStat(nowcache);
     }
 
+    forget_flights(path);
     return 0;
 }
 
@@ -3307,9 +3998,9 @@ static int s3fs_getxattr(const char* path, const char* name, char* value, size_t
     }
 #endif
 
-    int       result;
-    headers_t meta;
-    xattrs_t  xattrs;
+    int           result;
+    headers_t     meta;
+    xattr_cache_t xattrs;
 
     // check parent directory attribute.
     if(0 != (result = check_parent_object_access(path, X_OK))){
@@ -3329,36 +4020,28 @@ static int s3fs_getxattr(const char* path, const char* name, char* value, size_t
     }
     std::string strxattrs = hiter->second;
 
-    parse_xattrs(strxattrs, xattrs);
+    get_cached_xattrs(path, strxattrs, xattrs);
 
     // search name
     std::string strname = name;
-    xattrs_t::iterator xiter = xattrs.find(strname);
+    xattr_cache_t::const_iterator xiter = xattrs.find(strname);
     if(xattrs.end() == xiter){
         // not found name in xattrs
-        free_xattrs(xattrs);
         return -ENOATTR;
     }
 
-    // decode
-    size_t         length = 0;
-    unsigned char* pvalue = NULL;
-    if(NULL != xiter->second){
-        length = xiter->second->length;
-        pvalue = xiter->second->pvalue;
-    }
+    // decoded value
+    size_t length = xiter->second.length();
 
     if(0 < size){
         if(static_cast<size_t>(size) < length){
             // over buffer size
-            free_xattrs(xattrs);
             return -ERANGE;
         }
-        if(pvalue){
-            memcpy(value, pvalue, length);
+        if(0 < length){
+            memcpy(value, xiter->second.data(), length);
         }
     }
-    free_xattrs(xattrs);
 
     return static_cast<int>(length);
 }
@@ -3371,9 +4054,9 @@ static int s3fs_listxattr(const char* path, char* list, size_t size)
         return -EIO;
     }
 
-    int       result;
-    headers_t meta;
-    xattrs_t  xattrs;
+    int           result;
+    headers_t     meta;
+    xattr_cache_t xattrs;
 
     // check parent directory attribute.
     if(0 != (result = check_parent_object_access(path, X_OK))){
@@ -3393,40 +4076,36 @@ static int s3fs_listxattr(const char* path, char* list, size_t size)
     }
     std::string strxattrs = iter->second;
 
-    parse_xattrs(strxattrs, xattrs);
+    get_cached_xattrs(path, strxattrs, xattrs);
 
     // calculate total name length
     size_t total = 0;
-    for(xattrs_t::const_iterator xiter = xattrs.begin(); xiter != xattrs.end(); ++xiter){
+    for(xattr_cache_t::const_iterator xiter = xattrs.begin(); xiter != xattrs.end(); ++xiter){
         if(!xiter->first.empty()){
             total += xiter->first.length() + 1;
         }
     }
 
     if(0 == total){
-        free_xattrs(xattrs);
         return 0;
     }
 
     // check parameters
     if(0 == size){
-        free_xattrs(xattrs);
         return static_cast<int>(total);
     }
     if(!list || size < total){
-        free_xattrs(xattrs);
         return -ERANGE;
     }
 
     // copy to list
     char* setpos = list;
-    for(xattrs_t::const_iterator xiter = xattrs.begin(); xiter != xattrs.end(); ++xiter){
+    for(xattr_cache_t::const_iterator xiter = xattrs.begin(); xiter != xattrs.end(); ++xiter){
         if(!xiter->first.empty()){
             strcpy(setpos, xiter->first.c_str());
             setpos = &setpos[strlen(setpos) + 1];
         }
     }
-    free_xattrs(xattrs);
 
     return static_cast<int>(total);
 }
@@ -3559,6 +4238,7 @@ static int s3fs_removexattr(const char* path, const char* name)
         StatCache::getStatCacheData()->DelStat(nowcache);
     }
 
+    forget_flights(path);
     return 0;
 }
    
@@ -3581,6 +4261,14 @@ static void* s3fs_init(struct fuse_conn_info* conn)
     S3FS_PRN_INIT_INFO("init v%s(commit:%s) with %s, credential-library(%s)", VERSION, COMMIT_HASH_VAL, s3fs_crypt_lib_name(), ps3fscred->GetCredFuncVersion(false));
 
     // cache(remove cache dirs at first)
+    //
+    // [NOTE]
+    // The cache dirs are moved into the trash and are removed in background,
+    // then the mount does not wait for removing them.
+    //
+    if(FdManager::IsCacheDir() && !CacheTrash::Initialize()){
+        S3FS_PRN_WARN("Could not start removing cache directory in background, but continue...");
+    }
     if(is_remove_cache && (!CacheFileStat::DeleteCacheFileStatDirectory() || !FdManager::DeleteCacheDirectory())){
         S3FS_PRN_DBG("Could not initialize cache directory.");
     }
@@ -3617,6 +4305,51 @@ static void* s3fs_init(struct fuse_conn_info* conn)
         s3fs_exit_fuseloop(EXIT_FAILURE);
     }
 
+    if(0 < upload_concurrency && !UploadScheduler::Initialize(upload_concurrency)){
+        S3FS_PRN_CRIT("Could not create upload scheduler(%d)", upload_concurrency);
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    if(is_async_close && !AsyncCloseMan::Initialize(async_close_thread_count, forget_flights)){
+        S3FS_PRN_CRIT("Could not create threads for async close(%d)", async_close_thread_count);
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    if(0 < StatCache::getStatCacheData()->GetStaleGraceTime() && !StatCacheRefresher::Initialize(refresh_stat_cache)){
+        S3FS_PRN_CRIT("Could not create thread for refreshing stat cache.");
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    if(TraversalDetector::IsEnable() && !SubtreeLoader::Initialize(load_subtree)){
+        S3FS_PRN_CRIT("Could not create thread for loading subtrees.");
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    if(PeerCache::IsSpecified() && !PeerCache::Initialize()){
+        S3FS_PRN_CRIT("Could not start peer cache.");
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    if(direct_read && ChunkSpill::IsSpecified() && !ChunkSpill::Initialize()){
+        S3FS_PRN_CRIT("Could not start spilling chunks for direct read.");
+        s3fs_exit_fuseloop(EXIT_FAILURE);
+    }
+
+    // [NOTE]
+    // The budgets of the consumers are the percentages of the target memory,
+    // and the rest is left for the memory which is not governed(the buffers
+    // of requests and listings, etc).
+    //
+    if(MemoryGovernor::IsSpecified()){
+        MemoryGovernor::AddConsumer("stat cache", 10, stat_cache_memory_usage, stat_cache_memory_budget);
+        if(direct_read){
+            MemoryGovernor::AddConsumer("direct read chunks", 50, DirectReader::GetMemoryUsage, DirectReader::SetMemoryBudget);
+        }
+        if(!MemoryGovernor::Initialize()){
+            S3FS_PRN_WARN("Could not start the memory governor, but continue...");
+        }
+    }
+
     // Signal object
     if(!S3fsSignals::Initialize()){
         S3FS_PRN_ERR("Failed to initialize signal object, but continue...");
@@ -3634,9 +4367,24 @@ static void s3fs_destroy(void*)
         S3FS_PRN_WARN("Failed to clean up signal object.");
     }
 
+    // [NOTE]
+    // The deferred uploads are finished before the upload scheduler is destroyed.
+    AsyncCloseMan::Destroy();
+    PeerCache::Destroy();
+    StatCacheRefresher::Destroy();
+    SubtreeLoader::Destroy();
     ThreadPoolMan::Destroy();
+    UploadScheduler::Destroy();
+    ChunkSpill::Destroy();
+    MemoryGovernor::Destroy();
+
+    // lock profile(at last, for the whole period)
+    if(LockProfiler::IsEnable()){
+        LockProfiler::Dump();
+    }
 
     // cache(remove at last)
+    CacheTrash::Destroy(is_remove_cache);
     if(is_remove_cache && (!CacheFileStat::DeleteCacheFileStatDirectory() || !FdManager::DeleteCacheDirectory())){
         S3FS_PRN_WARN("Could not remove cache directory.");
     }
@@ -3727,6 +4475,75 @@ static bool check_error_message(const char* pbody, size_t len, std::string& mess
     return true;
 }
 
+//
+// Check whether the bucket supports the server side rename api.
+// It is supported by the buckets which enable hierarchical namespace.
+//
+static bool check_server_rename()
+{
+    S3fsCurl s3fscurl;
+    if(0 != s3fscurl.GetBucketInfoRequest()){
+        S3FS_PRN_INFO("Could not get the bucket information, so the server side rename is not used.");
+        return false;
+    }
+    const std::string* body = s3fscurl.GetBodyData();
+    if(!is_hierarchical_namespace_bucket(body->c_str(), body->size())){
+        S3FS_PRN_INFO("The bucket does not enable hierarchical namespace, so the server side rename is not used.");
+        return false;
+    }
+    S3FS_PRN_INFO("The bucket enables hierarchical namespace, so the server side rename is used.");
+    return true;
+}
+
+//
+// Sample the bucket by listing one page of objects, and learn the
+// directories which have "_$folder$" objects.
+// If the listing is truncated, the objects after the last object in the
+// page are not sampled, and last_path is set to it.
+//
+static bool sample_folder_objects(std::string& last_path)
+{
+    std::string query;
+    if(S3fsCurl::IsListObjectsV2()){
+        query += "list-type=2&";
+    }
+    query += "max-keys=" + str(max_keys_list_object) + "&prefix=";
+
+    S3fsCurl s3fscurl;
+    if(0 != s3fscurl.ListBucketRequest("/", query.c_str())){
+        S3FS_PRN_WARN("Could not list the bucket for detecting \"_$folder$\" objects.");
+        return false;
+    }
+    const std::string* body = s3fscurl.GetBodyData();
+
+    xmlDocPtr doc;
+    if(NULL == (doc = xmlReadMemory(body->c_str(), static_cast<int>(body->size()), "", NULL, 0))){
+        S3FS_PRN_WARN("xmlReadMemory returns with error.");
+        return false;
+    }
+    S3ObjList head;
+    int       result    = append_objects_from_xml("/", doc, head);
+    bool      truncated = is_truncated(doc);
+    S3FS_XMLFREEDOC(doc);
+    if(0 != result){
+        S3FS_PRN_WARN("append_objects_from_xml returns with error.");
+        return false;
+    }
+    FolderObjectDetector::AddFolderObjects("/", head);
+
+    last_path.clear();
+    if(truncated){
+        std::string lastname;
+        if(!head.GetLastName(lastname)){
+            S3FS_PRN_WARN("Could not find the last object in the listing for detecting \"_$folder$\" objects.");
+            return false;
+        }
+        last_path = "/" + lastname;
+    }
+
+    return true;
+}
+
 static int s3fs_check_service()
 {
     S3FS_PRN_INFO("check services.");
@@ -3852,6 +4669,18 @@ static int s3fs_check_service()
             }
         }
     }
+
+    // check the capability for renaming
+    if(serverrenameapi){
+        is_server_rename = check_server_rename();
+    }
+
+    // detect "_$folder$" objects
+    if(support_compat_dir && FolderObjectDetector::IsEnable()){
+        std::string last_path;
+        bool        is_sampled = sample_folder_objects(last_path);
+        FolderObjectDetector::SetSampled(is_sampled, last_path);
+    }
     S3FS_MALLOCTRIM(0);
     
     return EXIT_SUCCESS;
@@ -4065,6 +4894,67 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             FdManager::SetCheckCacheDirExist(true);
             return 0;
         }
+        if(is_prefix(arg, "cache_layout=")){
+            const char* layout = strchr(arg, '=') + sizeof(char);
+            if(0 == strcmp(layout, "chunk")){
+                ChunkCache::SetEnable(true);
+            }else if(0 == strcmp(layout, "sparse")){
+                ChunkCache::SetEnable(false);
+            }else{
+                S3FS_PRN_EXIT("unknown value for cache_layout: %s", layout);
+                return -1;
+            }
+            return 0;
+        }
+        if(0 == strcmp(arg, "cache_shared")){
+            ChunkCache::SetShared(true);
+            return 0;
+        }
+        if(0 == strcmp(arg, "cache_compress")){
+            if(!ChunkCache::CanCompress()){
+                S3FS_PRN_EXIT("cache_compress option is not supported, because ossfs is built without zlib.");
+                return -1;
+            }
+            ChunkCache::SetCompress(true);
+            return 0;
+        }
+        if(0 == strcmp(arg, "cache_hashed_dir")){
+            FdManager::SetHashedDir(true);
+            return 0;
+        }
+        if(is_prefix(arg, "peer_cache=")){
+            if(!PeerCache::SetPeers(strchr(arg, '=') + sizeof(char))){
+                S3FS_PRN_EXIT("peer_cache option must be the list of host:port separated by comma.");
+                return -1;
+            }
+            return 0;
+        }
+        if(is_prefix(arg, "peer_cache_self=")){
+            if(!PeerCache::SetSelf(strchr(arg, '=') + sizeof(char))){
+                S3FS_PRN_EXIT("peer_cache_self option must be host:port.");
+                return -1;
+            }
+            return 0;
+        }
+        if(is_prefix(arg, "peer_cache_token_file=")){
+            if(!PeerCache::SetTokenFile(strchr(arg, '=') + sizeof(char))){
+                S3FS_PRN_EXIT("failed to read the token from peer_cache_token_file option.");
+                return -1;
+            }
+            return 0;
+        }
+        if(is_prefix(arg, "peer_cache_token=")){
+            S3FS_PRN_EXIT("peer_cache_token option is not supported, specify the token by peer_cache_token_file option or OSSPEERCACHETOKEN environment.");
+            return -1;
+        }
+        if(is_prefix(arg, "cache_chunk_size=")){
+            off_t size = static_cast<off_t>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(!ChunkCache::SetChunkSize(size * 1024 * 1024)){
+                S3FS_PRN_EXIT("cache_chunk_size option must be at least 1 MB.");
+                return -1;
+            }
+            return 0;
+        }
         if(0 == strcmp(arg, "del_cache")){
             is_remove_cache = true;
             return 0;
@@ -4293,6 +5183,13 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             max_keys_list_object = max_keys;
             return 0;
         }
+        if(is_prefix(arg, "memory_limit=")){
+            if(!MemoryGovernor::SetMemoryLimit(strchr(arg, '=') + sizeof(char))){
+                S3FS_PRN_EXIT("memory_limit option should be \"auto\" or the size in MB greater than 0.");
+                return -1;
+            }
+            return 0;
+        }
         if(is_prefix(arg, "max_stat_cache_size=")){
             unsigned long cache_size = static_cast<unsigned long>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), 10));
             StatCache::getStatCacheData()->SetCacheSize(cache_size);
@@ -4309,6 +5206,15 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             StatCache::getStatCacheData()->SetExpireTime(expr_time);
             return 0;
         }
+        if(is_prefix(arg, "stat_cache_stale_grace=")){
+            off_t grace = cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10);
+            if(0 > grace){
+                S3FS_PRN_EXIT("argument should be over 0: stat_cache_stale_grace");
+                return -1;
+            }
+            StatCache::getStatCacheData()->SetStaleGraceTime(static_cast<time_t>(grace));
+            return 0;
+        }
         // [NOTE]
         // This option is for compatibility old version.
         if(is_prefix(arg, "stat_cache_interval_expire=")){
@@ -4337,6 +5243,15 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             S3fsCurl::SetMaxParallelCount(maxpara);
             return 0;
         }
+        if(is_prefix(arg, "upload_concurrency=")){
+            int maxupload = static_cast<int>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(0 > maxupload){
+                S3FS_PRN_EXIT("argument should be over 0: upload_concurrency");
+                return -1;
+            }
+            upload_concurrency = maxupload;
+            return 0;
+        }
         if(is_prefix(arg, "fd_page_size=")){
             S3FS_PRN_ERR("option fd_page_size is no longer supported, so skip this option.");
             return 0;
@@ -4455,6 +5370,10 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             support_compat_dir = false;
             return 0;
         }
+        if(0 == strcmp(arg, "compat_dir_detect")){
+            FolderObjectDetector::SetEnable(true);
+            return 0;
+        }
         if(0 == strcmp(arg, "enable_content_md5")){
             S3fsCurl::SetContentMd5(true);
             return 0;
@@ -4555,10 +5474,31 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             shallowcopyapi = false;
             return 0;
         }
+        if(0 == strcmp(arg, "noserverrenameapi")){
+            serverrenameapi = false;
+            return 0;
+        }
         if(0 == strcmp(arg, "readdir_optimize")){
             is_readdir_optimize = true;
             return 0;
         }
+        if(is_prefix(arg, "bulk_readdir=")){
+            int count = static_cast<int>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(!TraversalDetector::SetThreshold(count)){
+                S3FS_PRN_EXIT("argument should be over 0: bulk_readdir");
+                return -1;
+            }
+            return 0;
+        }
+        if(is_prefix(arg, "bulk_readdir_expire=")){
+            time_t expire = static_cast<time_t>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(!TraversalDetector::SetExpireTime(expire)){
+                S3FS_PRN_EXIT("argument should be over 1: bulk_readdir_expire");
+                return -1;
+            }
+            StatCache::getStatCacheData()->SetDirListExpireTime(expire);
+            return 0;
+        }
         if(is_prefix(arg, "readdir_check_size=")){
             readdir_check_size = static_cast<off_t>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
             return 0;
@@ -4567,10 +5507,27 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             is_new_symlink_format = true;
             return 0;
         }       
+        if(0 == strcmp(arg, "keep_cache")){
+            FdManager::SetKeepCache(true);
+            return 0;
+        }
         if(0 == strcmp(arg, "direct_read")){
             direct_read = true;
             return 0;
         }
+        if(0 == strcmp(arg, "async_close")){
+            is_async_close = true;
+            return 0;
+        }
+        if(is_prefix(arg, "async_close_thread=")){
+            int thcount = static_cast<int>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(0 >= thcount){
+                S3FS_PRN_EXIT("argument should be over 1: async_close_thread");
+                return -1;
+            }
+            async_close_thread_count = thcount;
+            return 0;
+        }
         if(is_prefix(arg, "direct_read_prefetch_thread=")){
             int max_thcount = static_cast<int>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
             if(0 >= max_thcount){
@@ -4610,6 +5567,21 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             }
             return 0;
         }
+        if(is_prefix(arg, "direct_read_spill_dir=")) {
+            if(!ChunkSpill::SetSpillDir(strchr(arg, '=') + sizeof(char))) {
+                S3FS_PRN_EXIT("direct_read_spill_dir option requires a directory.");
+                return -1;
+            }
+            return 0;
+        }
+        if(is_prefix(arg, "direct_read_spill_size_mb=")) {
+            off_t size = static_cast<off_t>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
+            if(!ChunkSpill::SetSpillLimit(size * 1024 * 1024)) {
+                S3FS_PRN_EXIT("direct_read_spill_size_mb option should be greater than 0.");
+                return -1;
+            }
+            return 0;
+        }
         // takes effect only when direct_read == true
         if(is_prefix(arg, "direct_read_local_file_cache_size_mb=")) {
             long limit = static_cast<long>(cvt_strtoofft(strchr(arg, '=') + sizeof(char), /*base=*/ 10));
@@ -4713,6 +5685,13 @@ static int my_fuse_opt_proc(void* data, const char* arg, int key, struct fuse_ar
             }
             return 0;
         }
+        if(0 == strcmp(arg, "lock_profile")){
+            S3fsSignals::SetUsr1LockProfile(NULL);
+            return 0;
+        }else if(is_prefix(arg, "lock_profile=")){
+            S3fsSignals::SetUsr1LockProfile(strchr(arg, '=') + sizeof(char));
+            return 0;
+        }
         if(is_prefix(arg, "accessKeyId=")){
             S3FS_PRN_EXIT("option accessKeyId is no longer supported.");
             return -1;
@@ -5013,6 +5992,42 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
+    // check the chunked cache layout
+    if(ChunkCache::IsEnable() && !FdManager::IsCacheDir()){
+        S3FS_PRN_EXIT("cache_layout=chunk option requires use_cache option.");
+        S3fsCurl::DestroyS3fsCurl();
+        s3fs_destroy_global_ssl();
+        destroy_parser_xml_lock();
+        delete ps3fscred;
+        exit(EXIT_FAILURE);
+    }
+
+    if(ChunkCache::IsShared() && !ChunkCache::IsEnable()){
+        S3FS_PRN_EXIT("cache_shared option requires cache_layout=chunk option.");
+        S3fsCurl::DestroyS3fsCurl();
+        s3fs_destroy_global_ssl();
+        destroy_parser_xml_lock();
+        delete ps3fscred;
+        exit(EXIT_FAILURE);
+    }
+
+    if(ChunkCache::IsCompress() && !ChunkCache::IsEnable()){
+        S3FS_PRN_EXIT("cache_compress option requires cache_layout=chunk option.");
+        S3fsCurl::DestroyS3fsCurl();
+        s3fs_destroy_global_ssl();
+        destroy_parser_xml_lock();
+        delete ps3fscred;
+        exit(EXIT_FAILURE);
+    }
+
+    if(!PeerCache::CheckParameters()){
+        S3fsCurl::DestroyS3fsCurl();
+        s3fs_destroy_global_ssl();
+        destroy_parser_xml_lock();
+        delete ps3fscred;
+        exit(EXIT_FAILURE);
+    }
+
     // set fake free disk space
     if(-1 != fake_diskfree_size){
         FdManager::InitFakeUsedDiskSize(fake_diskfree_size);
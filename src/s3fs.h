@@ -48,16 +48,12 @@
 // the MMAP_THRESHOLD environment variable and check more
 // accurate memory leak.( see, man 3 free )
 //
-#ifdef S3FS_MALLOC_TRIM
-#ifdef HAVE_MALLOC_TRIM
-#include <malloc.h>
-#define S3FS_MALLOCTRIM(pad)    malloc_trim(pad)
-#else   // HAVE_MALLOC_TRIM
-#define S3FS_MALLOCTRIM(pad)
-#endif  // HAVE_MALLOC_TRIM
-#else   // S3FS_MALLOC_TRIM
-#define S3FS_MALLOCTRIM(pad)
-#endif  // S3FS_MALLOC_TRIM
+// While MemoryGovernor is running(memory_limit option), the trimming
+// is requested to its thread regardless of the S3FS_MALLOC_TRIM flag,
+// and otherwise it is done in the caller only with the flag.
+//
+#include "memory_governor.h"
+#define S3FS_MALLOCTRIM(pad)    MemoryGovernor::RequestTrim(pad)
 
 #define S3FS_XMLFREEDOC(doc) \
         do{ \
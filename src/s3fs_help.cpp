@@ -79,8 +79,68 @@ static const char help_string[] =
     "        If this option is not specified, it will be created at runtime\n"
     "        when the cache directory does not exist.\n"
     "\n"
+    "   cache_layout (default=\"sparse\")\n"
+    "      - layout of the local file cache which is specified by use_cache.\n"
+    "        \"sparse\" caches an object as one sparse file of the object\n"
+    "        size. \"chunk\" caches an object as fixed size chunk files\n"
+    "        keyed by the path, the etag and the chunk index, which are\n"
+    "        evicted one by one in the order of the last access time.\n"
+    "        The opened file uses a temporary file in tmpdir with \"chunk\".\n"
+    "\n"
+    "   cache_chunk_size (default=\"8\")\n"
+    "      - chunk size in MB for cache_layout=chunk.\n"
+    "\n"
+    "   cache_shared (default is disable)\n"
+    "      - share the chunks of cache_layout=chunk between the ossfs\n"
+    "        processes on the host which mount the same bucket with the same\n"
+    "        use_cache directory(and the same cache_chunk_size). Each chunk is\n"
+    "        downloaded by one process which owns the file lock of it, and\n"
+    "        the other processes read it from the cache after that.\n"
+    "        del_cache does not remove the shared chunks.\n"
+    "\n"
+    "   cache_compress (default is disable)\n"
+    "      - compress the chunks of cache_layout=chunk by zlib, so that\n"
+    "        more objects are cached in the same disk space. The chunk which\n"
+    "        does not become smaller(judged by its head) is not compressed.\n"
+    "        The compressed and not compressed chunks are both read\n"
+    "        regardless of this option.\n"
+    "\n"
+    "   cache_hashed_dir (default is disable)\n"
+    "      - place the cache files of cache_layout=sparse in two levels of\n"
+    "        256 directories by the hash of the object path, instead of\n"
+    "        the directories which mirror the object paths. The object path\n"
+    "        is kept in the stats file of the cache file. This keeps the\n"
+    "        cache directories small for the bucket which has many objects\n"
+    "        in one directory. The cache files which are left in the\n"
+    "        mirrored directories are moved when they are opened, and the\n"
+    "        others are removed by the cache cleanup.\n"
+    "\n"
+    "   peer_cache (default is disable)\n"
+    "      - share the chunks of cache_layout=chunk between the ossfs\n"
+    "        processes on the nodes of a cluster. Specify all nodes as\n"
+    "        \"host:port,host:port,...\". Each chunk is owned by one node by\n"
+    "        the consistent hashing, and the other nodes get it from the\n"
+    "        owner before downloading it from the server. When the owner\n"
+    "        fails, the chunk is downloaded from the server. All nodes must\n"
+    "        mount the same bucket and path with the same cache_chunk_size.\n"
+    "        This option requires peer_cache_self and peer_cache_token_file\n"
+    "        (or OSSPEERCACHETOKEN environment).\n"
+    "\n"
+    "   peer_cache_self (default=\"\")\n"
+    "      - host:port of this node in the peer_cache list. ossfs listens\n"
+    "        on it for the requests from the other nodes.\n"
+    "\n"
+    "   peer_cache_token_file (default=\"\")\n"
+    "      - the file which has the shared secret in the first line. All\n"
+    "        nodes of peer_cache send and check it with each request. The\n"
+    "        file must be 0600 permissions. The secret can be specified by\n"
+    "        OSSPEERCACHETOKEN environment instead. The chunks are served\n"
+    "        over plain HTTP, then use it only in the trusted network.\n"
+    "\n"
     "   del_cache (delete local file cache)\n"
     "      - delete local file cache when ossfs starts and exits.\n"
+    "        At starting, the cache directories are moved into\n"
+    "        \"<use_cache>/.<bucket>.trash\" and are removed in background.\n"
     "\n"
     "   storage_class (default=\"Standard\")\n"
     "      - store object with specified sstorage class. Possible values:\n"
@@ -147,6 +207,14 @@ static const char help_string[] =
     "      - maximum number of entries in the stat cache, and this maximum is\n"
     "        also treated as the number of symbolic link cache.\n"
     "\n"
+    "   memory_limit (default is disable)\n"
+    "      - specify the memory limit of ossfs in MB, or \"auto\" to use the\n"
+    "        memory limit of the cgroup(container) which ossfs runs in.\n"
+    "        When the memory(RSS) of ossfs exceeds 80%% of the limit, the stat\n"
+    "        cache and the chunks of direct_read are shrunk in their budgets,\n"
+    "        and the freed memory is returned to the system, until it goes\n"
+    "        down under 70%% of the limit.\n"
+    "\n"
     "   stat_cache_expire (default is 900))\n"
     "      - specify expire time (seconds) for entries in the stat cache.\n"
     "        This expire time indicates the time since stat cached. and this\n"
@@ -160,6 +228,13 @@ static const char help_string[] =
     "      of the stat cache. This option is exclusive with stat_cache_expire,\n"
     "      and is left for compatibility with older versions.\n"
     "\n"
+    "   stat_cache_stale_grace (default is 0)\n"
+    "      - specify the grace time (seconds) after the expire time of the\n"
+    "        stat cache. The expired entries in this time are returned at\n"
+    "        once, and are refreshed by one HEAD request in background.\n"
+    "        The entries over this time are removed as before.\n"
+    "        0 value means disable.\n"
+    "\n"
     "   enable_noobj_cache (default is disable)\n"
     "      - enable cache entries for the object which does not exist.\n"
     "      ossfs always has to check whether file (or sub directory) exists \n"
@@ -195,6 +270,16 @@ static const char help_string[] =
     "      at once. It is necessary to set this value depending on a CPU \n"
     "      and a network band.\n"
     "\n"
+    "   upload_concurrency (default=\"0\")\n"
+    "      - maximum number of uploading requests(PUT object and upload\n"
+    "      part) which ossfs sends at once over all files.\n"
+    "      When many files are flushed at once, the requests are\n"
+    "      interleaved fairly between the files, so that small files\n"
+    "      are not blocked by the parts of large files.\n"
+    "      The parallel_count option still limits the parallel requests\n"
+    "      of one file. 0 means that the upload requests are not\n"
+    "      limited over all files.\n"
+    "\n"
     "   multipart_size (default=\"10\")\n"
     "      - part size, in MB, for each multipart request.\n"
     "      The minimum value is 5 MB and the maximum value is 5 GB.\n"
@@ -391,6 +476,14 @@ static const char help_string[] =
     "        scheme, this option can be used to disable support for alternative\n"
     "        naming schemes. This reduces access time and can save costs.\n"
     "\n"
+    "   compat_dir_detect (detect \"dir_$folder$\" objects automatically)\n"
+    "      - ossfs lists the bucket at mounting, and learns the directories\n"
+    "        which have \"dir_$folder$\" objects from it and from all listings\n"
+    "        after that. The requests for checking \"dir_$folder$\" objects\n"
+    "        are sent only under those directories. If other clients make\n"
+    "        \"dir_$folder$\" objects, the checks are enabled again after the\n"
+    "        parent directory is listed.\n"
+    "\n"
     "   use_wtf8 - support arbitrary file system encoding.\n"
     "        OSS requires all object names to be valid UTF-8. But some\n"
     "        clients, notably Windows NFS clients, use their own encoding.\n"
@@ -433,6 +526,12 @@ static const char help_string[] =
     "        It can speed up the process of renaming a large file or updating a file's meta.\n"
     "        If this option is specified, renames a large file or update a large file's meta by multipart upload.\n"
     "\n"
+    "   noserverrenameapi - disable using server side rename api\n"
+    "        At mounting, ossfs checks whether the bucket enables hierarchical namespace.\n"
+    "        If it does, a file or a directory(with all objects under it) is renamed by one\n"
+    "        rename request instead of copying and deleting objects.\n"
+    "        If this option is specified, ossfs does not check it and does not use the rename api.\n"
+    "\n"
     "   readdir_optimize (default is disable)\n"
     "        ossfs stroes extended information like access & change time, owner, permissions, etc in the object's meta data.\n"
     "        The ListObjects only returns basic information like name, size, and modified time, so ossfs issues\n"
@@ -447,10 +546,46 @@ static const char help_string[] =
     "        If a file size is greater than this threshold, only use the basic information from ListObjects result.\n"
     "        This option works when readdir_optimize option is eanbled.\n"
     "\n"
+    "   bulk_readdir (default is disable)\n"
+    "        Detect recursive traversals(find, du, rsync, ls -R etc), and list\n"
+    "        the whole subtree by one ListObjects without delimiter. When this\n"
+    "        count of child directories of a directory which was listed in\n"
+    "        bulk_readdir_expire seconds are listed, the subtree of the\n"
+    "        directory is loaded in background and the rest of the traversal\n"
+    "        does not list each directory. The mount point is never loaded.\n"
+    "        The subtree which has more objects than max_stat_cache_size is\n"
+    "        not loaded. With readdir_optimize, the stats are also made from\n"
+    "        the loaded listings.\n"
+    "\n"
+    "   bulk_readdir_expire (default=\"30\")\n"
+    "        Specify the time (seconds) for detecting the traversal, and for\n"
+    "        keeping the loaded listings. The listing of a directory is also\n"
+    "        removed when an object in it is changed by this ossfs.\n"
+    "\n"
     "   symlink_in_meta (default is disable)\n"
     "        Enable to save the symbolic link target in object user metadata.\n"
     "        This option is used in conjunction with the readdir_optimize option.\n"
     "\n"
+    "   async_close (default is disable)\n"
+    "        Enable to upload the modified file in the background after it is\n"
+    "        closed. close() returns without waiting for the upload, and the\n"
+    "        file stays opened in ossfs until the upload is finished.\n"
+    "        fsync() waits for the upload. If the upload fails, it is only\n"
+    "        logged, so use fsync() if the application needs to know it.\n"
+    "        All uploads are finished before unmounting.\n"
+    "\n"
+    "   async_close_thread (default is 4)\n"
+    "        Specifies the number of threads uploading the closed files.\n"
+    "        Note that this option only works when async_close option is specified.\n"
+    "\n"
+    "   keep_cache (default is disable)\n"
+    "        Keep the kernel page cache of the file at opening for reading,\n"
+    "        if the etag and the size of the object are the same as the last\n"
+    "        opening. This avoids reading the files which are opened again and\n"
+    "        again through ossfs each time. The files in direct read mode are\n"
+    "        opened with direct_io instead, so that the streamed data is not\n"
+    "        cached twice.\n"
+    "\n"
     "   direct_read (default is disable)\n"
     "        Enable read file from oss directly without using local disk.\n"
     "        Beyond that, data will also be prefetched to memory in the backgroud if direct_read_prefetch_chunks option is not 0.\n"
@@ -463,22 +598,40 @@ static const char help_string[] =
     "   direct_read_chunk_size (default is 4)\n"
     "        chunk size, in MB, for each direct read and prefetch request to get data from oss.\n"
     "        The minimum value is 1(MB) and the maximum value is 32(MB).\n"
+    "        For the sequential read, the continuous chunks up to 64MB are\n"
+    "        prefetched by one request as the read goes on.\n"
     "        Note that this option only works when direct_read option is true.\n"
     "\n"
     "   direct_read_prefetch_chunks (default is 32)\n"
     "        Specifies the number of prefetch requests generated one time.\n" 
     "        If this option is set to 0, it means that no data will be prefetched.\n"
+    "        The number is also limited by the chunks which the reader reads\n"
+    "        while one prefetch request is downloaded.\n"
     "        Note that this option only works when direct_read option is true.\n "
     "\n"
     "   direct_read_prefetch_limit (default is 1024)\n"
     "        Specifies the total memory that all prefetch chunks can use, in MB.\n"
-    "        The minimum value is 128(MB).\n"
+    "        The minimum value is 128(MB). When the limit is reached, the\n"
+    "        least recently used chunks of the other files are evicted for\n"
+    "        the prefetch.\n"
     "        Note that this option only works when direct_read option is true.\n"
     "\n"
     "   direct_read_backward_chunks (default is 1)\n"
     "        Specifies the number of chunks reserved of backward direction.\n"
     "        Note that this option only works when direct_read option is true.\n"
     "\n"
+    "   direct_read_spill_dir (default is not specified)\n"
+    "        Specifies the directory where the chunks which are released from\n"
+    "        the memory in direct read mode are written. The chunk which is\n"
+    "        read again(by the backward seek or by the next opening) is read\n"
+    "        from this directory instead of oss, if the etag of the object is\n"
+    "        not changed.\n"
+    "        Note that this option only works when direct_read option is true.\n"
+    "\n"
+    "   direct_read_spill_size_mb (default is 10240)\n"
+    "        Specifies the total size of the chunk files in direct_read_spill_dir,\n"
+    "        in MB. The least recently used files are removed over it.\n"
+    "\n"
     "   direct_read_local_file_cache_size_mb (default is 0)\n"
     "        Takes effect only in direct-read mode.\n"
     "        When loaded size is smaller than it, ossfs prefetches and writes data to the local disk.\n"
@@ -523,6 +676,15 @@ static const char help_string[] =
     "        check result to that file. The file path parameter can be omitted.\n"
     "        If omitted, the result will be output to stdout or syslog.\n"
     "\n"
+    "   lock_profile (default is disable)\n"
+    "        Record the count of acquiring, the contended count, and the\n"
+    "        histograms of the wait time and the hold time of each internal\n"
+    "        lock(ex. stat_cache_lock, fdent_lock). The profile is output\n"
+    "        when ossfs catches the SIGUSR1 signal and when it exits.\n"
+    "        This option can take a file path as parameter to output the\n"
+    "        profile to that file. If omitted, the profile will be output to\n"
+    "        stdout or syslog.\n"
+    "\n"
     "   sigv4 (default is signature version 1)\n"
     "      - sets signing OSS requests by using only signature version 4.\n"
     "\n"
@@ -559,6 +559,45 @@ bool simple_parse_xml(const char* data, size_t len, const char* key, std::string
     return result;
 }
 
+//
+// Check the HierarchicalNamespace element in the GetBucketInfo response.
+// (BucketInfo -> Bucket -> HierarchicalNamespace)
+//
+bool is_hierarchical_namespace_bucket(const char* data, size_t len)
+{
+    bool result = false;
+
+    if(!data){
+        return false;
+    }
+
+    xmlDocPtr doc;
+    if(NULL == (doc = xmlReadMemory(data, static_cast<int>(len), "", NULL, 0))){
+        return false;
+    }
+
+    if(NULL == doc->children){
+        S3FS_XMLFREEDOC(doc);
+        return false;
+    }
+    for(xmlNodePtr bucket_node = doc->children->children; NULL != bucket_node && !result; bucket_node = bucket_node->next){
+        if(XML_ELEMENT_NODE != bucket_node->type || 0 != strcmp(reinterpret_cast<const char*>(bucket_node->name), "Bucket")){
+            continue;
+        }
+        for(xmlNodePtr cur_node = bucket_node->children; NULL != cur_node; cur_node = cur_node->next){
+            if(XML_ELEMENT_NODE == cur_node->type && 0 == strcmp(reinterpret_cast<const char*>(cur_node->name), "HierarchicalNamespace")){
+                if(cur_node->children && XML_TEXT_NODE == cur_node->children->type){
+                    result = (0 == strcmp(reinterpret_cast<const char*>(cur_node->children->content), "Enabled"));
+                }
+                break;
+            }
+        }
+    }
+    S3FS_XMLFREEDOC(doc);
+
+    return result;
+}
+
 //-------------------------------------------------------------------
 // Utility for lock
 //-------------------------------------------------------------------
@@ -41,6 +41,7 @@ xmlChar* get_next_marker(xmlDocPtr doc);
 bool get_incomp_mpu_list(xmlDocPtr doc, incomp_mpu_list_t& list);
 
 bool simple_parse_xml(const char* data, size_t len, const char* key, std::string& value);
+bool is_hierarchical_namespace_bucket(const char* data, size_t len);
 
 bool init_parser_xml_lock();
 bool destroy_parser_xml_lock();
@@ -58,6 +58,7 @@ class S3ObjList
         ~S3ObjList() {}
 
         bool IsEmpty() const { return objects.empty(); }
+        size_t Size() const { return objects.size(); }
         bool insert(const char* name, const char* etag = NULL, bool is_dir = false, const char* size = NULL, const char* last_modified = NULL);
         std::string GetOrgName(const char* name) const;
         std::string GetNormalizedName(const char* name) const;
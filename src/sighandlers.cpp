@@ -27,12 +27,14 @@
 #include "s3fs.h"
 #include "sighandlers.h"
 #include "fdcache.h"
+#include "autolock.h"
 
 //-------------------------------------------------------------------
 // Class S3fsSignals
 //-------------------------------------------------------------------
 S3fsSignals* S3fsSignals::pSingleton = NULL;
 bool S3fsSignals::enableUsr1         = false;
+bool S3fsSignals::enableCheckCache   = false;
 
 //-------------------------------------------------------------------
 // Class methods
@@ -84,6 +86,18 @@ bool S3fsSignals::SetUsr1Handler(const char* path)
         return false;
     }
 
+    S3fsSignals::enableUsr1       = true;
+    S3fsSignals::enableCheckCache = true;
+
+    return true;
+}
+
+//
+// SIGUSR1 also dumps the lock profile, then it is enabled with it.
+//
+bool S3fsSignals::SetUsr1LockProfile(const char* path)
+{
+    LockProfiler::SetEnable(true, path);
     S3fsSignals::enableUsr1 = true;
 
     return true;
@@ -108,10 +122,15 @@ void* S3fsSignals::CheckCacheWorker(void* arg)
         }
 
         // check all cache
-        if(!FdManager::get()->CheckAllCache()){
+        if(S3fsSignals::enableCheckCache && !FdManager::get()->CheckAllCache()){
             S3FS_PRN_ERR("Processing failed due to some problem.");
         }
 
+        // dump lock profile
+        if(LockProfiler::IsEnable() && !LockProfiler::Dump()){
+            S3FS_PRN_ERR("Could not dump lock profile.");
+        }
+
         // do not allow request queuing
         for(int value = pSem->get_value(); 0 < value; value = pSem->get_value()){
             pSem->wait();
@@ -31,6 +31,7 @@ class S3fsSignals
     private:
         static S3fsSignals* pSingleton;
         static bool         enableUsr1;
+        static bool         enableCheckCache;
 
         pthread_t*          pThreadUsr1;
         Semaphore*          pSemUsr1;
@@ -59,6 +60,7 @@ class S3fsSignals
         static bool Destroy();
 
         static bool SetUsr1Handler(const char* path);
+        static bool SetUsr1LockProfile(const char* path);
 };
 
 #endif // S3FS_SIGHANDLERS_H_
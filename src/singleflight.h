@@ -0,0 +1,183 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_SINGLEFLIGHT_H_
+#define S3FS_SINGLEFLIGHT_H_
+
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+#include "s3fs_logger.h"
+#include "psemaphore.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Class SingleFlight
+//------------------------------------------------
+// [NOTE]
+// This class deduplicates the concurrent requests for the same key.
+// The first caller of Join() becomes the leader, which runs the request
+// and calls Done() with the result. The other callers wait in Join()
+// until Done() is called, and they get the same result(positive or
+// negative) without sending any request.
+//
+// When the key is changed while the request is in flight, Forget() marks
+// the flight stale. The waiters of the stale flight do not get its result
+// but join the next flight(or lead it), and Done() returns false so that
+// the leader sends the request again.
+//
+//   int result;
+//   T   value;
+//   while(flight.Join(key, result, value)){
+//       result = request(value);
+//       if(flight.Done(key, result, value)){
+//           break;
+//       }
+//   }
+//
+template <class T>
+class SingleFlight
+{
+    private:
+        struct flight
+        {
+            int                     result;
+            T                       value;
+            int                     refcnt;     // count of waiters which do not get the result yet
+            bool                    is_stale;   // the key was changed after sending the request
+            std::list<Semaphore*>   waiters;
+
+            flight() : result(0), value(), refcnt(0), is_stale(false) {}
+        };
+        typedef std::map<std::string, flight*> flight_map_t;
+
+        pthread_mutex_t flight_lock;            // protects flights
+        flight_map_t    flights;
+
+    public:
+        SingleFlight()
+        {
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+            int result;
+            if(0 != (result = pthread_mutex_init(&flight_lock, &attr))){
+                S3FS_PRN_CRIT("failed to init flight_lock: %d", result);
+                abort();
+            }
+        }
+
+        ~SingleFlight()
+        {
+            int result;
+            if(0 != (result = pthread_mutex_destroy(&flight_lock))){
+                S3FS_PRN_CRIT("failed to destroy flight_lock: %d", result);
+                abort();
+            }
+        }
+
+        // Returns true if the caller is the leader, then it must call Done().
+        bool Join(const std::string& key, int& result, T& value)
+        {
+            for(bool is_stale = true; is_stale; ){
+                Semaphore sem(0);
+                flight*   pflight;
+                {
+                    AutoLock auto_lock(&flight_lock);
+
+                    typename flight_map_t::iterator iter = flights.find(key);
+                    if(flights.end() == iter){
+                        flights[key] = new flight();
+                        return true;
+                    }
+                    pflight = iter->second;
+                    pflight->waiters.push_back(&sem);
+                    ++(pflight->refcnt);
+                }
+                sem.wait();
+
+                AutoLock auto_lock(&flight_lock);
+
+                is_stale = pflight->is_stale;
+                if(!is_stale){
+                    result = pflight->result;
+                    value  = pflight->value;
+                }
+                if(0 == --(pflight->refcnt)){
+                    delete pflight;
+                }
+            }
+            return false;
+        }
+
+        // Returns false if the flight was stale, then the leader must retry.
+        bool Done(const std::string& key, int result, const T& value)
+        {
+            AutoLock auto_lock(&flight_lock);
+
+            typename flight_map_t::iterator iter = flights.find(key);
+            if(flights.end() == iter){
+                S3FS_PRN_WARN("The flight(%s) is not found.", key.c_str());
+                return true;
+            }
+            flight* pflight  = iter->second;
+            bool    is_stale = pflight->is_stale;
+            flights.erase(iter);
+
+            pflight->result = result;
+            pflight->value  = value;
+            for(std::list<Semaphore*>::iterator witer = pflight->waiters.begin(); witer != pflight->waiters.end(); ++witer){
+                (*witer)->post();
+            }
+            pflight->waiters.clear();
+
+            if(0 == pflight->refcnt){
+                delete pflight;
+            }
+            return !is_stale;
+        }
+
+        // Mark the flight for the key stale if it is in flight.
+        void Forget(const std::string& key)
+        {
+            AutoLock auto_lock(&flight_lock);
+
+            typename flight_map_t::iterator iter = flights.find(key);
+            if(flights.end() != iter){
+                iter->second->is_stale = true;
+            }
+        }
+};
+
+#endif // S3FS_SINGLEFLIGHT_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,183 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "fdcache_chunk_compress.h"
+#include "test_util.h"
+
+static const size_t FRAME = ChunkCompress::FRAME_SIZE;
+
+// compressible data which is different in each frame
+static std::string make_text(size_t size)
+{
+  std::string text;
+  for(size_t cnt = 0; text.size() < size; ++cnt){
+    text += "line " + str(static_cast<long long>(cnt)) + " of the compressible chunk\n";
+  }
+  text.resize(size);
+  return text;
+}
+
+static std::string make_random(size_t size)
+{
+  std::string data(size, '\0');
+  unsigned int seed = 1;
+  for(size_t pos = 0; pos < size; ++pos){
+    seed = seed * 1103515245 + 12345;
+    data[pos] = static_cast<char>(seed >> 16);
+  }
+  return data;
+}
+
+static int write_temp_file(const std::string& data)
+{
+  char filepath[] = "/tmp/test_chunk_compress.XXXXXX";
+  int  fd         = mkstemp(filepath);
+  ASSERT_TRUE(-1 != fd);
+  unlink(filepath);
+  ASSERT_EQUALS(static_cast<ssize_t>(data.size()), write(fd, data.data(), data.size()));
+  return fd;
+}
+
+static void check_part(int fd, const std::string& chunk, off_t offset, size_t size)
+{
+  std::string buf(size, '\0');
+  ASSERT_EQUALS(static_cast<ssize_t>(size), ChunkCompress::ReadPart(fd, static_cast<off_t>(chunk.size()), offset, (size ? &buf[0] : NULL), size));
+  ASSERT_BUFEQUALS(buf.data(), size, &chunk[offset], size);
+}
+
+void test_round_trip()
+{
+  // the last frame is shorter than the frame size
+  std::string chunk = make_text(4 * FRAME + 1000);
+  std::string data;
+  ASSERT_TRUE(ChunkCompress::Compress(chunk.data(), chunk.size(), data));
+  ASSERT_TRUE(data.size() < chunk.size());
+
+  int fd = write_temp_file(data);
+
+  // whole chunk
+  check_part(fd, chunk, 0, chunk.size());
+
+  // edges of the chunk
+  check_part(fd, chunk, 0, 1);
+  check_part(fd, chunk, chunk.size() - 1, 1);
+  check_part(fd, chunk, 0, 0);
+  check_part(fd, chunk, chunk.size(), 0);
+
+  // edges of the frames
+  check_part(fd, chunk, FRAME - 1, 2);
+  check_part(fd, chunk, FRAME, FRAME);
+  check_part(fd, chunk, FRAME - 1, FRAME + 2);
+  check_part(fd, chunk, 1, 3 * FRAME);
+
+  // last frame
+  check_part(fd, chunk, 4 * FRAME, 1000);
+  check_part(fd, chunk, 4 * FRAME - 10, 1010);
+  check_part(fd, chunk, 4 * FRAME + 999, 1);
+
+  // out of the chunk
+  char buf[2];
+  ASSERT_EQUALS(static_cast<ssize_t>(-EINVAL), ChunkCompress::ReadPart(fd, static_cast<off_t>(chunk.size()), static_cast<off_t>(chunk.size()) - 1, buf, 2));
+
+  close(fd);
+}
+
+void test_small_chunk()
+{
+  // smaller than one frame
+  std::string chunk = make_text(5000);
+  std::string data;
+  ASSERT_TRUE(ChunkCompress::Compress(chunk.data(), chunk.size(), data));
+
+  int fd = write_temp_file(data);
+  check_part(fd, chunk, 0, chunk.size());
+  check_part(fd, chunk, 4999, 1);
+  check_part(fd, chunk, 100, 200);
+  close(fd);
+}
+
+void test_incompressible()
+{
+  std::string chunk = make_random(2 * FRAME);
+  std::string data;
+  ASSERT_FALSE(ChunkCompress::Compress(chunk.data(), chunk.size(), data));
+  ASSERT_FALSE(ChunkCompress::Compress(chunk.data(), 0, data));
+}
+
+void test_broken()
+{
+  std::string chunk = make_text(2 * FRAME);
+  std::string data;
+  ASSERT_TRUE(ChunkCompress::Compress(chunk.data(), chunk.size(), data));
+  char buf[16];
+
+  // the chunk size is different from the compressed one
+  int fd = write_temp_file(data);
+  ASSERT_EQUALS(static_cast<ssize_t>(-EIO), ChunkCompress::ReadPart(fd, static_cast<off_t>(3 * FRAME), 0, buf, sizeof(buf)));
+  close(fd);
+
+  // truncated
+  fd = write_temp_file(data.substr(0, data.size() - 1));
+  ASSERT_EQUALS(static_cast<ssize_t>(-EIO), ChunkCompress::ReadPart(fd, static_cast<off_t>(chunk.size()), 0, buf, sizeof(buf)));
+  close(fd);
+
+  // not this format
+  fd = write_temp_file(chunk);
+  ASSERT_EQUALS(static_cast<ssize_t>(-EIO), ChunkCompress::ReadPart(fd, static_cast<off_t>(chunk.size()), 0, buf, sizeof(buf)));
+  close(fd);
+
+  // broken frame
+  std::string broken = data;
+  broken[broken.size() - 10] ^= 0x55;
+  fd = write_temp_file(broken);
+  ASSERT_EQUALS(static_cast<ssize_t>(-EIO), ChunkCompress::ReadPart(fd, static_cast<off_t>(chunk.size()), static_cast<off_t>(chunk.size()) - 1, buf, 1));
+  // the other frame is still read
+  check_part(fd, chunk, 0, 10);
+  close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  if(!ChunkCompress::IsSupported()){
+    return 0;
+  }
+  test_round_trip();
+  test_small_chunk();
+  test_incompressible();
+  test_broken();
+  return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
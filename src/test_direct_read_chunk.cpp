@@ -0,0 +1,114 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdint.h>
+
+#include "direct_reader.h"
+#include "test_util.h"
+
+uint64_t              DirectReader::prefetch_cache_limits = 1024 * 1024 * 1024;
+std::atomic<uint64_t> DirectReader::prefetch_cache_budget(0);
+void ChunkLru::Remove(Chunk* chunk) {}
+
+void test_partial_blocks()
+{
+  const off_t size = 3 * Chunk::BLOCK_SIZE + 100;
+  uint64_t    base = Chunk::cache_usage;
+  {
+    Chunk chunk(0, size, /*is_partial=*/ true);
+    ASSERT_FALSE(chunk.IsComplete());
+    ASSERT_EQUALS(base, static_cast<uint64_t>(Chunk::cache_usage));
+    ASSERT_FALSE(chunk.IsLoaded(0, 1));
+    ASSERT_TRUE(chunk.IsLoaded(0, 0));
+
+    chunk.SetLoaded(10, 20);
+    ASSERT_TRUE(chunk.IsLoaded(0, Chunk::BLOCK_SIZE));
+    ASSERT_FALSE(chunk.IsLoaded(0, Chunk::BLOCK_SIZE + 1));
+    ASSERT_FALSE(chunk.IsLoaded(Chunk::BLOCK_SIZE, 1));
+    ASSERT_EQUALS(base + Chunk::BLOCK_SIZE, static_cast<uint64_t>(Chunk::cache_usage));
+
+    // setting the same block again is not counted twice
+    chunk.SetLoaded(0, Chunk::BLOCK_SIZE);
+    ASSERT_EQUALS(base + Chunk::BLOCK_SIZE, static_cast<uint64_t>(Chunk::cache_usage));
+  }
+  ASSERT_EQUALS(base, static_cast<uint64_t>(Chunk::cache_usage));
+}
+
+void test_across_blocks()
+{
+  const off_t size = 3 * Chunk::BLOCK_SIZE + 100;
+  Chunk chunk(0, size, /*is_partial=*/ true);
+
+  // the range touches the end of the 2nd block and the head of the 3rd block
+  chunk.SetLoaded(2 * Chunk::BLOCK_SIZE - 1, 2);
+  ASSERT_FALSE(chunk.IsLoaded(0, 1));
+  ASSERT_TRUE(chunk.IsLoaded(Chunk::BLOCK_SIZE, 2 * Chunk::BLOCK_SIZE));
+  ASSERT_FALSE(chunk.IsLoaded(Chunk::BLOCK_SIZE, 2 * Chunk::BLOCK_SIZE + 1));
+  ASSERT_FALSE(chunk.IsComplete());
+}
+
+void test_last_block()
+{
+  const off_t size = 3 * Chunk::BLOCK_SIZE + 100;
+  uint64_t    base = Chunk::cache_usage;
+  Chunk chunk(0, size, /*is_partial=*/ true);
+
+  // the last block is shorter than BLOCK_SIZE
+  chunk.SetLoaded(3 * Chunk::BLOCK_SIZE, 100);
+  ASSERT_TRUE(chunk.IsLoaded(3 * Chunk::BLOCK_SIZE, 100));
+  ASSERT_FALSE(chunk.IsLoaded(2 * Chunk::BLOCK_SIZE, 1));
+  ASSERT_EQUALS(base + 100, static_cast<uint64_t>(Chunk::cache_usage));
+
+  // the blocks are cleared when the whole chunk is loaded
+  chunk.SetLoaded(0, 3 * Chunk::BLOCK_SIZE);
+  ASSERT_TRUE(chunk.IsComplete());
+  ASSERT_TRUE(chunk.IsLoaded(0, size));
+  ASSERT_EQUALS(base + static_cast<uint64_t>(size), static_cast<uint64_t>(Chunk::cache_usage));
+}
+
+void test_complete_chunk()
+{
+  uint64_t base = Chunk::cache_usage;
+  {
+    Chunk chunk(0, 2 * Chunk::BLOCK_SIZE);
+    ASSERT_TRUE(chunk.IsComplete());
+    ASSERT_TRUE(chunk.IsLoaded(0, 2 * Chunk::BLOCK_SIZE));
+    ASSERT_EQUALS(base + 2 * Chunk::BLOCK_SIZE, static_cast<uint64_t>(Chunk::cache_usage));
+  }
+  ASSERT_EQUALS(base, static_cast<uint64_t>(Chunk::cache_usage));
+}
+
+int main(int argc, char *argv[])
+{
+  test_partial_blocks();
+  test_across_blocks();
+  test_last_block();
+  test_complete_chunk();
+  return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,91 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <string>
+
+#include "folder_detector.h"
+#include "test_util.h"
+
+void test_not_sampled()
+{
+    // checked under all directories until sampling
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/dir/sub"));
+
+    // sampling failed
+    FolderObjectDetector::SetSampled(false);
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/dir/sub"));
+}
+
+void test_sampled_all()
+{
+    S3ObjList head;
+    head.insert("a/file");
+    head.insert("a/sub_$folder$");
+    head.insert("b/file");
+    FolderObjectDetector::AddFolderObjects("/", head);
+    FolderObjectDetector::SetSampled(true);
+
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/a/sub"));
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/a/other/"));
+    ASSERT_FALSE(FolderObjectDetector::IsNeedCheck("/b/sub"));
+    ASSERT_FALSE(FolderObjectDetector::IsNeedCheck("/z/sub"));
+}
+
+void test_sampled_first_page()
+{
+    // the first page ends with "b/file", and "c/sub_$folder$" is in the next page
+    FolderObjectDetector::SetSampled(true, "/b/file");
+
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/a/sub"));
+    ASSERT_FALSE(FolderObjectDetector::IsNeedCheck("/b/dir"));
+    ASSERT_FALSE(FolderObjectDetector::IsNeedCheck("/a/"));
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/b/sub"));
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/c/sub"));
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/c/sub_$folder$"));
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/b/x/"));
+
+    // learned by listing the directory after mounting
+    S3ObjList head;
+    head.insert("sub_$folder$");
+    FolderObjectDetector::AddFolderObjects("/c", head);
+    ASSERT_TRUE(FolderObjectDetector::IsNeedCheck("/c/sub"));
+}
+
+int main(int argc, char *argv[])
+{
+    FolderObjectDetector::SetEnable(true);
+
+    test_not_sampled();
+    test_sampled_all();
+    test_sampled_first_page();
+    return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -26,6 +26,8 @@
 #include "test_util.h"
 
 bool CacheFileStat::Open() { return false; }
+std::string CacheFileStat::GetKeyLine() const { return std::string(""); }
+bool CacheFileStat::ParseKeyLine(const std::string& line, std::string& key) { return false; }
 
 void test_compress()
 {
@@ -75,8 +77,27 @@ void test_compress()
   ASSERT_EQUALS(off_t(36), size);
 }
 
+void test_modified()
+{
+  PageList list;
+  list.Init(42, /*is_loaded=*/ false, /*is_modified=*/ false);
+  ASSERT_FALSE(list.IsPageModified());
+
+  list.SetPageLoadedStatus(10, 5, /*pstatus=*/ PageList::PAGE_LOAD_MODIFIED);
+  ASSERT_TRUE(list.IsPageModified());
+  ASSERT_TRUE(list.IsPageModified(0, 11));
+  ASSERT_TRUE(list.IsPageModified(14, 1));
+  ASSERT_FALSE(list.IsPageModified(0, 10));
+  ASSERT_FALSE(list.IsPageModified(15, 0));
+
+  list.ClearAllModified();
+  ASSERT_FALSE(list.IsPageModified());
+  ASSERT_TRUE(list.IsPageLoaded(10, 5));
+}
+
 int main(int argc, char *argv[])
 {
   test_compress();
+  test_modified();
   return 0;
 }
@@ -0,0 +1,208 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "peer_cache.h"
+#include "fdcache_chunk.h"
+#include "curl.h"
+#include "test_util.h"
+
+//------------------------------------------------
+// Stubs for the chunk cache and the requests to the server
+//------------------------------------------------
+bool  ChunkCache::is_enable  = true;
+off_t ChunkCache::chunk_size = 1024 * 1024;
+
+ssize_t ChunkCache::Read(const char* path, const std::string& etag, off_t index, char* buf, size_t size) { return -1; }
+bool ChunkCache::Write(const char* path, const std::string& etag, off_t index, const char* buf, size_t size) { return false; }
+
+S3fsCurl::S3fsCurl(bool ahbe) : b_ssetype(sse_type_t::SSE_DISABLE) {}
+S3fsCurl::~S3fsCurl() {}
+int S3fsCurl::HeadRequest(const char* tpath, headers_t& meta, const std::string& etag) { return -EIO; }
+int S3fsCurl::GetObjectStreamRequest(const char* tpath, char* buf, off_t start, off_t size, ssize_t& rsize, const std::string& etag) { return -EIO; }
+
+static const char TEST_TOKEN[] = "test-token";
+
+static void set_test_token()
+{
+  char filepath[] = "/tmp/test_peer_cache.XXXXXX";
+  int  fd         = mkstemp(filepath);
+  ASSERT_TRUE(-1 != fd);
+  ASSERT_EQUALS(0, fchmod(fd, S_IRUSR | S_IWUSR));
+  std::string line = std::string(TEST_TOKEN) + "\n";
+  ASSERT_EQUALS(static_cast<ssize_t>(line.size()), write(fd, line.c_str(), line.size()));
+  close(fd);
+  ASSERT_TRUE(PeerCache::SetTokenFile(filepath));
+  unlink(filepath);
+}
+
+static std::string make_request(const std::string& query, const char* token)
+{
+  std::string request = "GET /chunk?" + query + " HTTP/1.0\r\nHost: peer\r\n";
+  if(token){
+    request += std::string("X-Ossfs-Peer-Token: ") + token + "\r\n";
+  }
+  return request + "\r\n";
+}
+
+void test_parse_request()
+{
+  std::string path;
+  std::string etag;
+  off_t       index;
+  off_t       size;
+
+  ASSERT_EQUALS(200, PeerCache::ParseRequest(make_request("path=%2Fdir%2Ffile%201&etag=%22abc%22&index=3&size=1048576", TEST_TOKEN), path, etag, index, size));
+  ASSERT_STREQUALS("/dir/file 1", path.c_str());
+  ASSERT_STREQUALS("\"abc\"", etag.c_str());
+  ASSERT_EQUALS(static_cast<off_t>(3), index);
+  ASSERT_EQUALS(static_cast<off_t>(1024 * 1024), size);
+
+  // the header name is not case sensitive, and the value is trimmed
+  ASSERT_EQUALS(200, PeerCache::ParseRequest("GET /chunk?path=/a&etag=e&index=0&size=1 HTTP/1.0\r\nx-ossfs-peer-token:  test-token \r\n\r\n", path, etag, index, size));
+}
+
+void test_parse_request_token()
+{
+  std::string path;
+  std::string etag;
+  off_t       index;
+  off_t       size;
+  std::string query = "path=/a&etag=e&index=0&size=1";
+
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request(query, NULL), path, etag, index, size));
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request(query, ""), path, etag, index, size));
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request(query, "test-toke"), path, etag, index, size));
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request(query, "test-token2"), path, etag, index, size));
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request(query, "TEST-TOKEN"), path, etag, index, size));
+
+  // the token is checked before the parameters
+  ASSERT_EQUALS(403, PeerCache::ParseRequest(make_request("path=/../a&etag=e&index=0&size=1", "wrong"), path, etag, index, size));
+}
+
+void test_parse_request_invalid()
+{
+  std::string path;
+  std::string etag;
+  off_t       index;
+  off_t       size;
+
+  // request line
+  ASSERT_EQUALS(400, PeerCache::ParseRequest("", path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest("GET /chunk?path=/a&etag=e&index=0&size=1", path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest("POST /chunk?path=/a&etag=e&index=0&size=1 HTTP/1.0\r\nX-Ossfs-Peer-Token: test-token\r\n\r\n", path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest("GET /chunk?path=/a&etag=e&index=0&size=1\r\nX-Ossfs-Peer-Token: test-token\r\n\r\n", path, etag, index, size));
+
+  // parameters
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("etag=e&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=a&etag=e&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a/../b&etag=e&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a/..&etag=e&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a&etag=e&index=-1&size=1", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a&etag=e&index=0", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a&etag=e&index=0&size=0", TEST_TOKEN), path, etag, index, size));
+  ASSERT_EQUALS(400, PeerCache::ParseRequest(make_request("path=/a&etag=e&index=0&size=1048577", TEST_TOKEN), path, etag, index, size));
+
+  // the file name which only starts with ".." is valid
+  ASSERT_EQUALS(200, PeerCache::ParseRequest(make_request("path=/a/..b&etag=e&index=0&size=1", TEST_TOKEN), path, etag, index, size));
+}
+
+void test_hash()
+{
+  // FNV-1a 64bit with the finalizer of MurmurHash3
+  ASSERT_EQUALS(0xefd01f60ba992926ULL, PeerCache::Hash(""));
+  ASSERT_EQUALS(0x82a2a958a9bece5bULL, PeerCache::Hash("a"));
+  ASSERT_NEQUALS(PeerCache::Hash("/file:1"), PeerCache::Hash("/file:2"));
+}
+
+void test_ring_placement()
+{
+  peer_list_t peers;
+  peers.push_back("10.0.0.1:18080");
+  peers.push_back("10.0.0.2:18080");
+  peers.push_back("10.0.0.3:18080");
+
+  peer_ring_t ring;
+  PeerCache::MakeRing(peers, ring);
+  ASSERT_EQUALS(static_cast<size_t>(3 * 64), ring.size());
+
+  // no owner without peers
+  peer_ring_t empty;
+  ASSERT_STREQUALS("", PeerCache::FindOwner(empty, "/file", 0).c_str());
+
+  // the order of the peers does not change the owners
+  peer_list_t reversed(peers.rbegin(), peers.rend());
+  peer_ring_t reversed_ring;
+  PeerCache::MakeRing(reversed, reversed_ring);
+
+  // the chunks are spread over all peers
+  const int                  count = 3000;
+  std::map<std::string, int> owned;
+  for(int index = 0; index < count; ++index){
+    std::string owner = PeerCache::FindOwner(ring, "/dir/file", index);
+    ASSERT_STREQUALS(owner.c_str(), PeerCache::FindOwner(reversed_ring, "/dir/file", index).c_str());
+    ++owned[owner];
+  }
+  ASSERT_EQUALS(static_cast<size_t>(3), owned.size());
+  for(std::map<std::string, int>::const_iterator iter = owned.begin(); iter != owned.end(); ++iter){
+    ASSERT_TRUE(count / 6 < iter->second);
+  }
+
+  // removing a peer moves only the chunks which it owned
+  peer_list_t rest(peers.begin(), peers.begin() + 2);
+  peer_ring_t rest_ring;
+  PeerCache::MakeRing(rest, rest_ring);
+  for(int index = 0; index < count; ++index){
+    std::string owner = PeerCache::FindOwner(ring, "/dir/file", index);
+    std::string moved = PeerCache::FindOwner(rest_ring, "/dir/file", index);
+    if(owner != peers[2]){
+      ASSERT_STREQUALS(owner.c_str(), moved.c_str());
+    }else{
+      ASSERT_NEQUALS(owner, moved);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  set_test_token();
+
+  test_parse_request();
+  test_parse_request_token();
+  test_parse_request_invalid();
+  test_hash();
+  test_ring_placement();
+  return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
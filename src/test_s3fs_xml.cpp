@@ -0,0 +1,102 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <string>
+
+#include "s3fs_xml.h"
+#include "s3fs_util.h"
+#include "test_util.h"
+
+std::string mydirname(const std::string& path) { return std::string(""); }
+std::string mybasename(const std::string& path) { return std::string(""); }
+
+static bool check_bucket_info(const std::string& body)
+{
+    return is_hierarchical_namespace_bucket(body.c_str(), body.size());
+}
+
+void test_hierarchical_namespace()
+{
+    std::string enabled =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<BucketInfo>\n"
+        "  <Bucket>\n"
+        "    <Name>test-bucket</Name>\n"
+        "    <StorageClass>Standard</StorageClass>\n"
+        "    <HierarchicalNamespace>Enabled</HierarchicalNamespace>\n"
+        "  </Bucket>\n"
+        "</BucketInfo>\n";
+    ASSERT_TRUE(check_bucket_info(enabled));
+
+    std::string disabled =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<BucketInfo>\n"
+        "  <Bucket>\n"
+        "    <Name>test-bucket</Name>\n"
+        "    <HierarchicalNamespace>Disabled</HierarchicalNamespace>\n"
+        "  </Bucket>\n"
+        "</BucketInfo>\n";
+    ASSERT_FALSE(check_bucket_info(disabled));
+
+    // no element
+    std::string none =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<BucketInfo>\n"
+        "  <Bucket>\n"
+        "    <Name>test-bucket</Name>\n"
+        "  </Bucket>\n"
+        "</BucketInfo>\n";
+    ASSERT_FALSE(check_bucket_info(none));
+
+    // the element out of the Bucket element is not used
+    std::string outside =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<BucketInfo>\n"
+        "  <HierarchicalNamespace>Enabled</HierarchicalNamespace>\n"
+        "  <Bucket>\n"
+        "    <Name>test-bucket</Name>\n"
+        "  </Bucket>\n"
+        "</BucketInfo>\n";
+    ASSERT_FALSE(check_bucket_info(outside));
+
+    // empty and broken
+    ASSERT_FALSE(check_bucket_info("<BucketInfo><Bucket><HierarchicalNamespace/></Bucket></BucketInfo>"));
+    ASSERT_FALSE(check_bucket_info("<BucketInfo><Bucket>"));
+    ASSERT_FALSE(check_bucket_info(""));
+    ASSERT_FALSE(is_hierarchical_namespace_bucket(NULL, 0));
+}
+
+int main(int argc, char *argv[])
+{
+    test_hierarchical_namespace();
+    return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
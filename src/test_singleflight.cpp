@@ -0,0 +1,137 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstring>
+#include <pthread.h>
+#include <string>
+#include <unistd.h>
+
+#include "singleflight.h"
+#include "psemaphore.h"
+#include "test_util.h"
+
+static SingleFlight<std::string> flight;
+static const std::string         flight_key = "0/dir/file";
+
+struct flight_arg
+{
+    Semaphore   started;
+    Semaphore   gate;
+    bool        is_leader;
+    bool        is_done;
+    std::string value;
+
+    flight_arg() : started(0), gate(0), is_leader(false), is_done(false) {}
+};
+
+// The lookup which is sent before changing the object.
+static void* old_lookup(void* arg)
+{
+    flight_arg* parg = static_cast<flight_arg*>(arg);
+    int         result;
+
+    parg->is_leader = flight.Join(flight_key, result, parg->value);
+    parg->started.post();
+    if(parg->is_leader){
+        parg->gate.wait();
+        parg->is_done = flight.Done(flight_key, 0, std::string("old"));
+    }
+    return NULL;
+}
+
+// The lookup which is sent after changing the object.
+static void* new_lookup(void* arg)
+{
+    flight_arg* parg = static_cast<flight_arg*>(arg);
+    int         result;
+
+    parg->started.post();
+    while(flight.Join(flight_key, result, parg->value)){
+        parg->is_leader = true;
+        parg->value     = "new";
+        if(flight.Done(flight_key, 0, parg->value)){
+            break;
+        }
+    }
+    return NULL;
+}
+
+void test_join()
+{
+    int         result = -1;
+    std::string value;
+
+    // no flight, then the caller is the leader
+    ASSERT_TRUE(flight.Join(flight_key, result, value));
+    ASSERT_TRUE(flight.Done(flight_key, 0, std::string("value")));
+
+    // the flight is done, then the next caller is the leader again
+    ASSERT_TRUE(flight.Join(flight_key, result, value));
+    ASSERT_TRUE(flight.Done(flight_key, 0, std::string("value")));
+
+    // forgetting the key which is not in flight does nothing
+    flight.Forget(flight_key);
+    ASSERT_TRUE(flight.Join(flight_key, result, value));
+    ASSERT_TRUE(flight.Done(flight_key, 0, std::string("value")));
+}
+
+void test_join_after_forget()
+{
+    flight_arg old_arg;
+    flight_arg new_arg;
+    pthread_t  old_thread;
+    pthread_t  new_thread;
+
+    ASSERT_EQUALS(0, pthread_create(&old_thread, NULL, old_lookup, &old_arg));
+    old_arg.started.wait();
+    ASSERT_TRUE(old_arg.is_leader);
+
+    // the object is changed while the old lookup is in flight
+    flight.Forget(flight_key);
+
+    // the lookup after changing does not get the result of the old lookup
+    ASSERT_EQUALS(0, pthread_create(&new_thread, NULL, new_lookup, &new_arg));
+    new_arg.started.wait();
+    usleep(100 * 1000);
+    old_arg.gate.post();
+
+    pthread_join(old_thread, NULL);
+    pthread_join(new_thread, NULL);
+
+    ASSERT_FALSE(old_arg.is_done);
+    ASSERT_TRUE(new_arg.is_leader);
+    ASSERT_STREQUALS("new", new_arg.value.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    test_join();
+    test_join_after_forget();
+    return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,114 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "upload_scheduler.h"
+#include "psemaphore.h"
+#include "test_util.h"
+
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             running      = 0;
+static int             max_running  = 0;
+
+static void* upload_worker(void* arg)
+{
+    AutoUploadSlot slot(true, UploadScheduler::NO_JOB);
+
+    pthread_mutex_lock(&counter_lock);
+    if(max_running < ++running){
+        max_running = running;
+    }
+    pthread_mutex_unlock(&counter_lock);
+
+    usleep(20 * 1000);
+
+    pthread_mutex_lock(&counter_lock);
+    --running;
+    pthread_mutex_unlock(&counter_lock);
+    return NULL;
+}
+
+void test_limit()
+{
+    ASSERT_TRUE(UploadScheduler::Initialize(2));
+
+    pthread_t threads[8];
+    for(int cnt = 0; cnt < 8; ++cnt){
+        ASSERT_EQUALS(0, pthread_create(&threads[cnt], NULL, upload_worker, NULL));
+    }
+    for(int cnt = 0; cnt < 8; ++cnt){
+        pthread_join(threads[cnt], NULL);
+    }
+    ASSERT_EQUALS(0, running);
+    ASSERT_TRUE(0 < max_running && max_running <= 2);
+
+    UploadScheduler::Destroy();
+}
+
+static void* sleep_worker(void* arg)
+{
+    Semaphore*     psem = static_cast<Semaphore*>(arg);
+    AutoUploadSlot slot(true, UploadScheduler::NO_JOB);
+
+    psem->post();
+    slot.Sleep(2);
+    return NULL;
+}
+
+void test_release_while_sleeping()
+{
+    ASSERT_TRUE(UploadScheduler::Initialize(1));
+
+    Semaphore sem(0);
+    pthread_t thread;
+    ASSERT_EQUALS(0, pthread_create(&thread, NULL, sleep_worker, &sem));
+    sem.wait();
+
+    // the slot is free while the other request is sleeping
+    time_t start = time(NULL);
+    {
+        AutoUploadSlot slot(true, UploadScheduler::NO_JOB);
+    }
+    ASSERT_TRUE(time(NULL) - start < 2);
+
+    pthread_join(thread, NULL);
+    UploadScheduler::Destroy();
+}
+
+int main(int argc, char *argv[])
+{
+    test_limit();
+    test_release_while_sleeping();
+    return 0;
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
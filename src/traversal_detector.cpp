@@ -0,0 +1,401 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <set>
+
+#include "common.h"
+#include "s3fs.h"
+#include "traversal_detector.h"
+#include "cache.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// TraversalDetector class variables
+//------------------------------------------------
+TraversalDetector TraversalDetector::singleton;
+const time_t TraversalDetector::DEFAULT_EXPIRE_TIME;
+
+//------------------------------------------------
+// SubtreeLoader class variables
+//------------------------------------------------
+SubtreeLoader* SubtreeLoader::singleton = NULL;
+
+//------------------------------------------------
+// Utility functions
+//------------------------------------------------
+// Returns the directory path which is not terminated by "/"(except "/").
+static std::string get_traversal_dir(const std::string& path)
+{
+    std::string strpath = path;
+    while(1 < strpath.length() && '/' == *strpath.rbegin()){
+        strpath.erase(strpath.length() - 1);
+    }
+    if(strpath.empty()){
+        strpath = "/";
+    }
+    return strpath;
+}
+
+static std::string get_traversal_parent(const std::string& dirpath)
+{
+    std::string::size_type pos = dirpath.find_last_of('/');
+    if(std::string::npos == pos || 0 == pos){
+        return std::string("/");
+    }
+    return dirpath.substr(0, pos);
+}
+
+static std::string join_traversal_path(const std::string& dirpath, const std::string& name)
+{
+    return ("/" == dirpath ? dirpath : dirpath + "/") + name;
+}
+
+//------------------------------------------------
+// TraversalDetector class methods
+//------------------------------------------------
+bool TraversalDetector::SetThreshold(int count)
+{
+    if(count < 1){
+        return false;
+    }
+    TraversalDetector::singleton.threshold = count;
+    return true;
+}
+
+bool TraversalDetector::SetExpireTime(time_t expire)
+{
+    if(expire < 1){
+        return false;
+    }
+    TraversalDetector::singleton.expire_time = expire;
+    return true;
+}
+
+//
+// Record the listing of the directory, and returns the root directory of
+// the traversal if it is detected, otherwise returns empty.
+//
+std::string TraversalDetector::Detect(const char* path)
+{
+    std::string root;
+    if(!TraversalDetector::IsEnable() || !path || '\0' == path[0]){
+        return root;
+    }
+    std::string dirpath = get_traversal_dir(std::string(path));
+    time_t      now     = time(NULL);
+
+    AutoLock auto_lock(&TraversalDetector::singleton.detector_lock);
+
+    traversal_map_t& traversals = TraversalDetector::singleton.traversals;
+
+    // remove the directories which are not listed recently
+    for(traversal_map_t::iterator iter = traversals.begin(); iter != traversals.end(); ){
+        if(iter->second.last_time + TraversalDetector::singleton.expire_time < now){
+            traversals.erase(iter++);
+        }else{
+            ++iter;
+        }
+    }
+
+    // record the directory in its parent, the parent which has child
+    // directories over the threshold is the root(except the mount point)
+    if("/" != dirpath){
+        std::string               parent = get_traversal_parent(dirpath);
+        traversal_map_t::iterator iter   = traversals.find(parent);
+        if("/" != parent && iter != traversals.end()){
+            iter->second.last_time = now;
+            iter->second.children.insert(dirpath);
+            if(static_cast<size_t>(TraversalDetector::singleton.threshold) <= iter->second.children.size()){
+                root = parent;
+            }
+        }
+    }
+    traversals[dirpath].last_time = now;
+
+    if(!root.empty()){
+        // the subtree is going to be loaded, then forget the directories in it.
+        std::string prefix = join_traversal_path(root, "");
+        for(traversal_map_t::iterator iter = traversals.lower_bound(root); iter != traversals.end(); ){
+            if(iter->first == root || 0 == iter->first.compare(0, prefix.length(), prefix)){
+                traversals.erase(iter++);
+            }else if(iter->first.compare(0, root.length(), root) == 0){
+                // same prefix, but not in the subtree(ex. "/dir1" for "/dir")
+                ++iter;
+            }else{
+                break;
+            }
+        }
+        S3FS_PRN_INFO("detected the traversal under %s(from %s).", root.c_str(), dirpath.c_str());
+    }
+    return root;
+}
+
+void TraversalDetector::AddSubtreeEntry(std::map<std::string, S3ObjList>& lists, const std::string& dirpath, const std::string& name, const S3ObjList& flat, const std::string& flatname)
+{
+    S3ObjList& list = lists[dirpath];
+    if(flatname.empty()){
+        // the directory which has no object(common prefix)
+        list.insert(name.c_str(), NULL, true);
+    }else{
+        std::string etag         = flat.GetETag(flatname.c_str());
+        std::string size         = flat.GetSize(flatname.c_str());
+        std::string lastmodified = flat.GetLastModified(flatname.c_str());
+        list.insert(name.c_str(), (etag.empty() ? NULL : etag.c_str()), flat.IsDir(flatname.c_str()), (size.empty() ? NULL : size.c_str()), (lastmodified.empty() ? NULL : lastmodified.c_str()));
+    }
+}
+
+//
+// Split the listing of the subtree(without delimiter) into the listings of
+// every directory in it, and add them to the stat cache.
+// The names in the list are relative paths from the directory.
+// Returns the count of the directories.
+//
+size_t TraversalDetector::AddSubtree(const char* dirpath, const S3ObjList& flat)
+{
+    if(!dirpath || '\0' == dirpath[0]){
+        return 0;
+    }
+    std::string                      root = get_traversal_dir(std::string(dirpath));
+    std::map<std::string, S3ObjList> lists;
+    std::set<std::string>            added;     // paths of the directories which are added into their parent listings
+    s3obj_list_t                     names;
+
+    lists[root];    // the root is listed even if it is empty
+
+    flat.GetNameList(names, true, false);   // normalized names with "/"
+    for(s3obj_list_t::const_iterator iter = names.begin(); iter != names.end(); ++iter){
+        std::string orgname = flat.GetOrgName(iter->c_str());
+        if(orgname.empty()){
+            orgname = *iter;
+        }
+        std::string strname = get_traversal_dir(*iter);
+        bool        is_dir  = ('/' == *iter->rbegin());
+
+        // add the intermediate directories
+        std::string            curdir = root;
+        std::string::size_type start  = ('/' == strname[0] ? 1 : 0);
+        std::string::size_type pos;
+        while(std::string::npos != (pos = strname.find('/', start))){
+            std::string subname = strname.substr(start, pos - start);
+            std::string subdir  = join_traversal_path(curdir, subname);
+            if(added.insert(subdir).second){
+                TraversalDetector::AddSubtreeEntry(lists, curdir, subname + "/", flat, "");
+                lists[subdir];
+            }
+            curdir = subdir;
+            start  = pos + 1;
+        }
+
+        // add the object(it may be "_$folder$" object)
+        std::string leafname = strname.substr(start);
+        std::string leafpath = join_traversal_path(curdir, leafname);
+        std::string::size_type orgpos = orgname.find_last_of('/', orgname.length() - 2);
+        std::string orgleaf  = (std::string::npos == orgpos ? orgname : orgname.substr(orgpos + 1));
+        if(!is_dir || added.insert(leafpath).second){
+            TraversalDetector::AddSubtreeEntry(lists, curdir, orgleaf, flat, *iter);
+        }
+        if(is_dir){
+            lists[leafpath];
+        }
+    }
+
+    for(std::map<std::string, S3ObjList>::const_iterator iter = lists.begin(); iter != lists.end(); ++iter){
+        if(!StatCache::getStatCacheData()->AddDirList(iter->first, iter->second)){
+            S3FS_PRN_WARN("could not add the listing of %s, then stop loading the subtree.", iter->first.c_str());
+            break;
+        }
+    }
+    S3FS_PRN_INFO("loaded the listings of %zu directories under %s.", lists.size(), root.c_str());
+
+    return lists.size();
+}
+
+//------------------------------------------------
+// SubtreeLoader class methods
+//------------------------------------------------
+bool SubtreeLoader::Initialize(subtree_load_func func)
+{
+    if(!func){
+        S3FS_PRN_ERR("The function for loading subtree is NULL.");
+        return false;
+    }
+    if(SubtreeLoader::singleton){
+        S3FS_PRN_WARN("Already singleton for subtree loader is existed, then re-create it.");
+        SubtreeLoader::Destroy();
+    }
+    SubtreeLoader::singleton = new SubtreeLoader(func);
+    return true;
+}
+
+void SubtreeLoader::Destroy()
+{
+    if(SubtreeLoader::singleton){
+        delete SubtreeLoader::singleton;
+        SubtreeLoader::singleton = NULL;
+    }
+}
+
+bool SubtreeLoader::Instruct(const std::string& path)
+{
+    if(!SubtreeLoader::singleton){
+        return false;
+    }
+    return SubtreeLoader::singleton->SetJob(path);
+}
+
+//
+// Thread worker
+//
+void* SubtreeLoader::Worker(void* arg)
+{
+    SubtreeLoader* psingleton = static_cast<SubtreeLoader*>(arg);
+
+    if(!psingleton){
+        S3FS_PRN_ERR("The parameter for worker thread is invalid.");
+        return reinterpret_cast<void*>(-EIO);
+    }
+    S3FS_PRN_INFO3("Start worker thread in SubtreeLoader.");
+
+    while(true){
+        psingleton->load_sem.wait();
+
+        std::string path;
+        {
+            AutoLock auto_lock(&(psingleton->load_lock));
+
+            if(psingleton->is_exit){
+                break;
+            }
+            if(psingleton->job_list.empty()){
+                continue;
+            }
+            path = psingleton->job_list.front();
+            psingleton->job_list.pop_front();
+        }
+        S3FS_PRN_DBG("load subtree[path=%s]", path.c_str());
+
+        (*(psingleton->pfunc))(path.c_str());
+
+        AutoLock auto_lock(&(psingleton->load_lock));
+        psingleton->loading_paths.erase(path);
+    }
+    return NULL;
+}
+
+//------------------------------------------------
+// SubtreeLoader methods
+//------------------------------------------------
+SubtreeLoader::SubtreeLoader(subtree_load_func func) : pfunc(func), is_exit(false), load_sem(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&load_lock, &attr))){
+        S3FS_PRN_CRIT("failed to init load_lock: %d", result);
+        abort();
+    }
+    if(0 != (result = pthread_create(&thread, NULL, SubtreeLoader::Worker, static_cast<void*>(this)))){
+        S3FS_PRN_CRIT("failed pthread_create with return code(%d)", result);
+        abort();
+    }
+}
+
+SubtreeLoader::~SubtreeLoader()
+{
+    {
+        AutoLock auto_lock(&load_lock);
+        is_exit = true;
+    }
+    load_sem.post();
+
+    void* retval = NULL;
+    int   result;
+    if(0 != (result = pthread_join(thread, &retval))){
+        S3FS_PRN_ERR("failed pthread_join - result(%d)", result);
+    }
+    if(!job_list.empty()){
+        S3FS_PRN_INFO("%zu subtrees were not loaded before exiting.", job_list.size());
+    }
+
+    if(0 != (result = pthread_mutex_destroy(&load_lock))){
+        S3FS_PRN_CRIT("failed to destroy load_lock: %d", result);
+        abort();
+    }
+}
+
+bool SubtreeLoader::SetJob(const std::string& path)
+{
+    {
+        AutoLock auto_lock(&load_lock);
+
+        if(is_exit){
+            return false;
+        }
+        if(!loading_paths.insert(path).second){
+            S3FS_PRN_DBG("the subtree(%s) is already queued or loading.", path.c_str());
+            return true;
+        }
+        job_list.push_back(path);
+    }
+    load_sem.post();
+    return true;
+}
+
+//------------------------------------------------
+// TraversalDetector methods
+//------------------------------------------------
+TraversalDetector::TraversalDetector() : threshold(0), expire_time(TraversalDetector::DEFAULT_EXPIRE_TIME)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+    int result;
+    if(0 != (result = pthread_mutex_init(&detector_lock, &attr))){
+        S3FS_PRN_CRIT("failed to init detector_lock: %d", result);
+        abort();
+    }
+}
+
+TraversalDetector::~TraversalDetector()
+{
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&detector_lock))){
+        S3FS_PRN_CRIT("failed to destroy detector_lock: %d", result);
+        abort();
+    }
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
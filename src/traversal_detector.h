@@ -0,0 +1,151 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_TRAVERSAL_DETECTOR_H_
+#define S3FS_TRAVERSAL_DETECTOR_H_
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <set>
+#include <string>
+
+#include "psemaphore.h"
+#include "s3objlist.h"
+
+//------------------------------------------------
+// Structure / Typedefs
+//------------------------------------------------
+//
+// The directory which was listed recently
+//
+struct traversal_entry
+{
+    time_t                  last_time;      // last time when the directory or its child directories were listed
+    std::set<std::string>   children;       // child directories which were listed
+
+    traversal_entry() : last_time(0) {}
+};
+
+typedef std::map<std::string, traversal_entry> traversal_map_t;    // key=directory path(not terminated by "/")
+
+//
+// Function which loads the listings of the subtree
+//
+typedef int (*subtree_load_func)(const char* path);
+
+typedef std::list<std::string> subtree_jobs_t;
+
+//------------------------------------------------
+// Class TraversalDetector
+//------------------------------------------------
+// [NOTE]
+// When the bulk_readdir option is specified, this class detects recursive
+// traversals(find, du, rsync, ls -R etc) by the readdirs which descend
+// into a subtree in quick succession.
+// Each readdir is recorded in its parent directory if the parent was
+// listed recently, and when the count of the distinct child directories
+// of one parent reaches the threshold, the parent is returned as the root
+// of the traversal. The mount point is never the root, because listing
+// some top directories one by one(ls /; ls /a; ls /b) is not a traversal
+// and the whole bucket should not be listed for it.
+// Then SubtreeLoader lists the whole subtree by one listing without
+// delimiter in background, and the listing is split into the listings of
+// every directory in it, which are kept in StatCache. The rest of the
+// traversal is served from them without listing each directory.
+//
+class TraversalDetector
+{
+    private:
+        static TraversalDetector singleton;
+
+        int                 threshold;          // 0 means disabled
+        time_t              expire_time;        // the window for detecting(and the lifetime of loaded listings)
+        pthread_mutex_t     detector_lock;      // protects traversals
+        traversal_map_t     traversals;
+
+    private:
+        TraversalDetector();
+        ~TraversalDetector();
+
+        static void AddSubtreeEntry(std::map<std::string, S3ObjList>& lists, const std::string& dirpath, const std::string& name, const S3ObjList& flat, const std::string& flatname);
+
+    public:
+        static const time_t DEFAULT_EXPIRE_TIME = 30;
+
+        static bool SetThreshold(int count);
+        static int GetThreshold() { return TraversalDetector::singleton.threshold; }
+        static bool IsEnable() { return (0 < TraversalDetector::singleton.threshold); }
+        static bool SetExpireTime(time_t expire);
+        static time_t GetExpireTime() { return TraversalDetector::singleton.expire_time; }
+
+        static std::string Detect(const char* path);
+        static size_t AddSubtree(const char* dirpath, const S3ObjList& flat);
+};
+
+//------------------------------------------------
+// Class SubtreeLoader
+//------------------------------------------------
+// [NOTE]
+// The subtree which is detected by TraversalDetector is loaded by this
+// class in background, then the readdir which detected the traversal
+// does not wait for the listing of the whole subtree.
+// The same subtree is loaded only once while it is queued or loading.
+//
+class SubtreeLoader
+{
+    private:
+        static SubtreeLoader*   singleton;
+
+        subtree_load_func       pfunc;
+        bool                    is_exit;
+        Semaphore               load_sem;
+        pthread_t               thread;
+
+        pthread_mutex_t         load_lock;      // protects is_exit, job_list and loading_paths
+        subtree_jobs_t          job_list;
+        std::set<std::string>   loading_paths;  // paths which are queued or loading
+
+    private:
+        static void* Worker(void* arg);
+
+        explicit SubtreeLoader(subtree_load_func func);
+        ~SubtreeLoader();
+
+        bool SetJob(const std::string& path);
+
+    public:
+        static bool Initialize(subtree_load_func func);
+        static void Destroy();
+        static bool IsEnable() { return (NULL != SubtreeLoader::singleton); }
+        static bool Instruct(const std::string& path);
+};
+
+#endif // S3FS_TRAVERSAL_DETECTOR_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -68,6 +68,9 @@ typedef struct xattr_value
 
 typedef std::map<std::string, PXATTRVAL> xattrs_t;
 
+// decoded xattrs which are cached with the stat cache entry(value is binary)
+typedef std::map<std::string, std::string> xattr_cache_t;
+
 //-------------------------------------------------------------------
 // acl_t
 // Note: Header "x-oss-object-acl" is for acl. OSS's acl is not compatible with S3. 
@@ -0,0 +1,229 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "s3fs_logger.h"
+#include "upload_scheduler.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// UploadScheduler class variables
+//------------------------------------------------
+UploadScheduler* UploadScheduler::singleton = NULL;
+const uint64_t   UploadScheduler::NO_JOB;
+
+//------------------------------------------------
+// UploadScheduler class methods
+//------------------------------------------------
+bool UploadScheduler::Initialize(int count)
+{
+    if(count < 1){
+        S3FS_PRN_ERR("The upload concurrency(%d) is under 1.", count);
+        return false;
+    }
+    if(UploadScheduler::singleton){
+        S3FS_PRN_WARN("Already singleton for Upload Scheduler is existed, then re-create it.");
+        UploadScheduler::Destroy();
+    }
+    UploadScheduler::singleton = new UploadScheduler(count);
+    return true;
+}
+
+void UploadScheduler::Destroy()
+{
+    if(UploadScheduler::singleton){
+        delete UploadScheduler::singleton;
+        UploadScheduler::singleton = NULL;
+    }
+}
+
+uint64_t UploadScheduler::NewJob()
+{
+    if(!UploadScheduler::singleton){
+        return UploadScheduler::NO_JOB;
+    }
+    return UploadScheduler::singleton->MakeJob();
+}
+
+uint64_t UploadScheduler::Acquire(uint64_t job)
+{
+    if(!UploadScheduler::singleton){
+        return UploadScheduler::NO_JOB;
+    }
+    if(UploadScheduler::NO_JOB == job){
+        job = UploadScheduler::singleton->MakeJob();
+    }
+    UploadScheduler::singleton->AcquireSlot(job);
+    return job;
+}
+
+void UploadScheduler::Release(uint64_t job)
+{
+    if(!UploadScheduler::singleton || UploadScheduler::NO_JOB == job){
+        return;
+    }
+    UploadScheduler::singleton->ReleaseSlot(job);
+}
+
+//------------------------------------------------
+// UploadScheduler methods
+//------------------------------------------------
+UploadScheduler::UploadScheduler(int count) : max_inflight(count), inflight(0), last_job(UploadScheduler::NO_JOB)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#if S3FS_PTHREAD_ERRORCHECK
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
+
+    int result;
+    if(0 != (result = pthread_mutex_init(&sched_lock.mutex, &attr))){
+        S3FS_PRN_CRIT("failed to init sched_lock: %d", result);
+        abort();
+    }
+    LockProfiler::SetName(&sched_lock, "UploadScheduler::sched_lock");
+}
+
+UploadScheduler::~UploadScheduler()
+{
+    if(!waiters.empty() || 0 < inflight){
+        S3FS_PRN_WARN("Upload Scheduler is destroyed while %d requests are running and %zu requests are waiting.", inflight, waiters.size());
+    }
+
+
+    int result;
+    if(0 != (result = pthread_mutex_destroy(&sched_lock.mutex))){
+        S3FS_PRN_CRIT("failed to destroy sched_lock: %d", result);
+        abort();
+    }
+}
+
+uint64_t UploadScheduler::MakeJob()
+{
+    AutoLock auto_lock(&sched_lock);
+
+    if(UploadScheduler::NO_JOB == ++last_job){
+        ++last_job;
+    }
+    return last_job;
+}
+
+void UploadScheduler::AcquireSlot(uint64_t job)
+{
+    Semaphore     sem(0);
+    upload_waiter waiter(job, &sem);
+    {
+        AutoLock auto_lock(&sched_lock);
+
+        if(inflight < max_inflight && waiters.empty()){
+            ++inflight;
+            ++job_inflight[job];
+            return;
+        }
+        waiters.push_back(&waiter);
+    }
+    S3FS_PRN_DBG("Wait for upload slot[job=%llu]", static_cast<unsigned long long>(job));
+
+    // ReleaseSlot() posts after moving the slot to this waiter.
+    sem.wait();
+}
+
+void UploadScheduler::ReleaseSlot(uint64_t job)
+{
+    AutoLock auto_lock(&sched_lock);
+
+    upload_job_inflight_t::iterator jiter = job_inflight.find(job);
+    if(jiter == job_inflight.end()){
+        S3FS_PRN_WARN("The job(%llu) does not have any upload slot.", static_cast<unsigned long long>(job));
+        return;
+    }
+    if(0 >= --(jiter->second)){
+        job_inflight.erase(jiter);
+    }
+    --inflight;
+
+    // pick the waiter whose job has the fewest running requests
+    while(inflight < max_inflight && !waiters.empty()){
+        upload_waiters_t::iterator picked  = waiters.end();
+        int                        min_cnt = 0;
+        for(upload_waiters_t::iterator iter = waiters.begin(); iter != waiters.end(); ++iter){
+            upload_job_inflight_t::const_iterator citer = job_inflight.find((*iter)->job);
+            int cnt = (citer == job_inflight.end() ? 0 : citer->second);
+            if(picked == waiters.end() || cnt < min_cnt){
+                picked  = iter;
+                min_cnt = cnt;
+                if(0 == min_cnt){
+                    break;
+                }
+            }
+        }
+        upload_waiter* pwaiter = *picked;
+        waiters.erase(picked);
+
+        ++inflight;
+        ++job_inflight[pwaiter->job];
+        pwaiter->psem->post();
+    }
+}
+
+//------------------------------------------------
+// AutoUploadSlot methods
+//------------------------------------------------
+AutoUploadSlot::AutoUploadSlot(bool is_upload, uint64_t job_id) : is_acquired(false), job(UploadScheduler::NO_JOB)
+{
+    if(is_upload && UploadScheduler::IsEnable()){
+        job         = UploadScheduler::Acquire(job_id);
+        is_acquired = (UploadScheduler::NO_JOB != job);
+    }
+}
+
+AutoUploadSlot::~AutoUploadSlot()
+{
+    if(is_acquired){
+        UploadScheduler::Release(job);
+    }
+}
+
+void AutoUploadSlot::Sleep(unsigned int seconds)
+{
+    if(!is_acquired){
+        sleep(seconds);
+        return;
+    }
+    UploadScheduler::Release(job);
+    sleep(seconds);
+
+    // [NOTE]
+    // The slot is taken again by the same job, then the parts of the job
+    // are still handed out fairly.
+    UploadScheduler::Acquire(job);
+}
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
@@ -0,0 +1,128 @@
+/*
+ * ossfs - FUSE-based file system backed by Alibaba Cloud OSS
+ *
+ * Copyright(C) 2007 Randy Rizun <rrizun@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef S3FS_UPLOAD_SCHEDULER_H_
+#define S3FS_UPLOAD_SCHEDULER_H_
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "psemaphore.h"
+#include "autolock.h"
+
+//------------------------------------------------
+// Typedefs
+//------------------------------------------------
+//
+// Waiting request for an upload slot
+//
+struct upload_waiter
+{
+    uint64_t   job;
+    Semaphore* psem;
+
+    upload_waiter(uint64_t job_id, Semaphore* sem) : job(job_id), psem(sem) {}
+};
+
+typedef std::list<upload_waiter*>   upload_waiters_t;
+typedef std::map<uint64_t, int>     upload_job_inflight_t;
+
+//------------------------------------------------
+// Class UploadScheduler
+//------------------------------------------------
+// [NOTE]
+// This class limits the number of uploading requests(PUT object and
+// upload part) running at once over all files, and hands out the free
+// slots fairly to the upload jobs.
+// An upload job is one flush of one file, and all parts of a multipart
+// upload belong to the same job. When a slot is released, it is given
+// to the waiting job which has the fewest running requests(the oldest
+// waiter wins a tie), so that small files are not starved by the parts
+// of large files when many files are flushed at once.
+// If the scheduler is not initialized, all requests are run as before.
+//
+class UploadScheduler
+{
+    private:
+        static UploadScheduler* singleton;
+
+        named_mutex             sched_lock;
+        int                     max_inflight;
+        int                     inflight;
+        uint64_t                last_job;
+        upload_job_inflight_t   job_inflight;
+        upload_waiters_t        waiters;
+
+    private:
+        explicit UploadScheduler(int count);
+        ~UploadScheduler();
+
+        uint64_t MakeJob();
+        void AcquireSlot(uint64_t job);
+        void ReleaseSlot(uint64_t job);
+
+    public:
+        static const uint64_t NO_JOB = 0;
+
+        static bool Initialize(int count);
+        static void Destroy();
+        static bool IsEnable() { return (NULL != UploadScheduler::singleton); }
+        static uint64_t NewJob();
+        static uint64_t Acquire(uint64_t job);
+        static void Release(uint64_t job);
+};
+
+//------------------------------------------------
+// Class AutoUploadSlot
+//------------------------------------------------
+// Holds one slot of the upload scheduler while the object is alive.
+// If job is NO_JOB, a new job is made for this request only.
+// Sleep() gives the slot back while sleeping(for the back-off of the
+// retries), so that the other uploads are not blocked by a failing one.
+//
+class AutoUploadSlot
+{
+    private:
+        bool     is_acquired;
+        uint64_t job;
+
+    private:
+        AutoUploadSlot(const AutoUploadSlot&);
+        AutoUploadSlot& operator=(const AutoUploadSlot&);
+
+    public:
+        AutoUploadSlot(bool is_upload, uint64_t job_id);
+        ~AutoUploadSlot();
+
+        void Sleep(unsigned int seconds);
+};
+
+#endif // S3FS_UPLOAD_SCHEDULER_H_
+
+/*
+* Local variables:
+* tab-width: 4
+* c-basic-offset: 4
+* End:
+* vim600: expandtab sw=4 ts=4 fdm=marker
+* vim<600: expandtab sw=4 ts=4
+*/
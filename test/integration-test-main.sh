@@ -217,6 +217,29 @@ function test_mv_nonempty_directory {
     fi
 }
 
+function test_mv_directory_with_large_files {
+    describe "Testing mv directory with large files ..."
+
+    mk_test_dir
+
+    ../../junk_data $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT)) > "${TEMP_DIR}/${BIG_FILE}"
+    cp "${TEMP_DIR}/${BIG_FILE}" "${TEST_DIR}/${BIG_FILE}-1"
+    cp "${TEMP_DIR}/${BIG_FILE}" "${TEST_DIR}/${BIG_FILE}-2"
+    echo "${TEST_TEXT}" > "${TEST_DIR}/${TEST_TEXT_FILE}"
+
+    mv "${TEST_DIR}" "${TEST_DIR}_rename"
+    if [ -e "${TEST_DIR}" ]; then
+       echo "Directory ${TEST_DIR} still exists after renaming"
+       return 1
+    fi
+    cmp "${TEMP_DIR}/${BIG_FILE}" "${TEST_DIR}_rename/${BIG_FILE}-1"
+    cmp "${TEMP_DIR}/${BIG_FILE}" "${TEST_DIR}_rename/${BIG_FILE}-2"
+    [ "$(cat "${TEST_DIR}_rename/${TEST_TEXT_FILE}")" = "${TEST_TEXT}" ]
+
+    rm -f "${TEMP_DIR}/${BIG_FILE}"
+    rm -r "${TEST_DIR}_rename"
+}
+
 function test_redirects {
     describe "Testing redirects ..."
 
@@ -639,6 +662,235 @@ function test_multipart_upload {
     rm_test_file "${BIG_FILE}"
 }
 
+function test_async_close {
+    describe "Testing async close ..."
+
+    ../../junk_data $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT)) > "${TEMP_DIR}/${BIG_FILE}"
+    dd if="${TEMP_DIR}/${BIG_FILE}" of="${BIG_FILE}" bs="${BIG_FILE_BLOCK_SIZE}" count="${BIG_FILE_COUNT}"
+
+    # the file is readable and has the local size while uploading
+    local SIZE; SIZE=$(get_size "${BIG_FILE}")
+    if [ "${SIZE}" -ne $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT)) ]; then
+        echo "Unexpected size while uploading: ${SIZE}"
+        return 1
+    fi
+    cmp "${TEMP_DIR}/${BIG_FILE}" "${BIG_FILE}"
+
+    # fsync waits for the deferred upload
+    sync "${BIG_FILE}"
+    local OBJECT_NAME; OBJECT_NAME=$(basename "${PWD}")/"${BIG_FILE}"
+    aws_cli s3 cp "s3://${TEST_BUCKET_1}/${OBJECT_NAME}" "${TEMP_DIR}/${BIG_FILE}-server"
+    cmp "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-server"
+
+    # the new file is stated, listed and reopened while uploading
+    local NEW_FILE; NEW_FILE="async-close-new-file"
+    dd if="${TEMP_DIR}/${BIG_FILE}" of="${NEW_FILE}" bs="${BIG_FILE_BLOCK_SIZE}" count="${BIG_FILE_COUNT}"
+    stat "${NEW_FILE}" > /dev/null
+    ls | grep -q "^${NEW_FILE}$"
+    echo "${TEST_TEXT}" >> "${NEW_FILE}"
+    SIZE=$(get_size "${NEW_FILE}")
+    if [ "${SIZE}" -ne $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT + ${#TEST_TEXT} + 1)) ]; then
+        echo "Unexpected size after reopening while uploading: ${SIZE}"
+        return 1
+    fi
+    rm_test_file "${NEW_FILE}"
+
+    # rename right after closing
+    echo "${TEST_TEXT}" > "${TEST_TEXT_FILE}"
+    mv "${TEST_TEXT_FILE}" "${ALT_TEST_TEXT_FILE}"
+    [ ! -e "${TEST_TEXT_FILE}" ]
+    [ "$(cat "${ALT_TEST_TEXT_FILE}")" = "${TEST_TEXT}" ]
+
+    rm -f "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-server"
+    rm_test_file "${BIG_FILE}"
+    rm_test_file "${ALT_TEST_TEXT_FILE}"
+}
+
+function test_chunk_cache_reserved_names {
+    describe "Testing chunk cache with the object names of chunk files ..."
+
+    local DIR_NAME; DIR_NAME="chunk_names_dir"
+    mkdir -p "${DIR_NAME}/#1"
+    for name in "#etag" "#lock" "#0" "#0.z" "#1/#etag"; do
+        echo "${TEST_TEXT} ${name}" > "${DIR_NAME}/${name}"
+    done
+    ../../junk_data $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT)) > "${TEMP_DIR}/${BIG_FILE}"
+    cp "${TEMP_DIR}/${BIG_FILE}" "${DIR_NAME}/${BIG_FILE}"
+
+    # the second reading is from the chunks which are saved by the first
+    for _ in 1 2; do
+        for name in "#etag" "#lock" "#0" "#0.z" "#1/#etag"; do
+            if [ "$(cat "${DIR_NAME}/${name}")" != "${TEST_TEXT} ${name}" ]; then
+                echo "Unexpected content of ${DIR_NAME}/${name}: $(cat "${DIR_NAME}/${name}")"
+                return 1
+            fi
+        done
+        cmp "${TEMP_DIR}/${BIG_FILE}" "${DIR_NAME}/${BIG_FILE}"
+    done
+
+    # the chunks of the objects are in the escaped directories
+    local CHUNK_DIR; CHUNK_DIR="${CACHE_DIR}/.${TEST_BUCKET_1}.chunk/$(basename "${PWD}")/${DIR_NAME}"
+    if [ -d "${CHUNK_DIR}" ]; then
+        [ -d "${CHUNK_DIR}/##etag" ]
+        [ -d "${CHUNK_DIR}/##0" ]
+        [ -d "${CHUNK_DIR}/##1/##etag" ]
+    fi
+
+    rm -f "${TEMP_DIR}/${BIG_FILE}"
+    rm -rf "${DIR_NAME}"
+}
+
+function test_shared_chunk_cache_two_mounts {
+    describe "Testing shared chunk cache with two mounts ..."
+
+    local TESTRUN_DIR; TESTRUN_DIR=$(basename "${PWD}")
+    local MOUNT_POINT_2; MOUNT_POINT_2="${TEMP_DIR}/${TEST_BUCKET_1}-2"
+    mkdir -p "${MOUNT_POINT_2}"
+
+    # the second mount shares the cache directory
+    CURL_CA_BUNDLE=/tmp/keystore.pem "${TEST_SCRIPT_DIR}/../src/ossfs" "${TEST_BUCKET_1}" "${MOUNT_POINT_2}" \
+        -o url="${OSS_URL}" \
+        -o passwd_file="${OSSFS_CREDENTIALS_FILE:-${TEST_SCRIPT_DIR}/passwd-ossfs}" \
+        -o region="${OSS_REGION}" \
+        -o "${OSS_SIGNATURE_VERSION}" \
+        -o enable_unsigned_payload \
+        -o stat_cache_expire=1 \
+        -o use_cache="${CACHE_DIR}" \
+        -o cache_layout=chunk \
+        -o cache_shared
+    for _ in $(seq 20); do
+        if grep -q "${MOUNT_POINT_2}" /proc/mounts; then
+            break
+        fi
+        sleep 1
+    done
+    grep -q "${MOUNT_POINT_2}" /proc/mounts
+
+    # the chunks are removed and filled by both mounts at the same time
+    local RESULT=0
+    for i in 1 2 3; do
+        ../../junk_data $((BIG_FILE_BLOCK_SIZE * BIG_FILE_COUNT + i)) > "${TEMP_DIR}/${BIG_FILE}"
+        cp "${TEMP_DIR}/${BIG_FILE}" "${BIG_FILE}"
+        sleep 2
+
+        cat "${BIG_FILE}" > "${TEMP_DIR}/${BIG_FILE}-1" &
+        cat "${MOUNT_POINT_2}/${TESTRUN_DIR}/${BIG_FILE}" > "${TEMP_DIR}/${BIG_FILE}-2" &
+        wait
+
+        if ! cmp "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-1" || ! cmp "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-2"; then
+            RESULT=1
+            break
+        fi
+    done
+
+    fusermount -u "${MOUNT_POINT_2}" || umount "${MOUNT_POINT_2}"
+    rmdir "${MOUNT_POINT_2}"
+    rm -f "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-1" "${TEMP_DIR}/${BIG_FILE}-2"
+    rm_test_file "${BIG_FILE}"
+    return "${RESULT}"
+}
+
+# mount_peer_cache <mount point> <cache dir> <port>
+function mount_peer_cache {
+    mkdir -p "$1" "$2"
+    CURL_CA_BUNDLE=/tmp/keystore.pem "${TEST_SCRIPT_DIR}/../src/ossfs" "${TEST_BUCKET_1}" "$1" \
+        -o url="${OSS_URL}" \
+        -o passwd_file="${OSSFS_CREDENTIALS_FILE:-${TEST_SCRIPT_DIR}/passwd-ossfs}" \
+        -o region="${OSS_REGION}" \
+        -o "${OSS_SIGNATURE_VERSION}" \
+        -o enable_unsigned_payload \
+        -o use_cache="$2" \
+        -o cache_layout=chunk \
+        -o cache_chunk_size=1 \
+        -o peer_cache=127.0.0.1:18081,127.0.0.1:18082 \
+        -o peer_cache_self="127.0.0.1:$3" \
+        -o peer_cache_token_file="${TEMP_DIR}/peer-cache-token"
+    for _ in $(seq 20); do
+        if grep -q "$1" /proc/mounts; then
+            break
+        fi
+        sleep 1
+    done
+    grep -q "$1" /proc/mounts
+}
+
+function test_peer_cache_two_mounts {
+    describe "Testing peer cache with two mounts ..."
+
+    local TESTRUN_DIR; TESTRUN_DIR=$(basename "${PWD}")
+    local MOUNT_POINT_1; MOUNT_POINT_1="${TEMP_DIR}/${TEST_BUCKET_1}-peer1"
+    local MOUNT_POINT_2; MOUNT_POINT_2="${TEMP_DIR}/${TEST_BUCKET_1}-peer2"
+    local CACHE_DIR_1; CACHE_DIR_1="${TEMP_DIR}/peer-cache-1"
+    local CACHE_DIR_2; CACHE_DIR_2="${TEMP_DIR}/peer-cache-2"
+    local TOKEN; TOKEN="peer-cache-token-$$"
+
+    (umask 077; echo "${TOKEN}" > "${TEMP_DIR}/peer-cache-token")
+    mount_peer_cache "${MOUNT_POINT_1}" "${CACHE_DIR_1}" 18081
+    mount_peer_cache "${MOUNT_POINT_2}" "${CACHE_DIR_2}" 18082
+
+    # 16 chunks, then the both mounts own some of them
+    ../../junk_data $((16 * 1024 * 1024)) > "${TEMP_DIR}/${BIG_FILE}"
+    cp "${TEMP_DIR}/${BIG_FILE}" "${BIG_FILE}"
+    sleep 2
+
+    local RESULT=0
+
+    # the chunks which are owned by the second mount are served by it,
+    # then they are cached by it without reading the file through it.
+    cat "${MOUNT_POINT_1}/${TESTRUN_DIR}/${BIG_FILE}" > "${TEMP_DIR}/${BIG_FILE}-1"
+    if ! cmp "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-1"; then
+        echo "the file read with the peer cache is different."
+        RESULT=1
+    fi
+    if [ "${RESULT}" -eq 0 ] && [ -z "$(find "${CACHE_DIR_2}" -type f -name '#[0-9]*')" ]; then
+        echo "no chunk was served by the peer."
+        RESULT=1
+    fi
+
+    # the request without the token or with the wrong token is rejected
+    local QUERY; QUERY="path=/${TESTRUN_DIR}/${BIG_FILE}&etag=dummy&index=0&size=1048576"
+    local CODE
+    if [ "${RESULT}" -eq 0 ]; then
+        CODE=$(curl -s -o /dev/null -w "%{http_code}" "http://127.0.0.1:18082/chunk?${QUERY}")
+        if [ "${CODE}" != "403" ]; then
+            echo "the request without the token returned ${CODE}."
+            RESULT=1
+        fi
+        CODE=$(curl -s -o /dev/null -w "%{http_code}" -H "X-Ossfs-Peer-Token: ${TOKEN}-wrong" "http://127.0.0.1:18082/chunk?${QUERY}")
+        if [ "${CODE}" != "403" ]; then
+            echo "the request with the wrong token returned ${CODE}."
+            RESULT=1
+        fi
+        # the etag does not match, but the token is accepted
+        CODE=$(curl -s -o /dev/null -w "%{http_code}" -H "X-Ossfs-Peer-Token: ${TOKEN}" "http://127.0.0.1:18082/chunk?${QUERY}")
+        if [ "${CODE}" != "404" ]; then
+            echo "the request with the token returned ${CODE}."
+            RESULT=1
+        fi
+    fi
+
+    # the chunks are downloaded from the server while the peer is down
+    fusermount -u "${MOUNT_POINT_2}" || umount "${MOUNT_POINT_2}"
+    if [ "${RESULT}" -eq 0 ]; then
+        ../../junk_data $((16 * 1024 * 1024 + 1)) > "${TEMP_DIR}/${BIG_FILE}"
+        cp "${TEMP_DIR}/${BIG_FILE}" "${BIG_FILE}"
+        sleep 2
+
+        cat "${MOUNT_POINT_1}/${TESTRUN_DIR}/${BIG_FILE}" > "${TEMP_DIR}/${BIG_FILE}-1"
+        if ! cmp "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-1"; then
+            echo "the file read while the peer is down is different."
+            RESULT=1
+        fi
+    fi
+
+    fusermount -u "${MOUNT_POINT_1}" || umount "${MOUNT_POINT_1}"
+    rmdir "${MOUNT_POINT_1}" "${MOUNT_POINT_2}"
+    rm -rf "${CACHE_DIR_1}" "${CACHE_DIR_2}"
+    rm -f "${TEMP_DIR}/peer-cache-token" "${TEMP_DIR}/${BIG_FILE}" "${TEMP_DIR}/${BIG_FILE}-1"
+    rm_test_file "${BIG_FILE}"
+    return "${RESULT}"
+}
+
 function test_multipart_copy {
     describe "Testing multi-part copy ..."
 
@@ -2858,6 +3110,7 @@ function add_all_tests {
     add_tests test_mv_to_exist_file
     add_tests test_mv_empty_directory
     add_tests test_mv_nonempty_directory
+    add_tests test_mv_directory_with_large_files
     add_tests test_redirects
     add_tests test_mkdir_rmdir
     add_tests test_list
@@ -2874,6 +3127,22 @@ function add_all_tests {
     add_tests test_rename_large_file
     add_tests test_multipart_upload
     add_tests test_multipart_copy
+    # shellcheck disable=SC2009
+    if ps u -p "${OSSFS_PID}" | grep -q async_close; then
+        add_tests test_async_close
+    fi
+    # shellcheck disable=SC2009
+    if ps u -p "${OSSFS_PID}" | grep -q cache_layout=chunk; then
+        add_tests test_chunk_cache_reserved_names
+    fi
+    # shellcheck disable=SC2009
+    if ps u -p "${OSSFS_PID}" | grep -q cache_shared && [ "$(uname)" != "Darwin" ]; then
+        add_tests test_shared_chunk_cache_two_mounts
+    fi
+    # shellcheck disable=SC2009
+    if ps u -p "${OSSFS_PID}" | grep -q cache_layout=chunk && [ "$(uname)" != "Darwin" ]; then
+        add_tests test_peer_cache_two_mounts
+    fi
     add_tests test_multipart_mix
     add_tests test_utimens_during_multipart
     add_tests test_special_characters
@@ -51,9 +51,14 @@ export DIRECT_READ_LOCAL_FILE_CACHE_SIZE_MB
 if [ -n "${ALL_TESTS}" ]; then
     FLAGS=(
         "use_cache=${CACHE_DIR} -o ensure_diskfree=${ENSURE_DISKFREE_SIZE} -o fake_diskfree=${FAKE_FREE_DISK_SIZE} -o del_cache"
-        enable_content_md5
+        "enable_content_md5 -o upload_concurrency=2"
+        "use_cache=${CACHE_DIR} -o async_close -o async_close_thread=2"
         enable_noobj_cache
         "max_stat_cache_size=100 -o stat_cache_expire=-1"
+        "stat_cache_expire=1 -o stat_cache_stale_grace=5"
+        "compat_dir_detect"
+        "bulk_readdir=2 -o readdir_optimize"
+        keep_cache
         nocopyapi
         nomultipart
         notsup_compat_dir
@@ -71,11 +76,17 @@ if [ -n "${ALL_TESTS}" ]; then
         "fake_diskfree=${FAKE_FREE_DISK_SIZE} -oparallel_count=10 -omultipart_size=10"
         "default_acl=private"
         "direct_read -o direct_read_local_file_cache_size_mb=${DIRECT_READ_LOCAL_FILE_CACHE_SIZE_MB}"
+        "direct_read -o direct_read_backward_chunks=0 -o direct_read_spill_dir=${CACHE_DIR}/spill"
+        "direct_read -o memory_limit=256 -o max_stat_cache_size=1000"
         "sigv4 -o region=${OSS_REGION}"
         ahbe_conf=${AHBE_CONFIG}
         "use_cache=${CACHE_DIR} -o del_cache -o set_check_cache_sigusr1=${CHECK_CACHE_FILE} -o logfile=${LOGFILE} -o check_cache_dir_exist"
-        "max_dirty_data=50"
+        "max_dirty_data=50 -o lock_profile"
         "use_cache=${CACHE_DIR} -o free_space_ratio=1 -o del_cache"
+        "use_cache=${CACHE_DIR} -o cache_layout=chunk -o cache_chunk_size=1 -o del_cache"
+        "use_cache=${CACHE_DIR} -o cache_layout=chunk -o cache_shared"
+        "use_cache=${CACHE_DIR} -o cache_layout=chunk -o cache_compress -o del_cache"
+        "use_cache=${CACHE_DIR} -o cache_hashed_dir -o set_check_cache_sigusr1=${CHECK_CACHE_FILE} -o del_cache"
     )
 else
     FLAGS=(